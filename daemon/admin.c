@@ -36,6 +36,7 @@
 #include "virnetdaemon.h"
 #include "virnetserver.h"
 #include "virstring.h"
+#include "virstartuptime.h"
 #include "virthreadjob.h"
 #include "virtypedparam.h"
 
@@ -415,6 +416,16 @@ adminConnectGetLoggingFilters(char **filters, unsigned int flags)
     return ret;
 }
 
+static int
+adminConnectGetStartupTimes(virTypedParameterPtr *params,
+                            int *nparams,
+                            unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    return virStartupTimeGetParams(params, nparams);
+}
+
 static int
 adminConnectSetLoggingOutputs(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
                               const char *outputs,
@@ -487,4 +498,41 @@ adminDispatchConnectGetLoggingFilters(virNetServerPtr server ATTRIBUTE_UNUSED,
 
     return 0;
 }
+
+static int
+adminDispatchConnectGetStartupTimes(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                    virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                    virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                    virNetMessageErrorPtr rerr,
+                                    admin_connect_get_startup_times_args *args,
+                                    admin_connect_get_startup_times_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetStartupTimes(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_CONNECT_STARTUP_TIMES_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of startup time parameters %d exceeds "
+                         "max allowed limit: %d"), nparams,
+                       ADMIN_CONNECT_STARTUP_TIMES_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
 #include "admin_dispatch.h"
@@ -1253,6 +1253,12 @@ int main(int argc, char **argv) {
         }
     }
 
+    /* The writer thread would not survive daemonizing */
+    if (config->log_async && virLogSetAsync(true) < 0) {
+        VIR_ERROR(_("Can't enable asynchronous logging"));
+        goto cleanup;
+    }
+
     /* Ensure the rundir exists (on tmpfs on some systems) */
     if (privileged) {
         if (VIR_STRDUP_QUIET(run_dir, LOCALSTATEDIR "/run/libvirt") < 0) {
@@ -1533,5 +1539,8 @@ int main(int argc, char **argv) {
      * 'dmn' as a parameter are done, we can finally unref 'dmn' */
     virObjectUnref(dmn);
 
+    /* Write out any messages still queued by the asynchronous logger */
+    ignore_value(virLogSetAsync(false));
+
     return ret;
 }
@@ -946,6 +946,33 @@ virCapabilitiesFormatCaches(virBufferPtr buf,
     return 0;
 }
 
+/* A rough guess of the size of the XML of @caps, which is dominated by
+ * the host CPUs on large NUMA hosts and by the machine types otherwise */
+static unsigned int
+virCapabilitiesFormatSizeHint(virCapsPtr caps)
+{
+    size_t size = 1024;
+    size_t i, j;
+
+    for (i = 0; i < caps->host.nnumaCell; i++) {
+        virCapsHostNUMACellPtr cell = caps->host.numaCell[i];
+
+        size += 128 + cell->ncpus * 80 +
+                (cell->npageinfo + cell->nsiblings) * 48;
+    }
+
+    for (i = 0; i < caps->nguests; i++) {
+        virCapsGuestPtr guest = caps->guests[i];
+
+        size += 256 + guest->arch.defaultInfo.nmachines * 64;
+        for (j = 0; j < guest->arch.ndomains; j++)
+            size += 64 + guest->arch.domains[j]->info.nmachines * 64;
+    }
+
+    return MIN(size, 16 * 1024 * 1024);
+}
+
+
 /**
  * virCapabilitiesFormatXML:
  * @caps: capabilities to format
@@ -961,6 +988,8 @@ virCapabilitiesFormatXML(virCapsPtr caps)
     size_t i, j, k;
     char host_uuid[VIR_UUID_STRING_BUFLEN];
 
+    virBufferReserve(&buf, virCapabilitiesFormatSizeHint(caps));
+
     virBufferAddLit(&buf, "<capabilities>\n\n");
     virBufferAdjustIndent(&buf, 2);
     virBufferAddLit(&buf, "<host>\n");
@@ -82,6 +82,9 @@ struct _virDomainXMLOption {
 
     /* Private data for save image stored in snapshot XML */
     virSaveCookieCallbacks saveCookie;
+
+    /* Whether status XML changes are appended to a journal */
+    bool statusJournal;
 };
 
 #define VIR_DOMAIN_DEF_FORMAT_COMMON_FLAGS             \
@@ -1113,6 +1116,24 @@ virDomainXMLOptionGetNamespace(virDomainXMLOptionPtr xmlopt)
     return &xmlopt->ns;
 }
 
+
+/**
+ * virDomainXMLOptionSetStatusJournal:
+ *
+ * @xmlopt: XML parser configuration object
+ * @enable: whether to journal status XML changes
+ *
+ * When enabled, virDomainSaveStatus appends the changes of the status
+ * XML of a domain to a journal next to the status file instead of
+ * rewriting the whole file every time.
+ */
+void
+virDomainXMLOptionSetStatusJournal(virDomainXMLOptionPtr xmlopt,
+                                   bool enable)
+{
+    xmlopt->statusJournal = enable;
+}
+
 static int
 virDomainVirtioOptionsParseXML(xmlNodePtr driver,
                                virDomainVirtioOptionsPtr *virtio)
@@ -2178,6 +2199,9 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
         if (VIR_STRDUP(dest->data.tcp.service, src->data.tcp.service) < 0)
             return -1;
 
+        dest->data.tcp.listen = src->data.tcp.listen;
+        dest->data.tcp.protocol = src->data.tcp.protocol;
+        dest->data.tcp.tlscreds = src->data.tcp.tlscreds;
         dest->data.tcp.haveTLS = src->data.tcp.haveTLS;
         dest->data.tcp.tlsFromConfig = src->data.tcp.tlsFromConfig;
         break;
@@ -2185,6 +2209,7 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
     case VIR_DOMAIN_CHR_TYPE_UNIX:
         if (VIR_STRDUP(dest->data.nix.path, src->data.nix.path) < 0)
             return -1;
+        dest->data.nix.listen = src->data.nix.listen;
         break;
 
     case VIR_DOMAIN_CHR_TYPE_NMDM:
@@ -2194,8 +2219,22 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
             return -1;
 
         break;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEVMC:
+        dest->data.spicevmc = src->data.spicevmc;
+        break;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEPORT:
+        if (VIR_STRDUP(dest->data.spiceport.channel,
+                       src->data.spiceport.channel) < 0)
+            return -1;
+        break;
     }
 
+    if (VIR_STRDUP(dest->logfile, src->logfile) < 0)
+        return -1;
+    dest->logappend = src->logappend;
+
     dest->type = src->type;
 
     return 0;
@@ -3014,6 +3053,7 @@ static void virDomainObjDispose(void *obj)
         (dom->privateDataFreeFunc)(dom->privateData);
 
     virDomainSnapshotObjListFree(dom->snapshots);
+    virFileJournalFree(dom->statusJournal);
 }
 
 virDomainObjPtr
@@ -19105,15 +19145,30 @@ virDomainObjParseFile(const char *filename,
 {
     xmlDocPtr xml;
     virDomainObjPtr obj = NULL;
-    int keepBlanksDefault = xmlKeepBlanksDefault(0);
+    char *content = NULL;
+    int keepBlanksDefault;
+    int rc;
+
+    /* The status XML may have been saved to a journal since the file
+     * was written */
+    if ((rc = virFileJournalRead(filename, &content)) < 0)
+        return NULL;
 
-    if ((xml = virXMLParseFile(filename))) {
+    keepBlanksDefault = xmlKeepBlanksDefault(0);
+
+    if (rc > 0)
+        xml = virXMLParseString(content, filename);
+    else
+        xml = virXMLParseFile(filename);
+
+    if (xml) {
         obj = virDomainObjParseNode(xml, xmlDocGetRootElement(xml),
                                     caps, xmlopt, flags);
         xmlFreeDoc(xml);
     }
 
     xmlKeepBlanksDefault(keepBlanksDefault);
+    VIR_FREE(content);
     return obj;
 }
 
@@ -25556,12 +25611,34 @@ unsigned int virDomainDefFormatConvertXMLFlags(unsigned int flags)
 }
 
 
+/* A rough guess of the size of the XML of @def, most of which is taken
+ * by the devices */
+static unsigned int
+virDomainDefFormatSizeHint(virDomainDefPtr def)
+{
+    size_t ndevices;
+
+    ndevices = def->ngraphics + def->ndisks + def->ncontrollers +
+               def->nfss + def->nnets + def->ninputs + def->nsounds +
+               def->nvideos + def->nhostdevs + def->nredirdevs +
+               def->nsmartcards + def->nserials + def->nparallels +
+               def->nchannels + def->nconsoles + def->nleases +
+               def->nhubs + def->nrngs + def->nshmems + def->nmems +
+               def->npanics;
+
+    return 512 + MIN(ndevices, 10000) * 192;
+}
+
+
 char *
 virDomainDefFormat(virDomainDefPtr def, virCapsPtr caps, unsigned int flags)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
 
     virCheckFlags(VIR_DOMAIN_DEF_FORMAT_COMMON_FLAGS, NULL);
+
+    virBufferReserve(&buf, virDomainDefFormatSizeHint(def));
+
     if (virDomainDefFormatInternal(def, caps, flags, &buf) < 0)
         return NULL;
 
@@ -25763,15 +25840,38 @@ virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
 
     int ret = -1;
     char *xml;
+    char *statusFile = NULL;
 
     if (!(xml = virDomainObjFormat(xmlopt, obj, caps, flags)))
         goto cleanup;
 
+    /* Append the change to the journal of the status file if possible,
+     * falling back to rewriting the file whole */
+    if (xmlopt->statusJournal && statusDir) {
+        if (!(statusFile = virDomainConfigFile(statusDir, obj->def->name)))
+            goto cleanup;
+
+        if (!obj->statusJournal &&
+            !(obj->statusJournal = virFileJournalNew()))
+            goto cleanup;
+
+        if (virFileJournalAppend(obj->statusJournal, statusFile, xml) == 0) {
+            ret = 0;
+            goto cleanup;
+        }
+        virResetLastError();
+    }
+
     if (virDomainSaveXML(statusDir, obj->def, xml))
         goto cleanup;
 
+    if (statusFile &&
+        virFileJournalReset(obj->statusJournal, statusFile, xml) < 0)
+        goto cleanup;
+
     ret = 0;
  cleanup:
+    VIR_FREE(statusFile);
     VIR_FREE(xml);
     return ret;
 }
@@ -25803,6 +25903,11 @@ virDomainDeleteConfig(const char *configDir,
         goto cleanup;
     }
 
+    if (virFileJournalRemove(configFile) < 0)
+        goto cleanup;
+    virFileJournalFree(dom->statusJournal);
+    dom->statusJournal = NULL;
+
     ret = 0;
 
  cleanup:
@@ -26108,27 +26213,1778 @@ virDomainDiskDefForeachPath(virDomainDiskDefPtr disk,
 }
 
 
-/* Copy src into a new definition; with the quality of the copy
- * depending on the migratable flag (false for transitions between
- * persistent and active, true for transitions across save files or
- * snapshots).  */
-virDomainDefPtr
-virDomainDefCopy(virDomainDefPtr src,
-                 virCapsPtr caps,
-                 virDomainXMLOptionPtr xmlopt,
-                 void *parseOpaque,
-                 bool migratable)
+/* Copies the guest address of a device, dropping the alias which is
+ * only ever parsed from live XML. The PCI isolation group and connect
+ * flags are never formatted either. */
+static int
+virDomainDeviceInfoCopyInactive(virDomainDeviceInfoPtr dst,
+                                virDomainDeviceInfoPtr src)
 {
-    char *xml;
-    virDomainDefPtr ret;
-    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
-    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    if (virDomainDeviceInfoCopy(dst, src) < 0)
+        return -1;
+
+    VIR_FREE(dst->alias);
+    dst->pciConnectFlags = 0;
+    dst->isolationGroup = 0;
+    dst->isolationGroupLocked = false;
+    return 0;
+}
+
+
+static int
+virDomainVirtioOptionsCopy(virDomainVirtioOptionsPtr *dst,
+                           const virDomainVirtioOptions *src)
+{
+    *dst = NULL;
+
+    if (!src)
+        return 0;
+
+    if (VIR_ALLOC(*dst) < 0)
+        return -1;
+
+    **dst = *src;
+    return 0;
+}
+
+
+/* labelskip is live-only: an inactive parse of a label formatted with it
+ * ignores the flag and, as relabel isn't formatted along, defaults to
+ * relabeling */
+static void
+virDomainDeviceLabelDefsClearSkip(virSecurityDeviceLabelDefPtr *seclabels,
+                                  size_t nseclabels)
+{
+    size_t i;
+
+    for (i = 0; i < nseclabels; i++) {
+        if (seclabels[i]->labelskip) {
+            seclabels[i]->labelskip = false;
+            seclabels[i]->relabel = true;
+        }
+    }
+}
+
+
+static int
+virDomainChrSourceDefCopyInactive(virDomainChrSourceDefPtr dst,
+                                  virDomainChrSourceDefPtr src)
+{
+    size_t i;
+
+    if (virDomainChrSourceDefCopy(dst, src) < 0)
+        return -1;
+
+    switch ((virDomainChrType) dst->type) {
+    case VIR_DOMAIN_CHR_TYPE_PTY:
+        /* PTY path is only parsed from live xml */
+        VIR_FREE(dst->data.file.path);
+        break;
+
+    case VIR_DOMAIN_CHR_TYPE_TCP:
+        dst->data.tcp.tlscreds = false;
+        dst->data.tcp.tlsFromConfig = false;
+        break;
+
+    case VIR_DOMAIN_CHR_TYPE_NULL:
+    case VIR_DOMAIN_CHR_TYPE_VC:
+    case VIR_DOMAIN_CHR_TYPE_DEV:
+    case VIR_DOMAIN_CHR_TYPE_FILE:
+    case VIR_DOMAIN_CHR_TYPE_PIPE:
+    case VIR_DOMAIN_CHR_TYPE_STDIO:
+    case VIR_DOMAIN_CHR_TYPE_UDP:
+    case VIR_DOMAIN_CHR_TYPE_UNIX:
+    case VIR_DOMAIN_CHR_TYPE_SPICEVMC:
+    case VIR_DOMAIN_CHR_TYPE_SPICEPORT:
+    case VIR_DOMAIN_CHR_TYPE_NMDM:
+    case VIR_DOMAIN_CHR_TYPE_LAST:
+        break;
+    }
+
+    if (src->nseclabels) {
+        if (VIR_ALLOC_N(dst->seclabels, src->nseclabels) < 0)
+            return -1;
+
+        for (i = 0; i < src->nseclabels; i++) {
+            if (!(dst->seclabels[i] =
+                  virSecurityDeviceLabelDefCopy(src->seclabels[i])))
+                return -1;
+            dst->nseclabels++;
+        }
+
+        virDomainDeviceLabelDefsClearSkip(dst->seclabels, dst->nseclabels);
+    }
+
+    return 0;
+}
+
+
+static virDomainChrSourceDefPtr
+virDomainChrSourceDefNewCopy(virDomainChrSourceDefPtr src,
+                             virDomainXMLOptionPtr xmlopt)
+{
+    virDomainChrSourceDefPtr def;
+
+    if (!(def = virDomainChrSourceDefNew(xmlopt)))
+        return NULL;
+
+    if (virDomainChrSourceDefCopyInactive(def, src) < 0) {
+        virDomainChrSourceDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+/* Copies @src into @dst, keeping the parent, guest address and
+ * private data that @dst already has. */
+static int
+virDomainHostdevDefCopyInto(virDomainHostdevDefPtr dst,
+                            virDomainHostdevDefPtr src)
+{
+    virDomainDeviceDef parent = dst->parent;
+    virDomainDeviceInfoPtr info = dst->info;
+    virObjectPtr privateData = dst->privateData;
+
+    /* first a shallow copy of *everything* */
+    *dst = *src;
+    dst->parent = parent;
+    dst->info = info;
+    dst->privateData = privateData;
+
+    /* forget the state of a running domain */
+    dst->missing = false;
+    memset(&dst->origstates, 0, sizeof(dst->origstates));
+
+    switch ((virDomainHostdevMode) dst->mode) {
+    case VIR_DOMAIN_HOSTDEV_MODE_SUBSYS: {
+        virDomainHostdevSubsysPtr subsys = &dst->source.subsys;
+
+        switch ((virDomainHostdevSubsysType) subsys->type) {
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_USB:
+            subsys->u.usb.autoAddress = false;
+            break;
+
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_SCSI:
+            if (subsys->u.scsi.protocol ==
+                VIR_DOMAIN_HOSTDEV_SCSI_PROTOCOL_TYPE_ISCSI) {
+                virDomainHostdevSubsysSCSIiSCSIPtr iscsisrc = &subsys->u.scsi.u.iscsi;
+                virDomainHostdevSubsysSCSIiSCSIPtr srciscsi =
+                    &src->source.subsys.u.scsi.u.iscsi;
+
+                iscsisrc->path = NULL;
+                iscsisrc->nhosts = 0;
+                iscsisrc->hosts = NULL;
+                iscsisrc->auth = NULL;
+
+                if (VIR_STRDUP(iscsisrc->path, srciscsi->path) < 0)
+                    return -1;
+
+                if (srciscsi->nhosts) {
+                    if (!(iscsisrc->hosts =
+                          virStorageNetHostDefCopy(srciscsi->nhosts,
+                                                   srciscsi->hosts)))
+                        return -1;
+                    iscsisrc->nhosts = srciscsi->nhosts;
+                }
+
+                if (srciscsi->auth &&
+                    !(iscsisrc->auth = virStorageAuthDefCopy(srciscsi->auth)))
+                    return -1;
+            } else {
+                subsys->u.scsi.u.host.adapter = NULL;
+                if (VIR_STRDUP(subsys->u.scsi.u.host.adapter,
+                               src->source.subsys.u.scsi.u.host.adapter) < 0)
+                    return -1;
+            }
+            break;
+
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_SCSI_HOST:
+            subsys->u.scsi_host.wwpn = NULL;
+            if (VIR_STRDUP(subsys->u.scsi_host.wwpn,
+                           src->source.subsys.u.scsi_host.wwpn) < 0)
+                return -1;
+            break;
+
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_PCI:
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_MDEV:
+        case VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_LAST:
+            break;
+        }
+        break;
+    }
+
+    case VIR_DOMAIN_HOSTDEV_MODE_CAPABILITIES: {
+        virDomainHostdevCapsPtr hostcaps = &dst->source.caps;
+
+        switch ((virDomainHostdevCapsType) hostcaps->type) {
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_STORAGE:
+            hostcaps->u.storage.block = NULL;
+            if (VIR_STRDUP(hostcaps->u.storage.block,
+                           src->source.caps.u.storage.block) < 0)
+                return -1;
+            break;
+
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_MISC:
+            hostcaps->u.misc.chardev = NULL;
+            if (VIR_STRDUP(hostcaps->u.misc.chardev,
+                           src->source.caps.u.misc.chardev) < 0)
+                return -1;
+            break;
+
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_NET:
+            hostcaps->u.net.ifname = NULL;
+            memset(&hostcaps->u.net.ip, 0, sizeof(hostcaps->u.net.ip));
+            if (VIR_STRDUP(hostcaps->u.net.ifname,
+                           src->source.caps.u.net.ifname) < 0 ||
+                virNetDevIPInfoCopy(&hostcaps->u.net.ip,
+                                    &src->source.caps.u.net.ip) < 0)
+                return -1;
+            break;
+
+        case VIR_DOMAIN_HOSTDEV_CAPS_TYPE_LAST:
+            break;
+        }
+        break;
+    }
+
+    case VIR_DOMAIN_HOSTDEV_MODE_LAST:
+        break;
+    }
+
+    return 0;
+}
+
+
+static virDomainHostdevDefPtr
+virDomainHostdevDefCopyInactive(virDomainHostdevDefPtr src,
+                                virDomainXMLOptionPtr xmlopt)
+{
+    virDomainHostdevDefPtr def;
+
+    if (!(def = virDomainHostdevDefNew(xmlopt)))
+        return NULL;
+
+    if (virDomainHostdevDefCopyInto(def, src) < 0 ||
+        virDomainDeviceInfoCopyInactive(def->info, src->info) < 0) {
+        virDomainHostdevDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainDiskDefPtr
+virDomainDiskDefCopyInactive(virDomainDiskDefPtr src,
+                             virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDiskDefPtr def;
+    virStorageSourcePtr n;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    /* The fields are copied one by one so that anything added to the
+     * struct is left out rather than shared with @src. The mirror is
+     * only valid for a running domain. */
+    def->device = src->device;
+    def->bus = src->bus;
+    def->tray_status = src->tray_status;
+    def->removable = src->removable;
+    def->geometry = src->geometry;
+    def->blockio = src->blockio;
+    def->blkdeviotune = src->blkdeviotune;
+    def->blkdeviotune.group_name = NULL;
+    def->cachemode = src->cachemode;
+    def->error_policy = src->error_policy;
+    def->rerror_policy = src->rerror_policy;
+    def->iomode = src->iomode;
+    def->ioeventfd = src->ioeventfd;
+    def->event_idx = src->event_idx;
+    def->copy_on_read = src->copy_on_read;
+    def->snapshot = src->snapshot;
+    def->startupPolicy = src->startupPolicy;
+    def->transient = src->transient;
+    def->rawio = src->rawio;
+    def->sgio = src->sgio;
+    def->discard = src->discard;
+    def->iothread = src->iothread;
+    def->detect_zeroes = src->detect_zeroes;
+
+    if (xmlopt &&
+        xmlopt->privateData.diskNew &&
+        !(def->privateData = xmlopt->privateData.diskNew()))
+        goto error;
+
+    if (!(def->src = virStorageSourceCopy(src->src, true)))
+        goto error;
+
+    for (n = def->src; n; n = n->backingStore)
+        virDomainDeviceLabelDefsClearSkip(n->seclabels, n->nseclabels);
+
+    if (VIR_STRDUP(def->dst, src->dst) < 0 ||
+        VIR_STRDUP(def->blkdeviotune.group_name,
+                   src->blkdeviotune.group_name) < 0 ||
+        VIR_STRDUP(def->serial, src->serial) < 0 ||
+        VIR_STRDUP(def->wwn, src->wwn) < 0 ||
+        VIR_STRDUP(def->vendor, src->vendor) < 0 ||
+        VIR_STRDUP(def->product, src->product) < 0 ||
+        VIR_STRDUP(def->domain_name, src->domain_name) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(def);
+    return NULL;
+}
+
+
+static virDomainControllerDefPtr
+virDomainControllerDefCopyInactive(virDomainControllerDefPtr src)
+{
+    virDomainControllerDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->virtio = NULL;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0) {
+        virDomainControllerDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainFSDefPtr
+virDomainFSDefCopyInactive(virDomainFSDefPtr src)
+{
+    virDomainFSDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->src = NULL;
+    def->dst = NULL;
+    def->virtio = NULL;
+    def->symlinksResolved = false;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (!(def->src = virStorageSourceCopy(src->src, false)) ||
+        VIR_STRDUP(def->dst, src->dst) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0) {
+        virDomainFSDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainNetDefPtr
+virDomainNetDefCopyInactive(virDomainNetDefPtr src,
+                            virCapsPtr caps)
+{
+    virDomainNetDefPtr def;
+    const char *prefix = caps ? caps->host.netprefix : NULL;
+    virDomainHostdevDefPtr hostdev;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    /* first a shallow copy of *everything* */
+    *def = *src;
+
+    /* then forget everything owned by @src */
+    def->model = NULL;
+    memset(&def->data, 0, sizeof(def->data));
+    def->backend.tap = NULL;
+    def->backend.vhost = NULL;
+    def->virtPortProfile = NULL;
+    def->script = NULL;
+    def->domain_name = NULL;
+    def->ifname = NULL;
+    memset(&def->hostIP, 0, sizeof(def->hostIP));
+    def->ifname_guest_actual = NULL;
+    def->ifname_guest = NULL;
+    memset(&def->guestIP, 0, sizeof(def->guestIP));
+    memset(&def->info, 0, sizeof(def->info));
+    def->filter = NULL;
+    def->filterparams = NULL;
+    def->bandwidth = NULL;
+    memset(&def->vlan, 0, sizeof(def->vlan));
+    def->coalesce = NULL;
+    def->virtio = NULL;
+
+    switch (def->type) {
+    case VIR_DOMAIN_NET_TYPE_VHOSTUSER:
+        if (src->data.vhostuser &&
+            !(def->data.vhostuser =
+              virDomainChrSourceDefNewCopy(src->data.vhostuser, NULL)))
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_SERVER:
+    case VIR_DOMAIN_NET_TYPE_CLIENT:
+    case VIR_DOMAIN_NET_TYPE_MCAST:
+    case VIR_DOMAIN_NET_TYPE_UDP:
+        def->data.socket.port = src->data.socket.port;
+        def->data.socket.localport = src->data.socket.localport;
+        if (VIR_STRDUP(def->data.socket.address,
+                       src->data.socket.address) < 0 ||
+            VIR_STRDUP(def->data.socket.localaddr,
+                       src->data.socket.localaddr) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_NETWORK:
+        /* the actual network connection belongs to the running domain */
+        if (VIR_STRDUP(def->data.network.name, src->data.network.name) < 0 ||
+            VIR_STRDUP(def->data.network.portgroup,
+                       src->data.network.portgroup) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_BRIDGE:
+        if (VIR_STRDUP(def->data.bridge.brname, src->data.bridge.brname) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_INTERNAL:
+        if (VIR_STRDUP(def->data.internal.name, src->data.internal.name) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_DIRECT:
+        def->data.direct.mode = src->data.direct.mode;
+        if (VIR_STRDUP(def->data.direct.linkdev, src->data.direct.linkdev) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_HOSTDEV:
+        hostdev = &def->data.hostdev.def;
+        hostdev->parent.type = VIR_DOMAIN_DEVICE_NET;
+        hostdev->parent.data.net = def;
+        hostdev->info = &def->info;
+        if (virDomainHostdevDefCopyInto(hostdev, &src->data.hostdev.def) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_ETHERNET:
+    case VIR_DOMAIN_NET_TYPE_USER:
+    case VIR_DOMAIN_NET_TYPE_LAST:
+        break;
+    }
+
+    /* Skip auto-generated target names */
+    if (src->ifname &&
+        !STRPREFIX(src->ifname, VIR_NET_GENERATED_TAP_PREFIX) &&
+        !(prefix && STRPREFIX(src->ifname, prefix)) &&
+        !(def->type == VIR_DOMAIN_NET_TYPE_DIRECT &&
+          (STRPREFIX(src->ifname, VIR_NET_GENERATED_MACVTAP_PREFIX) ||
+           STRPREFIX(src->ifname, VIR_NET_GENERATED_MACVLAN_PREFIX))) &&
+        VIR_STRDUP(def->ifname, src->ifname) < 0)
+        goto error;
+
+    if (VIR_STRDUP(def->model, src->model) < 0 ||
+        VIR_STRDUP(def->backend.tap, src->backend.tap) < 0 ||
+        VIR_STRDUP(def->backend.vhost, src->backend.vhost) < 0 ||
+        VIR_STRDUP(def->script, src->script) < 0 ||
+        VIR_STRDUP(def->domain_name, src->domain_name) < 0 ||
+        VIR_STRDUP(def->ifname_guest_actual, src->ifname_guest_actual) < 0 ||
+        VIR_STRDUP(def->ifname_guest, src->ifname_guest) < 0 ||
+        VIR_STRDUP(def->filter, src->filter) < 0)
+        goto error;
+
+    if (src->virtPortProfile) {
+        if (VIR_ALLOC(def->virtPortProfile) < 0)
+            goto error;
+        *def->virtPortProfile = *src->virtPortProfile;
+    }
+
+    if (src->coalesce) {
+        if (VIR_ALLOC(def->coalesce) < 0)
+            goto error;
+        *def->coalesce = *src->coalesce;
+    }
+
+    if (src->filterparams &&
+        (!(def->filterparams = virNWFilterHashTableCreate(0)) ||
+         virNWFilterHashTablePutAll(src->filterparams, def->filterparams) < 0))
+        goto error;
+
+    if (virNetDevIPInfoCopy(&def->hostIP, &src->hostIP) < 0 ||
+        virNetDevIPInfoCopy(&def->guestIP, &src->guestIP) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virNetDevBandwidthCopy(&def->bandwidth, src->bandwidth) < 0 ||
+        virNetDevVlanCopy(&def->vlan, &src->vlan) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainNetDefFree(def);
+    return NULL;
+}
+
+
+static virDomainInputDefPtr
+virDomainInputDefCopyInactive(virDomainInputDefPtr src)
+{
+    virDomainInputDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->source.evdev = NULL;
+    def->virtio = NULL;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (VIR_STRDUP(def->source.evdev, src->source.evdev) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0) {
+        virDomainInputDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainSoundDefPtr
+virDomainSoundDefCopyInactive(virDomainSoundDefPtr src)
+{
+    virDomainSoundDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->ncodecs = 0;
+    def->codecs = NULL;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0)
+        goto error;
+
+    if (src->ncodecs && VIR_ALLOC_N(def->codecs, src->ncodecs) < 0)
+        goto error;
+
+    for (i = 0; i < src->ncodecs; i++) {
+        if (VIR_ALLOC(def->codecs[i]) < 0)
+            goto error;
+        def->ncodecs++;
+        *def->codecs[i] = *src->codecs[i];
+    }
+
+    return def;
+
+ error:
+    virDomainSoundDefFree(def);
+    return NULL;
+}
+
+
+static virDomainVideoDefPtr
+virDomainVideoDefCopyInactive(virDomainVideoDefPtr src)
+{
+    virDomainVideoDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->accel = NULL;
+    def->driver = NULL;
+    def->virtio = NULL;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (src->accel) {
+        if (VIR_ALLOC(def->accel) < 0)
+            goto error;
+        *def->accel = *src->accel;
+    }
+
+    if (src->driver) {
+        if (VIR_ALLOC(def->driver) < 0)
+            goto error;
+        *def->driver = *src->driver;
+    }
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainVideoDefFree(def);
+    return NULL;
+}
+
+
+static virDomainGraphicsDefPtr
+virDomainGraphicsDefCopyInactive(virDomainGraphicsDefPtr src)
+{
+    virDomainGraphicsDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->nListens = 0;
+    def->listens = NULL;
+
+    /* Ports allocated automatically are released when the domain
+     * stops, only the ones from the config are kept */
+    switch (def->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        def->data.vnc.keymap = NULL;
+        def->data.vnc.auth.passwd = NULL;
+        if (def->data.vnc.autoport)
+            def->data.vnc.port = 0;
+        def->data.vnc.portReserved = false;
+        def->data.vnc.websocketGenerated = false;
+        if (VIR_STRDUP(def->data.vnc.keymap, src->data.vnc.keymap) < 0 ||
+            VIR_STRDUP(def->data.vnc.auth.passwd,
+                       src->data.vnc.auth.passwd) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+        def->data.sdl.display = NULL;
+        def->data.sdl.xauth = NULL;
+        if (VIR_STRDUP(def->data.sdl.display, src->data.sdl.display) < 0 ||
+            VIR_STRDUP(def->data.sdl.xauth, src->data.sdl.xauth) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+        if (def->data.rdp.autoport)
+            def->data.rdp.port = 0;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+        def->data.desktop.display = NULL;
+        if (VIR_STRDUP(def->data.desktop.display,
+                       src->data.desktop.display) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        def->data.spice.keymap = NULL;
+        def->data.spice.auth.passwd = NULL;
+        def->data.spice.rendernode = NULL;
+        if (def->data.spice.autoport) {
+            def->data.spice.port = 0;
+            def->data.spice.tlsPort = 0;
+        }
+        def->data.spice.portReserved = false;
+        def->data.spice.tlsPortReserved = false;
+        if (VIR_STRDUP(def->data.spice.keymap, src->data.spice.keymap) < 0 ||
+            VIR_STRDUP(def->data.spice.auth.passwd,
+                       src->data.spice.auth.passwd) < 0 ||
+            VIR_STRDUP(def->data.spice.rendernode,
+                       src->data.spice.rendernode) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+        break;
+    }
+
+    if (src->nListens && VIR_ALLOC_N(def->listens, src->nListens) < 0)
+        goto error;
+
+    for (i = 0; i < src->nListens; i++) {
+        virDomainGraphicsListenDefPtr glisten = &def->listens[i];
+        virDomainGraphicsListenDefPtr srcglisten = &src->listens[i];
+
+        def->nListens++;
+        glisten->type = srcglisten->type;
+
+        /* The address of a network is looked up on each start */
+        switch (glisten->type) {
+        case VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_ADDRESS:
+            if (VIR_STRDUP(glisten->address, srcglisten->address) < 0)
+                goto error;
+            break;
+
+        case VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_NETWORK:
+            if (VIR_STRDUP(glisten->network, srcglisten->network) < 0)
+                goto error;
+            break;
+
+        case VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_SOCKET:
+            if (VIR_STRDUP(glisten->socket, srcglisten->socket) < 0)
+                goto error;
+            break;
+
+        case VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_NONE:
+        case VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_LAST:
+            break;
+        }
+    }
+
+    return def;
+
+ error:
+    virDomainGraphicsDefFree(def);
+    return NULL;
+}
+
+
+static virDomainLeaseDefPtr
+virDomainLeaseDefCopy(virDomainLeaseDefPtr src)
+{
+    virDomainLeaseDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->offset = src->offset;
+
+    if (VIR_STRDUP(def->lockspace, src->lockspace) < 0 ||
+        VIR_STRDUP(def->key, src->key) < 0 ||
+        VIR_STRDUP(def->path, src->path) < 0) {
+        virDomainLeaseDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainSmartcardDefPtr
+virDomainSmartcardDefCopyInactive(virDomainSmartcardDefPtr src,
+                                  virDomainXMLOptionPtr xmlopt)
+{
+    virDomainSmartcardDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+
+    switch (def->type) {
+    case VIR_DOMAIN_SMARTCARD_TYPE_HOST_CERTIFICATES:
+        for (i = 0; i < VIR_DOMAIN_SMARTCARD_NUM_CERTIFICATES; i++) {
+            if (VIR_STRDUP(def->data.cert.file[i],
+                           src->data.cert.file[i]) < 0)
+                goto error;
+        }
+        if (VIR_STRDUP(def->data.cert.database, src->data.cert.database) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_SMARTCARD_TYPE_PASSTHROUGH:
+        if (!(def->data.passthru =
+              virDomainChrSourceDefNewCopy(src->data.passthru, xmlopt)))
+            goto error;
+        break;
+
+    default:
+        break;
+    }
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainSmartcardDefFree(def);
+    return NULL;
+}
+
+
+static virDomainChrDefPtr
+virDomainChrDefCopyInactive(virDomainChrDefPtr src,
+                            virDomainXMLOptionPtr xmlopt)
+{
+    virDomainChrDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->deviceType = src->deviceType;
+    def->targetTypeAttr = src->targetTypeAttr;
+    def->targetType = src->targetType;
+    /* the state of a channel is only known while the domain runs */
+    def->state = VIR_DOMAIN_CHR_DEVICE_STATE_DEFAULT;
+
+    switch (def->deviceType) {
+    case VIR_DOMAIN_CHR_DEVICE_TYPE_CHANNEL:
+        switch (def->targetType) {
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_GUESTFWD:
+            if (src->target.addr) {
+                if (VIR_ALLOC(def->target.addr) < 0)
+                    goto error;
+                *def->target.addr = *src->target.addr;
+            }
+            break;
+
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_XEN:
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO:
+            if (VIR_STRDUP(def->target.name, src->target.name) < 0)
+                goto error;
+            break;
+
+        default:
+            def->target = src->target;
+            break;
+        }
+        break;
+
+    default:
+        def->target.port = src->target.port;
+        break;
+    }
+
+    if (!(def->source = virDomainChrSourceDefNewCopy(src->source, xmlopt)) ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainChrDefFree(def);
+    return NULL;
+}
+
+
+static virDomainHubDefPtr
+virDomainHubDefCopyInactive(virDomainHubDefPtr src)
+{
+    virDomainHubDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0) {
+        virDomainHubDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainRedirdevDefPtr
+virDomainRedirdevDefCopyInactive(virDomainRedirdevDefPtr src,
+                                 virDomainXMLOptionPtr xmlopt)
+{
+    virDomainRedirdevDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->bus = src->bus;
+
+    if (!(def->source = virDomainChrSourceDefNewCopy(src->source, xmlopt)) ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0) {
+        virDomainRedirdevDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainRNGDefPtr
+virDomainRNGDefCopyInactive(virDomainRNGDefPtr src,
+                            virDomainXMLOptionPtr xmlopt)
+{
+    virDomainRNGDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    memset(&def->source, 0, sizeof(def->source));
+    memset(&def->info, 0, sizeof(def->info));
+    def->virtio = NULL;
+
+    switch ((virDomainRNGBackend) def->backend) {
+    case VIR_DOMAIN_RNG_BACKEND_RANDOM:
+        if (VIR_STRDUP(def->source.file, src->source.file) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_EGD:
+        if (!(def->source.chardev =
+              virDomainChrSourceDefNewCopy(src->source.chardev, xmlopt)))
+            goto error;
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_LAST:
+        break;
+    }
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainRNGDefFree(def);
+    return NULL;
+}
+
+
+static virDomainMemoryDefPtr
+virDomainMemoryDefCopyInactive(virDomainMemoryDefPtr src)
+{
+    virDomainMemoryDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->sourceNodes = NULL;
+    def->nvdimmPath = NULL;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if ((src->sourceNodes &&
+         !(def->sourceNodes = virBitmapNewCopy(src->sourceNodes))) ||
+        VIR_STRDUP(def->nvdimmPath, src->nvdimmPath) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0) {
+        virDomainMemoryDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainShmemDefPtr
+virDomainShmemDefCopyInactive(virDomainShmemDefPtr src)
+{
+    virDomainShmemDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->name = NULL;
+    memset(&def->server.chr, 0, sizeof(def->server.chr));
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (VIR_STRDUP(def->name, src->name) < 0 ||
+        virDomainChrSourceDefCopyInactive(&def->server.chr,
+                                          &src->server.chr) < 0 ||
+        virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0) {
+        virDomainShmemDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainTPMDefPtr
+virDomainTPMDefCopyInactive(virDomainTPMDefPtr src)
+{
+    virDomainTPMDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    memset(&def->data, 0, sizeof(def->data));
+    memset(&def->info, 0, sizeof(def->info));
+
+    switch (def->type) {
+    case VIR_DOMAIN_TPM_TYPE_PASSTHROUGH:
+        def->data.passthrough.source.type = src->data.passthrough.source.type;
+        if (VIR_STRDUP(def->data.passthrough.source.data.file.path,
+                       src->data.passthrough.source.data.file.path) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_TPM_TYPE_LAST:
+        break;
+    }
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainTPMDefFree(def);
+    return NULL;
+}
+
+
+static virDomainPanicDefPtr
+virDomainPanicDefCopyInactive(virDomainPanicDefPtr src)
+{
+    virDomainPanicDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0) {
+        virDomainPanicDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainWatchdogDefPtr
+virDomainWatchdogDefCopyInactive(virDomainWatchdogDefPtr src)
+{
+    virDomainWatchdogDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+    def->action = src->action;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0) {
+        virDomainWatchdogDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainMemballoonDefPtr
+virDomainMemballoonDefCopyInactive(virDomainMemballoonDefPtr src)
+{
+    virDomainMemballoonDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->virtio = NULL;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0 ||
+        virDomainVirtioOptionsCopy(&def->virtio, src->virtio) < 0) {
+        virDomainMemballoonDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainNVRAMDefPtr
+virDomainNVRAMDefCopyInactive(virDomainNVRAMDefPtr src)
+{
+    virDomainNVRAMDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    if (virDomainDeviceInfoCopyInactive(&def->info, &src->info) < 0) {
+        virDomainNVRAMDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+/* Mimics how the domain security labels are parsed from the XML of
+ * an inactive domain: the dynamically assigned labels are dropped
+ * and an omitted model is taken from the host. */
+static int
+virDomainDefSeclabelsCopyInactive(virDomainDefPtr def,
+                                  virDomainDefPtr src,
+                                  virCapsPtr caps)
+{
+    virSecurityLabelDefPtr seclabel;
+    size_t i;
+
+    if (src->nseclabels && VIR_ALLOC_N(def->seclabels, src->nseclabels) < 0)
+        return -1;
+
+    for (i = 0; i < src->nseclabels; i++) {
+        if (src->seclabels[i]->type == VIR_DOMAIN_SECLABEL_DEFAULT)
+            continue;
+
+        if (!(seclabel = virSecurityLabelDefCopy(src->seclabels[i])))
+            return -1;
+        def->seclabels[def->nseclabels++] = seclabel;
+
+        seclabel->implicit = false;
+
+        if (STREQ_NULLABLE(seclabel->model, "none") ||
+            seclabel->type == VIR_DOMAIN_SECLABEL_NONE) {
+            if (STREQ_NULLABLE(seclabel->model, "none"))
+                seclabel->type = VIR_DOMAIN_SECLABEL_NONE;
+            seclabel->relabel = false;
+            VIR_FREE(seclabel->label);
+            VIR_FREE(seclabel->imagelabel);
+            VIR_FREE(seclabel->baselabel);
+            continue;
+        }
+
+        if (seclabel->type != VIR_DOMAIN_SECLABEL_STATIC)
+            VIR_FREE(seclabel->label);
+        VIR_FREE(seclabel->imagelabel);
+        if (seclabel->type != VIR_DOMAIN_SECLABEL_DYNAMIC)
+            VIR_FREE(seclabel->baselabel);
+    }
+
+    if (def->nseclabels == 1 &&
+        !def->seclabels[0]->model &&
+        caps && caps->host.nsecModels > 0 &&
+        (def->seclabels[0]->type == VIR_DOMAIN_SECLABEL_NONE ||
+         (def->seclabels[0]->type == VIR_DOMAIN_SECLABEL_DYNAMIC &&
+          !def->seclabels[0]->baselabel))) {
+        seclabel = def->seclabels[0];
+
+        if (VIR_STRDUP(seclabel->model, caps->host.secModels[0].model) < 0)
+            return -1;
+
+        if (STREQ(seclabel->model, "none")) {
+            seclabel->type = VIR_DOMAIN_SECLABEL_NONE;
+            seclabel->relabel = false;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDefOSCopy(virDomainOSDefPtr os,
+                   virDomainOSDefPtr src)
+{
+    size_t n;
+    size_t i;
+
+    if (VIR_STRDUP(os->machine, src->machine) < 0 ||
+        VIR_STRDUP(os->init, src->init) < 0 ||
+        VIR_STRDUP(os->initdir, src->initdir) < 0 ||
+        VIR_STRDUP(os->inituser, src->inituser) < 0 ||
+        VIR_STRDUP(os->initgroup, src->initgroup) < 0 ||
+        VIR_STRDUP(os->kernel, src->kernel) < 0 ||
+        VIR_STRDUP(os->initrd, src->initrd) < 0 ||
+        VIR_STRDUP(os->cmdline, src->cmdline) < 0 ||
+        VIR_STRDUP(os->dtb, src->dtb) < 0 ||
+        VIR_STRDUP(os->root, src->root) < 0 ||
+        VIR_STRDUP(os->slic_table, src->slic_table) < 0 ||
+        VIR_STRDUP(os->bootloader, src->bootloader) < 0 ||
+        VIR_STRDUP(os->bootloaderArgs, src->bootloaderArgs) < 0)
+        return -1;
+
+    if (src->initargv) {
+        for (n = 0; src->initargv[n]; n++)
+            ;
+        if (VIR_ALLOC_N(os->initargv, n + 1) < 0)
+            return -1;
+        for (i = 0; i < n; i++) {
+            if (VIR_STRDUP(os->initargv[i], src->initargv[i]) < 0)
+                return -1;
+        }
+    }
+
+    if (src->initenv) {
+        for (n = 0; src->initenv[n]; n++)
+            ;
+        if (VIR_ALLOC_N(os->initenv, n + 1) < 0)
+            return -1;
+        for (i = 0; i < n; i++) {
+            if (VIR_ALLOC(os->initenv[i]) < 0 ||
+                VIR_STRDUP(os->initenv[i]->name, src->initenv[i]->name) < 0 ||
+                VIR_STRDUP(os->initenv[i]->value, src->initenv[i]->value) < 0)
+                return -1;
+        }
+    }
+
+    if (src->loader) {
+        if (VIR_ALLOC(os->loader) < 0)
+            return -1;
+        os->loader->readonly = src->loader->readonly;
+        os->loader->type = src->loader->type;
+        os->loader->secure = src->loader->secure;
+        if (VIR_STRDUP(os->loader->path, src->loader->path) < 0 ||
+            VIR_STRDUP(os->loader->nvram, src->loader->nvram) < 0 ||
+            VIR_STRDUP(os->loader->templt, src->loader->templt) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* Copies @src the way formatting and parsing it back as an inactive
+ * definition would, without going through the XML. */
+static virDomainDefPtr
+virDomainDefCopyInactive(virDomainDefPtr src,
+                         virCapsPtr caps,
+                         virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    /* first a shallow copy of *everything* */
+    *def = *src;
+
+    /* then forget everything owned by @src; any pointer added to
+     * virDomainDef has to be listed here or it ends up shared */
+    def->name = NULL;
+    def->title = NULL;
+    def->description = NULL;
+    def->blkio.ndevices = 0;
+    def->blkio.devices = NULL;
+    def->mem.nhugepages = 0;
+    def->mem.hugepages = NULL;
+    def->maxvcpus = 0;
+    def->vcpus = NULL;
+    def->cpumask = NULL;
+    def->niothreadids = 0;
+    def->iothreadids = NULL;
+    def->cputune.emulatorpin = NULL;
+    def->numa = NULL;
+    def->resource = NULL;
+    memset(&def->idmap, 0, sizeof(def->idmap));
+    memset(&def->os, 0, sizeof(def->os));
+    def->emulator = NULL;
+    def->hyperv_vendor_id = NULL;
+    if (def->clock.offset == VIR_DOMAIN_CLOCK_OFFSET_TIMEZONE)
+        def->clock.data.timezone = NULL;
+    def->clock.ntimers = 0;
+    def->clock.timers = NULL;
+    def->ngraphics = 0;
+    def->graphics = NULL;
+    def->ndisks = 0;
+    def->disks = NULL;
+    def->ncontrollers = 0;
+    def->controllers = NULL;
+    def->nfss = 0;
+    def->fss = NULL;
+    def->nnets = 0;
+    def->nets = NULL;
+    def->ninputs = 0;
+    def->inputs = NULL;
+    def->nsounds = 0;
+    def->sounds = NULL;
+    def->nvideos = 0;
+    def->videos = NULL;
+    def->nhostdevs = 0;
+    def->hostdevs = NULL;
+    def->nredirdevs = 0;
+    def->redirdevs = NULL;
+    def->nsmartcards = 0;
+    def->smartcards = NULL;
+    def->nserials = 0;
+    def->serials = NULL;
+    def->nparallels = 0;
+    def->parallels = NULL;
+    def->nchannels = 0;
+    def->channels = NULL;
+    def->nconsoles = 0;
+    def->consoles = NULL;
+    def->nleases = 0;
+    def->leases = NULL;
+    def->nhubs = 0;
+    def->hubs = NULL;
+    def->nseclabels = 0;
+    def->seclabels = NULL;
+    def->nrngs = 0;
+    def->rngs = NULL;
+    def->nshmems = 0;
+    def->shmems = NULL;
+    def->nmems = 0;
+    def->mems = NULL;
+    def->npanics = 0;
+    def->panics = NULL;
+    def->watchdog = NULL;
+    def->memballoon = NULL;
+    def->nvram = NULL;
+    def->tpm = NULL;
+    def->cpu = NULL;
+    def->sysinfo = NULL;
+    def->redirfilter = NULL;
+    def->iommu = NULL;
+    def->namespaceData = NULL;
+    def->keywrap = NULL;
+    def->metadata = NULL;
+
+    def->id = -1;
+
+    if (VIR_STRDUP(def->name, src->name) < 0 ||
+        VIR_STRDUP(def->title, src->title) < 0 ||
+        VIR_STRDUP(def->description, src->description) < 0 ||
+        VIR_STRDUP(def->emulator, src->emulator) < 0 ||
+        VIR_STRDUP(def->hyperv_vendor_id, src->hyperv_vendor_id) < 0)
+        goto error;
+
+    if (src->blkio.ndevices &&
+        VIR_ALLOC_N(def->blkio.devices, src->blkio.ndevices) < 0)
+        goto error;
+    for (i = 0; i < src->blkio.ndevices; i++) {
+        def->blkio.devices[i] = src->blkio.devices[i];
+        def->blkio.devices[i].path = NULL;
+        def->blkio.ndevices++;
+        if (VIR_STRDUP(def->blkio.devices[i].path,
+                       src->blkio.devices[i].path) < 0)
+            goto error;
+    }
+
+    if (src->mem.nhugepages &&
+        VIR_ALLOC_N(def->mem.hugepages, src->mem.nhugepages) < 0)
+        goto error;
+    for (i = 0; i < src->mem.nhugepages; i++) {
+        def->mem.hugepages[i].size = src->mem.hugepages[i].size;
+        def->mem.nhugepages++;
+        if (src->mem.hugepages[i].nodemask &&
+            !(def->mem.hugepages[i].nodemask =
+              virBitmapNewCopy(src->mem.hugepages[i].nodemask)))
+            goto error;
+    }
+
+    if (src->maxvcpus && VIR_ALLOC_N(def->vcpus, src->maxvcpus) < 0)
+        goto error;
+    for (i = 0; i < src->maxvcpus; i++) {
+        virDomainVcpuDefPtr vcpu;
+
+        if (!(vcpu = virDomainVcpuDefNew(xmlopt)))
+            goto error;
+        def->vcpus[def->maxvcpus++] = vcpu;
+
+        vcpu->online = src->vcpus[i]->online;
+        vcpu->hotpluggable = src->vcpus[i]->hotpluggable;
+        vcpu->order = src->vcpus[i]->order;
+        vcpu->sched = src->vcpus[i]->sched;
+        if (src->vcpus[i]->cpumask &&
+            !(vcpu->cpumask = virBitmapNewCopy(src->vcpus[i]->cpumask)))
+            goto error;
+    }
+
+    if (src->cpumask && !(def->cpumask = virBitmapNewCopy(src->cpumask)))
+        goto error;
+
+    if (src->niothreadids &&
+        VIR_ALLOC_N(def->iothreadids, src->niothreadids) < 0)
+        goto error;
+    for (i = 0; i < src->niothreadids; i++) {
+        virDomainIOThreadIDDefPtr iothrid;
+
+        if (VIR_ALLOC(iothrid) < 0)
+            goto error;
+        def->iothreadids[def->niothreadids++] = iothrid;
+
+        *iothrid = *src->iothreadids[i];
+        iothrid->thread_id = 0;
+        iothrid->cpumask = NULL;
+        if (src->iothreadids[i]->cpumask &&
+            !(iothrid->cpumask =
+              virBitmapNewCopy(src->iothreadids[i]->cpumask)))
+            goto error;
+    }
+
+    if (src->cputune.emulatorpin &&
+        !(def->cputune.emulatorpin = virBitmapNewCopy(src->cputune.emulatorpin)))
+        goto error;
+
+    if (!(def->numa = src->numa ? virDomainNumaCopy(src->numa) :
+                                  virDomainNumaNew()))
+        goto error;
+
+    if (src->resource) {
+        if (VIR_ALLOC(def->resource) < 0 ||
+            VIR_STRDUP(def->resource->partition,
+                       src->resource->partition) < 0)
+            goto error;
+    }
+
+    if (src->idmap.nuidmap) {
+        if (VIR_ALLOC_N(def->idmap.uidmap, src->idmap.nuidmap) < 0)
+            goto error;
+        memcpy(def->idmap.uidmap, src->idmap.uidmap,
+               src->idmap.nuidmap * sizeof(*src->idmap.uidmap));
+        def->idmap.nuidmap = src->idmap.nuidmap;
+    }
+    if (src->idmap.ngidmap) {
+        if (VIR_ALLOC_N(def->idmap.gidmap, src->idmap.ngidmap) < 0)
+            goto error;
+        memcpy(def->idmap.gidmap, src->idmap.gidmap,
+               src->idmap.ngidmap * sizeof(*src->idmap.gidmap));
+        def->idmap.ngidmap = src->idmap.ngidmap;
+    }
+
+    def->os.type = src->os.type;
+    def->os.arch = src->os.arch;
+    def->os.nBootDevs = src->os.nBootDevs;
+    memcpy(def->os.bootDevs, src->os.bootDevs, sizeof(src->os.bootDevs));
+    def->os.bootmenu = src->os.bootmenu;
+    def->os.bm_timeout = src->os.bm_timeout;
+    def->os.bm_timeout_set = src->os.bm_timeout_set;
+    def->os.smbios_mode = src->os.smbios_mode;
+    def->os.bios = src->os.bios;
+    if (virDomainDefOSCopy(&def->os, &src->os) < 0)
+        goto error;
+
+    if (src->clock.offset == VIR_DOMAIN_CLOCK_OFFSET_TIMEZONE &&
+        VIR_STRDUP(def->clock.data.timezone, src->clock.data.timezone) < 0)
+        goto error;
+    if (src->clock.ntimers &&
+        VIR_ALLOC_N(def->clock.timers, src->clock.ntimers) < 0)
+        goto error;
+    for (i = 0; i < src->clock.ntimers; i++) {
+        if (VIR_ALLOC(def->clock.timers[i]) < 0)
+            goto error;
+        def->clock.ntimers++;
+        *def->clock.timers[i] = *src->clock.timers[i];
+    }
+
+    if (src->ngraphics && VIR_ALLOC_N(def->graphics, src->ngraphics) < 0)
+        goto error;
+    for (i = 0; i < src->ngraphics; i++) {
+        if (!(def->graphics[i] =
+              virDomainGraphicsDefCopyInactive(src->graphics[i])))
+            goto error;
+        def->ngraphics++;
+    }
+
+    if (src->ndisks && VIR_ALLOC_N(def->disks, src->ndisks) < 0)
+        goto error;
+    for (i = 0; i < src->ndisks; i++) {
+        if (!(def->disks[i] = virDomainDiskDefCopyInactive(src->disks[i],
+                                                           xmlopt)))
+            goto error;
+        def->ndisks++;
+    }
+
+    if (src->ncontrollers &&
+        VIR_ALLOC_N(def->controllers, src->ncontrollers) < 0)
+        goto error;
+    for (i = 0; i < src->ncontrollers; i++) {
+        if (!(def->controllers[i] =
+              virDomainControllerDefCopyInactive(src->controllers[i])))
+            goto error;
+        def->ncontrollers++;
+    }
+
+    if (src->nfss && VIR_ALLOC_N(def->fss, src->nfss) < 0)
+        goto error;
+    for (i = 0; i < src->nfss; i++) {
+        if (!(def->fss[i] = virDomainFSDefCopyInactive(src->fss[i])))
+            goto error;
+        def->nfss++;
+    }
+
+    if (src->nnets && VIR_ALLOC_N(def->nets, src->nnets) < 0)
+        goto error;
+    for (i = 0; i < src->nnets; i++) {
+        if (!(def->nets[i] = virDomainNetDefCopyInactive(src->nets[i], caps)))
+            goto error;
+        def->nnets++;
+    }
+
+    if (src->ninputs && VIR_ALLOC_N(def->inputs, src->ninputs) < 0)
+        goto error;
+    for (i = 0; i < src->ninputs; i++) {
+        if (!(def->inputs[i] = virDomainInputDefCopyInactive(src->inputs[i])))
+            goto error;
+        def->ninputs++;
+    }
+
+    if (src->nsounds && VIR_ALLOC_N(def->sounds, src->nsounds) < 0)
+        goto error;
+    for (i = 0; i < src->nsounds; i++) {
+        if (!(def->sounds[i] = virDomainSoundDefCopyInactive(src->sounds[i])))
+            goto error;
+        def->nsounds++;
+    }
+
+    if (src->nvideos && VIR_ALLOC_N(def->videos, src->nvideos) < 0)
+        goto error;
+    for (i = 0; i < src->nvideos; i++) {
+        if (!(def->videos[i] = virDomainVideoDefCopyInactive(src->videos[i])))
+            goto error;
+        def->nvideos++;
+    }
+
+    /* The hostdev of an <interface type='hostdev'> is embedded in the
+     * interface and has been copied along with it already */
+    if (src->nhostdevs && VIR_ALLOC_N(def->hostdevs, src->nhostdevs) < 0)
+        goto error;
+    for (i = 0; i < src->nhostdevs; i++) {
+        virDomainHostdevDefPtr hostdev = src->hostdevs[i];
+
+        if (hostdev->parent.type == VIR_DOMAIN_DEVICE_NET) {
+            size_t j;
+
+            for (j = 0; j < src->nnets; j++) {
+                if (src->nets[j] == hostdev->parent.data.net)
+                    break;
+            }
+
+            if (j == src->nnets ||
+                def->nets[j]->type != VIR_DOMAIN_NET_TYPE_HOSTDEV) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("cannot find interface of a hostdev"));
+                goto error;
+            }
+            def->hostdevs[i] = &def->nets[j]->data.hostdev.def;
+        } else if (!(def->hostdevs[i] =
+                     virDomainHostdevDefCopyInactive(hostdev, xmlopt))) {
+            goto error;
+        }
+        def->nhostdevs++;
+    }
+
+    if (src->nredirdevs && VIR_ALLOC_N(def->redirdevs, src->nredirdevs) < 0)
+        goto error;
+    for (i = 0; i < src->nredirdevs; i++) {
+        if (!(def->redirdevs[i] =
+              virDomainRedirdevDefCopyInactive(src->redirdevs[i], xmlopt)))
+            goto error;
+        def->nredirdevs++;
+    }
+
+    if (src->nsmartcards &&
+        VIR_ALLOC_N(def->smartcards, src->nsmartcards) < 0)
+        goto error;
+    for (i = 0; i < src->nsmartcards; i++) {
+        if (!(def->smartcards[i] =
+              virDomainSmartcardDefCopyInactive(src->smartcards[i], xmlopt)))
+            goto error;
+        def->nsmartcards++;
+    }
+
+    if (src->nserials && VIR_ALLOC_N(def->serials, src->nserials) < 0)
+        goto error;
+    for (i = 0; i < src->nserials; i++) {
+        if (!(def->serials[i] = virDomainChrDefCopyInactive(src->serials[i],
+                                                            xmlopt)))
+            goto error;
+        def->nserials++;
+    }
+
+    if (src->nparallels && VIR_ALLOC_N(def->parallels, src->nparallels) < 0)
+        goto error;
+    for (i = 0; i < src->nparallels; i++) {
+        if (!(def->parallels[i] =
+              virDomainChrDefCopyInactive(src->parallels[i], xmlopt)))
+            goto error;
+        def->nparallels++;
+    }
+
+    if (src->nchannels && VIR_ALLOC_N(def->channels, src->nchannels) < 0)
+        goto error;
+    for (i = 0; i < src->nchannels; i++) {
+        if (!(def->channels[i] =
+              virDomainChrDefCopyInactive(src->channels[i], xmlopt)))
+            goto error;
+        def->nchannels++;
+    }
+
+    if (src->nconsoles && VIR_ALLOC_N(def->consoles, src->nconsoles) < 0)
+        goto error;
+    for (i = 0; i < src->nconsoles; i++) {
+        virDomainChrDefPtr console = src->consoles[i];
+        bool serial = false;
+
+        /* A serial console of a hvm guest is formatted as a copy of
+         * the serial device, see virDomainDefFormatInternal */
+        if (src->os.type == VIR_DOMAIN_OSTYPE_HVM &&
+            (console->targetType == VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_SERIAL ||
+             console->targetType == VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_NONE) &&
+            i < src->nserials) {
+            console = src->serials[i];
+            serial = true;
+        }
+
+        if (!(def->consoles[i] = virDomainChrDefCopyInactive(console, xmlopt)))
+            goto error;
+        def->nconsoles++;
+
+        if (serial) {
+            def->consoles[i]->deviceType = VIR_DOMAIN_CHR_DEVICE_TYPE_CONSOLE;
+            def->consoles[i]->targetType = VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_SERIAL;
+        }
+    }
+
+    if (src->nleases && VIR_ALLOC_N(def->leases, src->nleases) < 0)
+        goto error;
+    for (i = 0; i < src->nleases; i++) {
+        if (!(def->leases[i] = virDomainLeaseDefCopy(src->leases[i])))
+            goto error;
+        def->nleases++;
+    }
+
+    if (src->nhubs && VIR_ALLOC_N(def->hubs, src->nhubs) < 0)
+        goto error;
+    for (i = 0; i < src->nhubs; i++) {
+        if (!(def->hubs[i] = virDomainHubDefCopyInactive(src->hubs[i])))
+            goto error;
+        def->nhubs++;
+    }
+
+    if (virDomainDefSeclabelsCopyInactive(def, src, caps) < 0)
+        goto error;
+
+    if (src->nrngs && VIR_ALLOC_N(def->rngs, src->nrngs) < 0)
+        goto error;
+    for (i = 0; i < src->nrngs; i++) {
+        if (!(def->rngs[i] = virDomainRNGDefCopyInactive(src->rngs[i], xmlopt)))
+            goto error;
+        def->nrngs++;
+    }
+
+    if (src->nshmems && VIR_ALLOC_N(def->shmems, src->nshmems) < 0)
+        goto error;
+    for (i = 0; i < src->nshmems; i++) {
+        if (!(def->shmems[i] = virDomainShmemDefCopyInactive(src->shmems[i])))
+            goto error;
+        def->nshmems++;
+    }
+
+    if (src->nmems && VIR_ALLOC_N(def->mems, src->nmems) < 0)
+        goto error;
+    for (i = 0; i < src->nmems; i++) {
+        if (!(def->mems[i] = virDomainMemoryDefCopyInactive(src->mems[i])))
+            goto error;
+        def->nmems++;
+    }
+
+    if (src->npanics && VIR_ALLOC_N(def->panics, src->npanics) < 0)
+        goto error;
+    for (i = 0; i < src->npanics; i++) {
+        if (!(def->panics[i] = virDomainPanicDefCopyInactive(src->panics[i])))
+            goto error;
+        def->npanics++;
+    }
+
+    if (src->watchdog &&
+        !(def->watchdog = virDomainWatchdogDefCopyInactive(src->watchdog)))
+        goto error;
+
+    if (src->memballoon &&
+        !(def->memballoon = virDomainMemballoonDefCopyInactive(src->memballoon)))
+        goto error;
+
+    if (src->nvram &&
+        !(def->nvram = virDomainNVRAMDefCopyInactive(src->nvram)))
+        goto error;
+
+    if (src->tpm &&
+        !(def->tpm = virDomainTPMDefCopyInactive(src->tpm)))
+        goto error;
+
+    if (src->cpu && !(def->cpu = virCPUDefCopy(src->cpu)))
+        goto error;
+
+    if (src->sysinfo && !(def->sysinfo = virSysinfoDefCopy(src->sysinfo)))
+        goto error;
+
+    if (src->redirfilter) {
+        if (VIR_ALLOC(def->redirfilter) < 0)
+            goto error;
+        if (src->redirfilter->nusbdevs &&
+            VIR_ALLOC_N(def->redirfilter->usbdevs,
+                        src->redirfilter->nusbdevs) < 0)
+            goto error;
+        for (i = 0; i < src->redirfilter->nusbdevs; i++) {
+            if (VIR_ALLOC(def->redirfilter->usbdevs[i]) < 0)
+                goto error;
+            def->redirfilter->nusbdevs++;
+            *def->redirfilter->usbdevs[i] = *src->redirfilter->usbdevs[i];
+        }
+    }
+
+    if (src->iommu) {
+        if (VIR_ALLOC(def->iommu) < 0)
+            goto error;
+        *def->iommu = *src->iommu;
+    }
+
+    if (src->keywrap) {
+        if (VIR_ALLOC(def->keywrap) < 0)
+            goto error;
+        *def->keywrap = *src->keywrap;
+    }
+
+    if (src->metadata &&
+        !(def->metadata = xmlCopyNode(src->metadata, 1))) {
+        virReportOOMError();
+        goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainDefFree(def);
+    return NULL;
+}
+
+
+/* Copy src into a new definition; with the quality of the copy
+ * depending on the migratable flag (false for transitions between
+ * persistent and active, true for transitions across save files or
+ * snapshots).  */
+virDomainDefPtr
+virDomainDefCopy(virDomainDefPtr src,
+                 virCapsPtr caps,
+                 virDomainXMLOptionPtr xmlopt,
+                 void *parseOpaque,
+                 bool migratable)
+{
+    char *xml;
+    virDomainDefPtr ret;
+    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
+    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+    size_t i;
+
+    /* Copy the structures directly, unless the XML is formatted in a
+     * way the copy doesn't know about: for migration, with driver
+     * specific namespace data or with the actual connection of an
+     * interface replacing its configuration.  */
+    if (!migratable && !src->namespaceData) {
+        for (i = 0; i < src->nnets; i++) {
+            if (src->nets[i]->type == VIR_DOMAIN_NET_TYPE_NETWORK &&
+                src->nets[i]->data.network.actual)
+                break;
+        }
+
+        if (i == src->nnets)
+            return virDomainDefCopyInactive(src, caps, xmlopt);
+    }
 
     if (migratable)
         format_flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_MIGRATABLE;
 
-    /* Easiest to clone via a round-trip through XML.  */
+    /* Otherwise it's easiest to clone via a round-trip through XML.  */
     if (!(xml = virDomainDefFormat(src, caps, format_flags)))
         return NULL;
 
@@ -56,6 +56,7 @@
 # include "virperf.h"
 # include "virtypedparam.h"
 # include "virsavecookie.h"
+# include "virfilejournal.h"
 
 /* forward declarations of all device types, required by
  * virDomainDeviceDef
@@ -617,7 +618,11 @@ typedef enum {
 } virDomainMemoryAllocation;
 
 
-/* Stores the virtual disk configuration */
+/* Stores the virtual disk configuration
+ *
+ * NB: virDomainDiskDefCopyInactive copies the fields one by one and
+ * needs an update when adding to this struct
+ */
 struct _virDomainDiskDef {
     virStorageSourcePtr src; /* non-NULL.  XXX Allow NULL for empty cdrom? */
 
@@ -2267,7 +2272,9 @@ struct _virDomainVirtioOptions {
  * Guest VM main configuration
  *
  * NB: if adding to this struct, virDomainDefCheckABIStability
- * may well need an update
+ * may well need an update. virDomainDefCopyInactive starts off
+ * with a shallow copy of it, so any pointer added here has to be
+ * cleared and copied there as well.
  */
 typedef struct _virDomainDef virDomainDef;
 typedef virDomainDef *virDomainDefPtr;
@@ -2477,6 +2484,8 @@ struct _virDomainObj {
 
     unsigned long long original_memlock; /* Original RLIMIT_MEMLOCK, zero if no
                                           * restore will be required later */
+
+    virFileJournalPtr statusJournal; /* Changes of the status XML */
 };
 
 typedef bool (*virDomainObjListACLFilter)(virConnectPtr conn,
@@ -2611,6 +2620,10 @@ virDomainXMLNamespacePtr
 virDomainXMLOptionGetNamespace(virDomainXMLOptionPtr xmlopt)
     ATTRIBUTE_NONNULL(1);
 
+void virDomainXMLOptionSetStatusJournal(virDomainXMLOptionPtr xmlopt,
+                                        bool enable)
+    ATTRIBUTE_NONNULL(1);
+
 int virDomainDefPostParse(virDomainDefPtr def,
                           virCapsPtr caps,
                           unsigned int parseFlags,
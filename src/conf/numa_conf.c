@@ -880,6 +880,52 @@ virDomainNumaNew(void)
 }
 
 
+virDomainNumaPtr
+virDomainNumaCopy(const virDomainNuma *src)
+{
+    virDomainNumaPtr ret = NULL;
+    size_t i;
+
+    if (!(ret = virDomainNumaNew()))
+        return NULL;
+
+    ret->memory = src->memory;
+    ret->memory.nodeset = NULL;
+
+    if (src->memory.nodeset &&
+        !(ret->memory.nodeset = virBitmapNewCopy(src->memory.nodeset)))
+        goto error;
+
+    if (src->nmem_nodes) {
+        if (VIR_ALLOC_N(ret->mem_nodes, src->nmem_nodes) < 0)
+            goto error;
+        ret->nmem_nodes = src->nmem_nodes;
+    }
+
+    for (i = 0; i < src->nmem_nodes; i++) {
+        ret->mem_nodes[i].mem = src->mem_nodes[i].mem;
+        ret->mem_nodes[i].mode = src->mem_nodes[i].mode;
+        ret->mem_nodes[i].memAccess = src->mem_nodes[i].memAccess;
+
+        if (src->mem_nodes[i].cpumask &&
+            !(ret->mem_nodes[i].cpumask =
+              virBitmapNewCopy(src->mem_nodes[i].cpumask)))
+            goto error;
+
+        if (src->mem_nodes[i].nodeset &&
+            !(ret->mem_nodes[i].nodeset =
+              virBitmapNewCopy(src->mem_nodes[i].nodeset)))
+            goto error;
+    }
+
+    return ret;
+
+ error:
+    virDomainNumaFree(ret);
+    return NULL;
+}
+
+
 bool
 virDomainNumaCheckABIStability(virDomainNumaPtr src,
                                virDomainNumaPtr tgt)
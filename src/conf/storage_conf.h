@@ -58,6 +58,19 @@ struct _virStorageVolSource {
                    * backend for partition type creation */
 };
 
+/*
+ * Identity of the file a volume was probed from, which lets backends
+ * refreshing a pool incrementally skip volumes that did not change
+ */
+typedef struct _virStorageVolProbeStamp virStorageVolProbeStamp;
+typedef virStorageVolProbeStamp *virStorageVolProbeStampPtr;
+struct _virStorageVolProbeStamp {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+};
 
 typedef struct _virStorageVolDef virStorageVolDef;
 typedef virStorageVolDef *virStorageVolDefPtr;
@@ -69,6 +82,8 @@ struct _virStorageVolDef {
     bool building;
     unsigned int in_use;
 
+    virStorageVolProbeStamp probed;
+
     virStorageVolSource source;
     virStorageSource target;
 };
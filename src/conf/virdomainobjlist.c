@@ -30,8 +30,11 @@
 #include "snapshot_conf.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhashcode.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthreadpool.h"
+#include "virxml.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -51,6 +54,16 @@ struct _virDomainObjList {
     /* name -> virDomainObj mapping for O(1),
      * lockless lookup-by-name */
     virHashTable *objsName;
+
+    /* id -> uuid string mapping for O(1) lookup-by-id of running
+     * domains, kept up to date by virDomainObjListSetID.  It has a lock
+     * of its own which is never held while acquiring other locks, since
+     * drivers change domain IDs with the domain locked. */
+    virMutex idLock;
+    virHashTable *objsID;
+    /* set if an entry couldn't be added to objsID, lookups have to fall
+     * back to checking every domain then */
+    bool objsIDIncomplete;
 };
 
 
@@ -67,6 +80,35 @@ static int virDomainObjListOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virDomainObjList)
 
+
+/* Domain IDs are never negative, but 0 is a valid one (e.g. Xen's Domain-0)
+ * and the hash table doesn't take NULL keys, hence the shift */
+#define VIR_DOMAIN_OBJ_LIST_ID_KEY(id) \
+    ((void *)((uintptr_t)(unsigned int)(id) + 1))
+
+
+static uint32_t
+virDomainObjListIDCode(const void *name, uint32_t seed)
+{
+    uintptr_t key = (uintptr_t)name;
+    return virHashCodeGen(&key, sizeof(key), seed);
+}
+
+
+static bool
+virDomainObjListIDEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+
+static void *
+virDomainObjListIDCopy(const void *name)
+{
+    return (void *)name;
+}
+
+
 virDomainObjListPtr virDomainObjListNew(void)
 {
     virDomainObjListPtr doms;
@@ -77,8 +119,20 @@ virDomainObjListPtr virDomainObjListNew(void)
     if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
+    if (virMutexInit(&doms->idLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize mutex"));
+        virObjectUnref(doms);
+        return NULL;
+    }
+
     if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+        !(doms->objsName = virHashCreate(50, virObjectFreeHashData)) ||
+        !(doms->objsID = virHashCreateFull(50, virHashValueFree,
+                                           virDomainObjListIDCode,
+                                           virDomainObjListIDEqual,
+                                           virDomainObjListIDCopy,
+                                           NULL))) {
         virObjectUnref(doms);
         return NULL;
     }
@@ -93,6 +147,8 @@ static void virDomainObjListDispose(void *obj)
 
     virHashFree(doms->objs);
     virHashFree(doms->objsName);
+    virHashFree(doms->objsID);
+    virMutexDestroy(&doms->idLock);
 }
 
 
@@ -112,14 +168,102 @@ static int virDomainObjListSearchID(const void *payload,
     return want;
 }
 
+/*
+ * Returns the domain running with @id according to the ID index.  The
+ * caller must hold a lock on @doms.
+ */
+static virDomainObjPtr
+virDomainObjListLookupID(virDomainObjListPtr doms,
+                         int id)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN] = "";
+    const char *value;
+    virDomainObjPtr obj;
+    bool incomplete;
+
+    virMutexLock(&doms->idLock);
+    if ((value = virHashLookup(doms->objsID, VIR_DOMAIN_OBJ_LIST_ID_KEY(id))))
+        ignore_value(virStrcpyStatic(uuidstr, value));
+    incomplete = doms->objsIDIncomplete;
+    virMutexUnlock(&doms->idLock);
+
+    /* The domain may have been stopped since the index was read */
+    if (*uuidstr &&
+        (obj = virHashLookup(doms->objs, uuidstr)) &&
+        virDomainObjListSearchID(obj, NULL, &id))
+        return obj;
+
+    if (incomplete)
+        return virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
+
+    return NULL;
+}
+
+
+/*
+ * Updates the ID index for @obj to start running with @id, or to stop
+ * running if @id is -1.  The caller must hold a lock on @obj, @doms needn't
+ * be locked.
+ */
+static void
+virDomainObjListIndexID(virDomainObjListPtr doms,
+                        virDomainObjPtr obj,
+                        int id)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int oldid = obj->def->id;
+    const char *value;
+    char *newvalue = NULL;
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+
+    virMutexLock(&doms->idLock);
+    if (oldid >= 0 && oldid != id &&
+        (value = virHashLookup(doms->objsID,
+                               VIR_DOMAIN_OBJ_LIST_ID_KEY(oldid))) &&
+        STREQ(value, uuidstr))
+        virHashRemoveEntry(doms->objsID, VIR_DOMAIN_OBJ_LIST_ID_KEY(oldid));
+
+    if (id >= 0 &&
+        (VIR_STRDUP_QUIET(newvalue, uuidstr) < 0 ||
+         virHashUpdateEntry(doms->objsID, VIR_DOMAIN_OBJ_LIST_ID_KEY(id),
+                            newvalue) < 0)) {
+        VIR_FREE(newvalue);
+        doms->objsIDIncomplete = true;
+    }
+    virMutexUnlock(&doms->idLock);
+}
+
+
+/**
+ * virDomainObjListSetID:
+ * @doms: list the domain belongs to
+ * @obj: locked domain object
+ * @id: the new ID of the domain, -1 if it isn't running anymore
+ *
+ * Sets the ID of @obj and updates the index virDomainObjListFindByID uses.
+ * Drivers must change the ID of domains in @doms only through this.
+ */
+void
+virDomainObjListSetID(virDomainObjListPtr doms,
+                      virDomainObjPtr obj,
+                      int id)
+{
+    virDomainObjListIndexID(doms, obj, id);
+    obj->def->id = id;
+}
+
+
 static virDomainObjPtr
 virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
                                  int id,
                                  bool ref)
 {
     virDomainObjPtr obj;
+
     virObjectRWLockRead(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
+    obj = virDomainObjListLookupID(doms, id);
+
     if (ref) {
         virObjectRef(obj);
         virObjectRWUnlock(doms);
@@ -309,6 +453,11 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
          * reference counter */
         virObjectRef(vm);
     }
+
+    /* Drivers may add domains which are running already */
+    if (vm->def == def && virDomainObjIsActive(vm))
+        virDomainObjListIndexID(doms, vm, def->id);
+
  cleanup:
     return vm;
 
@@ -351,6 +500,8 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 
     virObjectRWLockWrite(doms);
     virObjectLock(dom);
+    if (virDomainObjIsActive(dom))
+        virDomainObjListIndexID(doms, dom, -1);
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
     virObjectUnlock(dom);
@@ -438,86 +589,138 @@ void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
 
     virUUIDFormat(dom->def->uuid, uuidstr);
 
+    if (virDomainObjIsActive(dom))
+        virDomainObjListIndexID(doms, dom, -1);
     virHashRemoveEntry(doms->objs, uuidstr);
     virHashRemoveEntry(doms->objsName, dom->def->name);
     virObjectUnlock(dom);
 }
 
 
+/* Maximum number of threads parsing domain configs at once */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS 8
+
+typedef struct _virDomainObjListLoadData virDomainObjListLoadData;
+typedef virDomainObjListLoadData *virDomainObjListLoadDataPtr;
+struct _virDomainObjListLoadData {
+    virMutex lock;
+    virCond cond;
+
+    const char *configDir;
+    const char *autostartDir;
+    bool liveStatus;
+    virCapsPtr caps;
+    virDomainXMLOptionPtr xmlopt;
+
+    size_t pending; /* number of files not parsed yet */
+};
+
+typedef struct _virDomainObjListLoadEntry virDomainObjListLoadEntry;
+typedef virDomainObjListLoadEntry *virDomainObjListLoadEntryPtr;
+struct _virDomainObjListLoadEntry {
+    char *name;
+
+    /* filled in by virDomainObjListParseConfig */
+    virDomainDefPtr def;
+    int autostart;
+
+    /* filled in by virDomainObjListParseStatus */
+    virDomainObjPtr obj;
+};
+
+
+static int
+virDomainObjListParseConfig(virDomainObjListLoadDataPtr data,
+                            virDomainObjListLoadEntryPtr entry)
+{
+    char *configFile = NULL, *autostartLink = NULL;
+    int ret = -1;
+
+    if ((configFile = virDomainConfigFile(data->configDir, entry->name)) == NULL)
+        goto cleanup;
+    if (!(entry->def = virDomainDefParseFile(configFile, data->caps,
+                                             data->xmlopt, NULL,
+                                             VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                             VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+                                             VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
+        goto cleanup;
+
+    if ((autostartLink = virDomainConfigFile(data->autostartDir,
+                                             entry->name)) == NULL)
+        goto cleanup;
+
+    if ((entry->autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(configFile);
+    VIR_FREE(autostartLink);
+    return ret;
+}
+
+
 static virDomainObjPtr
 virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virCapsPtr caps,
+                           virDomainObjListLoadEntryPtr entry,
                            virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
     virDomainObjPtr dom;
-    int autostart;
     virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, caps, xmlopt, NULL,
-                                      VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
-        goto error;
-
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
-
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
+    if (!entry->def)
+        return NULL;
 
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+    if (!(dom = virDomainObjListAddLocked(doms, entry->def, xmlopt, 0, &oldDef)))
+        return NULL;
+    entry->def = NULL;
 
-    dom->autostart = autostart;
+    dom->autostart = entry->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
+}
 
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
+
+static int
+virDomainObjListParseStatus(virDomainObjListLoadDataPtr data,
+                            virDomainObjListLoadEntryPtr entry)
+{
+    char *statusFile = NULL;
+
+    if ((statusFile = virDomainConfigFile(data->configDir, entry->name)) == NULL)
+        return -1;
+
+    entry->obj = virDomainObjParseFile(statusFile, data->caps, data->xmlopt,
+                                       VIR_DOMAIN_DEF_PARSE_STATUS |
+                                       VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                       VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                       VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+                                       VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE);
+
+    VIR_FREE(statusFile);
+    return entry->obj ? 0 : -1;
 }
 
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadEntryPtr entry,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = entry->obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, caps, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
-        goto error;
+    if (!obj)
+        return NULL;
+    entry->obj = NULL;
 
     virUUIDFormat(obj->def->uuid, uuidstr);
 
@@ -540,19 +743,135 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
      * reference counter */
     virObjectRef(obj);
 
+    if (virDomainObjIsActive(obj))
+        virDomainObjListIndexID(doms, obj, obj->def->id);
+
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
 
  error:
     virObjectUnref(obj);
-    VIR_FREE(statusFile);
     return NULL;
 }
 
 
+static void
+virDomainObjListParseEntry(virDomainObjListLoadDataPtr data,
+                           virDomainObjListLoadEntryPtr entry)
+{
+    int rc;
+
+    /* NB: ignoring errors, so one malformed config doesn't
+       kill the whole process */
+    VIR_INFO("Loading config file '%s.xml'", entry->name);
+    if (data->liveStatus)
+        rc = virDomainObjListParseStatus(data, entry);
+    else
+        rc = virDomainObjListParseConfig(data, entry);
+
+    if (rc < 0)
+        virResetLastError();
+}
+
+
+static void
+virDomainObjListParseWorker(void *jobdata,
+                            void *opaque)
+{
+    virDomainObjListLoadEntryPtr entry = jobdata;
+    virDomainObjListLoadDataPtr data = opaque;
+
+    virDomainObjListParseEntry(data, entry);
+
+    virMutexLock(&data->lock);
+    data->pending--;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+/*
+ * Parses the files of all @entries, using a pool of worker threads if
+ * there are several of them. Failures to parse a file are ignored.
+ */
+static int
+virDomainObjListParseEntries(virDomainObjListLoadDataPtr data,
+                             virDomainObjListLoadEntryPtr entries,
+                             size_t nentries)
+{
+    virThreadPoolPtr workers = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (nentries <= 1) {
+        for (i = 0; i < nentries; i++)
+            virDomainObjListParseEntry(data, &entries[i]);
+        return 0;
+    }
+
+    /* libxml2 has to be initialized before it's used by several
+     * threads at once */
+    xmlInitParser();
+
+    if (virMutexInit(&data->lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        return -1;
+    }
+
+    if (virCondInit(&data->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+
+    if (!(workers = virThreadPoolNew(0, MIN(nentries,
+                                            VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS),
+                                     0, virDomainObjListParseWorker, data)))
+        goto cleanup;
+
+    virMutexLock(&data->lock);
+
+    for (i = 0; i < nentries; i++) {
+        if (virThreadPoolSendJob(workers, 0, &entries[i]) < 0)
+            break;
+
+        data->pending++;
+    }
+
+    if (i == nentries)
+        ret = 0;
+
+    /* Even on failure we have to wait for the files which were
+     * already submitted as they reference @data and @entries */
+    while (data->pending > 0)
+        ignore_value(virCondWait(&data->cond, &data->lock));
+
+    virMutexUnlock(&data->lock);
+
+ cleanup:
+    virThreadPoolFree(workers);
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+    return ret;
+}
+
+
+/**
+ * virDomainObjListLoadAllConfigs:
+ *
+ * Loads the domains from all XML files in @configDir, either their
+ * persistent configs or, if @liveStatus is set, the status of running
+ * domains. The files are parsed in parallel without holding the lock
+ * of @doms, the domains are then added to @doms and @notify is called
+ * for them one by one in the order of the files in @configDir.
+ *
+ * Files which fail to load are skipped.
+ *
+ * Returns 0 on success, -1 if @configDir could not be read.
+ */
 int
 virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                const char *configDir,
@@ -565,6 +884,10 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
 {
     DIR *dir;
     struct dirent *entry;
+    virDomainObjListLoadData data;
+    virDomainObjListLoadEntryPtr entries = NULL;
+    size_t nentries = 0;
+    size_t i;
     int ret = -1;
     int rc;
 
@@ -573,34 +896,45 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectRWLockWrite(doms);
-
-    while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObjPtr dom;
+    while ((rc = virDirRead(dir, &entry, configDir)) > 0) {
+        char *name = NULL;
 
         if (!virFileStripSuffix(entry->d_name, ".xml"))
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
+        if (VIR_STRDUP(name, entry->d_name) < 0 ||
+            VIR_EXPAND_N(entries, nentries, 1) < 0) {
+            VIR_FREE(name);
+            goto cleanup;
+        }
+
+        entries[nentries - 1].name = name;
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    memset(&data, 0, sizeof(data));
+    data.configDir = configDir;
+    data.autostartDir = autostartDir;
+    data.liveStatus = !!liveStatus;
+    data.caps = caps;
+    data.xmlopt = xmlopt;
+
+    if (virDomainObjListParseEntries(&data, entries, nentries) < 0)
+        goto cleanup;
+
+    virObjectRWLockWrite(doms);
+
+    for (i = 0; i < nentries; i++) {
+        virDomainObjPtr dom;
+
         if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             caps,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadStatus(doms, &entries[i],
+                                             notify, opaque);
         else
-            dom = virDomainObjListLoadConfig(doms,
-                                             caps,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadConfig(doms, &entries[i],
+                                             xmlopt, notify, opaque);
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
@@ -608,8 +942,17 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
         }
     }
 
-    VIR_DIR_CLOSE(dir);
     virObjectRWUnlock(doms);
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nentries; i++) {
+        VIR_FREE(entries[i].name);
+        virDomainDefFree(entries[i].def);
+        virObjectUnref(entries[i].obj);
+    }
+    VIR_FREE(entries);
+    VIR_DIR_CLOSE(dir);
     return ret;
 }
 
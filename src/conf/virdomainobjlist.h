@@ -64,6 +64,10 @@ int virDomainObjListRename(virDomainObjListPtr doms,
                            virDomainObjListRenameCallback callback,
                            void *opaque);
 
+void virDomainObjListSetID(virDomainObjListPtr doms,
+                           virDomainObjPtr obj,
+                           int id);
+
 void virDomainObjListRemove(virDomainObjListPtr doms,
                             virDomainObjPtr dom);
 void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
@@ -37,34 +37,245 @@
 VIR_LOG_INIT("conf.virstorageobj");
 
 
-void
-virStoragePoolObjFree(virStoragePoolObjPtr obj)
+struct _virStoragePoolObjList {
+    virObjectRWLockable parent;
+
+    /* uuid string -> virStoragePoolObj mapping
+     * for O(1) lookup-by-uuid */
+    virHashTablePtr objs;
+
+    /* name -> virStoragePoolObj mapping
+     * for O(1) lookup-by-name */
+    virHashTablePtr objsName;
+};
+
+static virClassPtr virStoragePoolObjClass;
+static virClassPtr virStoragePoolObjListClass;
+
+static void virStoragePoolObjDispose(void *opaque);
+static void virStoragePoolObjListDispose(void *opaque);
+
+
+static int
+virStoragePoolObjOnceInit(void)
+{
+    if (!(virStoragePoolObjClass = virClassNew(virClassForObjectLockable(),
+                                               "virStoragePoolObj",
+                                               sizeof(virStoragePoolObj),
+                                               virStoragePoolObjDispose)))
+        return -1;
+
+    if (!(virStoragePoolObjListClass = virClassNew(virClassForObjectRWLockable(),
+                                                   "virStoragePoolObjList",
+                                                   sizeof(virStoragePoolObjList),
+                                                   virStoragePoolObjListDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStoragePoolObj)
+
+
+static virStoragePoolObjPtr
+virStoragePoolObjNew(void)
+{
+    virStoragePoolObjPtr obj;
+
+    if (virStoragePoolObjInitialize() < 0)
+        return NULL;
+
+    if (!(obj = virObjectLockableNew(virStoragePoolObjClass)))
+        return NULL;
+
+    if (!(obj->volumesByName = virHashCreate(10, NULL)) ||
+        !(obj->volumesByKey = virHashCreate(10, NULL)) ||
+        !(obj->volumesByPath = virHashCreate(10, NULL))) {
+        virObjectUnref(obj);
+        return NULL;
+    }
+
+    virObjectLock(obj);
+    obj->active = false;
+    return obj;
+}
+
+
+static void
+virStoragePoolObjDispose(void *opaque)
 {
-    if (!obj)
-        return;
+    virStoragePoolObjPtr obj = opaque;
 
     virStoragePoolObjClearVols(obj);
+    virHashFree(obj->volumesByName);
+    virHashFree(obj->volumesByKey);
+    virHashFree(obj->volumesByPath);
 
     virStoragePoolDefFree(obj->def);
     virStoragePoolDefFree(obj->newDef);
 
     VIR_FREE(obj->configFile);
     VIR_FREE(obj->autostartLink);
+}
+
+
+virStoragePoolObjListPtr
+virStoragePoolObjListNew(void)
+{
+    virStoragePoolObjListPtr pools;
+
+    if (virStoragePoolObjInitialize() < 0)
+        return NULL;
 
-    virMutexDestroy(&obj->lock);
+    if (!(pools = virObjectRWLockableNew(virStoragePoolObjListClass)))
+        return NULL;
+
+    if (!(pools->objs = virHashCreate(20, virObjectFreeHashData)) ||
+        !(pools->objsName = virHashCreate(20, virObjectFreeHashData))) {
+        virObjectUnref(pools);
+        return NULL;
+    }
 
-    VIR_FREE(obj);
+    return pools;
 }
 
 
-void
-virStoragePoolObjListFree(virStoragePoolObjListPtr pools)
+static void
+virStoragePoolObjListDispose(void *opaque)
+{
+    virStoragePoolObjListPtr pools = opaque;
+
+    virHashFree(pools->objs);
+    virHashFree(pools->objsName);
+}
+
+
+struct _virStoragePoolObjListData {
+    virStoragePoolObjPtr *objs;
+    size_t nobjs;
+};
+
+
+static int
+virStoragePoolObjListCollectIterator(void *payload,
+                                     const void *name ATTRIBUTE_UNUSED,
+                                     void *opaque)
 {
+    struct _virStoragePoolObjListData *data = opaque;
+
+    data->objs[data->nobjs++] = virObjectRef(payload);
+    return 0;
+}
+
+
+/*
+ * virStoragePoolObjListCollect:
+ *
+ * Takes a snapshot of the pools in @pools, so that they can be
+ * enumerated without holding the lock of the list. The objects in
+ * @objs are referenced, but not locked.
+ */
+static int
+virStoragePoolObjListCollect(virStoragePoolObjListPtr pools,
+                             virStoragePoolObjPtr **objs,
+                             size_t *nobjs)
+{
+    struct _virStoragePoolObjListData data = { NULL, 0 };
+
+    virObjectRWLockRead(pools);
+    if (VIR_ALLOC_N(data.objs, virHashSize(pools->objs)) < 0) {
+        virObjectRWUnlock(pools);
+        return -1;
+    }
+
+    virHashForEach(pools->objs, virStoragePoolObjListCollectIterator, &data);
+    virObjectRWUnlock(pools);
+
+    *objs = data.objs;
+    *nobjs = data.nobjs;
+    return 0;
+}
+
+
+/**
+ * virStoragePoolObjListForEach:
+ * @pools: list of pool objects
+ * @iter: function to call on each pool
+ * @opaque: data passed to @iter
+ *
+ * Calls @iter on a snapshot of the pools in @pools, without holding
+ * the lock of the list. The pool object is passed to @iter unlocked,
+ * so @iter may even remove it from the list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virStoragePoolObjListForEach(virStoragePoolObjListPtr pools,
+                             virStoragePoolObjListIterator iter,
+                             void *opaque)
+{
+    virStoragePoolObjPtr *objs = NULL;
+    size_t nobjs = 0;
     size_t i;
-    for (i = 0; i < pools->count; i++)
-        virStoragePoolObjFree(pools->objs[i]);
-    VIR_FREE(pools->objs);
-    pools->count = 0;
+
+    if (virStoragePoolObjListCollect(pools, &objs, &nobjs) < 0)
+        return -1;
+
+    for (i = 0; i < nobjs; i++)
+        iter(objs[i], opaque);
+
+    virObjectListFreeCount(objs, nobjs);
+    return 0;
+}
+
+
+struct _virStoragePoolObjListSearchData {
+    virStoragePoolObjListSearcher searcher;
+    void *opaque;
+};
+
+
+static int
+virStoragePoolObjListSearchCb(const void *payload,
+                              const void *name ATTRIBUTE_UNUSED,
+                              const void *opaque)
+{
+    virStoragePoolObjPtr obj = (virStoragePoolObjPtr) payload;
+    const struct _virStoragePoolObjListSearchData *data = opaque;
+
+    virObjectLock(obj);
+    if (data->searcher(obj, data->opaque))
+        return 1;
+    virObjectUnlock(obj);
+    return 0;
+}
+
+
+/**
+ * virStoragePoolObjListSearch:
+ * @pools: list of pool objects
+ * @searcher: function to call on each pool
+ * @opaque: data passed to @searcher
+ *
+ * Calls @searcher on the pools in @pools in turn, with the pool locked,
+ * until it returns true.
+ *
+ * Returns the locked pool object @searcher matched or NULL.
+ */
+virStoragePoolObjPtr
+virStoragePoolObjListSearch(virStoragePoolObjListPtr pools,
+                            virStoragePoolObjListSearcher searcher,
+                            void *opaque)
+{
+    struct _virStoragePoolObjListSearchData data = { searcher, opaque };
+    virStoragePoolObjPtr obj;
+
+    virObjectRWLockRead(pools);
+    obj = virHashSearch(pools->objs, virStoragePoolObjListSearchCb,
+                        &data, NULL);
+    virObjectRWUnlock(pools);
+
+    return obj;
 }
 
 
@@ -72,21 +283,30 @@ void
 virStoragePoolObjRemove(virStoragePoolObjListPtr pools,
                         virStoragePoolObjPtr obj)
 {
-    size_t i;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+    virObjectRef(obj);
+    virObjectUnlock(obj);
+    virObjectRWLockWrite(pools);
+    virObjectLock(obj);
+    virHashRemoveEntry(pools->objs, uuidstr);
+    virHashRemoveEntry(pools->objsName, obj->def->name);
+    virObjectUnlock(obj);
+    virObjectRWUnlock(pools);
+    virObjectUnref(obj);
+}
 
-    virStoragePoolObjUnlock(obj);
 
-    for (i = 0; i < pools->count; i++) {
-        virStoragePoolObjLock(pools->objs[i]);
-        if (pools->objs[i] == obj) {
-            virStoragePoolObjUnlock(pools->objs[i]);
-            virStoragePoolObjFree(pools->objs[i]);
+static virStoragePoolObjPtr
+virStoragePoolObjFindByUUIDLocked(virStoragePoolObjListPtr pools,
+                                  const unsigned char *uuid)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-            VIR_DELETE_ELEMENT(pools->objs, i, pools->count);
-            break;
-        }
-        virStoragePoolObjUnlock(pools->objs[i]);
-    }
+    virUUIDFormat(uuid, uuidstr);
+
+    return virHashLookup(pools->objs, uuidstr);
 }
 
 
@@ -94,16 +314,22 @@ virStoragePoolObjPtr
 virStoragePoolObjFindByUUID(virStoragePoolObjListPtr pools,
                             const unsigned char *uuid)
 {
-    size_t i;
+    virStoragePoolObjPtr obj;
 
-    for (i = 0; i < pools->count; i++) {
-        virStoragePoolObjLock(pools->objs[i]);
-        if (!memcmp(pools->objs[i]->def->uuid, uuid, VIR_UUID_BUFLEN))
-            return pools->objs[i];
-        virStoragePoolObjUnlock(pools->objs[i]);
-    }
+    virObjectRWLockRead(pools);
+    if ((obj = virStoragePoolObjFindByUUIDLocked(pools, uuid)))
+        virObjectLock(obj);
+    virObjectRWUnlock(pools);
 
-    return NULL;
+    return obj;
+}
+
+
+static virStoragePoolObjPtr
+virStoragePoolObjFindByNameLocked(virStoragePoolObjListPtr pools,
+                                  const char *name)
+{
+    return virHashLookup(pools->objsName, name);
 }
 
 
@@ -111,16 +337,14 @@ virStoragePoolObjPtr
 virStoragePoolObjFindByName(virStoragePoolObjListPtr pools,
                             const char *name)
 {
-    size_t i;
+    virStoragePoolObjPtr obj;
 
-    for (i = 0; i < pools->count; i++) {
-        virStoragePoolObjLock(pools->objs[i]);
-        if (STREQ(pools->objs[i]->def->name, name))
-            return pools->objs[i];
-        virStoragePoolObjUnlock(pools->objs[i]);
-    }
+    virObjectRWLockRead(pools);
+    if ((obj = virStoragePoolObjFindByNameLocked(pools, name)))
+        virObjectLock(obj);
+    virObjectRWUnlock(pools);
 
-    return NULL;
+    return obj;
 }
 
 
@@ -150,34 +374,117 @@ virStoragePoolObjClearVols(virStoragePoolObjPtr obj)
 
     VIR_FREE(obj->volumes.objs);
     obj->volumes.count = 0;
+
+    virHashRemoveAll(obj->volumesByName);
+    virHashRemoveAll(obj->volumesByKey);
+    virHashRemoveAll(obj->volumesByPath);
 }
 
 
-virStorageVolDefPtr
-virStorageVolDefFindByKey(virStoragePoolObjPtr obj,
-                          const char *key)
+static void
+virStoragePoolObjUnindexVol(virStoragePoolObjPtr obj,
+                            virStorageVolDefPtr voldef)
+{
+    if (voldef->name &&
+        virHashLookup(obj->volumesByName, voldef->name) == voldef)
+        virHashRemoveEntry(obj->volumesByName, voldef->name);
+    if (voldef->key &&
+        virHashLookup(obj->volumesByKey, voldef->key) == voldef)
+        virHashRemoveEntry(obj->volumesByKey, voldef->key);
+    if (voldef->target.path &&
+        virHashLookup(obj->volumesByPath, voldef->target.path) == voldef)
+        virHashRemoveEntry(obj->volumesByPath, voldef->target.path);
+}
+
+
+static int
+virStoragePoolObjIndexVol(virHashTablePtr table,
+                          const char *name,
+                          virStorageVolDefPtr voldef)
+{
+    /* The first volume wins should there be duplicates, just like
+     * it did when looking the volumes up in the list */
+    if (!name || virHashLookup(table, name))
+        return 0;
+
+    return virHashAddEntry(table, name, voldef);
+}
+
+
+/**
+ * virStoragePoolObjAddVol:
+ * @obj: locked pool object
+ * @voldef: volume to add
+ *
+ * Adds @voldef to the volumes of @obj, which takes over its ownership
+ * on success. The name, key and target path of @voldef must be filled
+ * in before, as they are not allowed to change while the volume is
+ * in the pool.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virStoragePoolObjAddVol(virStoragePoolObjPtr obj,
+                        virStorageVolDefPtr voldef)
+{
+    if (virStoragePoolObjIndexVol(obj->volumesByName,
+                                  voldef->name, voldef) < 0 ||
+        virStoragePoolObjIndexVol(obj->volumesByKey,
+                                  voldef->key, voldef) < 0 ||
+        virStoragePoolObjIndexVol(obj->volumesByPath,
+                                  voldef->target.path, voldef) < 0 ||
+        VIR_APPEND_ELEMENT_COPY(obj->volumes.objs,
+                                obj->volumes.count, voldef) < 0) {
+        virStoragePoolObjUnindexVol(obj, voldef);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virStoragePoolObjRemoveVol:
+ * @obj: locked pool object
+ * @voldef: volume to remove
+ *
+ * Removes @voldef from the volumes of @obj and frees it. Nothing is done
+ * if @voldef isn't one of them (anymore), e.g. because the backend
+ * refreshed the whole pool while deleting it.
+ */
+void
+virStoragePoolObjRemoveVol(virStoragePoolObjPtr obj,
+                           virStorageVolDefPtr voldef)
 {
     size_t i;
 
-    for (i = 0; i < obj->volumes.count; i++)
-        if (STREQ(obj->volumes.objs[i]->key, key))
-            return obj->volumes.objs[i];
+    for (i = 0; i < obj->volumes.count; i++) {
+        if (obj->volumes.objs[i] == voldef) {
+            VIR_INFO("Deleting volume '%s' from storage pool '%s'",
+                     voldef->name, obj->def->name);
+            virStoragePoolObjUnindexVol(obj, voldef);
+            virStorageVolDefFree(voldef);
 
-    return NULL;
+            VIR_DELETE_ELEMENT(obj->volumes.objs, i, obj->volumes.count);
+            return;
+        }
+    }
 }
 
 
 virStorageVolDefPtr
-virStorageVolDefFindByPath(virStoragePoolObjPtr obj,
-                           const char *path)
+virStorageVolDefFindByKey(virStoragePoolObjPtr obj,
+                          const char *key)
 {
-    size_t i;
+    return virHashLookup(obj->volumesByKey, key);
+}
 
-    for (i = 0; i < obj->volumes.count; i++)
-        if (STREQ(obj->volumes.objs[i]->target.path, path))
-            return obj->volumes.objs[i];
 
-    return NULL;
+virStorageVolDefPtr
+virStorageVolDefFindByPath(virStoragePoolObjPtr obj,
+                           const char *path)
+{
+    return virHashLookup(obj->volumesByPath, path);
 }
 
 
@@ -185,13 +492,7 @@ virStorageVolDefPtr
 virStorageVolDefFindByName(virStoragePoolObjPtr obj,
                            const char *name)
 {
-    size_t i;
-
-    for (i = 0; i < obj->volumes.count; i++)
-        if (STREQ(obj->volumes.objs[i]->name, name))
-            return obj->volumes.objs[i];
-
-    return NULL;
+    return virHashLookup(obj->volumesByName, name);
 }
 
 
@@ -300,8 +601,24 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
                            virStoragePoolDefPtr def)
 {
     virStoragePoolObjPtr obj;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virObjectRWLockWrite(pools);
+
+    if ((obj = virStoragePoolObjFindByNameLocked(pools, def->name))) {
+        virObjectLock(obj);
+
+        /* The pool is indexed by its UUID */
+        if (memcmp(obj->def->uuid, def->uuid, VIR_UUID_BUFLEN) != 0) {
+            virUUIDFormat(obj->def->uuid, uuidstr);
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("pool '%s' is already defined with uuid %s"),
+                           obj->def->name, uuidstr);
+            virObjectUnlock(obj);
+            obj = NULL;
+            goto cleanup;
+        }
 
-    if ((obj = virStoragePoolObjFindByName(pools, def->name))) {
         if (!virStoragePoolObjIsActive(obj)) {
             virStoragePoolDefFree(obj->def);
             obj->def = def;
@@ -309,29 +626,37 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
             virStoragePoolDefFree(obj->newDef);
             obj->newDef = def;
         }
-        return obj;
+        goto cleanup;
     }
 
-    if (VIR_ALLOC(obj) < 0)
-        return NULL;
+    if (!(obj = virStoragePoolObjNew()))
+        goto cleanup;
 
-    if (virMutexInit(&obj->lock) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("cannot initialize mutex"));
-        VIR_FREE(obj);
-        return NULL;
-    }
-    virStoragePoolObjLock(obj);
-    obj->active = 0;
+    virUUIDFormat(def->uuid, uuidstr);
+    if (virHashAddEntry(pools->objs, uuidstr, obj) < 0)
+        goto error;
+    virObjectRef(obj);
 
-    if (VIR_APPEND_ELEMENT_COPY(pools->objs, pools->count, obj) < 0) {
-        virStoragePoolObjUnlock(obj);
-        virStoragePoolObjFree(obj);
-        return NULL;
+    if (virHashAddEntry(pools->objsName, def->name, obj) < 0) {
+        virHashRemoveEntry(pools->objs, uuidstr);
+        goto error;
     }
+    virObjectRef(obj);
+
     obj->def = def;
 
+    /* The list holds the references now */
+    virObjectUnref(obj);
+
+ cleanup:
+    virObjectRWUnlock(pools);
     return obj;
+
+ error:
+    virObjectUnlock(obj);
+    virObjectUnref(obj);
+    obj = NULL;
+    goto cleanup;
 }
 
 
@@ -564,11 +889,16 @@ virStoragePoolObjNumOfStoragePools(virStoragePoolObjListPtr pools,
                                    bool wantActive,
                                    virStoragePoolObjListACLFilter filter)
 {
+    virStoragePoolObjPtr *objs = NULL;
+    size_t nobjs = 0;
     int npools = 0;
     size_t i;
 
-    for (i = 0; i < pools->count; i++) {
-        virStoragePoolObjPtr obj = pools->objs[i];
+    if (virStoragePoolObjListCollect(pools, &objs, &nobjs) < 0)
+        return -1;
+
+    for (i = 0; i < nobjs; i++) {
+        virStoragePoolObjPtr obj = objs[i];
         virStoragePoolObjLock(obj);
         if (!filter || filter(conn, obj->def)) {
             if (wantActive == virStoragePoolObjIsActive(obj))
@@ -577,6 +907,7 @@ virStoragePoolObjNumOfStoragePools(virStoragePoolObjListPtr pools,
         virStoragePoolObjUnlock(obj);
     }
 
+    virObjectListFreeCount(objs, nobjs);
     return npools;
 }
 
@@ -589,11 +920,16 @@ virStoragePoolObjGetNames(virStoragePoolObjListPtr pools,
                           char **const names,
                           int maxnames)
 {
+    virStoragePoolObjPtr *objs = NULL;
+    size_t nobjs = 0;
     int nnames = 0;
     size_t i;
 
-    for (i = 0; i < pools->count && nnames < maxnames; i++) {
-        virStoragePoolObjPtr obj = pools->objs[i];
+    if (virStoragePoolObjListCollect(pools, &objs, &nobjs) < 0)
+        return -1;
+
+    for (i = 0; i < nobjs && nnames < maxnames; i++) {
+        virStoragePoolObjPtr obj = objs[i];
         virStoragePoolObjLock(obj);
         if (!filter || filter(conn, obj->def)) {
             if (wantActive == virStoragePoolObjIsActive(obj)) {
@@ -607,12 +943,14 @@ virStoragePoolObjGetNames(virStoragePoolObjListPtr pools,
         virStoragePoolObjUnlock(obj);
     }
 
+    virObjectListFreeCount(objs, nobjs);
     return nnames;
 
  failure:
     while (--nnames >= 0)
         VIR_FREE(names[nnames]);
 
+    virObjectListFreeCount(objs, nobjs);
     return -1;
 }
 
@@ -977,14 +1315,19 @@ virStoragePoolObjSourceFindDuplicate(virConnectPtr conn,
                                      virStoragePoolObjListPtr pools,
                                      virStoragePoolDefPtr def)
 {
+    virStoragePoolObjPtr *objs = NULL;
+    size_t nobjs = 0;
     size_t i;
     int ret = 1;
     virStoragePoolObjPtr obj = NULL;
     virStoragePoolObjPtr matchobj = NULL;
 
+    if (virStoragePoolObjListCollect(pools, &objs, &nobjs) < 0)
+        return -1;
+
     /* Check the pool list for duplicate underlying storage */
-    for (i = 0; i < pools->count; i++) {
-        obj = pools->objs[i];
+    for (i = 0; i < nobjs; i++) {
+        obj = objs[i];
 
         /* Don't match against ourself if re-defining existing pool ! */
         if (STREQ(obj->def->name, def->name))
@@ -1054,6 +1397,7 @@ virStoragePoolObjSourceFindDuplicate(virConnectPtr conn,
                        matchobj->def->name);
         ret = -1;
     }
+    virObjectListFreeCount(objs, nobjs);
     return ret;
 }
 
@@ -1061,14 +1405,14 @@ virStoragePoolObjSourceFindDuplicate(virConnectPtr conn,
 void
 virStoragePoolObjLock(virStoragePoolObjPtr obj)
 {
-    virMutexLock(&obj->lock);
+    virObjectLock(obj);
 }
 
 
 void
 virStoragePoolObjUnlock(virStoragePoolObjPtr obj)
 {
-    virMutexUnlock(&obj->lock);
+    virObjectUnlock(obj);
 }
 
 
@@ -1144,17 +1488,22 @@ virStoragePoolObjListExport(virConnectPtr conn,
                             virStoragePoolObjListFilter filter,
                             unsigned int flags)
 {
+    virStoragePoolObjPtr *objs = NULL;
+    size_t nobjs = 0;
     virStoragePoolPtr *tmp_pools = NULL;
     virStoragePoolPtr pool = NULL;
     int npools = 0;
     int ret = -1;
     size_t i;
 
-    if (pools && VIR_ALLOC_N(tmp_pools, poolobjs->count + 1) < 0)
+    if (virStoragePoolObjListCollect(poolobjs, &objs, &nobjs) < 0)
+        return -1;
+
+    if (pools && VIR_ALLOC_N(tmp_pools, nobjs + 1) < 0)
         goto cleanup;
 
-    for (i = 0; i < poolobjs->count; i++) {
-        virStoragePoolObjPtr obj = poolobjs->objs[i];
+    for (i = 0; i < nobjs; i++) {
+        virStoragePoolObjPtr obj = objs[i];
         virStoragePoolObjLock(obj);
         if ((!filter || filter(conn, obj->def)) &&
             virStoragePoolMatch(obj, flags)) {
@@ -1189,5 +1538,6 @@ virStoragePoolObjListExport(virConnectPtr conn,
     }
 
     VIR_FREE(tmp_pools);
+    virObjectListFreeCount(objs, nobjs);
     return ret;
 }
@@ -23,12 +23,14 @@
 # include "internal.h"
 
 # include "storage_conf.h"
+# include "virhash.h"
+# include "virobject.h"
 
 typedef struct _virStoragePoolObj virStoragePoolObj;
 typedef virStoragePoolObj *virStoragePoolObjPtr;
 
 struct _virStoragePoolObj {
-    virMutex lock;
+    virObjectLockable parent;
 
     char *configFile;
     char *autostartLink;
@@ -40,14 +42,16 @@ struct _virStoragePoolObj {
     virStoragePoolDefPtr newDef;
 
     virStorageVolDefList volumes;
+
+    /* name, key and target path -> virStorageVolDef mappings
+     * for O(1) lookup of volumes, see virStoragePoolObjAddVol */
+    virHashTablePtr volumesByName;
+    virHashTablePtr volumesByKey;
+    virHashTablePtr volumesByPath;
 };
 
 typedef struct _virStoragePoolObjList virStoragePoolObjList;
 typedef virStoragePoolObjList *virStoragePoolObjListPtr;
-struct _virStoragePoolObjList {
-    size_t count;
-    virStoragePoolObjPtr *objs;
-};
 
 typedef struct _virStorageDriverState virStorageDriverState;
 typedef virStorageDriverState *virStorageDriverStatePtr;
@@ -55,7 +59,8 @@ typedef virStorageDriverState *virStorageDriverStatePtr;
 struct _virStorageDriverState {
     virMutex lock;
 
-    virStoragePoolObjList pools;
+    /* Immutable pointer, self-locking APIs */
+    virStoragePoolObjListPtr pools;
 
     char *configDir;
     char *autostartDir;
@@ -76,6 +81,9 @@ virStoragePoolObjIsActive(virStoragePoolObjPtr obj)
     return obj->active;
 }
 
+virStoragePoolObjListPtr
+virStoragePoolObjListNew(void);
+
 int
 virStoragePoolObjLoadAllConfigs(virStoragePoolObjListPtr pools,
                                 const char *configDir,
@@ -108,6 +116,14 @@ virStorageVolDefFindByName(virStoragePoolObjPtr obj,
 void
 virStoragePoolObjClearVols(virStoragePoolObjPtr obj);
 
+int
+virStoragePoolObjAddVol(virStoragePoolObjPtr obj,
+                        virStorageVolDefPtr voldef);
+
+void
+virStoragePoolObjRemoveVol(virStoragePoolObjPtr obj,
+                           virStorageVolDefPtr voldef);
+
 typedef bool
 (*virStoragePoolVolumeACLFilter)(virConnectPtr conn,
                                  virStoragePoolDefPtr pool,
@@ -160,12 +176,6 @@ virStoragePoolObjGetNames(virStoragePoolObjListPtr pools,
                           char **const names,
                           int maxnames);
 
-void
-virStoragePoolObjFree(virStoragePoolObjPtr obj);
-
-void
-virStoragePoolObjListFree(virStoragePoolObjListPtr pools);
-
 void
 virStoragePoolObjRemove(virStoragePoolObjListPtr pools,
                         virStoragePoolObjPtr obj);
@@ -193,4 +203,22 @@ virStoragePoolObjListExport(virConnectPtr conn,
                             virStoragePoolObjListFilter filter,
                             unsigned int flags);
 
+typedef void
+(*virStoragePoolObjListIterator)(virStoragePoolObjPtr obj,
+                                 void *opaque);
+
+int
+virStoragePoolObjListForEach(virStoragePoolObjListPtr pools,
+                             virStoragePoolObjListIterator iter,
+                             void *opaque);
+
+typedef bool
+(*virStoragePoolObjListSearcher)(virStoragePoolObjPtr obj,
+                                 void *opaque);
+
+virStoragePoolObjPtr
+virStoragePoolObjListSearch(virStoragePoolObjListPtr pools,
+                            virStoragePoolObjListSearcher searcher,
+                            void *opaque);
+
 #endif /* __VIRSTORAGEOBJ_H__ */
@@ -1241,3 +1241,55 @@ virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
     virDispatchError(NULL);
     return -1;
 }
+
+/**
+ * virAdmConnectGetStartupTimes:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to a variable to store the startup phases
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves how long the phases of the daemon startup took, such as
+ * initializing each of the drivers or loading the configs and status of
+ * domains. The phases are returned in the order they finished in as the
+ * following parameters:
+ *
+ *  "phase.count" - number of phases as unsigned int
+ *  "phase.<num>.name" - name of the phase as string
+ *  "phase.<num>.start" - time the phase started at, in milliseconds since
+ *                        the epoch, as unsigned long long
+ *  "phase.<num>.duration" - duration of the phase in milliseconds as
+ *                           unsigned long long
+ *
+ * Phases may overlap, e.g. the initialization of a driver includes the
+ * loading of its domains.
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetStartupTimes(virAdmConnectPtr conn,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetStartupTimes(conn, params,
+                                                 nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
@@ -67,6 +67,8 @@
 #include "virstring.h"
 #include "virutil.h"
 #include "virtypedparam.h"
+#include "virstartuptime.h"
+#include "virtime.h"
 
 #ifdef WITH_TEST
 # include "test/test_driver.h"
@@ -759,6 +761,8 @@ virStateInitialize(bool privileged,
                    void *opaque)
 {
     size_t i;
+    unsigned long long start;
+    char *phase = NULL;
 
     if (virInitialize() < 0)
         return -1;
@@ -767,6 +771,8 @@ virStateInitialize(bool privileged,
         if (virStateDriverTab[i]->stateInitialize) {
             VIR_DEBUG("Running global init for %s state driver",
                       virStateDriverTab[i]->name);
+            if (virTimeMillisNow(&start) < 0)
+                return -1;
             if (virStateDriverTab[i]->stateInitialize(privileged,
                                                       callback,
                                                       opaque) < 0) {
@@ -775,6 +781,12 @@ virStateInitialize(bool privileged,
                           virGetLastErrorMessage());
                 return -1;
             }
+            if (virAsprintf(&phase, "%s.init",
+                            virStateDriverTab[i]->name) < 0 ||
+                virStartupTimeAdd(phase, start) < 0)
+                VIR_WARN("Failed to record startup time of %s state driver",
+                         virStateDriverTab[i]->name);
+            VIR_FREE(phase);
         }
     }
 
@@ -782,7 +794,15 @@ virStateInitialize(bool privileged,
         if (virStateDriverTab[i]->stateAutoStart) {
             VIR_DEBUG("Running global auto start for %s state driver",
                       virStateDriverTab[i]->name);
+            if (virTimeMillisNow(&start) < 0)
+                return -1;
             virStateDriverTab[i]->stateAutoStart();
+            if (virAsprintf(&phase, "%s.autostart",
+                            virStateDriverTab[i]->name) < 0 ||
+                virStartupTimeAdd(phase, start) < 0)
+                VIR_WARN("Failed to record startup time of %s state driver",
+                         virStateDriverTab[i]->name);
+            VIR_FREE(phase);
         }
     }
     return 0;
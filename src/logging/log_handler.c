@@ -31,6 +31,8 @@
 #include "virlog.h"
 #include "virrotatingfile.h"
 #include "viruuid.h"
+#include "virhash.h"
+#include "virhashcode.h"
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -43,10 +45,24 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Size of the buffer log pipes are read into */
+#define VIR_LOG_HANDLER_READ_BUFSIZE (64 * 1024)
+
+/* Most data read from a single log pipe per wakeup, so that a
+ * chatty guest doesn't hold up the others */
+#define VIR_LOG_HANDLER_READ_MAX (1024 * 1024)
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 typedef virLogHandlerLogFile *virLogHandlerLogFilePtr;
 
+/*
+ * The handler lock protects the list of files and the watch
+ * table. Writing to a log file only needs the lock of that file,
+ * which must never be held while acquiring the handler lock.
+ */
 struct _virLogHandlerLogFile {
+    virObjectLockable parent;
+
     virRotatingFileWriterPtr file;
     int watch;
     int pipefd; /* Read from QEMU via this */
@@ -65,13 +81,20 @@ struct _virLogHandler {
 
     virLogHandlerLogFilePtr *files;
     size_t nfiles;
+    virHashTablePtr watches; /* watch -> virLogHandlerLogFilePtr */
+
+    /* Log pipes are all read into the same buffer */
+    virMutex readLock;
+    char *readbuf;
 
     virLogHandlerShutdownInhibitor inhibitor;
     void *opaque;
 };
 
 static virClassPtr virLogHandlerClass;
+static virClassPtr virLogHandlerLogFileClass;
 static void virLogHandlerDispose(void *obj);
+static void virLogHandlerLogFileDispose(void *obj);
 
 static int
 virLogHandlerOnceInit(void)
@@ -82,30 +105,73 @@ virLogHandlerOnceInit(void)
                                           virLogHandlerDispose)))
         return -1;
 
+    if (!(virLogHandlerLogFileClass = virClassNew(virClassForObjectLockable(),
+                                                  "virLogHandlerLogFile",
+                                                  sizeof(virLogHandlerLogFile),
+                                                  virLogHandlerLogFileDispose)))
+        return -1;
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virLogHandler)
 
 
+static virLogHandlerLogFilePtr
+virLogHandlerLogFileNew(void)
+{
+    virLogHandlerLogFilePtr file;
+
+    if (!(file = virObjectLockableNew(virLogHandlerLogFileClass)))
+        return NULL;
+
+    file->watch = -1;
+    file->pipefd = -1;
+
+    return file;
+}
+
+
 static void
-virLogHandlerLogFileFree(virLogHandlerLogFilePtr file)
+virLogHandlerLogFileDispose(void *obj)
 {
-    if (!file)
-        return;
+    virLogHandlerLogFilePtr file = obj;
 
     VIR_FORCE_CLOSE(file->pipefd);
     virRotatingFileWriterFree(file->file);
 
-    if (file->watch != -1)
-        virEventRemoveHandle(file->watch);
-
     VIR_FREE(file->driver);
     VIR_FREE(file->domname);
-    VIR_FREE(file);
 }
 
 
+static uint32_t
+virLogHandlerWatchCode(const void *name, uint32_t seed)
+{
+    int watch = (intptr_t)name;
+    return virHashCodeGen(&watch, sizeof(watch), seed);
+}
+
+
+static bool
+virLogHandlerWatchEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+
+static void *
+virLogHandlerWatchCopy(const void *name)
+{
+    return (void *)name;
+}
+
+
+/*
+ * Removes @file from @handler, stops watching its log pipe and
+ * drops the reference held by the list of files. Must be called
+ * with @handler locked. Does nothing if @file was closed already.
+ */
 static void
 virLogHandlerLogFileClose(virLogHandlerPtr handler,
                           virLogHandlerLogFilePtr file)
@@ -115,28 +181,91 @@ virLogHandlerLogFileClose(virLogHandlerPtr handler,
     for (i = 0; i < handler->nfiles; i++) {
         if (handler->files[i] == file) {
             VIR_DELETE_ELEMENT(handler->files, i, handler->nfiles);
-            virLogHandlerLogFileFree(file);
+            if (file->watch != -1) {
+                virHashRemoveEntry(handler->watches,
+                                   (void *)(intptr_t)file->watch);
+                virEventRemoveHandle(file->watch);
+                file->watch = -1;
+            }
+            virObjectUnref(file);
             break;
         }
     }
 }
 
 
+/*
+ * Looks up an open log file by its path. Must be called with
+ * @handler locked. Returns a new reference to the file or NULL.
+ */
 static virLogHandlerLogFilePtr
-virLogHandlerGetLogFileFromWatch(virLogHandlerPtr handler,
-                                 int watch)
+virLogHandlerGetLogFileFromPath(virLogHandlerPtr handler,
+                                const char *path)
 {
     size_t i;
 
     for (i = 0; i < handler->nfiles; i++) {
-        if (handler->files[i]->watch == watch)
-            return handler->files[i];
+        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
+                  path))
+            return virObjectRef(handler->files[i]);
     }
 
     return NULL;
 }
 
 
+/*
+ * Moves whatever @fd has to offer into @logfile until the pipe
+ * is drained or VIR_LOG_HANDLER_READ_MAX bytes were read, in
+ * which case the rest is left for the next wakeup.
+ *
+ * Returns 1 if the other end was closed, 0 if the pipe should be
+ * watched further, -1 on error.
+ */
+static int
+virLogHandlerLogFileDrain(virLogHandlerPtr handler,
+                          virLogHandlerLogFilePtr logfile,
+                          int fd)
+{
+    size_t total = 0;
+    ssize_t len;
+    int ret = -1;
+
+    virMutexLock(&handler->readLock);
+
+    while (total < VIR_LOG_HANDLER_READ_MAX) {
+        len = read(fd, handler->readbuf, VIR_LOG_HANDLER_READ_BUFSIZE);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            virReportSystemError(errno, "%s",
+                                 _("Unable to read from log pipe"));
+            goto cleanup;
+        }
+
+        if (len == 0) {
+            ret = 1;
+            goto cleanup;
+        }
+
+        if (virRotatingFileWriterAppend(logfile->file,
+                                        handler->readbuf, len) != len)
+            goto cleanup;
+
+        total += len;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&handler->readLock);
+    return ret;
+}
+
+
 static void
 virLogHandlerDomainLogFileEvent(int watch,
                                 int fd,
@@ -145,41 +274,61 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandlerPtr handler = opaque;
     virLogHandlerLogFilePtr logfile;
-    char buf[1024];
-    ssize_t len;
+    int rc;
 
     virObjectLock(handler);
-    logfile = virLogHandlerGetLogFileFromWatch(handler, watch);
+    logfile = virHashLookup(handler->watches, (void *)(intptr_t)watch);
     if (!logfile || logfile->pipefd != fd) {
         virEventRemoveHandle(watch);
         virObjectUnlock(handler);
         return;
     }
+    virObjectRef(logfile);
+    virObjectUnlock(handler);
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
+    virObjectLock(logfile);
+    rc = virLogHandlerLogFileDrain(handler, logfile, fd);
+    virObjectUnlock(logfile);
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
+    if (rc != 0 || (events & VIR_EVENT_HANDLE_HANGUP)) {
+        virObjectLock(handler);
+        /* Somebody else may have closed the file meanwhile */
+        if (logfile->watch == watch) {
+            handler->inhibitor(false, handler->opaque);
+            virLogHandlerLogFileClose(handler, logfile);
+        }
+        virObjectUnlock(handler);
     }
 
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
-        goto error;
+    virObjectUnref(logfile);
+}
 
-    if (events & VIR_EVENT_HANDLE_HANGUP)
-        goto error;
 
-    virObjectUnlock(handler);
-    return;
+/*
+ * Starts watching the log pipe of @file, which must be in the
+ * list of files already. Must be called with @handler locked.
+ */
+static int
+virLogHandlerLogFileWatch(virLogHandlerPtr handler,
+                          virLogHandlerLogFilePtr file)
+{
+    if ((file->watch = virEventAddHandle(file->pipefd,
+                                         VIR_EVENT_HANDLE_READABLE,
+                                         virLogHandlerDomainLogFileEvent,
+                                         handler,
+                                         NULL)) < 0) {
+        file->watch = -1;
+        return -1;
+    }
 
- error:
-    handler->inhibitor(false, handler->opaque);
-    virLogHandlerLogFileClose(handler, logfile);
-    virObjectUnlock(handler);
+    if (virHashAddEntry(handler->watches,
+                        (void *)(intptr_t)file->watch, file) < 0) {
+        virEventRemoveHandle(file->watch);
+        file->watch = -1;
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -198,6 +347,23 @@ virLogHandlerNew(bool privileged,
     if (!(handler = virObjectLockableNew(virLogHandlerClass)))
         goto error;
 
+    if (virMutexInit(&handler->readLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        virObjectUnref(handler);
+        goto error;
+    }
+
+    if (VIR_ALLOC_N(handler->readbuf, VIR_LOG_HANDLER_READ_BUFSIZE) < 0 ||
+        !(handler->watches = virHashCreateFull(32, NULL,
+                                               virLogHandlerWatchCode,
+                                               virLogHandlerWatchEqual,
+                                               virLogHandlerWatchCopy,
+                                               NULL))) {
+        virObjectUnref(handler);
+        goto error;
+    }
+
     handler->privileged = privileged;
     handler->max_size = max_size;
     handler->max_backups = max_backups;
@@ -220,7 +386,7 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
     const char *domuuid;
     const char *tmp;
 
-    if (VIR_ALLOC(file) < 0)
+    if (!(file = virLogHandlerLogFileNew()))
         return NULL;
 
     handler->inhibitor(true, handler->opaque);
@@ -275,12 +441,17 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
                              _("Cannot enable close-on-exec flag"));
         goto error;
     }
+    if (virSetNonBlock(file->pipefd) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot enable non-blocking mode"));
+        goto error;
+    }
 
     return file;
 
  error:
     handler->inhibitor(false, handler->opaque);
-    virLogHandlerLogFileFree(file);
+    virObjectUnref(file);
     return NULL;
 }
 
@@ -324,17 +495,14 @@ virLogHandlerNewPostExecRestart(virJSONValuePtr object,
         if (!(file = virLogHandlerLogFilePostExecRestart(handler, child)))
             goto error;
 
-        if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0)
+        if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0) {
+            handler->inhibitor(false, handler->opaque);
+            virObjectUnref(file);
             goto error;
+        }
 
-        if ((file->watch = virEventAddHandle(file->pipefd,
-                                             VIR_EVENT_HANDLE_READABLE,
-                                             virLogHandlerDomainLogFileEvent,
-                                             handler,
-                                             NULL)) < 0) {
-            VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
+        if (virLogHandlerLogFileWatch(handler, file) < 0)
             goto error;
-        }
     }
 
 
@@ -354,9 +522,14 @@ virLogHandlerDispose(void *obj)
 
     for (i = 0; i < handler->nfiles; i++) {
         handler->inhibitor(false, handler->opaque);
-        virLogHandlerLogFileFree(handler->files[i]);
+        if (handler->files[i]->watch != -1)
+            virEventRemoveHandle(handler->files[i]->watch);
+        virObjectUnref(handler->files[i]);
     }
     VIR_FREE(handler->files);
+    virHashFree(handler->watches);
+    VIR_FREE(handler->readbuf);
+    virMutexDestroy(&handler->readLock);
 }
 
 
@@ -370,7 +543,6 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
                                ino_t *inode,
                                off_t *offset)
 {
-    size_t i;
     virLogHandlerLogFilePtr file = NULL;
     int pipefd[2] = { -1, -1 };
 
@@ -378,14 +550,13 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
 
     handler->inhibitor(true, handler->opaque);
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
-                  path)) {
-            virReportSystemError(EBUSY,
-                                 _("Cannot open log file: '%s'"),
-                                 path);
-            goto error;
-        }
+    if ((file = virLogHandlerGetLogFileFromPath(handler, path))) {
+        virObjectUnref(file);
+        file = NULL;
+        virReportSystemError(EBUSY,
+                             _("Cannot open log file: '%s'"),
+                             path);
+        goto error;
     }
 
     if (pipe(pipefd) < 0) {
@@ -393,10 +564,14 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
                              _("Cannot open fifo pipe"));
         goto error;
     }
-    if (VIR_ALLOC(file) < 0)
+    if (virSetNonBlock(pipefd[0]) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot enable non-blocking mode"));
+        goto error;
+    }
+    if (!(file = virLogHandlerLogFileNew()))
         goto error;
 
-    file->watch = -1;
     file->pipefd = pipefd[0];
     pipefd[0] = -1;
     memcpy(file->domuuid, domuuid, VIR_UUID_BUFLEN);
@@ -414,11 +589,7 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
     if (VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file) < 0)
         goto error;
 
-    if ((file->watch = virEventAddHandle(file->pipefd,
-                                         VIR_EVENT_HANDLE_READABLE,
-                                         virLogHandlerDomainLogFileEvent,
-                                         handler,
-                                         NULL)) < 0) {
+    if (virLogHandlerLogFileWatch(handler, file) < 0) {
         VIR_DELETE_ELEMENT(handler->files, handler->nfiles - 1, handler->nfiles);
         goto error;
     }
@@ -433,7 +604,7 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
     VIR_FORCE_CLOSE(pipefd[0]);
     VIR_FORCE_CLOSE(pipefd[1]);
     handler->inhibitor(false, handler->opaque);
-    virLogHandlerLogFileFree(file);
+    virObjectUnref(file);
     virObjectUnlock(handler);
     return -1;
 }
@@ -447,36 +618,27 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
                                       off_t *offset)
 {
     virLogHandlerLogFilePtr file = NULL;
-    int ret = -1;
-    size_t i;
 
     virCheckFlags(0, -1);
 
     virObjectLock(handler);
-
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
-                  path)) {
-            file = handler->files[i];
-            break;
-        }
-    }
+    file = virLogHandlerGetLogFileFromPath(handler, path);
+    virObjectUnlock(handler);
 
     if (!file) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("No open log file %s"),
                        path);
-        goto cleanup;
+        return -1;
     }
 
+    virObjectLock(file);
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
+    virObjectUnlock(file);
 
-    ret = 0;
-
- cleanup:
-    virObjectUnlock(handler);
-    return ret;
+    virObjectUnref(file);
+    return 0;
 }
 
 
@@ -531,7 +693,7 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
                                  const char *message,
                                  unsigned int flags)
 {
-    size_t i;
+    virLogHandlerLogFilePtr file = NULL;
     virRotatingFileWriterPtr writer = NULL;
     virRotatingFileWriterPtr newwriter = NULL;
     int ret = -1;
@@ -542,14 +704,12 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
 
     virObjectLock(handler);
 
-    for (i = 0; i < handler->nfiles; i++) {
-        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file), path)) {
-            writer = handler->files[i]->file;
-            break;
-        }
-    }
-
-    if (!writer) {
+    if ((file = virLogHandlerGetLogFileFromPath(handler, path))) {
+        /* The file can be written to without holding up others */
+        virObjectUnlock(handler);
+        virObjectLock(file);
+        writer = file->file;
+    } else {
         if (!(newwriter = virRotatingFileWriterNew(path,
                                                    handler->max_size,
                                                    handler->max_backups,
@@ -567,7 +727,12 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
 
  cleanup:
     virRotatingFileWriterFree(newwriter);
-    virObjectUnlock(handler);
+    if (file) {
+        virObjectUnlock(file);
+        virObjectUnref(file);
+    } else {
+        virObjectUnlock(handler);
+    }
     return ret;
 }
 
@@ -39,6 +39,7 @@
 #include "virjson.h"
 #include "virfile.h"
 #include "virprocess.h"
+#include "virreadbuffer.h"
 #include "virtime.h"
 #include "virobject.h"
 #include "virstring.h"
@@ -53,6 +54,13 @@ VIR_LOG_INIT("qemu.qemu_agent");
 #define DEBUG_IO 0
 #define DEBUG_RAW_IO 0
 
+/* Maximum number of bytes read from the agent in a single wakeup, so
+ * that a chatty peer cannot hold up the event loop */
+#define QEMU_AGENT_READ_MAX (1024 * 1024)
+
+/* Maximum size of a message received from the agent */
+#define QEMU_AGENT_BUFFER_MAX (64 * 1024 * 1024)
+
 /* When you are the first to uncomment this,
  * don't forget to uncomment the corresponding
  * part in qemuAgentIOProcessEvent as well.
@@ -110,9 +118,7 @@ struct _qemuAgent {
 
     /* Buffer incoming data ready for Agent monitor
      * code to process & find message boundaries */
-    size_t bufferOffset;
-    size_t bufferLength;
-    char *buffer;
+    virReadBuffer buffer;
 
     /* If anything went wrong, this will be fed back
      * the next monitor msg */
@@ -169,7 +175,7 @@ static void qemuAgentDispose(void *obj)
     if (mon->cb && mon->cb->destroy)
         (mon->cb->destroy)(mon, mon->vm);
     virCondDestroy(&mon->notify);
-    VIR_FREE(mon->buffer);
+    virReadBufferFree(&mon->buffer);
     virResetError(&mon->lastError);
 }
 
@@ -431,32 +437,26 @@ qemuAgentIOProcess(qemuAgentPtr mon)
 #if DEBUG_IO
 # if DEBUG_RAW_IO
     char *str1 = qemuAgentEscapeNonPrintable(msg ? msg->txBuffer : "");
-    char *str2 = qemuAgentEscapeNonPrintable(mon->buffer);
+    char *str2 = qemuAgentEscapeNonPrintable(mon->buffer.data);
     VIR_ERROR(_("Process %zu %p %p [[[%s]]][[[%s]]]"),
-              mon->bufferOffset, mon->msg, msg, str1, str2);
+              mon->buffer.used, mon->msg, msg, str1, str2);
     VIR_FREE(str1);
     VIR_FREE(str2);
 # else
-    VIR_DEBUG("Process %zu", mon->bufferOffset);
+    VIR_DEBUG("Process %zu", mon->buffer.used);
 # endif
 #endif
 
     len = qemuAgentIOProcessData(mon,
-                                 mon->buffer, mon->bufferOffset,
+                                 mon->buffer.data, mon->buffer.used,
                                  msg);
 
     if (len < 0)
         return -1;
 
-    if (len < mon->bufferOffset) {
-        memmove(mon->buffer, mon->buffer + len, mon->bufferOffset - len);
-        mon->bufferOffset -= len;
-    } else {
-        VIR_FREE(mon->buffer);
-        mon->bufferOffset = mon->bufferLength = 0;
-    }
+    virReadBufferConsume(&mon->buffer, len);
 #if DEBUG_IO
-    VIR_DEBUG("Process done %zu used %d", mon->bufferOffset, len);
+    VIR_DEBUG("Process done %zu used %d", mon->buffer.used, len);
 #endif
     if (msg && msg->finished)
         virCondBroadcast(&mon->notify);
@@ -531,24 +531,28 @@ qemuAgentIOWrite(qemuAgentPtr mon)
 static int
 qemuAgentIORead(qemuAgentPtr mon)
 {
-    size_t avail = mon->bufferLength - mon->bufferOffset;
     int ret = 0;
 
-    if (avail < 1024) {
-        if (VIR_REALLOC_N(mon->buffer,
-                          mon->bufferLength + 1024) < 0)
+    /* Read as much as we can get into our buffer, until we block
+       on EAGAIN, hit EOF or read QEMU_AGENT_READ_MAX bytes */
+    while (ret < QEMU_AGENT_READ_MAX) {
+        char *data;
+        size_t avail;
+        int got;
+
+        if (mon->buffer.used >= QEMU_AGENT_BUFFER_MAX) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("QEMU guest agent reply exceeds maximum size of %d bytes"),
+                           QEMU_AGENT_BUFFER_MAX);
             return -1;
-        mon->bufferLength += 1024;
-        avail += 1024;
-    }
+        }
 
-    /* Read as much as we can get into our buffer,
-       until we block on EAGAIN, or hit EOF */
-    while (avail > 1) {
-        int got;
-        got = read(mon->fd,
-                   mon->buffer + mon->bufferOffset,
-                   avail - 1);
+        if (virReadBufferReserve(&mon->buffer, 1024) < 0)
+            return -1;
+
+        data = virReadBufferTail(&mon->buffer, &avail);
+        avail = MIN(avail, QEMU_AGENT_READ_MAX - ret);
+        got = read(mon->fd, data, avail);
         if (got < 0) {
             if (errno == EAGAIN)
                 break;
@@ -561,13 +565,11 @@ qemuAgentIORead(qemuAgentPtr mon)
             break;
 
         ret += got;
-        avail -= got;
-        mon->bufferOffset += got;
-        mon->buffer[mon->bufferOffset] = '\0';
+        virReadBufferAdvance(&mon->buffer, got);
     }
 
 #if DEBUG_IO
-    VIR_DEBUG("Now read %zu bytes of data", mon->bufferOffset);
+    VIR_DEBUG("Now read %zu bytes of data", mon->buffer.used);
 #endif
 
     return ret;
@@ -687,7 +689,7 @@ qemuAgentIO(int watch, int fd, int events, void *opaque)
          * then wakeup that waiter */
         if (mon->msg && !mon->msg->finished) {
             mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
+            virCondBroadcast(&mon->notify);
         }
     }
 
@@ -702,7 +704,7 @@ qemuAgentIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         virObjectUnref(mon);
         VIR_DEBUG("Triggering EOF callback");
@@ -713,7 +715,7 @@ qemuAgentIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         virObjectUnref(mon);
         VIR_DEBUG("Triggering error callback");
@@ -818,7 +820,7 @@ qemuAgentNotifyCloseLocked(qemuAgentPtr mon)
          * wake him up. No message will arrive anyway. */
         if (mon->msg && !mon->msg->finished) {
             mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
+            virCondBroadcast(&mon->notify);
         }
     }
 }
@@ -904,6 +906,23 @@ static int qemuAgentSend(qemuAgentPtr mon,
         then = now + seconds * 1000ull;
     }
 
+    /* Threads sharing a query job may use the agent at the same time,
+     * wait until the message of the other one is processed */
+    while (mon->msg) {
+        if ((then && virCondWaitUntil(&mon->notify, &mon->parent.lock, then) < 0) ||
+            (!then && virCondWait(&mon->notify, &mon->parent.lock) < 0)) {
+            if (errno == ETIMEDOUT) {
+                virReportError(VIR_ERR_AGENT_UNRESPONSIVE, "%s",
+                               _("Guest agent not available for now"));
+                return -2;
+            }
+            virReportSystemError(errno, "%s",
+                                 _("Unable to wait on agent monitor "
+                                   "condition"));
+            return -1;
+        }
+    }
+
     mon->msg = msg;
     qemuAgentUpdateWatch(mon);
 
@@ -935,6 +954,7 @@ static int qemuAgentSend(qemuAgentPtr mon,
  cleanup:
     mon->msg = NULL;
     qemuAgentUpdateWatch(mon);
+    virCondBroadcast(&mon->notify);
 
     return ret;
 }
@@ -1256,7 +1276,7 @@ void qemuAgentNotifyEvent(qemuAgentPtr mon,
         /* somebody waiting for this event, wake him up. */
         if (mon->msg && !mon->msg->finished) {
             mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
+            virCondBroadcast(&mon->notify);
         }
     }
 
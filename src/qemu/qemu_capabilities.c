@@ -30,6 +30,7 @@
 #include "virerror.h"
 #include "virfile.h"
 #include "virfilecache.h"
+#include "viratomic.h"
 #include "virpidfile.h"
 #include "virprocess.h"
 #include "cpu/cpu.h"
@@ -42,6 +43,7 @@
 #include "virhostcpu.h"
 #include "qemu_monitor.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 #include "qemu_hostdev.h"
 #include "qemu_domain.h"
 #define __QEMU_CAPSPRIV_H_ALLOW__
@@ -958,29 +960,73 @@ virQEMUCapsFindBinaryForArch(virArch hostarch,
     return ret;
 }
 
-static int
-virQEMUCapsInitGuest(virCapsPtr caps,
-                     virFileCachePtr cache,
-                     virArch hostarch,
-                     virArch guestarch)
+/* Binaries found for a guest architecture and their capabilities */
+typedef struct _virQEMUCapsGuestBinaries virQEMUCapsGuestBinaries;
+typedef virQEMUCapsGuestBinaries *virQEMUCapsGuestBinariesPtr;
+struct _virQEMUCapsGuestBinaries {
+    virArch arch;
+    char *binary;
+    virQEMUCapsPtr qemubinCaps;
+    char *kvmbin;
+    virQEMUCapsPtr kvmbinCaps;
+};
+
+
+static void
+virQEMUCapsGuestBinariesClear(virQEMUCapsGuestBinariesPtr bins)
+{
+    VIR_FREE(bins->binary);
+    VIR_FREE(bins->kvmbin);
+    virObjectUnref(bins->qemubinCaps);
+    virObjectUnref(bins->kvmbinCaps);
+    bins->qemubinCaps = NULL;
+    bins->kvmbinCaps = NULL;
+}
+
+
+/* Looks up capabilities of @binary, or returns NULL if it shouldn't be
+ * probed now because of @lazy */
+static virQEMUCapsPtr
+virQEMUCapsGuestBinaryLookup(virFileCachePtr cache,
+                             const char *binary,
+                             bool lazy)
+{
+    if (lazy)
+        return virFileCacheLookupCached(cache, binary);
+
+    return virQEMUCapsCacheLookup(cache, binary);
+}
+
+
+/*
+ * Finds the binaries usable for guests of @bins->arch and looks up
+ * their capabilities. With @lazy set, binaries for architectures other
+ * than the native ones are not probed; they are used without their
+ * capabilities unless they were probed earlier.
+ */
+static void
+virQEMUCapsInitGuestBinaries(virFileCachePtr cache,
+                             virArch hostarch,
+                             virQEMUCapsGuestBinariesPtr bins,
+                             bool lazy)
 {
     size_t i;
-    char *kvmbin = NULL;
-    char *binary = NULL;
-    virQEMUCapsPtr qemubinCaps = NULL;
-    virQEMUCapsPtr kvmbinCaps = NULL;
-    int ret = -1;
+    virArch guestarch = bins->arch;
+    bool native = virQEMUCapsGuestIsNative(hostarch, guestarch);
 
     /* Check for existence of base emulator, or alternate base
      * which can be used with magic cpu choice
      */
-    binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
+    bins->binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
 
     /* Ignore binary if extracting version info fails */
-    if (binary) {
-        if (!(qemubinCaps = virQEMUCapsCacheLookup(cache, binary))) {
+    if (bins->binary) {
+        if (!(bins->qemubinCaps =
+              virQEMUCapsGuestBinaryLookup(cache, bins->binary,
+                                           lazy && !native))) {
             virResetLastError();
-            VIR_FREE(binary);
+            if (!lazy || native)
+                VIR_FREE(bins->binary);
         }
     }
 
@@ -990,7 +1036,7 @@ virQEMUCapsInitGuest(virCapsPtr caps,
      *  - hostarch is aarch64 and guest arch is armv7l (needs -cpu aarch64=off)
      *  - hostarch and guestarch are both ppc64*
      */
-    if (virQEMUCapsGuestIsNative(hostarch, guestarch)) {
+    if (native) {
         const char *kvmbins[] = {
             "/usr/libexec/qemu-kvm", /* RHEL */
             "qemu-kvm", /* Fedora */
@@ -1013,40 +1059,28 @@ virQEMUCapsInitGuest(virCapsPtr caps,
             if (!kvmbins[i])
                 continue;
 
-            kvmbin = virFindFileInPath(kvmbins[i]);
+            bins->kvmbin = virFindFileInPath(kvmbins[i]);
 
-            if (!kvmbin)
+            if (!bins->kvmbin)
                 continue;
 
-            if (!(kvmbinCaps = virQEMUCapsCacheLookup(cache, kvmbin))) {
+            if (!(bins->kvmbinCaps = virQEMUCapsCacheLookup(cache,
+                                                            bins->kvmbin))) {
                 virResetLastError();
-                VIR_FREE(kvmbin);
+                VIR_FREE(bins->kvmbin);
                 continue;
             }
 
-            if (!binary) {
-                binary = kvmbin;
-                qemubinCaps = kvmbinCaps;
-                kvmbin = NULL;
-                kvmbinCaps = NULL;
+            if (!bins->binary) {
+                VIR_STEAL_PTR(bins->binary, bins->kvmbin);
+                VIR_STEAL_PTR(bins->qemubinCaps, bins->kvmbinCaps);
             }
             break;
         }
     }
-
-    ret = virQEMUCapsInitGuestFromBinary(caps,
-                                         binary, qemubinCaps,
-                                         kvmbin, kvmbinCaps,
-                                         guestarch);
-
-    VIR_FREE(binary);
-    VIR_FREE(kvmbin);
-    virObjectUnref(qemubinCaps);
-    virObjectUnref(kvmbinCaps);
-
-    return ret;
 }
 
+
 int
 virQEMUCapsInitGuestFromBinary(virCapsPtr caps,
                                const char *binary,
@@ -1071,7 +1105,9 @@ virQEMUCapsInitGuestFromBinary(virCapsPtr caps,
          kvmbin))
         haskvm = true;
 
-    if (virQEMUCapsGetMachineTypesCaps(qemubinCaps, &nmachines, &machines) < 0)
+    /* The capabilities of a binary which was not probed yet are unknown */
+    if (qemubinCaps &&
+        virQEMUCapsGetMachineTypesCaps(qemubinCaps, &nmachines, &machines) < 0)
         goto cleanup;
 
     /* We register kvm as the base emulator too, since we can
@@ -1177,10 +1213,123 @@ virQEMUCapsProbeHostCPUForEmulator(virArch hostArch,
 }
 
 
+/* Maximum number of threads probing QEMU binaries at once */
+#define VIR_QEMU_CAPS_INIT_WORKERS 8
+
+typedef struct _virQEMUCapsInitData virQEMUCapsInitData;
+typedef virQEMUCapsInitData *virQEMUCapsInitDataPtr;
+struct _virQEMUCapsInitData {
+    virMutex lock;
+    virCond cond;
+
+    virFileCachePtr cache;
+    virArch hostarch;
+    bool lazy;
+
+    size_t pending; /* number of architectures not looked up yet */
+};
+
+
+static void
+virQEMUCapsInitWorker(void *jobdata,
+                      void *opaque)
+{
+    virQEMUCapsGuestBinariesPtr bins = jobdata;
+    virQEMUCapsInitDataPtr data = opaque;
+
+    virQEMUCapsInitGuestBinaries(data->cache, data->hostarch, bins,
+                                 data->lazy);
+
+    virMutexLock(&data->lock);
+    data->pending--;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+/*
+ * Looks up the binaries of all guest architectures in @bins using a pool
+ * of worker threads, so that QEMU binaries whose capabilities are not
+ * cached are probed in parallel rather than one after another.
+ */
+static int
+virQEMUCapsInitAllGuestBinaries(virFileCachePtr cache,
+                                virArch hostarch,
+                                virQEMUCapsGuestBinariesPtr bins,
+                                size_t nbins,
+                                bool lazy)
+{
+    virQEMUCapsInitData data;
+    virThreadPoolPtr workers = NULL;
+    size_t i;
+    int ret = -1;
+
+    memset(&data, 0, sizeof(data));
+    data.cache = cache;
+    data.hostarch = hostarch;
+    data.lazy = lazy;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        return -1;
+    }
+
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    if (!(workers = virThreadPoolNew(0, VIR_QEMU_CAPS_INIT_WORKERS, 0,
+                                     virQEMUCapsInitWorker, &data)))
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+
+    for (i = 0; i < nbins; i++) {
+        if (virThreadPoolSendJob(workers, 0, &bins[i]) < 0)
+            break;
+
+        data.pending++;
+    }
+
+    if (i == nbins)
+        ret = 0;
+
+    /* Even on failure we have to wait for the lookups which were
+     * already submitted as they reference @data and @bins */
+    while (data.pending > 0)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+
+    virMutexUnlock(&data.lock);
+
+ cleanup:
+    virThreadPoolFree(workers);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+/**
+ * virQEMUCapsInit:
+ * @cache: QEMU capabilities cache
+ * @lazy: don't probe binaries of foreign architectures
+ *
+ * Creates the host capabilities with a guest for each architecture a
+ * QEMU binary is found for. If @lazy is true, the binaries of other than
+ * the native architectures are only probed on their first use. Until
+ * then the guests are listed without their machine types.
+ *
+ * Returns the capabilities or NULL on error.
+ */
 virCapsPtr
-virQEMUCapsInit(virFileCachePtr cache)
+virQEMUCapsInit(virFileCachePtr cache,
+                bool lazy)
 {
     virCapsPtr caps;
+    virQEMUCapsGuestBinariesPtr bins = NULL;
     size_t i;
     virArch hostarch = virArchFromHost();
 
@@ -1219,15 +1368,38 @@ virQEMUCapsInit(virFileCachePtr cache)
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
      */
+    if (VIR_ALLOC_N(bins, VIR_ARCH_LAST) < 0)
+        goto error;
+
     for (i = 0; i < VIR_ARCH_LAST; i++)
-        if (virQEMUCapsInitGuest(caps, cache,
-                                 hostarch,
-                                 i) < 0)
+        bins[i].arch = i;
+
+    if (virQEMUCapsInitAllGuestBinaries(cache, hostarch, bins,
+                                        VIR_ARCH_LAST, lazy) < 0)
+        goto error;
+
+    /* The guests are added in the order of architectures regardless
+     * of which binary was probed first */
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        if (virQEMUCapsInitGuestFromBinary(caps,
+                                           bins[i].binary,
+                                           bins[i].qemubinCaps,
+                                           bins[i].kvmbin,
+                                           bins[i].kvmbinCaps,
+                                           bins[i].arch) < 0)
             goto error;
+    }
+
+    for (i = 0; i < VIR_ARCH_LAST; i++)
+        virQEMUCapsGuestBinariesClear(&bins[i]);
+    VIR_FREE(bins);
 
     return caps;
 
  error:
+    for (i = 0; bins && i < VIR_ARCH_LAST; i++)
+        virQEMUCapsGuestBinariesClear(&bins[i]);
+    VIR_FREE(bins);
     virObjectUnref(caps);
     return NULL;
 }
@@ -4919,6 +5091,10 @@ virQEMUCapsInitQMPCommandFree(virQEMUCapsInitQMPCommandPtr cmd)
 }
 
 
+/* Distinguishes the files of QEMU processes probed at the same time */
+static int virQEMUCapsInitQMPCommandCounter;
+
+
 static virQEMUCapsInitQMPCommandPtr
 virQEMUCapsInitQMPCommandNew(char *binary,
                              const char *libDir,
@@ -4927,6 +5103,7 @@ virQEMUCapsInitQMPCommandNew(char *binary,
                              char **qmperr)
 {
     virQEMUCapsInitQMPCommandPtr cmd = NULL;
+    int id = virAtomicIntInc(&virQEMUCapsInitQMPCommandCounter);
 
     if (VIR_ALLOC(cmd) < 0)
         goto error;
@@ -4941,8 +5118,8 @@ virQEMUCapsInitQMPCommandNew(char *binary,
     /* the ".sock" sufix is important to avoid a possible clash with a qemu
      * domain called "capabilities"
      */
-    if (virAsprintf(&cmd->monpath, "%s/%s", libDir,
-                    "capabilities.monitor.sock") < 0)
+    if (virAsprintf(&cmd->monpath, "%s/capabilities.monitor.%d.sock",
+                    libDir, id) < 0)
         goto error;
     if (virAsprintf(&cmd->monarg, "unix:%s,server,nowait", cmd->monpath) < 0)
         goto error;
@@ -4953,7 +5130,8 @@ virQEMUCapsInitQMPCommandNew(char *binary,
      * -daemonize we need QEMU to be allowed to create them, rather
      * than libvirtd. So we're using libDir which QEMU can write to
      */
-    if (virAsprintf(&cmd->pidfile, "%s/%s", libDir, "capabilities.pidfile") < 0)
+    if (virAsprintf(&cmd->pidfile, "%s/capabilities.%d.pidfile",
+                    libDir, id) < 0)
         goto error;
 
     virPidFileForceCleanupPath(cmd->pidfile);
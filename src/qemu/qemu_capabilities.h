@@ -512,7 +512,8 @@ virQEMUCapsPtr virQEMUCapsCacheLookupCopy(virFileCachePtr cache,
 virQEMUCapsPtr virQEMUCapsCacheLookupByArch(virFileCachePtr cache,
                                             virArch arch);
 
-virCapsPtr virQEMUCapsInit(virFileCachePtr cache);
+virCapsPtr virQEMUCapsInit(virFileCachePtr cache,
+                           bool lazy);
 
 int virQEMUCapsGetDefaultVersion(virCapsPtr caps,
                                  virFileCachePtr capsCache,
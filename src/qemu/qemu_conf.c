@@ -804,9 +804,21 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
         VIR_FREE(stdioHandler);
     }
 
+    if (virConfGetValueBool(conf, "status_journal", &cfg->statusJournal) < 0)
+        goto cleanup;
+
+    if (virConfGetValueBool(conf, "lazy_capabilities_probing",
+                            &cfg->lazyCapsProbing) < 0)
+        goto cleanup;
+
     if (virConfGetValueUInt(conf, "max_queued", &cfg->maxQueuedJobs) < 0)
         goto cleanup;
 
+    if (virConfGetValueUInt(conf, "stats_workers", &cfg->statsWorkers) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "stats_job_wait_time", &cfg->statsJobWaitTime) < 0)
+        goto cleanup;
+
     if (virConfGetValueInt(conf, "keepalive_interval", &cfg->keepAliveInterval) < 0)
         goto cleanup;
     if (virConfGetValueUInt(conf, "keepalive_count", &cfg->keepAliveCount) < 0)
@@ -1019,7 +1031,8 @@ virCapsPtr virQEMUDriverCreateCapabilities(virQEMUDriverPtr driver)
                              VIR_DOMAIN_VIRT_QEMU,};
 
     /* Basic host arch / guest machine capabilities */
-    if (!(caps = virQEMUCapsInit(driver->qemuCapsCache)))
+    if (!(caps = virQEMUCapsInit(driver->qemuCapsCache,
+                                 cfg->lazyCapsProbing)))
         goto error;
 
     if (virGetHostUUID(caps->host.host_uuid)) {
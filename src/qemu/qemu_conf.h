@@ -170,6 +170,9 @@ struct _virQEMUDriverConfig {
 
     unsigned int maxQueuedJobs;
 
+    unsigned int statsWorkers;
+    unsigned int statsJobWaitTime;
+
     char **securityDriverNames;
     bool securityDefaultConfined;
     bool securityRequireConfined;
@@ -198,6 +201,10 @@ struct _virQEMUDriverConfig {
     bool logTimestamp;
     bool stdioLogD;
 
+    bool statusJournal;
+
+    bool lazyCapsProbing;
+
     virFirmwarePtr *firmwares;
     size_t nfirmwares;
     unsigned int glusterDebugLevel;
@@ -216,6 +223,10 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable pointer, self-locking APIs. NULL if bulk stats
+     * are collected serially */
+    virThreadPoolPtr statsPool;
+
     /* Atomic increment only */
     int lastvmid;
 
@@ -63,6 +63,7 @@
 # include <sys/sysmacros.h>
 #endif
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #if defined(HAVE_SYS_MOUNT_H)
 # include <sys/mount.h>
@@ -315,6 +316,7 @@ qemuDomainObjResetJob(qemuDomainObjPrivatePtr priv)
     job->owner = 0;
     job->ownerAPI = NULL;
     job->started = 0;
+    job->nshared = 0;
 }
 
 static void
@@ -940,17 +942,30 @@ qemuDomainHostdevPrivateDispose(void *obj)
 static virClassPtr qemuDomainVcpuPrivateClass;
 static void qemuDomainVcpuPrivateDispose(void *obj);
 
+/* The /proc files of vcpu threads kept open between stats queries must
+ * not use up the file descriptors of the daemon. At most a quarter of
+ * RLIMIT_NOFILE is spent on them, vcpus beyond that open their files for
+ * each query. */
+static int qemuDomainVcpuStatFilesMax;
+static volatile int qemuDomainVcpuStatFilesOpen;
+
 static int
 qemuDomainVcpuPrivateOnceInit(void)
 {
+    struct rlimit rlim;
+
     qemuDomainVcpuPrivateClass = virClassNew(virClassForObject(),
                                              "qemuDomainVcpuPrivate",
                                              sizeof(qemuDomainVcpuPrivate),
                                              qemuDomainVcpuPrivateDispose);
     if (!qemuDomainVcpuPrivateClass)
         return -1;
-    else
-        return 0;
+
+    if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+        rlim.rlim_cur = 1024;
+    qemuDomainVcpuStatFilesMax = MIN(rlim.rlim_cur, 65536) / 4;
+
+    return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(qemuDomainVcpuPrivate)
@@ -966,6 +981,9 @@ qemuDomainVcpuPrivateNew(void)
     if (!(priv = virObjectNew(qemuDomainVcpuPrivateClass)))
         return NULL;
 
+    priv->statfd = -1;
+    priv->schedfd = -1;
+
     return (virObjectPtr) priv;
 }
 
@@ -977,10 +995,80 @@ qemuDomainVcpuPrivateDispose(void *obj)
 
     VIR_FREE(priv->type);
     VIR_FREE(priv->alias);
+    qemuDomainVcpuPrivateCloseStatFiles(priv);
     return;
 }
 
 
+/**
+ * qemuDomainVcpuPrivateCloseStatFiles:
+ * @vcpupriv: vcpu private data
+ *
+ * Closes the /proc files of the vcpu thread cached for sampling its stats,
+ * e.g. because the thread went away or the vcpu is now run by another one.
+ */
+void
+qemuDomainVcpuPrivateCloseStatFiles(qemuDomainVcpuPrivatePtr vcpupriv)
+{
+    if (vcpupriv->statfd >= 0)
+        ignore_value(virAtomicIntDecAndTest(&qemuDomainVcpuStatFilesOpen));
+    if (vcpupriv->schedfd >= 0)
+        ignore_value(virAtomicIntDecAndTest(&qemuDomainVcpuStatFilesOpen));
+    VIR_FORCE_CLOSE(vcpupriv->statfd);
+    VIR_FORCE_CLOSE(vcpupriv->schedfd);
+    vcpupriv->statpid = 0;
+    vcpupriv->stattid = 0;
+}
+
+
+/**
+ * qemuDomainVcpuPrivateHoldStatFile:
+ * @fd: a cached /proc file of a vcpu thread, i.e. its statfd or schedfd
+ * @tmpfd: closed file descriptor to use instead of @fd
+ *
+ * Decides whether the file read through @fd next may stay open. That's
+ * the case if it's open already or if the budget of cached files allows
+ * another one. The caller reads the file through the returned file
+ * descriptor and passes it to qemuDomainVcpuPrivateReleaseStatFile
+ * afterwards.
+ *
+ * Returns @fd if the file may be kept open, @tmpfd otherwise.
+ */
+int *
+qemuDomainVcpuPrivateHoldStatFile(int *fd,
+                                  int *tmpfd)
+{
+    if (*fd >= 0)
+        return fd;
+
+    if (virAtomicIntInc(&qemuDomainVcpuStatFilesOpen) <=
+        qemuDomainVcpuStatFilesMax)
+        return fd;
+
+    ignore_value(virAtomicIntDecAndTest(&qemuDomainVcpuStatFilesOpen));
+    return tmpfd;
+}
+
+
+/**
+ * qemuDomainVcpuPrivateReleaseStatFile:
+ * @fd: the cached file passed to qemuDomainVcpuPrivateHoldStatFile
+ * @usedfd: the file descriptor it returned
+ *
+ * Closes @usedfd unless it's the cached one and gives back the budget of
+ * a cached file which didn't end up open.
+ */
+void
+qemuDomainVcpuPrivateReleaseStatFile(int *fd,
+                                     int *usedfd)
+{
+    if (usedfd != fd)
+        VIR_FORCE_CLOSE(*usedfd);
+    else if (*fd < 0)
+        ignore_value(virAtomicIntDecAndTest(&qemuDomainVcpuStatFilesOpen));
+}
+
+
 static virClassPtr qemuDomainChrSourcePrivateClass;
 static void qemuDomainChrSourcePrivateDispose(void *obj);
 
@@ -3818,17 +3906,35 @@ qemuDomainJobAllowed(qemuDomainObjPrivatePtr priv, qemuDomainJob job)
     return !priv->job.active && qemuDomainNestedJobAllowed(priv, job);
 }
 
+/*
+ * Query jobs don't change the domain state and thus any number of them
+ * can run at the same time. A new query job won't join the running ones
+ * if a thread is already waiting for an exclusive job though, to avoid
+ * starving it.
+ */
+static bool
+qemuDomainObjCanShareJob(qemuDomainObjPrivatePtr priv, qemuDomainJob job)
+{
+    return job == QEMU_JOB_QUERY &&
+           priv->job.active == QEMU_JOB_QUERY &&
+           priv->job.waiters == 0;
+}
+
 /* Give up waiting for mutex after 30 seconds */
 #define QEMU_JOB_WAIT_TIME (1000ull * 30)
 
 /*
  * obj must be locked before calling
+ *
+ * @waitTime is the maximum time in milliseconds to wait for
+ * the job to become available.
  */
 static int ATTRIBUTE_NONNULL(1)
 qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
                               virDomainObjPtr obj,
                               qemuDomainJob job,
-                              qemuDomainAsyncJob asyncJob)
+                              qemuDomainAsyncJob asyncJob,
+                              unsigned long long waitTime)
 {
     qemuDomainObjPrivatePtr priv = obj->privateData;
     unsigned long long now;
@@ -3841,6 +3947,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     unsigned long long duration = 0;
     unsigned long long asyncDuration = 0;
     const char *jobStr;
+    int rc;
 
     if (async)
         jobStr = qemuDomainAsyncJobTypeToString(asyncJob);
@@ -3858,7 +3965,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     }
 
     priv->jobs_queued++;
-    then = now + QEMU_JOB_WAIT_TIME;
+    then = now + waitTime;
 
  retry:
     if (cfg->maxQueuedJobs &&
@@ -3872,9 +3979,14 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
             goto error;
     }
 
-    while (priv->job.active) {
+    while (priv->job.active && !qemuDomainObjCanShareJob(priv, job)) {
         VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
-        if (virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then) < 0)
+        if (job != QEMU_JOB_QUERY)
+            priv->job.waiters++;
+        rc = virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then);
+        if (job != QEMU_JOB_QUERY)
+            priv->job.waiters--;
+        if (rc < 0)
             goto error;
     }
 
@@ -3883,6 +3995,16 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     if (!nested && !qemuDomainNestedJobAllowed(priv, job))
         goto retry;
 
+    if (priv->job.active) {
+        priv->job.nshared++;
+        VIR_DEBUG("Joined job: %s (async=%s vm=%p name=%s nshared=%u)",
+                  qemuDomainJobTypeToString(job),
+                  qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+                  obj, obj->def->name, priv->job.nshared);
+        virObjectUnref(cfg);
+        return 0;
+    }
+
     qemuDomainObjResetJob(priv);
 
     ignore_value(virTimeMillisNow(&now));
@@ -3896,6 +4018,13 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
         priv->job.owner = virThreadSelfID();
         priv->job.ownerAPI = virThreadJobGet();
         priv->job.started = now;
+
+        /* Let other query jobs waiting for the one which just ended
+         * join this one */
+        if (job == QEMU_JOB_QUERY) {
+            priv->job.nshared = 1;
+            virCondBroadcast(&priv->job.cond);
+        }
     } else {
         VIR_DEBUG("Started async job: %s (vm=%p name=%s)",
                   qemuDomainAsyncJobTypeToString(asyncJob),
@@ -3987,7 +4116,34 @@ int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
                           qemuDomainJob job)
 {
     if (qemuDomainObjBeginJobInternal(driver, obj, job,
-                                      QEMU_ASYNC_JOB_NONE) < 0)
+                                      QEMU_ASYNC_JOB_NONE,
+                                      QEMU_JOB_WAIT_TIME) < 0)
+        return -1;
+    else
+        return 0;
+}
+
+/*
+ * obj must be locked before calling
+ *
+ * Same as qemuDomainObjBeginJob(), but gives up waiting for the job
+ * after @waitTime milliseconds. A @waitTime of zero means the default
+ * wait time is used.
+ *
+ * Successful calls must be followed by EndJob eventually
+ */
+int
+qemuDomainObjBeginJobWithTimeout(virQEMUDriverPtr driver,
+                                 virDomainObjPtr obj,
+                                 qemuDomainJob job,
+                                 unsigned long long waitTime)
+{
+    if (waitTime == 0)
+        waitTime = QEMU_JOB_WAIT_TIME;
+
+    if (qemuDomainObjBeginJobInternal(driver, obj, job,
+                                      QEMU_ASYNC_JOB_NONE,
+                                      waitTime) < 0)
         return -1;
     else
         return 0;
@@ -4001,7 +4157,7 @@ int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv;
 
     if (qemuDomainObjBeginJobInternal(driver, obj, QEMU_JOB_ASYNC,
-                                      asyncJob) < 0)
+                                      asyncJob, QEMU_JOB_WAIT_TIME) < 0)
         return -1;
 
     priv = obj->privateData;
@@ -4029,7 +4185,8 @@ qemuDomainObjBeginNestedJob(virQEMUDriverPtr driver,
 
     return qemuDomainObjBeginJobInternal(driver, obj,
                                          QEMU_JOB_ASYNC_NESTED,
-                                         QEMU_ASYNC_JOB_NONE);
+                                         QEMU_ASYNC_JOB_NONE,
+                                         QEMU_JOB_WAIT_TIME);
 }
 
 
@@ -4047,6 +4204,15 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
 
     priv->jobs_queued--;
 
+    if (job == QEMU_JOB_QUERY && priv->job.nshared > 1) {
+        priv->job.nshared--;
+        VIR_DEBUG("Leaving shared job: %s (async=%s vm=%p name=%s nshared=%u)",
+                  qemuDomainJobTypeToString(job),
+                  qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+                  obj, obj->def->name, priv->job.nshared);
+        return;
+    }
+
     VIR_DEBUG("Stopping job: %s (async=%s vm=%p name=%s)",
               qemuDomainJobTypeToString(job),
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
@@ -4055,7 +4221,9 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
     qemuDomainObjResetJob(priv);
     if (qemuDomainTrackJob(job))
         qemuDomainObjSaveJob(driver, obj);
-    virCondSignal(&priv->job.cond);
+    /* Wake up all waiters as more than one of them may be able to
+     * start a shared query job */
+    virCondBroadcast(&priv->job.cond);
 }
 
 void
@@ -7060,8 +7228,11 @@ qemuDomainRefreshVcpuInfo(virQEMUDriverPtr driver,
          * Just disable CPU pinning with TCG until someone wants
          * to try to do this hard work.
          */
-        if (vm->def->virtType != VIR_DOMAIN_VIRT_QEMU)
+        if (vm->def->virtType != VIR_DOMAIN_VIRT_QEMU &&
+            vcpupriv->tid != info[i].tid) {
+            qemuDomainVcpuPrivateCloseStatFiles(vcpupriv);
             vcpupriv->tid = info[i].tid;
+        }
 
         vcpupriv->socket_id = info[i].socket_id;
         vcpupriv->core_id = info[i].core_id;
@@ -62,7 +62,8 @@
     (JOB_MASK(QEMU_JOB_DESTROY) |       \
      JOB_MASK(QEMU_JOB_ASYNC))
 
-/* Only 1 job is allowed at any time
+/* Only 1 job is allowed at any time, except for QEMU_JOB_QUERY which
+ * can be shared by any number of threads as it doesn't change anything.
  * A job includes *all* monitor commands, even those just querying
  * information, not merely actions */
 typedef enum {
@@ -129,6 +130,10 @@ struct qemuDomainJobObj {
     unsigned long long owner;           /* Thread id which set current job */
     const char *ownerAPI;               /* The API which owns the job */
     unsigned long long started;         /* When the current job started */
+    unsigned int nshared;               /* Number of threads sharing the
+                                         * current QEMU_JOB_QUERY job */
+    unsigned int waiters;               /* Number of threads waiting for
+                                         * an exclusive job */
 
     virCond asyncCond;                  /* Use to coordinate with async jobs */
     qemuDomainAsyncJob asyncJob;        /* Currently active async job */
@@ -363,11 +368,24 @@ struct _qemuDomainVcpuPrivate {
     int thread_id;
     int node_id;
     int vcpus;
+
+    /* /proc stat and sched files of the vcpu thread, kept open between
+     * stats queries within a daemon-wide budget, see
+     * qemuDomainVcpuPrivateHoldStatFile; valid only for @statpid and
+     * @stattid */
+    pid_t statpid;
+    pid_t stattid;
+    int statfd;
+    int schedfd;
 };
 
 # define QEMU_DOMAIN_VCPU_PRIVATE(vcpu)    \
     ((qemuDomainVcpuPrivatePtr) (vcpu)->privateData)
 
+void qemuDomainVcpuPrivateCloseStatFiles(qemuDomainVcpuPrivatePtr vcpupriv);
+int *qemuDomainVcpuPrivateHoldStatFile(int *fd, int *tmpfd);
+void qemuDomainVcpuPrivateReleaseStatFile(int *fd, int *usedfd);
+
 
 struct qemuDomainDiskInfo {
     bool removable;
@@ -452,6 +470,11 @@ int qemuDomainObjBeginJob(virQEMUDriverPtr driver,
                           virDomainObjPtr obj,
                           qemuDomainJob job)
     ATTRIBUTE_RETURN_CHECK;
+int qemuDomainObjBeginJobWithTimeout(virQEMUDriverPtr driver,
+                                     virDomainObjPtr obj,
+                                     qemuDomainJob job,
+                                     unsigned long long waitTime)
+    ATTRIBUTE_RETURN_CHECK;
 int qemuDomainObjBeginAsyncJob(virQEMUDriverPtr driver,
                                virDomainObjPtr obj,
                                qemuDomainAsyncJob asyncJob,
@@ -97,6 +97,7 @@
 #include "virtypedparam.h"
 #include "virbitmap.h"
 #include "virstring.h"
+#include "virstartuptime.h"
 #include "viraccessapicheck.h"
 #include "viraccessapicheckqemu.h"
 #include "storage/storage_driver.h"
@@ -139,6 +140,8 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 static void qemuProcessEventHandler(void *data, void *opaque);
 
+static void qemuConnectGetAllDomainStatsWorker(void *data, void *opaque);
+
 static int qemuStateCleanup(void);
 
 static int qemuDomainObjStart(virConnectPtr conn,
@@ -629,6 +632,7 @@ qemuStateInitialize(bool privileged,
     gid_t run_gid = -1;
     char *hugepagePath = NULL;
     size_t i;
+    unsigned long long start;
 
     if (VIR_ALLOC(qemu_driver) < 0)
         return -1;
@@ -858,12 +862,20 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->qemuCapsCache)
         goto error;
 
+    if (virTimeMillisNow(&start) < 0)
+        goto error;
+
     if ((qemu_driver->caps = virQEMUDriverCreateCapabilities(qemu_driver)) == NULL)
         goto error;
 
+    ignore_value(virStartupTimeAdd(QEMU_DRIVER_NAME ".capabilities", start));
+
     if (!(qemu_driver->xmlopt = virQEMUDriverCreateXMLConf(qemu_driver)))
         goto error;
 
+    virDomainXMLOptionSetStatusJournal(qemu_driver->xmlopt,
+                                       cfg->statusJournal);
+
     /* If hugetlbfs is present, then we need to create a sub-directory within
      * it, since we can't assume the root mount point has permissions that
      * will let our spawned QEMU instances use it. */
@@ -889,6 +901,9 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->closeCallbacks = virCloseCallbacksNew()))
         goto error;
 
+    if (virTimeMillisNow(&start) < 0)
+        goto error;
+
     /* Get all the running persistent or transient configs first */
     if (virDomainObjListLoadAllConfigs(qemu_driver->domains,
                                        cfg->stateDir,
@@ -898,6 +913,8 @@ qemuStateInitialize(bool privileged,
                                        NULL, NULL) < 0)
         goto error;
 
+    ignore_value(virStartupTimeAdd(QEMU_DRIVER_NAME ".status", start));
+
     /* find the maximum ID from active and transient configs to initialize
      * the driver with. This is to avoid race between autostart and reconnect
      * threads */
@@ -911,6 +928,9 @@ qemuStateInitialize(bool privileged,
 
     conn = virConnectOpen(cfg->uri);
 
+    if (virTimeMillisNow(&start) < 0)
+        goto error;
+
     /* Then inactive persistent configs */
     if (virDomainObjListLoadAllConfigs(qemu_driver->domains,
                                        cfg->configDir,
@@ -920,6 +940,11 @@ qemuStateInitialize(bool privileged,
                                        NULL, NULL) < 0)
         goto error;
 
+    ignore_value(virStartupTimeAdd(QEMU_DRIVER_NAME ".config", start));
+
+    if (virTimeMillisNow(&start) < 0)
+        goto error;
+
     virDomainObjListForEach(qemu_driver->domains,
                             qemuDomainSnapshotLoad,
                             cfg->snapshotDir);
@@ -928,12 +953,22 @@ qemuStateInitialize(bool privileged,
                             qemuDomainManagedSaveLoad,
                             qemu_driver);
 
+    ignore_value(virStartupTimeAdd(QEMU_DRIVER_NAME ".snapshots", start));
+
     qemuProcessReconnectAll(conn, qemu_driver);
 
     qemu_driver->workerPool = virThreadPoolNew(0, 1, 0, qemuProcessEventHandler, qemu_driver);
     if (!qemu_driver->workerPool)
         goto error;
 
+    if (cfg->statsWorkers > 0) {
+        qemu_driver->statsPool = virThreadPoolNew(0, cfg->statsWorkers, 0,
+                                                  qemuConnectGetAllDomainStatsWorker,
+                                                  qemu_driver);
+        if (!qemu_driver->statsPool)
+            goto error;
+    }
+
     virObjectUnref(conn);
 
     virNWFilterRegisterCallbackDriver(&qemuCallbackDriver);
@@ -1078,6 +1113,7 @@ qemuStateCleanup(void)
 
     virNWFilterUnRegisterCallbackDriver(&qemuCallbackDriver);
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->statsPool);
     virObjectUnref(qemu_driver->config);
     virObjectUnref(qemu_driver->hostdevMgr);
     virHashFree(qemu_driver->sharedDevices);
@@ -1319,116 +1355,86 @@ static char *qemuConnectGetCapabilities(virConnectPtr conn) {
 }
 
 
-static int
-qemuGetSchedInfo(unsigned long long *cpuWait,
-                 pid_t pid, pid_t tid)
-{
-    char *proc = NULL;
-    char *data = NULL;
-    char **lines = NULL;
-    size_t i;
-    int ret = -1;
-    double val;
-
-    *cpuWait = 0;
+/*
+ * Reads /proc/@pid/task/@tid/@name (or /proc/@pid/@name if @tid is 0)
+ * into @buf as a NUL terminated string. The file is opened only if @fd is
+ * -1 and is left open in @fd, so callers sampling the same thread
+ * repeatedly can keep it and avoid the path lookup on subsequent calls:
+ * procfs regenerates the contents on every read from offset 0.
+ *
+ * Returns the number of bytes read or -1 with errno set. @fd is closed on
+ * read errors.
+ */
+static ssize_t
+qemuReadProcFile(int *fd,
+                 pid_t pid,
+                 pid_t tid,
+                 const char *name,
+                 char *buf,
+                 size_t buflen)
+{
+    char path[64];
+    ssize_t got;
+
+    if (*fd < 0) {
+        /* In general, we cannot assume pid_t fits in int; but /proc parsing
+         * is specific to Linux where int works fine.  */
+        if (tid)
+            snprintf(path, sizeof(path), "/proc/%d/task/%d/%s",
+                     (int) pid, (int) tid, name);
+        else
+            snprintf(path, sizeof(path), "/proc/%d/%s", (int) pid, name);
 
-    /* In general, we cannot assume pid_t fits in int; but /proc parsing
-     * is specific to Linux where int works fine.  */
-    if (tid)
-        ret = virAsprintf(&proc, "/proc/%d/task/%d/sched", (int)pid, (int)tid);
-    else
-        ret = virAsprintf(&proc, "/proc/%d/sched", (int)pid);
-    if (ret < 0)
-        goto cleanup;
-    ret = -1;
+        if ((*fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+            return -1;
+    }
 
-    /* The file is not guaranteed to exist (needs CONFIG_SCHED_DEBUG) */
-    if (access(proc, R_OK) < 0) {
-        ret = 0;
-        goto cleanup;
+    if ((got = pread(*fd, buf, buflen - 1, 0)) < 0) {
+        VIR_FORCE_CLOSE(*fd);
+        return -1;
     }
 
-    if (virFileReadAll(proc, (1<<16), &data) < 0)
-        goto cleanup;
+    buf[got] = '\0';
+    return got;
+}
 
-    lines = virStringSplit(data, "\n", 0);
-    if (!lines)
-        goto cleanup;
 
-    for (i = 0; lines[i] != NULL; i++) {
-        const char *line = lines[i];
+static int
+qemuGetSchedInfo(unsigned long long *cpuWait,
+                 int *fd,
+                 pid_t pid, pid_t tid)
+{
+    /* the wait_sum line is near the top of the file */
+    char data[4096];
 
-        /* Needs CONFIG_SCHEDSTATS. The second check
-         * is the old name the kernel used in past */
-        if (STRPREFIX(line, "se.statistics.wait_sum") ||
-            STRPREFIX(line, "se.wait_sum")) {
-            line = strchr(line, ':');
-            if (!line) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Missing separator in sched info '%s'"),
-                               lines[i]);
-                goto cleanup;
-            }
-            line++;
-            while (*line == ' ')
-                line++;
+    *cpuWait = 0;
 
-            if (virStrToDouble(line, NULL, &val) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Unable to parse sched info value '%s'"),
-                               line);
-                goto cleanup;
-            }
+    if (qemuReadProcFile(fd, pid, tid, "sched", data, sizeof(data)) < 0) {
+        /* The file is not guaranteed to exist (needs CONFIG_SCHED_DEBUG) */
+        if (errno == ENOENT || errno == ESRCH)
+            return 0;
 
-            *cpuWait = (unsigned long long)(val * 1000000);
-            break;
-        }
+        virReportSystemError(errno,
+                             _("Unable to read sched info of %d/%d"),
+                             (int) pid, (int) tid);
+        return -1;
     }
 
-    ret = 0;
-
- cleanup:
-    VIR_FREE(data);
-    VIR_FREE(proc);
-    virStringListFree(lines);
-    return ret;
+    return virProcessParseSchedWait(data, cpuWait);
 }
 
 
 static int
-qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
-                   pid_t pid, int tid)
+qemuGetProcessInfoFd(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
+                     int *fd, pid_t pid, int tid)
 {
-    char *proc;
-    FILE *pidinfo;
+    char data[1024];
     unsigned long long usertime = 0, systime = 0;
     long rss = 0;
     int cpu = 0;
-    int ret;
-
-    /* In general, we cannot assume pid_t fits in int; but /proc parsing
-     * is specific to Linux where int works fine.  */
-    if (tid)
-        ret = virAsprintf(&proc, "/proc/%d/task/%d/stat", (int) pid, tid);
-    else
-        ret = virAsprintf(&proc, "/proc/%d/stat", (int) pid);
-    if (ret < 0)
-        return -1;
 
-    pidinfo = fopen(proc, "r");
-    VIR_FREE(proc);
-
-    /* See 'man proc' for information about what all these fields are. We're
-     * only interested in a very few of them */
-    if (!pidinfo ||
-        fscanf(pidinfo,
-               /* pid -> stime */
-               "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
-               /* cutime -> endcode */
-               "%*d %*d %*d %*d %*d %*d %*u %*u %ld %*u %*u %*u"
-               /* startstack -> processor */
-               "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
-               &usertime, &systime, &rss, &cpu) != 4) {
+    if (qemuReadProcFile(fd, pid, tid, "stat", data, sizeof(data)) < 0 ||
+        virProcessParseStat(data, &usertime, &systime, &rss, &cpu) < 0) {
         VIR_WARN("cannot parse process status data");
     }
 
@@ -1450,12 +1456,46 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
     VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%d rss=%ld",
               (int) pid, tid, usertime, systime, cpu, rss);
 
-    VIR_FORCE_FCLOSE(pidinfo);
-
     return 0;
 }
 
 
+static int
+qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
+                   pid_t pid, int tid)
+{
+    int fd = -1;
+    int ret;
+
+    ret = qemuGetProcessInfoFd(cpuTime, lastCpu, vm_rss, &fd, pid, tid);
+
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
+/*
+ * Returns the vcpu private data of @vcpu with the cached /proc files
+ * matching the thread which currently runs it.
+ */
+static qemuDomainVcpuPrivatePtr
+qemuDomainGetVcpuStatFiles(virDomainObjPtr vm,
+                           virDomainVcpuDefPtr vcpu,
+                           pid_t vcpupid)
+{
+    qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+
+    if (vcpupriv->statpid != vm->pid ||
+        vcpupriv->stattid != vcpupid) {
+        qemuDomainVcpuPrivateCloseStatFiles(vcpupriv);
+        vcpupriv->statpid = vm->pid;
+        vcpupriv->stattid = vcpupid;
+    }
+
+    return vcpupriv;
+}
+
+
 static int
 qemuDomainHelperGetVcpus(virDomainObjPtr vm,
                          virVcpuInfoPtr info,
@@ -1490,17 +1530,26 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
         virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, i);
         pid_t vcpupid = qemuDomainGetVcpuPid(vm, i);
         virVcpuInfoPtr vcpuinfo = info + ncpuinfo;
+        qemuDomainVcpuPrivatePtr vcpupriv;
 
         if (!vcpu->online)
             continue;
 
+        vcpupriv = qemuDomainGetVcpuStatFiles(vm, vcpu, vcpupid);
+
         if (info) {
             vcpuinfo->number = i;
             vcpuinfo->state = VIR_VCPU_RUNNING;
 
-            if (qemuGetProcessInfo(&vcpuinfo->cpuTime,
-                                   &vcpuinfo->cpu, NULL,
-                                   vm->pid, vcpupid) < 0) {
+            int tmpfd = -1;
+            int *statfd = qemuDomainVcpuPrivateHoldStatFile(&vcpupriv->statfd,
+                                                            &tmpfd);
+            int rc = qemuGetProcessInfoFd(&vcpuinfo->cpuTime,
+                                          &vcpuinfo->cpu, NULL, statfd,
+                                          vm->pid, vcpupid);
+
+            qemuDomainVcpuPrivateReleaseStatFile(&vcpupriv->statfd, statfd);
+            if (rc < 0) {
                 virReportSystemError(errno, "%s",
                                      _("cannot get vCPU placement & pCPU time"));
                 return -1;
@@ -1519,7 +1568,14 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
         }
 
         if (cpuwait) {
-            if (qemuGetSchedInfo(&(cpuwait[ncpuinfo]), vm->pid, vcpupid) < 0)
+            int tmpfd = -1;
+            int *schedfd = qemuDomainVcpuPrivateHoldStatFile(&vcpupriv->schedfd,
+                                                             &tmpfd);
+            int rc = qemuGetSchedInfo(&(cpuwait[ncpuinfo]), schedfd,
+                                      vm->pid, vcpupid);
+
+            qemuDomainVcpuPrivateReleaseStatFile(&vcpupriv->schedfd, schedfd);
+            if (rc < 0)
                 return -1;
         }
 
@@ -19054,25 +19110,60 @@ qemuConnectGetDomainCapabilities(virConnectPtr conn,
 }
 
 
+/* Host wide data which is gathered once per bulk stats query and then
+ * shared by all the domains instead of being fetched for each of them.
+ * It's read only once created so the stats workers can use it without
+ * any locking. */
+typedef struct _qemuDomainStatsSnapshot qemuDomainStatsSnapshot;
+typedef qemuDomainStatsSnapshot *qemuDomainStatsSnapshotPtr;
+struct _qemuDomainStatsSnapshot {
+    virNetDevTapStatsPtr ifstats;
+};
+
+
+static qemuDomainStatsSnapshotPtr
+qemuDomainStatsSnapshotNew(unsigned int stats)
+{
+    qemuDomainStatsSnapshotPtr snapshot;
+
+    if (VIR_ALLOC(snapshot) < 0)
+        return NULL;
+
+    /* Failing to gather the data in bulk is not fatal, the domains are
+     * then queried one by one */
+    if (stats & VIR_DOMAIN_STATS_INTERFACE &&
+        !(snapshot->ifstats = virNetDevTapStatsNew())) {
+        VIR_WARN("Failed to gather host interface stats: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    return snapshot;
+}
+
+
+static void
+qemuDomainStatsSnapshotFree(qemuDomainStatsSnapshotPtr snapshot)
+{
+    if (!snapshot)
+        return;
+
+    virNetDevTapStatsFree(snapshot->ifstats);
+    VIR_FREE(snapshot);
+}
+
+
 static int
 qemuDomainGetStatsState(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
                         virDomainObjPtr dom,
-                        virDomainStatsRecordPtr record,
-                        int *maxparams,
+                        virTypedParamListPtr params,
+                        qemuDomainStatsSnapshotPtr snapshot ATTRIBUTE_UNUSED,
                         unsigned int privflags ATTRIBUTE_UNUSED)
 {
-    if (virTypedParamsAddInt(&record->params,
-                             &record->nparams,
-                             maxparams,
-                             "state.state",
-                             dom->state.state) < 0)
+    if (virTypedParamListAddInt(params, dom->state.state, "state.state") < 0)
         return -1;
 
-    if (virTypedParamsAddInt(&record->params,
-                             &record->nparams,
-                             maxparams,
-                             "state.reason",
-                             dom->state.reason) < 0)
+    if (virTypedParamListAddInt(params, dom->state.reason, "state.reason") < 0)
         return -1;
 
     return 0;
@@ -19093,8 +19184,8 @@ typedef enum {
 static int
 qemuDomainGetStatsCpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
                       virDomainObjPtr dom,
-                      virDomainStatsRecordPtr record,
-                      int *maxparams,
+                      virTypedParamListPtr params,
+                      qemuDomainStatsSnapshotPtr snapshot ATTRIBUTE_UNUSED,
                       unsigned int privflags ATTRIBUTE_UNUSED)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
@@ -19107,25 +19198,13 @@ qemuDomainGetStatsCpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
         return 0;
 
     err = virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time);
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.time",
-                                        cpu_time) < 0)
+    if (!err && virTypedParamListAddULLong(params, cpu_time, "cpu.time") < 0)
         return -1;
 
     err = virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time);
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.user",
-                                        user_time) < 0)
+    if (!err && virTypedParamListAddULLong(params, user_time, "cpu.user") < 0)
         return -1;
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.system",
-                                        sys_time) < 0)
+    if (!err && virTypedParamListAddULLong(params, sys_time, "cpu.system") < 0)
         return -1;
 
     return 0;
@@ -19134,8 +19213,8 @@ qemuDomainGetStatsCpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 static int
 qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
-                          virDomainStatsRecordPtr record,
-                          int *maxparams,
+                          virTypedParamListPtr params,
+                          qemuDomainStatsSnapshotPtr snapshot ATTRIBUTE_UNUSED,
                           unsigned int privflags)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
@@ -19153,18 +19232,13 @@ qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
         err = -1;
     }
 
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "balloon.current",
-                                        cur_balloon) < 0)
+    if (!err &&
+        virTypedParamListAddULLong(params, cur_balloon, "balloon.current") < 0)
         return -1;
 
-    if (virTypedParamsAddULLong(&record->params,
-                                &record->nparams,
-                                maxparams,
-                                "balloon.maximum",
-                                virDomainDefGetMemoryTotal(dom->def)) < 0)
+    if (virTypedParamListAddULLong(params,
+                                   virDomainDefGetMemoryTotal(dom->def),
+                                   "balloon.maximum") < 0)
         return -1;
 
     if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
@@ -19177,11 +19251,8 @@ qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
 
 #define STORE_MEM_RECORD(TAG, NAME)                                             \
     if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ ##TAG)                          \
-        if (virTypedParamsAddULLong(&record->params,                            \
-                                    &record->nparams,                           \
-                                    maxparams,                                  \
-                                    "balloon." NAME,                            \
-                                    stats[i].val) < 0)                          \
+        if (virTypedParamListAddULLong(params, stats[i].val,                    \
+                                       "balloon." NAME) < 0)                    \
             return -1;
 
     for (i = 0; i < nr_stats; i++) {
@@ -19205,29 +19276,22 @@ qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
                        virDomainObjPtr dom,
-                       virDomainStatsRecordPtr record,
-                       int *maxparams,
+                       virTypedParamListPtr params,
+                       qemuDomainStatsSnapshotPtr snapshot ATTRIBUTE_UNUSED,
                        unsigned int privflags)
 {
     size_t i;
     int ret = -1;
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
     virVcpuInfoPtr cpuinfo = NULL;
     unsigned long long *cpuwait = NULL;
     bool *cpuhalted = NULL;
 
-    if (virTypedParamsAddUInt(&record->params,
-                              &record->nparams,
-                              maxparams,
-                              "vcpu.current",
-                              virDomainDefGetVcpus(dom->def)) < 0)
+    if (virTypedParamListAddUInt(params, virDomainDefGetVcpus(dom->def),
+                                 "vcpu.current") < 0)
         return -1;
 
-    if (virTypedParamsAddUInt(&record->params,
-                              &record->nparams,
-                              maxparams,
-                              "vcpu.maximum",
-                              virDomainDefGetVcpusMax(dom->def)) < 0)
+    if (virTypedParamListAddUInt(params, virDomainDefGetVcpusMax(dom->def),
+                                 "vcpu.maximum") < 0)
         return -1;
 
     if (VIR_ALLOC_N(cpuinfo, virDomainDefGetVcpus(dom->def)) < 0 ||
@@ -19254,44 +19318,25 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
     }
 
     for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.state", cpuinfo[i].number);
-        if (virTypedParamsAddInt(&record->params,
-                                 &record->nparams,
-                                 maxparams,
-                                 param_name,
-                                 cpuinfo[i].state) < 0)
+        if (virTypedParamListAddInt(params, cpuinfo[i].state,
+                                    "vcpu.%u.state", cpuinfo[i].number) < 0)
             goto cleanup;
 
         /* stats below are available only if the VM is alive */
         if (!virDomainObjIsActive(dom))
             continue;
 
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.time", cpuinfo[i].number);
-        if (virTypedParamsAddULLong(&record->params,
-                                    &record->nparams,
-                                    maxparams,
-                                    param_name,
-                                    cpuinfo[i].cpuTime) < 0)
+        if (virTypedParamListAddULLong(params, cpuinfo[i].cpuTime,
+                                       "vcpu.%u.time", cpuinfo[i].number) < 0)
             goto cleanup;
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.wait", cpuinfo[i].number);
-        if (virTypedParamsAddULLong(&record->params,
-                                    &record->nparams,
-                                    maxparams,
-                                    param_name,
-                                    cpuwait[i]) < 0)
+        if (virTypedParamListAddULLong(params, cpuwait[i],
+                                       "vcpu.%u.wait", cpuinfo[i].number) < 0)
             goto cleanup;
 
         if (cpuhalted) {
-            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                     "vcpu.%u.halted", cpuinfo[i].number);
-            if (virTypedParamsAddBoolean(&record->params,
-                                         &record->nparams,
-                                         maxparams,
-                                         param_name,
-                                         cpuhalted[i]) < 0)
+            if (virTypedParamListAddBoolean(params, cpuhalted[i],
+                                            "vcpu.%u.halted",
+                                            cpuinfo[i].number) < 0)
                 goto cleanup;
         }
     }
@@ -19305,59 +19350,65 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
     return ret;
 }
 
-#define QEMU_ADD_COUNT_PARAM(record, maxparams, type, count) \
+#define QEMU_ADD_COUNT_PARAM(params, type, count) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
-    if (virTypedParamsAddUInt(&(record)->params, \
-                              &(record)->nparams, \
-                              maxparams, \
-                              param_name, \
-                              count) < 0) \
+    if (virTypedParamListAddUInt(params, count, "%s.count", type) < 0) \
         goto cleanup; \
 } while (0)
 
-#define QEMU_ADD_NAME_PARAM(record, maxparams, type, subtype, num, name) \
+#define QEMU_ADD_NAME_PARAM(params, type, subtype, num, name) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "%s.%zu.%s", type, num, subtype); \
-    if (virTypedParamsAddString(&(record)->params, \
-                                &(record)->nparams, \
-                                maxparams, \
-                                param_name, \
-                                name) < 0) \
+    if (virTypedParamListAddString(params, name, \
+                                   "%s.%zu.%s", type, num, subtype) < 0) \
         goto cleanup; \
 } while (0)
 
-#define QEMU_ADD_NET_PARAM(record, maxparams, num, name, value) \
+#define QEMU_ADD_NET_PARAM(params, num, name, value) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "net.%zu.%s", num, name); \
-    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
-                                              &(record)->nparams, \
-                                              maxparams, \
-                                              param_name, \
-                                              value) < 0) \
-        return -1; \
+    if (value >= 0 && \
+        virTypedParamListAddULLong(params, value, \
+                                   "net.%zu.%s", num, name) < 0) \
+        goto cleanup; \
 } while (0)
 
 static int
 qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
                             virDomainObjPtr dom,
-                            virDomainStatsRecordPtr record,
-                            int *maxparams,
+                            virTypedParamListPtr params,
+                            qemuDomainStatsSnapshotPtr snapshot,
                             unsigned int privflags ATTRIBUTE_UNUSED)
 {
     size_t i;
     struct _virDomainInterfaceStats tmp;
+    const char **ovsnames = NULL;
+    virDomainInterfaceStatsPtr ovsstats = NULL;
+    size_t novs = 0;
+    size_t ovsidx = 0;
     int ret = -1;
 
     if (!virDomainObjIsActive(dom))
         return 0;
 
-    QEMU_ADD_COUNT_PARAM(record, maxparams, "net", dom->def->nnets);
+    QEMU_ADD_COUNT_PARAM(params, "net", dom->def->nnets);
+
+    /* Fetch the stats of all the vhostuser interfaces, which live in
+     * Open vSwitch, at once */
+    for (i = 0; i < dom->def->nnets; i++) {
+        if (dom->def->nets[i]->ifname &&
+            dom->def->nets[i]->type == VIR_DOMAIN_NET_TYPE_VHOSTUSER &&
+            VIR_APPEND_ELEMENT_COPY(ovsnames, novs,
+                                    dom->def->nets[i]->ifname) < 0)
+            goto cleanup;
+    }
+
+    if (novs > 0) {
+        if (VIR_ALLOC_N(ovsstats, novs) < 0)
+            goto cleanup;
+
+        if (virNetDevOpenvswitchInterfaceStatsList(ovsnames, novs,
+                                                   ovsstats) < 0)
+            goto cleanup;
+    }
 
     /* Check the path is one of the domain's network interfaces. */
     for (i = 0; i < dom->def->nnets; i++) {
@@ -19366,12 +19417,14 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 
         memset(&tmp, 0, sizeof(tmp));
 
-        QEMU_ADD_NAME_PARAM(record, maxparams,
-                            "net", "name", i, dom->def->nets[i]->ifname);
+        QEMU_ADD_NAME_PARAM(params, "net", "name", i,
+                            dom->def->nets[i]->ifname);
 
         if (dom->def->nets[i]->type == VIR_DOMAIN_NET_TYPE_VHOSTUSER) {
-            if (virNetDevOpenvswitchInterfaceStats(dom->def->nets[i]->ifname,
-                                                   &tmp) < 0) {
+            tmp = ovsstats[ovsidx++];
+        } else if (snapshot && snapshot->ifstats) {
+            if (virNetDevTapStatsGet(snapshot->ifstats,
+                                     dom->def->nets[i]->ifname, &tmp) < 0) {
                 virResetLastError();
                 continue;
             }
@@ -19382,68 +19435,53 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
             }
         }
 
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "rx.bytes", tmp.rx_bytes);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "rx.pkts", tmp.rx_packets);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "rx.errs", tmp.rx_errs);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "rx.drop", tmp.rx_drop);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "tx.bytes", tmp.tx_bytes);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "tx.pkts", tmp.tx_packets);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "tx.errs", tmp.tx_errs);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
+        QEMU_ADD_NET_PARAM(params, i,
                            "tx.drop", tmp.tx_drop);
     }
 
     ret = 0;
  cleanup:
+    VIR_FREE(ovsnames);
+    VIR_FREE(ovsstats);
     return ret;
 }
 
 #undef QEMU_ADD_NET_PARAM
 
-#define QEMU_ADD_BLOCK_PARAM_UI(record, maxparams, num, name, value) \
+#define QEMU_ADD_BLOCK_PARAM_UI(params, num, name, value)            \
     do {                                                             \
-        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];               \
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,           \
-                 "block.%zu.%s", num, name);                         \
-        if (virTypedParamsAddUInt(&(record)->params,                 \
-                                  &(record)->nparams,                \
-                                  maxparams,                         \
-                                  param_name,                        \
-                                  value) < 0)                        \
+        if (virTypedParamListAddUInt(params, value,                  \
+                                     "block.%zu.%s", num, name) < 0) \
             goto cleanup;                                            \
     } while (0)
 
 /* expects a LL, but typed parameter must be ULL */
-#define QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, num, name, value) \
+#define QEMU_ADD_BLOCK_PARAM_LL(params, num, name, value) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
-    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
-                                              &(record)->nparams, \
-                                              maxparams, \
-                                              param_name, \
-                                              value) < 0) \
+    if (value >= 0 && \
+        virTypedParamListAddULLong(params, value, \
+                                   "block.%zu.%s", num, name) < 0) \
         goto cleanup; \
 } while (0)
 
-#define QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, num, name, value) \
+#define QEMU_ADD_BLOCK_PARAM_ULL(params, num, name, value) \
 do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
-    if (virTypedParamsAddULLong(&(record)->params, \
-                                &(record)->nparams, \
-                                maxparams, \
-                                param_name, \
-                                value) < 0) \
+    if (virTypedParamListAddULLong(params, value, \
+                                   "block.%zu.%s", num, name) < 0) \
         goto cleanup; \
 } while (0)
 
@@ -19452,8 +19490,7 @@ static int
 qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
                                    virQEMUDriverConfigPtr cfg,
                                    virDomainObjPtr dom,
-                                   virDomainStatsRecordPtr record,
-                                   int *maxparams,
+                                   virTypedParamListPtr params,
                                    virStorageSourcePtr src,
                                    size_t block_idx)
 {
@@ -19468,13 +19505,13 @@ qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
     }
 
     if (src->allocation)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "allocation", src->allocation);
     if (src->capacity)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "capacity", src->capacity);
     if (src->physical)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "physical", src->physical);
     ret = 0;
  cleanup:
@@ -19483,8 +19520,7 @@ qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
 
 
 static int
-qemuDomainGetStatsOneBlockNode(virDomainStatsRecordPtr record,
-                               int *maxparams,
+qemuDomainGetStatsOneBlockNode(virTypedParamListPtr params,
                                virStorageSourcePtr src,
                                size_t block_idx,
                                virHashTablePtr nodedata)
@@ -19497,7 +19533,7 @@ qemuDomainGetStatsOneBlockNode(virDomainStatsRecordPtr record,
         (data = virHashLookup(nodedata, src->nodestorage))) {
         if (virJSONValueObjectGetNumberUlong(data, "write_threshold", &tmp) == 0 &&
             tmp > 0)
-            QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+            QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                      "threshold", tmp);
     }
 
@@ -19512,8 +19548,7 @@ static int
 qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
                            virQEMUDriverConfigPtr cfg,
                            virDomainObjPtr dom,
-                           virDomainStatsRecordPtr record,
-                           int *maxparams,
+                           virTypedParamListPtr params,
                            virDomainDiskDefPtr disk,
                            virStorageSourcePtr src,
                            size_t block_idx,
@@ -19528,20 +19563,19 @@ qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
     if (disk->info.alias)
         alias = qemuDomainStorageAlias(disk->info.alias, backing_idx);
 
-    QEMU_ADD_NAME_PARAM(record, maxparams, "block", "name", block_idx,
-                        disk->dst);
+    QEMU_ADD_NAME_PARAM(params, "block", "name", block_idx, disk->dst);
     if (virStorageSourceIsLocalStorage(src) && src->path)
-        QEMU_ADD_NAME_PARAM(record, maxparams, "block", "path",
+        QEMU_ADD_NAME_PARAM(params, "block", "path",
                             block_idx, src->path);
     if (backing_idx)
-        QEMU_ADD_BLOCK_PARAM_UI(record, maxparams, block_idx, "backingIndex",
+        QEMU_ADD_BLOCK_PARAM_UI(params, block_idx, "backingIndex",
                                 backing_idx);
 
     /* the VM is offline so we have to go and load the stast from the disk by
      * ourselves */
     if (!virDomainObjIsActive(dom)) {
-        ret = qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, record,
-                                                 maxparams, src, block_idx);
+        ret = qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, params,
+                                                 src, block_idx);
         goto cleanup;
     }
 
@@ -19553,42 +19587,42 @@ qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "rd.reqs", entry->rd_req);
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "rd.bytes", entry->rd_bytes);
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "rd.times", entry->rd_total_times);
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "wr.reqs", entry->wr_req);
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "wr.bytes", entry->wr_bytes);
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "wr.times", entry->wr_total_times);
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "fl.reqs", entry->flush_req);
-    QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_LL(params, block_idx,
                             "fl.times", entry->flush_total_times);
 
-    QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+    QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                              "allocation", entry->wr_highest_offset);
 
     if (entry->capacity)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "capacity", entry->capacity);
     if (entry->physical) {
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+        QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                  "physical", entry->physical);
     } else {
         if (qemuDomainStorageUpdatePhysical(driver, cfg, dom, src) == 0) {
-            QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+            QEMU_ADD_BLOCK_PARAM_ULL(params, block_idx,
                                      "physical", src->physical);
         } else {
             virResetLastError();
         }
     }
 
-    if (qemuDomainGetStatsOneBlockNode(record, maxparams, src, block_idx,
+    if (qemuDomainGetStatsOneBlockNode(params, src, block_idx,
                                        nodedata) < 0)
         goto cleanup;
 
@@ -19602,8 +19636,8 @@ qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
                         virDomainObjPtr dom,
-                        virDomainStatsRecordPtr record,
-                        int *maxparams,
+                        virTypedParamListPtr params,
+                        qemuDomainStatsSnapshotPtr snapshot ATTRIBUTE_UNUSED,
                         unsigned int privflags)
 {
     size_t i;
@@ -19622,11 +19656,8 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
 
     if (HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
         qemuDomainObjEnterMonitor(driver, dom);
-        rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats,
-                                             visitBacking);
-        if (rc >= 0)
-            ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
-                                                             visitBacking));
+        rc = qemuMonitorGetAllBlockStatsInfoCapacity(priv->mon, &stats,
+                                                     visitBacking);
 
         if (fetchnodedata)
             nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
@@ -19646,8 +19677,8 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
     /* When listing backing chains, it's easier to fix up the count
      * after the iteration than it is to iterate twice; but we still
      * want count listed first.  */
-    count_index = record->nparams;
-    QEMU_ADD_COUNT_PARAM(record, maxparams, "block", 0);
+    count_index = params->npar;
+    QEMU_ADD_COUNT_PARAM(params, "block", 0);
 
     for (i = 0; i < dom->def->ndisks; i++) {
         virDomainDiskDefPtr disk = dom->def->disks[i];
@@ -19655,7 +19686,7 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
         unsigned int backing_idx = 0;
 
         while (src && (backing_idx == 0 || visitBacking)) {
-            if (qemuDomainGetStatsOneBlock(driver, cfg, dom, record, maxparams,
+            if (qemuDomainGetStatsOneBlock(driver, cfg, dom, params,
                                            disk, src, visited, backing_idx,
                                            stats, nodestats) < 0)
                 goto cleanup;
@@ -19665,7 +19696,7 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
         }
     }
 
-    record->params[count_index].value.ui = visited;
+    params->par[count_index].value.ui = visited;
     ret = 0;
 
  cleanup:
@@ -19687,23 +19718,15 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
 static int
 qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
                                virPerfEventType type,
-                               virDomainStatsRecordPtr record,
-                               int *maxparams)
+                               virTypedParamListPtr params)
 {
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
     uint64_t value = 0;
 
     if (virPerfReadEvent(perf, type, &value) < 0)
         return -1;
 
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "perf.%s",
-             virPerfEventTypeToString(type));
-
-    if (virTypedParamsAddULLong(&record->params,
-                                &record->nparams,
-                                maxparams,
-                                param_name,
-                                value) < 0)
+    if (virTypedParamListAddULLong(params, value, "perf.%s",
+                                   virPerfEventTypeToString(type)) < 0)
         return -1;
 
     return 0;
@@ -19712,8 +19735,8 @@ qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
 static int
 qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
                        virDomainObjPtr dom,
-                       virDomainStatsRecordPtr record,
-                       int *maxparams,
+                       virTypedParamListPtr params,
+                       qemuDomainStatsSnapshotPtr snapshot ATTRIBUTE_UNUSED,
                        unsigned int privflags ATTRIBUTE_UNUSED)
 {
     size_t i;
@@ -19724,8 +19747,7 @@ qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
         if (!virPerfEventIsEnabled(priv->perf, i))
              continue;
 
-        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i,
-                                           record, maxparams) < 0)
+        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i, params) < 0)
             goto cleanup;
     }
 
@@ -19738,8 +19760,8 @@ qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 typedef int
 (*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
-                          virDomainStatsRecordPtr record,
-                          int *maxparams,
+                          virTypedParamListPtr params,
+                          qemuDomainStatsSnapshotPtr snapshot,
                           unsigned int flags);
 
 struct qemuDomainGetStatsWorker {
@@ -19802,40 +19824,99 @@ qemuDomainGetStatsNeedMonitor(unsigned int stats)
 }
 
 
+/*
+ * Returns an upper bound of the number of typed parameters the workers
+ * selected by @stats report for @dom, so that the parameter array of the
+ * record can be allocated at once rather than grown field by field.
+ */
+static size_t
+qemuDomainGetStatsParamsHint(virDomainObjPtr dom,
+                             unsigned int stats,
+                             unsigned int privflags)
+{
+    virStorageSourcePtr src;
+    size_t hint = 0;
+    size_t i;
+
+    if (stats & VIR_DOMAIN_STATS_STATE)
+        hint += 2;
+
+    if (stats & VIR_DOMAIN_STATS_CPU_TOTAL)
+        hint += 3;
+
+    if (stats & VIR_DOMAIN_STATS_BALLOON)
+        hint += 2 + VIR_DOMAIN_MEMORY_STAT_NR;
+
+    /* current, maximum and state, time, wait, halted per vCPU */
+    if (stats & VIR_DOMAIN_STATS_VCPU)
+        hint += 2 + 4 * virDomainDefGetVcpus(dom->def);
+
+    /* count and name plus eight counters per interface */
+    if (stats & VIR_DOMAIN_STATS_INTERFACE)
+        hint += 1 + 9 * dom->def->nnets;
+
+    /* count and up to 16 fields per disk or backing chain element */
+    if (stats & VIR_DOMAIN_STATS_BLOCK) {
+        hint += 1;
+        for (i = 0; i < dom->def->ndisks; i++) {
+            for (src = dom->def->disks[i]->src; src; src = src->backingStore) {
+                hint += 16;
+                if (!(privflags & QEMU_DOMAIN_STATS_BACKING))
+                    break;
+            }
+        }
+    }
+
+    if (stats & VIR_DOMAIN_STATS_PERF)
+        hint += VIR_PERF_EVENT_LAST;
+
+    return hint;
+}
+
+
 static int
 qemuDomainGetStats(virConnectPtr conn,
                    virDomainObjPtr dom,
                    unsigned int stats,
+                   qemuDomainStatsSnapshotPtr snapshot,
                    virDomainStatsRecordPtr *record,
                    unsigned int flags)
 {
-    int maxparams = 0;
-    virDomainStatsRecordPtr tmp;
+    virTypedParamList params = { 0 };
+    virDomainStatsRecordPtr tmp = NULL;
     size_t i;
     int ret = -1;
 
-    if (VIR_ALLOC(tmp) < 0)
+    if (virTypedParamListReserve(&params,
+                                 qemuDomainGetStatsParamsHint(dom, stats,
+                                                              flags)) < 0)
         goto cleanup;
 
     for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
         if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, tmp,
-                                                  &maxparams, flags) < 0)
+            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom,
+                                                  &params, snapshot,
+                                                  flags) < 0)
                 goto cleanup;
         }
     }
 
+    if (VIR_ALLOC(tmp) < 0)
+        goto cleanup;
+
     if (!(tmp->dom = virGetDomain(conn, dom->def->name,
                                   dom->def->uuid, dom->def->id)))
         goto cleanup;
 
+    tmp->nparams = virTypedParamListStealParams(&params, &tmp->params);
     *record = tmp;
     tmp = NULL;
     ret = 0;
 
  cleanup:
+    virTypedParamListClear(&params);
     if (tmp) {
-        virTypedParamsFree(tmp->params, tmp->nparams);
+        virObjectUnref(tmp->dom);
         VIR_FREE(tmp);
     }
 
@@ -19843,6 +19924,195 @@ qemuDomainGetStats(virConnectPtr conn,
 }
 
 
+/*
+ * Collects the stats record of a single domain. @vm must be referenced
+ * but unlocked. @record is set to NULL if there's nothing to report.
+ */
+static int
+qemuConnectGetAllDomainStatsOne(virConnectPtr conn,
+                                virDomainObjPtr vm,
+                                unsigned int stats,
+                                qemuDomainStatsSnapshotPtr snapshot,
+                                unsigned int privflags,
+                                unsigned int flags,
+                                virDomainStatsRecordPtr *record)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    unsigned int domflags = 0;
+    int ret;
+
+    *record = NULL;
+
+    virObjectLock(vm);
+
+    if (HAVE_JOB(privflags) &&
+        qemuDomainObjBeginJobWithTimeout(driver, vm, QEMU_JOB_QUERY,
+                                         cfg->statsJobWaitTime) == 0)
+        domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    /* else: without a job it's still possible to gather some data */
+
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    ret = qemuDomainGetStats(conn, vm, stats, snapshot, record, domflags);
+
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(driver, vm);
+
+    virObjectUnlock(vm);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+typedef struct _qemuConnectGetAllDomainStatsData qemuConnectGetAllDomainStatsData;
+typedef qemuConnectGetAllDomainStatsData *qemuConnectGetAllDomainStatsDataPtr;
+struct _qemuConnectGetAllDomainStatsData {
+    virMutex lock;
+    virCond cond;
+
+    virConnectPtr conn;
+    unsigned int stats;
+    qemuDomainStatsSnapshotPtr snapshot;
+    unsigned int privflags;
+    unsigned int flags;
+
+    virDomainObjPtr *vms;
+    /* indexed the same way as @vms so that the original order is kept */
+    virDomainStatsRecordPtr *records;
+
+    size_t pending; /* number of jobs not finished yet */
+    virErrorPtr error; /* first error reported by any of the jobs */
+};
+
+typedef struct _qemuConnectGetAllDomainStatsJob qemuConnectGetAllDomainStatsJob;
+typedef qemuConnectGetAllDomainStatsJob *qemuConnectGetAllDomainStatsJobPtr;
+struct _qemuConnectGetAllDomainStatsJob {
+    qemuConnectGetAllDomainStatsDataPtr data;
+    size_t idx;
+};
+
+
+static void
+qemuConnectGetAllDomainStatsWorker(void *opaque,
+                                   void *privdata ATTRIBUTE_UNUSED)
+{
+    qemuConnectGetAllDomainStatsJobPtr job = opaque;
+    qemuConnectGetAllDomainStatsDataPtr data = job->data;
+    virDomainStatsRecordPtr record = NULL;
+    virErrorPtr err = NULL;
+    bool skip;
+
+    virMutexLock(&data->lock);
+    skip = !!data->error;
+    virMutexUnlock(&data->lock);
+
+    /* don't bother collecting anything if the call is going to fail anyway */
+    if (!skip &&
+        qemuConnectGetAllDomainStatsOne(data->conn, data->vms[job->idx],
+                                        data->stats, data->snapshot,
+                                        data->privflags, data->flags,
+                                        &record) < 0)
+        err = virSaveLastError();
+
+    virMutexLock(&data->lock);
+    data->records[job->idx] = record;
+    if (err && !data->error) {
+        data->error = err;
+        err = NULL;
+    }
+    data->pending--;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+
+    virFreeError(err);
+    VIR_FREE(job);
+}
+
+
+/*
+ * Distributes the per-domain work among the workers of @pool and waits
+ * for all of them to finish. The records are stored into @records in the
+ * same order as @vms.
+ */
+static int
+qemuConnectGetAllDomainStatsParallel(virConnectPtr conn,
+                                     virThreadPoolPtr pool,
+                                     virDomainObjPtr *vms,
+                                     size_t nvms,
+                                     unsigned int stats,
+                                     qemuDomainStatsSnapshotPtr snapshot,
+                                     unsigned int privflags,
+                                     unsigned int flags,
+                                     virDomainStatsRecordPtr *records)
+{
+    qemuConnectGetAllDomainStatsData data;
+    qemuConnectGetAllDomainStatsJobPtr job = NULL;
+    size_t i;
+    int ret = -1;
+
+    memset(&data, 0, sizeof(data));
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        return -1;
+    }
+
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    data.conn = conn;
+    data.stats = stats;
+    data.snapshot = snapshot;
+    data.privflags = privflags;
+    data.flags = flags;
+    data.vms = vms;
+    data.records = records;
+
+    virMutexLock(&data.lock);
+
+    for (i = 0; i < nvms; i++) {
+        if (VIR_ALLOC(job) < 0)
+            break;
+
+        job->data = &data;
+        job->idx = i;
+
+        if (virThreadPoolSendJob(pool, 0, job) < 0) {
+            VIR_FREE(job);
+            break;
+        }
+
+        data.pending++;
+    }
+
+    if (i == nvms)
+        ret = 0;
+
+    /* Even on failure we have to wait for the jobs which were already
+     * submitted as they reference @data */
+    while (data.pending > 0)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+
+    virMutexUnlock(&data.lock);
+
+    if (data.error) {
+        virSetError(data.error);
+        virFreeError(data.error);
+        ret = -1;
+    }
+
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
 static int
 qemuConnectGetAllDomainStats(virConnectPtr conn,
                              virDomainPtr *doms,
@@ -19853,15 +20123,14 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 {
     virQEMUDriverPtr driver = conn->privateData;
     virDomainObjPtr *vms = NULL;
-    virDomainObjPtr vm;
     size_t nvms;
     virDomainStatsRecordPtr *tmpstats = NULL;
+    qemuDomainStatsSnapshotPtr snapshot = NULL;
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
     int nstats = 0;
     size_t i;
     int ret = -1;
     unsigned int privflags = 0;
-    unsigned int domflags = 0;
     unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
@@ -19891,40 +20160,43 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     }
 
     if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
-        return -1;
+        goto cleanup;
 
     if (qemuDomainGetStatsNeedMonitor(stats))
         privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-    for (i = 0; i < nvms; i++) {
-        virDomainStatsRecordPtr tmp = NULL;
-        domflags = 0;
-        vm = vms[i];
-
-        virObjectLock(vm);
-
-        if (HAVE_JOB(privflags) &&
-            qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) == 0)
-            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        /* else: without a job it's still possible to gather some data */
+    if (nvms > 1 &&
+        !(snapshot = qemuDomainStatsSnapshotNew(stats)))
+        goto cleanup;
 
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
-            if (HAVE_JOB(domflags) && vm)
-                qemuDomainObjEndJob(driver, vm);
+    if (driver->statsPool && nvms > 1) {
+        int rc = qemuConnectGetAllDomainStatsParallel(conn, driver->statsPool,
+                                                      vms, nvms, stats,
+                                                      snapshot, privflags,
+                                                      flags, tmpstats);
 
-            virObjectUnlock(vm);
-            goto cleanup;
+        /* squash the domains which had nothing to report so that the
+         * list is NULL terminated */
+        for (i = 0; i < nvms; i++) {
+            if (tmpstats[i])
+                tmpstats[nstats++] = tmpstats[i];
         }
+        for (i = nstats; i < nvms; i++)
+            tmpstats[i] = NULL;
 
-        if (tmp)
-            tmpstats[nstats++] = tmp;
+        if (rc < 0)
+            goto cleanup;
+    } else {
+        for (i = 0; i < nvms; i++) {
+            virDomainStatsRecordPtr tmp = NULL;
 
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(driver, vm);
+            if (qemuConnectGetAllDomainStatsOne(conn, vms[i], stats, snapshot,
+                                                privflags, flags, &tmp) < 0)
+                goto cleanup;
 
-        virObjectUnlock(vm);
+            if (tmp)
+                tmpstats[nstats++] = tmp;
+        }
     }
 
     *retStats = tmpstats;
@@ -19934,6 +20206,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 
  cleanup:
     virDomainStatsRecordListFree(tmpstats);
+    qemuDomainStatsSnapshotFree(snapshot);
     virObjectListFreeCount(vms, nvms);
 
     return ret;
@@ -42,6 +42,7 @@
 #include "virobject.h"
 #include "virprobe.h"
 #include "virstring.h"
+#include "virreadbuffer.h"
 #include "virtime.h"
 
 #ifdef WITH_DTRACE_PROBES
@@ -55,6 +56,13 @@ VIR_LOG_INIT("qemu.qemu_monitor");
 #define DEBUG_IO 0
 #define DEBUG_RAW_IO 0
 
+/* Maximum number of bytes read from the monitor in a single wakeup, so
+ * that a chatty peer cannot hold up the event loop */
+#define QEMU_MONITOR_READ_MAX (1024 * 1024)
+
+/* Maximum size of a message received from the monitor */
+#define QEMU_MONITOR_BUFFER_MAX (64 * 1024 * 1024)
+
 struct _qemuMonitor {
     virObjectLockable parent;
 
@@ -82,9 +90,9 @@ struct _qemuMonitor {
 
     /* Buffer incoming data ready for Text/QMP monitor
      * code to process & find message boundaries */
-    size_t bufferOffset;
-    size_t bufferLength;
-    char *buffer;
+    virReadBuffer buffer;
+    /* Incremental parser state of the QMP monitor */
+    virJSONStreamParserPtr jsonStream;
 
     /* If anything went wrong, this will be fed back
      * the next monitor msg */
@@ -327,7 +335,8 @@ qemuMonitorDispose(void *obj)
 
     virResetError(&mon->lastError);
     virCondDestroy(&mon->notify);
-    VIR_FREE(mon->buffer);
+    virReadBufferFree(&mon->buffer);
+    virJSONStreamParserFree(mon->jsonStream);
     virJSONValueFree(mon->options);
     VIR_FREE(mon->balloonpath);
 }
@@ -407,6 +416,42 @@ qemuMonitorOpenPty(const char *monitor)
 }
 
 
+/* Returns the first queued message which still has data to
+ * transmit, or NULL if everything was written already. */
+static qemuMonitorMessagePtr
+qemuMonitorNextTxMessage(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+
+    for (msg = mon->msg; msg; msg = msg->next) {
+        if (msg->txOffset < msg->txLength)
+            return msg;
+    }
+
+    return NULL;
+}
+
+
+/* Marks all queued messages as finished and wakes up their sender.
+ * Used when a fatal error occurred on the monitor channel. */
+static void
+qemuMonitorFinishMessages(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+    bool notify = false;
+
+    for (msg = mon->msg; msg; msg = msg->next) {
+        if (!msg->finished) {
+            msg->finished = 1;
+            notify = true;
+        }
+    }
+
+    if (notify)
+        virCondBroadcast(&mon->notify);
+}
+
+
 /* This method processes data that has been received
  * from the monitor. Looking for async events and
  * replies/errors.
@@ -416,6 +461,8 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
 {
     int len;
     qemuMonitorMessagePtr msg = NULL;
+    qemuMonitorMessagePtr tmp;
+    bool complete;
 
     /* See if there's a message & whether its ready for its reply
      * ie whether its completed writing all its data */
@@ -425,45 +472,47 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
 #if DEBUG_IO
 # if DEBUG_RAW_IO
     char *str1 = qemuMonitorEscapeNonPrintable(msg ? msg->txBuffer : "");
-    char *str2 = qemuMonitorEscapeNonPrintable(mon->buffer);
-    VIR_ERROR(_("Process %d %p %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, mon->msg, msg, str1, str2);
+    char *str2 = qemuMonitorEscapeNonPrintable(mon->buffer.data);
+    VIR_ERROR(_("Process %d %p %p [[[[%s]]][[[%s]]]"), (int)mon->buffer.used, mon->msg, msg, str1, str2);
     VIR_FREE(str1);
     VIR_FREE(str2);
 # else
-    VIR_DEBUG("Process %d", (int)mon->bufferOffset);
+    VIR_DEBUG("Process %d", (int)mon->buffer.used);
 # endif
 #endif
 
     PROBE(QEMU_MONITOR_IO_PROCESS,
-          "mon=%p buf=%s len=%zu", mon, mon->buffer, mon->bufferOffset);
+          "mon=%p buf=%s len=%zu", mon, mon->buffer.data, mon->buffer.used);
 
-    if (mon->json)
-        len = qemuMonitorJSONIOProcess(mon,
-                                       mon->buffer, mon->bufferOffset,
-                                       msg);
-    else
+    if (mon->json) {
+        len = qemuMonitorJSONIOProcess(mon, &mon->jsonStream,
+                                       mon->buffer.data, mon->buffer.used,
+                                       msg, &complete);
+    } else {
         len = qemuMonitorTextIOProcess(mon,
-                                       mon->buffer, mon->bufferOffset,
+                                       mon->buffer.data, mon->buffer.used,
                                        msg);
+        complete = len > 0;
+    }
 
     if (len < 0)
         return -1;
 
-    if (len && mon->waitGreeting)
+    if (complete && mon->waitGreeting)
         mon->waitGreeting = false;
 
-    if (len < mon->bufferOffset) {
-        memmove(mon->buffer, mon->buffer + len, mon->bufferOffset - len);
-        mon->bufferOffset -= len;
-    } else {
-        VIR_FREE(mon->buffer);
-        mon->bufferOffset = mon->bufferLength = 0;
-    }
+    virReadBufferConsume(&mon->buffer, len);
 #if DEBUG_IO
-    VIR_DEBUG("Process done %d used %d", (int)mon->bufferOffset, len);
+    VIR_DEBUG("Process done %d used %d", (int)mon->buffer.used, len);
 #endif
-    if (msg && msg->finished)
-        virCondBroadcast(&mon->notify);
+    /* With a pipelined batch any of the queued messages may have
+     * received its reply; the sender waits for all of them */
+    for (tmp = msg; tmp; tmp = tmp->next) {
+        if (tmp->finished) {
+            virCondBroadcast(&mon->notify);
+            break;
+        }
+    }
     return len;
 }
 
@@ -520,32 +569,33 @@ qemuMonitorIOWrite(qemuMonitorPtr mon)
     int done;
     char *buf;
     size_t len;
+    qemuMonitorMessagePtr msg;
 
-    /* If no active message, or fully transmitted, the no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
+    /* If no active message, or all fully transmitted, the no-op */
+    if (!(msg = qemuMonitorNextTxMessage(mon)))
         return 0;
 
-    if (mon->msg->txFD != -1 && !mon->hasSendFD) {
+    if (msg->txFD != -1 && !mon->hasSendFD) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Monitor does not support sending of file descriptors"));
         return -1;
     }
 
-    buf = mon->msg->txBuffer + mon->msg->txOffset;
-    len = mon->msg->txLength - mon->msg->txOffset;
-    if (mon->msg->txFD == -1)
+    buf = msg->txBuffer + msg->txOffset;
+    len = msg->txLength - msg->txOffset;
+    if (msg->txFD == -1)
         done = write(mon->fd, buf, len);
     else
-        done = qemuMonitorIOWriteWithFD(mon, buf, len, mon->msg->txFD);
+        done = qemuMonitorIOWriteWithFD(mon, buf, len, msg->txFD);
 
     PROBE(QEMU_MONITOR_IO_WRITE,
           "mon=%p buf=%s len=%zu ret=%d errno=%d",
           mon, buf, len, done, done < 0 ? errno : 0);
 
-    if (mon->msg->txFD != -1) {
+    if (msg->txFD != -1) {
         PROBE(QEMU_MONITOR_IO_SEND_FD,
               "mon=%p fd=%d ret=%d errno=%d",
-              mon, mon->msg->txFD, done, done < 0 ? errno : 0);
+              mon, msg->txFD, done, done < 0 ? errno : 0);
     }
 
     if (done < 0) {
@@ -556,7 +606,7 @@ qemuMonitorIOWrite(qemuMonitorPtr mon)
                              _("Unable to write to monitor"));
         return -1;
     }
-    mon->msg->txOffset += done;
+    msg->txOffset += done;
     return done;
 }
 
@@ -570,24 +620,28 @@ qemuMonitorIOWrite(qemuMonitorPtr mon)
 static int
 qemuMonitorIORead(qemuMonitorPtr mon)
 {
-    size_t avail = mon->bufferLength - mon->bufferOffset;
     int ret = 0;
 
-    if (avail < 1024) {
-        if (VIR_REALLOC_N(mon->buffer,
-                          mon->bufferLength + 1024) < 0)
+    /* Read as much as we can get into our buffer, until we block
+       on EAGAIN, hit EOF or read QEMU_MONITOR_READ_MAX bytes */
+    while (ret < QEMU_MONITOR_READ_MAX) {
+        char *data;
+        size_t avail;
+        int got;
+
+        if (mon->buffer.used >= QEMU_MONITOR_BUFFER_MAX) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("QEMU monitor reply exceeds maximum size of %d bytes"),
+                           QEMU_MONITOR_BUFFER_MAX);
             return -1;
-        mon->bufferLength += 1024;
-        avail += 1024;
-    }
+        }
 
-    /* Read as much as we can get into our buffer,
-       until we block on EAGAIN, or hit EOF */
-    while (avail > 1) {
-        int got;
-        got = read(mon->fd,
-                   mon->buffer + mon->bufferOffset,
-                   avail - 1);
+        if (virReadBufferReserve(&mon->buffer, 1024) < 0)
+            return -1;
+
+        data = virReadBufferTail(&mon->buffer, &avail);
+        avail = MIN(avail, QEMU_MONITOR_READ_MAX - ret);
+        got = read(mon->fd, data, avail);
         if (got < 0) {
             if (errno == EAGAIN)
                 break;
@@ -600,13 +654,11 @@ qemuMonitorIORead(qemuMonitorPtr mon)
             break;
 
         ret += got;
-        avail -= got;
-        mon->bufferOffset += got;
-        mon->buffer[mon->bufferOffset] = '\0';
+        virReadBufferAdvance(&mon->buffer, got);
     }
 
 #if DEBUG_IO
-    VIR_DEBUG("Now read %d bytes of data", (int)mon->bufferOffset);
+    VIR_DEBUG("Now read %d bytes of data", (int)mon->buffer.used);
 #endif
 
     return ret;
@@ -626,7 +678,7 @@ qemuMonitorUpdateWatch(qemuMonitorPtr mon)
     if (mon->lastError.code == VIR_ERR_OK) {
         events |= VIR_EVENT_HANDLE_READABLE;
 
-        if ((mon->msg && mon->msg->txOffset < mon->msg->txLength) &&
+        if (qemuMonitorNextTxMessage(mon) &&
             !mon->waitGreeting)
             events |= VIR_EVENT_HANDLE_WRITABLE;
     }
@@ -752,12 +804,9 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         }
 
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
-        /* If IO process resulted in an error & we have a message,
-         * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
-        }
+        /* If IO process resulted in an error & we have messages,
+         * then wakeup their waiter */
+        qemuMonitorFinishMessages(mon);
     }
 
     qemuMonitorUpdateWatch(mon);
@@ -770,7 +819,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering EOF callback");
         (eofNotify)(mon, vm, mon->callbackOpaque);
@@ -780,7 +829,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering error callback");
         (errorNotify)(mon, vm, mon->callbackOpaque);
@@ -1016,8 +1065,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
                 virResetLastError();
             }
         }
-        mon->msg->finished = 1;
-        virCondSignal(&mon->notify);
+        qemuMonitorFinishMessages(mon);
     }
 
     /* Propagate existing monitor error in case the current thread has no
@@ -1041,12 +1089,47 @@ qemuMonitorNextCommandID(qemuMonitorPtr mon)
 }
 
 
+static bool
+qemuMonitorMessagesFinished(qemuMonitorMessagePtr msg)
+{
+    for (; msg; msg = msg->next) {
+        if (!msg->finished)
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * qemuMonitorSend:
+ * @mon: monitor object
+ * @msg: message to send
+ *
+ * Sends @msg to the monitor and waits for its reply. Several messages
+ * can be chained via their @next member; they are then written
+ * back-to-back without waiting for the individual replies, which the
+ * JSON monitor matches by their @id. The call returns once all chained
+ * messages are finished.
+ *
+ * Returns 0 on success, -1 on error.
+ */
 int
 qemuMonitorSend(qemuMonitorPtr mon,
                 qemuMonitorMessagePtr msg)
 {
     int ret = -1;
 
+    /* Threads sharing a query job may use the monitor at the same
+     * time, wait until the message of the other one is processed */
+    while (mon->msg) {
+        if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to wait on monitor condition"));
+            return -1;
+        }
+    }
+
     /* Check whether qemu quit unexpectedly */
     if (mon->lastError.code != VIR_ERR_OK) {
         VIR_DEBUG("Attempt to send command while error is set %s",
@@ -1062,7 +1145,7 @@ qemuMonitorSend(qemuMonitorPtr mon,
           "mon=%p msg=%s fd=%d",
           mon, mon->msg->txBuffer, mon->msg->txFD);
 
-    while (!mon->msg->finished) {
+    while (!qemuMonitorMessagesFinished(mon->msg)) {
         if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to wait on monitor condition"));
@@ -1082,6 +1165,7 @@ qemuMonitorSend(qemuMonitorPtr mon,
  cleanup:
     mon->msg = NULL;
     qemuMonitorUpdateWatch(mon);
+    virCondBroadcast(&mon->notify);
 
     return ret;
 }
@@ -2321,6 +2405,44 @@ qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorGetAllBlockStatsInfoCapacity:
+ * @mon: monitor object
+ * @ret_stats: pointer that is filled with a hash table containing the stats
+ * @backingChain: recurse into the backing chain of devices
+ *
+ * Same as qemuMonitorGetAllBlockStatsInfo, but also fills in the virtual
+ * and physical size of the images. With the JSON monitor both queries are
+ * pipelined. Failure to get the sizes is ignored.
+ *
+ * Returns < 0 on error, count of supported block stats fields on success.
+ */
+int
+qemuMonitorGetAllBlockStatsInfoCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr *ret_stats,
+                                        bool backingChain)
+{
+    int ret = -1;
+    VIR_DEBUG("ret_stats=%p, backing=%d", ret_stats, backingChain);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (!mon->json)
+        return qemuMonitorGetAllBlockStatsInfo(mon, ret_stats, backingChain);
+
+    if (!(*ret_stats = virHashCreate(10, virHashValueFree)))
+        return -1;
+
+    if ((ret = qemuMonitorJSONGetAllBlockStatsInfoCapacity(mon, *ret_stats,
+                                                           backingChain)) < 0) {
+        virHashFree(*ret_stats);
+        *ret_stats = NULL;
+    }
+
+    return ret;
+}
+
+
 int
 qemuMonitorBlockResize(qemuMonitorPtr mon,
                        const char *device,
@@ -42,6 +42,13 @@ typedef qemuMonitor *qemuMonitorPtr;
 typedef struct _qemuMonitorMessage qemuMonitorMessage;
 typedef qemuMonitorMessage *qemuMonitorMessagePtr;
 
+/* Decides whether @key of the reply object nested @depth levels deep
+ * in the "return" value (1 for the keys of the returned object itself,
+ * each object or array adds 1) is kept */
+typedef bool (*qemuMonitorReplyFilter)(const char *key,
+                                       size_t depth,
+                                       void *opaque);
+
 typedef int (*qemuMonitorPasswordHandler)(qemuMonitorPtr mon,
                                           qemuMonitorMessagePtr msg,
                                           const char *data,
@@ -68,6 +75,16 @@ struct _qemuMonitorMessage {
 
     qemuMonitorPasswordHandler passwordHandler;
     void *passwordOpaque;
+
+    /* Used by the JSON monitor to match a reply to its command
+     * when several commands are pipelined */
+    const char *id;
+    /* Next message of a pipelined batch sent by qemuMonitorSend */
+    qemuMonitorMessagePtr next;
+    /* Used by the JSON monitor to drop parts of the reply
+     * the caller is not interested in while it is parsed */
+    qemuMonitorReplyFilter replyFilter;
+    void *replyFilterOpaque;
 };
 
 typedef enum {
@@ -550,6 +567,10 @@ int qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                     bool backingChain)
     ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorGetAllBlockStatsInfoCapacity(qemuMonitorPtr mon,
+                                            virHashTablePtr *ret_stats,
+                                            bool backingChain)
+    ATTRIBUTE_NONNULL(2);
 int qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                         virHashTablePtr stats,
                                         bool backingChain)
@@ -182,22 +182,54 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
     return 0;
 }
 
-int
-qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
-                             const char *line,
-                             qemuMonitorMessagePtr msg)
-{
-    virJSONValuePtr obj = NULL;
-    int ret = -1;
+/* Finds the message @reply belongs to. Replies are matched by the
+ * "id" of their command, falling back to the oldest message which
+ * was fully transmitted and is still waiting for its reply. */
+static qemuMonitorMessagePtr
+qemuMonitorJSONFindReplyMessage(qemuMonitorMessagePtr msg,
+                                virJSONValuePtr reply)
+{
+    const char *id = virJSONValueObjectGetString(reply, "id");
+    qemuMonitorMessagePtr first = NULL;
+
+    for (; msg; msg = msg->next) {
+        if (msg->txOffset < msg->txLength)
+            break;
 
-    VIR_DEBUG("Line [%s]", line);
+        if (msg->finished)
+            continue;
 
-    if (!(obj = virJSONValueFromString(line)))
-        goto cleanup;
+        if (!id)
+            return msg;
+
+        if (!first)
+            first = msg;
+
+        if (STREQ_NULLABLE(msg->id, id))
+            return msg;
+    }
+
+    return first;
+}
+
+/* Dispatches @obj received from the monitor as @line, which is used for
+ * the probes and error messages. @line may be NULL if the value was not
+ * formatted, in which case @obj is formatted for error messages only. */
+static int
+qemuMonitorJSONIOProcessObject(qemuMonitorPtr mon,
+                               virJSONValuePtr obj,
+                               const char *line,
+                               qemuMonitorMessagePtr msg)
+{
+    int ret = -1;
+    char *str = NULL;
 
     if (obj->type != VIR_JSON_TYPE_OBJECT) {
+        if (!line)
+            line = str = virJSONValueToString(obj, false);
         virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Parsed JSON reply '%s' isn't an object"), line);
+                       _("Parsed JSON reply '%s' isn't an object"),
+                       NULLSTR(line));
         goto cleanup;
     }
 
@@ -205,39 +237,201 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
         ret = 0;
     } else if (virJSONValueObjectHasKey(obj, "event") == 1) {
         PROBE(QEMU_MONITOR_RECV_EVENT,
-              "mon=%p event=%s", mon, line);
+              "mon=%p event=%s", mon, NULLSTR(line));
         ret = qemuMonitorJSONIOProcessEvent(mon, obj);
     } else if (virJSONValueObjectHasKey(obj, "error") == 1 ||
                virJSONValueObjectHasKey(obj, "return") == 1) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
-              "mon=%p reply=%s", mon, line);
-        if (msg) {
+              "mon=%p reply=%s", mon, NULLSTR(line));
+        if ((msg = qemuMonitorJSONFindReplyMessage(msg, obj))) {
             msg->rxObject = obj;
             msg->finished = 1;
             obj = NULL;
             ret = 0;
         } else {
+            if (!line)
+                line = str = virJSONValueToString(obj, false);
             virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Unexpected JSON reply '%s'"), line);
+                           _("Unexpected JSON reply '%s'"), NULLSTR(line));
         }
     } else {
+        if (!line)
+            line = str = virJSONValueToString(obj, false);
         virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unknown JSON reply '%s'"), line);
+                       _("Unknown JSON reply '%s'"), NULLSTR(line));
     }
 
  cleanup:
+    VIR_FREE(str);
     virJSONValueFree(obj);
     return ret;
 }
 
+
+/**
+ * qemuMonitorJSONIOProcessValue:
+ * @mon: monitor object
+ * @obj: value received from the monitor
+ * @msg: queue of messages sent to the monitor
+ *
+ * Dispatches a complete value received from the monitor: events are passed
+ * to their handlers, replies are attached to the message they belong to.
+ * The value is formatted back for the debug log and the probes only if
+ * either of them is enabled. Takes ownership of @obj.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMonitorJSONIOProcessValue(qemuMonitorPtr mon,
+                              virJSONValuePtr obj,
+                              qemuMonitorMessagePtr msg)
+{
+    char *line = NULL;
+    int ret;
+
+    if (virLogSourceEnabled(&virLogSelf, VIR_LOG_DEBUG) ||
+        PROBE_ENABLED(QEMU_MONITOR_RECV_EVENT) ||
+        PROBE_ENABLED(QEMU_MONITOR_RECV_REPLY)) {
+        line = virJSONValueToString(obj, false);
+        VIR_DEBUG("Line [%s]", NULLSTR(line));
+    }
+
+    ret = qemuMonitorJSONIOProcessObject(mon, obj, line, msg);
+    VIR_FREE(line);
+    return ret;
+}
+
+
+int
+qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
+                             const char *line,
+                             qemuMonitorMessagePtr msg)
+{
+    virJSONValuePtr obj = NULL;
+
+    VIR_DEBUG("Line [%s]", line);
+
+    if (!(obj = virJSONValueFromString(line)))
+        return -1;
+
+    return qemuMonitorJSONIOProcessObject(mon, obj, line, msg);
+}
+
+
+#ifdef WITH_YAJL2
+typedef struct _qemuMonitorJSONStreamData qemuMonitorJSONStreamData;
+typedef qemuMonitorJSONStreamData *qemuMonitorJSONStreamDataPtr;
+struct _qemuMonitorJSONStreamData {
+    qemuMonitorPtr mon;
+    qemuMonitorMessagePtr msg;
+    size_t nvalues;
+};
+
+
+static int
+qemuMonitorJSONStreamValue(virJSONValuePtr value,
+                           void *opaque)
+{
+    qemuMonitorJSONStreamDataPtr data = opaque;
+
+    data->nvalues++;
+    return qemuMonitorJSONIOProcessValue(data->mon, value, data->msg);
+}
+
+
+/* Finds the filter for the "return" member of a reply being parsed. The
+ * reply is matched to its command by "id" if it precedes "return" in
+ * @reply, otherwise a filter is used only if all the commands which may
+ * be waiting for the reply share it. */
+static bool
+qemuMonitorJSONStreamFilter(virJSONValuePtr reply,
+                            const char *member,
+                            const char *key,
+                            size_t depth,
+                            void *opaque)
+{
+    qemuMonitorJSONStreamDataPtr data = opaque;
+    qemuMonitorMessagePtr found = NULL;
+    qemuMonitorMessagePtr msg;
+    const char *id;
+
+    /* only the "return" value of replies is subject to filtering */
+    if (!member || STRNEQ(member, "return"))
+        return true;
+
+    id = virJSONValueObjectGetString(reply, "id");
+
+    for (msg = data->msg; msg; msg = msg->next) {
+        if (msg->txOffset < msg->txLength)
+            break;
+
+        if (msg->finished)
+            continue;
+
+        if (id) {
+            if (STREQ_NULLABLE(msg->id, id)) {
+                found = msg;
+                break;
+            }
+            continue;
+        }
+
+        if (!found) {
+            found = msg;
+        } else if (found->replyFilter != msg->replyFilter ||
+                   found->replyFilterOpaque != msg->replyFilterOpaque) {
+            return true;
+        }
+    }
+
+    if (!found || !found->replyFilter)
+        return true;
+
+    return found->replyFilter(key, depth - 1, found->replyFilterOpaque);
+}
+#endif /* WITH_YAJL2 */
+
+
+/**
+ * qemuMonitorJSONIOProcess:
+ * @mon: monitor object
+ * @stream: incremental parser state
+ * @data: data received from the monitor
+ * @len: length of @data
+ * @msg: queue of messages sent to the monitor
+ * @complete: set to true if at least one complete value was processed
+ *
+ * With yajl 2 the data is fed to the incremental parser stored in @stream
+ * (created on first use) and all of it is consumed, values split across
+ * several reads are completed once the rest arrives. Otherwise only
+ * complete lines are processed.
+ *
+ * Returns the number of bytes consumed or -1 on error.
+ */
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
+                             virJSONStreamParserPtr *stream ATTRIBUTE_UNUSED,
                              const char *data,
                              size_t len,
-                             qemuMonitorMessagePtr msg)
+                             qemuMonitorMessagePtr msg,
+                             bool *complete)
 {
     int used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
 
+#ifdef WITH_YAJL2
+    qemuMonitorJSONStreamData streamData = { mon, msg, 0 };
+
+    if (!*stream &&
+        !(*stream = virJSONStreamParserNew(qemuMonitorJSONStreamValue,
+                                           qemuMonitorJSONStreamFilter)))
+        return -1;
+
+    if (virJSONStreamParserFeed(*stream, data, len, &streamData) < 0)
+        return -1;
+
+    used = len;
+    *complete = streamData.nvalues > 0;
+#else
     while (used < len) {
         char *nl = strstr(data + used, LINE_ENDING);
 
@@ -259,29 +453,30 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
         }
     }
 
+    *complete = used > 0;
+#endif
+
     VIR_DEBUG("Total used %d bytes out of %zd available in buffer", used, len);
     return used;
 }
 
 static int
-qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
-                             virJSONValuePtr cmd,
-                             int scm_fd,
-                             virJSONValuePtr *reply)
+qemuMonitorJSONPrepareMessage(qemuMonitorPtr mon,
+                              virJSONValuePtr cmd,
+                              int scm_fd,
+                              qemuMonitorMessagePtr msg,
+                              char **id)
 {
     int ret = -1;
-    qemuMonitorMessage msg;
     char *cmdstr = NULL;
-    char *id = NULL;
 
-    *reply = NULL;
-
-    memset(&msg, 0, sizeof(msg));
+    memset(msg, 0, sizeof(*msg));
+    *id = NULL;
 
     if (virJSONValueObjectHasKey(cmd, "execute") == 1) {
-        if (!(id = qemuMonitorNextCommandID(mon)))
+        if (!(*id = qemuMonitorNextCommandID(mon)))
             goto cleanup;
-        if (virJSONValueObjectAppendString(cmd, "id", id) < 0) {
+        if (virJSONValueObjectAppendString(cmd, "id", *id) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to append command 'id' string"));
             goto cleanup;
@@ -290,13 +485,42 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
 
     if (!(cmdstr = virJSONValueToString(cmd, false)))
         goto cleanup;
-    if (virAsprintf(&msg.txBuffer, "%s\r\n", cmdstr) < 0)
+    if (virAsprintf(&msg->txBuffer, "%s\r\n", cmdstr) < 0)
         goto cleanup;
-    msg.txLength = strlen(msg.txBuffer);
-    msg.txFD = scm_fd;
+    msg->txLength = strlen(msg->txBuffer);
+    msg->txFD = scm_fd;
+    msg->id = *id;
 
     VIR_DEBUG("Send command '%s' for write with FD %d", cmdstr, scm_fd);
 
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(cmdstr);
+    return ret;
+}
+
+
+static int
+qemuMonitorJSONCommandFull(qemuMonitorPtr mon,
+                           virJSONValuePtr cmd,
+                           int scm_fd,
+                           qemuMonitorReplyFilter filter,
+                           void *filterOpaque,
+                           virJSONValuePtr *reply)
+{
+    int ret = -1;
+    qemuMonitorMessage msg;
+    char *id = NULL;
+
+    *reply = NULL;
+
+    if (qemuMonitorJSONPrepareMessage(mon, cmd, scm_fd, &msg, &id) < 0)
+        goto cleanup;
+
+    msg.replyFilter = filter;
+    msg.replyFilterOpaque = filterOpaque;
+
     ret = qemuMonitorSend(mon, &msg);
 
     VIR_DEBUG("Receive command reply ret=%d rxObject=%p",
@@ -315,13 +539,102 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
 
  cleanup:
     VIR_FREE(id);
-    VIR_FREE(cmdstr);
     VIR_FREE(msg.txBuffer);
 
     return ret;
 }
 
 
+static int
+qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             int scm_fd,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, scm_fd, NULL, NULL, reply);
+}
+
+
+/**
+ * qemuMonitorJSONCommands:
+ * @mon: monitor object
+ * @cmds: array of commands
+ * @ncmds: number of commands in @cmds
+ * @filters: optional array of @ncmds reply filters (entries may be NULL)
+ * @filterOpaque: data passed to @filters
+ * @replies: array of @ncmds elements filled with the replies
+ *
+ * Pipelines @cmds: all commands are written to the monitor back-to-back
+ * and their replies are matched by the command "id", so the caller pays
+ * a single round-trip instead of one per command. The replies are stored
+ * in @replies in the order of @cmds and have to be checked by the caller
+ * using qemuMonitorJSONCheckError.
+ *
+ * Returns 0 on success, -1 on error (in which case @replies are all NULL).
+ */
+static int
+qemuMonitorJSONCommands(qemuMonitorPtr mon,
+                        virJSONValuePtr *cmds,
+                        size_t ncmds,
+                        const qemuMonitorReplyFilter *filters,
+                        void *filterOpaque,
+                        virJSONValuePtr *replies)
+{
+    int ret = -1;
+    qemuMonitorMessagePtr msgs = NULL;
+    char **ids = NULL;
+    size_t i;
+
+    memset(replies, 0, sizeof(*replies) * ncmds);
+
+    if (VIR_ALLOC_N(msgs, ncmds) < 0 ||
+        VIR_ALLOC_N(ids, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (qemuMonitorJSONPrepareMessage(mon, cmds[i], -1,
+                                          &msgs[i], &ids[i]) < 0)
+            goto cleanup;
+
+        if (filters) {
+            msgs[i].replyFilter = filters[i];
+            msgs[i].replyFilterOpaque = filterOpaque;
+        }
+
+        if (i > 0)
+            msgs[i - 1].next = &msgs[i];
+    }
+
+    if (qemuMonitorSend(mon, &msgs[0]) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (!msgs[i].rxObject) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Missing monitor reply object"));
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < ncmds; i++) {
+        replies[i] = msgs[i].rxObject;
+        msgs[i].rxObject = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; msgs && ids && i < ncmds; i++) {
+        virJSONValueFree(msgs[i].rxObject);
+        VIR_FREE(msgs[i].txBuffer);
+        VIR_FREE(ids[i]);
+    }
+    VIR_FREE(msgs);
+    VIR_FREE(ids);
+    return ret;
+}
+
+
 static int
 qemuMonitorJSONCommand(qemuMonitorPtr mon,
                        virJSONValuePtr cmd,
@@ -2061,8 +2374,29 @@ qemuMonitorJSONGetOneBlockStatsInfo(virJSONValuePtr dev,
 }
 
 
-virJSONValuePtr
-qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
+/* Drops the members of query-blockstats which are never used by
+ * qemuMonitorJSONGetOneBlockStatsInfo while the reply is parsed. */
+static bool
+qemuMonitorJSONBlockStatsFilter(const char *key,
+                                size_t depth ATTRIBUTE_UNUSED,
+                                void *opaque)
+{
+    bool *backingChain = opaque;
+
+    if (STREQ(key, "timed_stats"))
+        return false;
+
+    if (!*backingChain && STREQ(key, "backing"))
+        return false;
+
+    return true;
+}
+
+
+static virJSONValuePtr
+qemuMonitorJSONQueryBlockstatsFull(qemuMonitorPtr mon,
+                                   qemuMonitorReplyFilter filter,
+                                   void *filterOpaque)
 {
     virJSONValuePtr cmd;
     virJSONValuePtr reply = NULL;
@@ -2071,7 +2405,8 @@ qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
     if (!(cmd = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
         return NULL;
 
-    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+    if (qemuMonitorJSONCommandFull(mon, cmd, -1, filter, filterOpaque,
+                                   &reply) < 0)
         goto cleanup;
 
     if (qemuMonitorJSONCheckError(cmd, reply) < 0)
@@ -2090,19 +2425,21 @@ qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
 }
 
 
-int
-qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
-                                    virHashTablePtr hash,
-                                    bool backingChain)
+virJSONValuePtr
+qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
+{
+    return qemuMonitorJSONQueryBlockstatsFull(mon, NULL, NULL);
+}
+
+
+static int
+qemuMonitorJSONGetAllBlockStatsInfoDevices(virJSONValuePtr devices,
+                                           virHashTablePtr hash,
+                                           bool backingChain)
 {
-    int ret = -1;
     int nstats = 0;
     int rc;
     size_t i;
-    virJSONValuePtr devices;
-
-    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev = virJSONValueArrayGet(devices, i);
@@ -2112,29 +2449,47 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("blockstats device entry was not "
                              "in expected format"));
-            goto cleanup;
+            return -1;
         }
 
         if (!(dev_name = virJSONValueObjectGetString(dev, "device"))) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("blockstats device entry was not "
                              "in expected format"));
-            goto cleanup;
+            return -1;
         }
 
         rc = qemuMonitorJSONGetOneBlockStatsInfo(dev, dev_name, 0, hash,
                                                  backingChain);
 
         if (rc < 0)
-            goto cleanup;
+            return -1;
 
         if (rc > nstats)
             nstats = rc;
     }
 
-    ret = nstats;
+    return nstats;
+}
+
+
+int
+qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
+                                    virHashTablePtr hash,
+                                    bool backingChain)
+{
+    int ret;
+    virJSONValuePtr devices;
+
+    devices = qemuMonitorJSONQueryBlockstatsFull(mon,
+                                                 qemuMonitorJSONBlockStatsFilter,
+                                                 &backingChain);
+    if (!devices)
+        return -1;
+
+    ret = qemuMonitorJSONGetAllBlockStatsInfoDevices(devices, hash,
+                                                     backingChain);
 
- cleanup:
     virJSONValueFree(devices);
     return ret;
 }
@@ -2189,17 +2544,12 @@ qemuMonitorJSONBlockStatsUpdateCapacityOne(virJSONValuePtr image,
 }
 
 
-int
-qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
-                                        virHashTablePtr stats,
-                                        bool backingChain)
+static int
+qemuMonitorJSONBlockStatsUpdateCapacityDevices(virJSONValuePtr devices,
+                                               virHashTablePtr stats,
+                                               bool backingChain)
 {
-    int ret = -1;
     size_t i;
-    virJSONValuePtr devices;
-
-    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev;
@@ -2208,10 +2558,10 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         const char *dev_name;
 
         if (!(dev = qemuMonitorJSONGetBlockDev(devices, i)))
-            goto cleanup;
+            return -1;
 
         if (!(dev_name = qemuMonitorJSONGetBlockDevDevice(dev)))
-            goto cleanup;
+            return -1;
 
         /* drive may be empty */
         if (!(inserted = virJSONValueObjectGetObject(dev, "inserted")) ||
@@ -2221,17 +2571,97 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         if (qemuMonitorJSONBlockStatsUpdateCapacityOne(image, dev_name, 0,
                                                        stats,
                                                        backingChain) < 0)
-            goto cleanup;
+            return -1;
     }
 
-    ret = 0;
+    return 0;
+}
+
+
+int
+qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr stats,
+                                        bool backingChain)
+{
+    int ret;
+    virJSONValuePtr devices;
+
+    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
+        return -1;
+
+    ret = qemuMonitorJSONBlockStatsUpdateCapacityDevices(devices, stats,
+                                                         backingChain);
 
- cleanup:
     virJSONValueFree(devices);
     return ret;
 }
 
 
+/**
+ * qemuMonitorJSONGetAllBlockStatsInfoCapacity:
+ * @mon: monitor object
+ * @hash: hash table to fill with block stats
+ * @backingChain: recurse into the backing chain of devices
+ *
+ * Equivalent of qemuMonitorJSONGetAllBlockStatsInfo followed by
+ * qemuMonitorJSONBlockStatsUpdateCapacity, but 'query-blockstats' and
+ * 'query-block' are pipelined so that only one round-trip to the
+ * monitor is needed. Failure to fetch the capacity is not fatal, the
+ * capacity fields are left zeroed in such case.
+ *
+ * Returns < 0 on error, count of supported block stats fields on success.
+ */
+int
+qemuMonitorJSONGetAllBlockStatsInfoCapacity(qemuMonitorPtr mon,
+                                            virHashTablePtr hash,
+                                            bool backingChain)
+{
+    int ret = -1;
+    virJSONValuePtr cmds[2] = { NULL, NULL };
+    virJSONValuePtr replies[2] = { NULL, NULL };
+    qemuMonitorReplyFilter filters[2] = { qemuMonitorJSONBlockStatsFilter, NULL };
+    virJSONValuePtr devices;
+    size_t i;
+
+    if (!(cmds[0] = qemuMonitorJSONMakeCommand("query-blockstats", NULL)) ||
+        !(cmds[1] = qemuMonitorJSONMakeCommand("query-block", NULL)))
+        goto cleanup;
+
+    if (qemuMonitorJSONCommands(mon, cmds, ARRAY_CARDINALITY(cmds),
+                                filters, &backingChain, replies) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckError(cmds[0], replies[0]) < 0)
+        goto cleanup;
+
+    if (!(devices = virJSONValueObjectGetArray(replies[0], "return"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("query-blockstats reply was missing device list"));
+        goto cleanup;
+    }
+
+    if ((ret = qemuMonitorJSONGetAllBlockStatsInfoDevices(devices, hash,
+                                                          backingChain)) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckError(cmds[1], replies[1]) < 0 ||
+        !(devices = virJSONValueObjectGetArray(replies[1], "return")) ||
+        qemuMonitorJSONBlockStatsUpdateCapacityDevices(devices, hash,
+                                                       backingChain) < 0) {
+        VIR_DEBUG("failed to update block capacity: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(cmds); i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    return ret;
+}
+
+
 /* Return 0 on success, -1 on failure, or -2 if not supported.  Size
  * is in bytes.  */
 int qemuMonitorJSONBlockResize(qemuMonitorPtr mon,
@@ -32,14 +32,20 @@
 # include "cpu/cpu.h"
 # include "util/virgic.h"
 
+int qemuMonitorJSONIOProcessValue(qemuMonitorPtr mon,
+                                  virJSONValuePtr obj,
+                                  qemuMonitorMessagePtr msg);
+
 int qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                                  const char *line,
                                  qemuMonitorMessagePtr msg);
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
+                             virJSONStreamParserPtr *stream,
                              const char *data,
                              size_t len,
-                             qemuMonitorMessagePtr msg);
+                             qemuMonitorMessagePtr msg,
+                             bool *complete);
 
 int qemuMonitorJSONHumanCommandWithFd(qemuMonitorPtr mon,
                                       const char *cmd,
@@ -89,6 +95,9 @@ int qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
 int qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                             virHashTablePtr stats,
                                             bool backingChain);
+int qemuMonitorJSONGetAllBlockStatsInfoCapacity(qemuMonitorPtr mon,
+                                                virHashTablePtr hash,
+                                                bool backingChain);
 int qemuMonitorJSONBlockResize(qemuMonitorPtr mon,
                                const char *devce,
                                unsigned long long size);
@@ -71,6 +71,7 @@
 #include "viratomic.h"
 #include "virnuma.h"
 #include "virstring.h"
+#include "virstartuptime.h"
 #include "virhostdev.h"
 #include "secret_util.h"
 #include "storage/storage_driver.h"
@@ -4718,7 +4719,8 @@ qemuProcessInit(virQEMUDriverPtr driver,
             goto cleanup;
         }
     } else {
-        vm->def->id = qemuDriverAllocateID(driver);
+        virDomainObjListSetID(driver->domains, vm,
+                              qemuDriverAllocateID(driver));
         qemuDomainSetFakeReboot(driver, vm, false);
         virDomainObjSetState(vm, VIR_DOMAIN_PAUSED, VIR_DOMAIN_PAUSED_STARTING_UP);
 
@@ -6076,7 +6078,7 @@ void qemuProcessStop(virQEMUDriverPtr driver,
 
     qemuProcessBuildDestroyHugepagesPath(driver, vm, NULL, false);
 
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     if (virAtomicIntDecAndTest(&driver->nactive) && driver->inhibitCallback)
         driver->inhibitCallback(false, driver->inhibitOpaque);
@@ -6416,7 +6418,8 @@ int qemuProcessAttach(virConnectPtr conn ATTRIBUTE_UNUSED,
     if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm) < 0)
         goto error;
 
-    vm->def->id = qemuDriverAllocateID(driver);
+    virDomainObjListSetID(driver->domains, vm,
+                          qemuDriverAllocateID(driver));
 
     if (virAtomicIntInc(&driver->nactive) == 1 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
@@ -6744,10 +6747,34 @@ qemuProcessRefreshDisks(virQEMUDriverPtr driver,
 }
 
 
+/* Measures how long it takes until all running domains are reconnected
+ * to after the daemon starts */
+typedef struct _qemuProcessReconnectTimer qemuProcessReconnectTimer;
+typedef qemuProcessReconnectTimer *qemuProcessReconnectTimerPtr;
+struct _qemuProcessReconnectTimer {
+    int pending; /* reconnect threads not finished yet, plus one held
+                    by qemuProcessReconnectAll while starting them */
+    unsigned long long start;
+};
+
+
+static void
+qemuProcessReconnectTimerRelease(qemuProcessReconnectTimerPtr timer)
+{
+    if (!timer || !virAtomicIntDecAndTest(&timer->pending))
+        return;
+
+    ignore_value(virStartupTimeAdd(QEMU_DRIVER_NAME ".reconnect",
+                                   timer->start));
+    VIR_FREE(timer);
+}
+
+
 struct qemuProcessReconnectData {
     virConnectPtr conn;
     virQEMUDriverPtr driver;
     virDomainObjPtr obj;
+    qemuProcessReconnectTimerPtr timer;
 };
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
@@ -6787,6 +6814,7 @@ qemuProcessReconnect(void *opaque)
     unsigned int stopFlags = 0;
     bool jobStarted = false;
     virCapsPtr caps = NULL;
+    qemuProcessReconnectTimerPtr timer = data->timer;
 
     VIR_FREE(data);
 
@@ -6996,6 +7024,7 @@ qemuProcessReconnect(void *opaque)
     virObjectUnref(cfg);
     virObjectUnref(caps);
     virNWFilterUnlockFilterUpdates();
+    qemuProcessReconnectTimerRelease(timer);
     return;
 
  error:
@@ -7054,6 +7083,9 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
      */
     virObjectRef(data->conn);
 
+    if (data->timer)
+        virAtomicIntInc(&data->timer->pending);
+
     if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Could not create thread. QEMU initialization "
@@ -7070,6 +7102,7 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
         virDomainObjEndAPI(&obj);
         virNWFilterUnlockFilterUpdates();
         virObjectUnref(data->conn);
+        qemuProcessReconnectTimerRelease(data->timer);
         VIR_FREE(data);
         return -1;
     }
@@ -7087,5 +7120,17 @@ void
 qemuProcessReconnectAll(virConnectPtr conn, virQEMUDriverPtr driver)
 {
     struct qemuProcessReconnectData data = {.conn = conn, .driver = driver};
+
+    /* Failing to measure the time is not fatal */
+    if (VIR_ALLOC(data.timer) < 0 ||
+        virTimeMillisNow(&data.timer->start) < 0) {
+        VIR_FREE(data.timer);
+        virResetLastError();
+    } else {
+        data.timer->pending = 1;
+    }
+
     virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
+
+    qemuProcessReconnectTimerRelease(data.timer);
 }
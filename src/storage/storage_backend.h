@@ -109,6 +109,9 @@ struct _virStorageBackend {
     virStorageBackendStartPool startPool;
     virStorageBackendBuildPool buildPool;
     virStorageBackendRefreshPool refreshPool; /* Must be non-NULL */
+    /* Whether refreshPool reuses the volumes of the previous refresh
+     * rather than expecting them to be cleared */
+    bool refreshPoolIncremental;
     virStorageBackendStopPool stopPool;
     virStorageBackendDeletePool deletePool;
 
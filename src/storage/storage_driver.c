@@ -92,7 +92,7 @@ virStoragePoolUpdateInactive(virStoragePoolObjPtr *objptr)
     virStoragePoolObjPtr obj = *objptr;
 
     if (obj->configFile == NULL) {
-        virStoragePoolObjRemove(&driver->pools, obj);
+        virStoragePoolObjRemove(driver->pools, obj);
         *objptr = NULL;
     } else if (obj->newDef) {
         virStoragePoolDefFree(obj->def);
@@ -102,6 +102,10 @@ virStoragePoolUpdateInactive(virStoragePoolObjPtr *objptr)
 }
 
 
+/*
+ * @obj is expected to be locked. It is unlocked on return, or removed
+ * from the list of pools if it is found to be transient and inactive.
+ */
 static void
 storagePoolUpdateState(virStoragePoolObjPtr obj)
 {
@@ -154,28 +158,81 @@ storagePoolUpdateState(virStoragePoolObjPtr obj)
     if (!active && stateFile)
         ignore_value(unlink(stateFile));
     VIR_FREE(stateFile);
+    if (obj)
+        virStoragePoolObjUnlock(obj);
 
     return;
 }
 
+static void
+storagePoolUpdateAllStateCallback(virStoragePoolObjPtr obj,
+                                  void *opaque ATTRIBUTE_UNUSED)
+{
+    virStoragePoolObjLock(obj);
+    storagePoolUpdateState(obj);
+}
+
 static void
 storagePoolUpdateAllState(void)
 {
-    size_t i;
+    virStoragePoolObjListForEach(driver->pools,
+                                 storagePoolUpdateAllStateCallback,
+                                 NULL);
+}
+
+static void
+storageDriverAutostartCallback(virStoragePoolObjPtr obj,
+                               void *opaque)
+{
+    virConnectPtr conn = opaque;
+    virStorageBackendPtr backend;
+    bool started = false;
 
-    for (i = 0; i < driver->pools.count; i++) {
-        virStoragePoolObjPtr obj = driver->pools.objs[i];
+    virStoragePoolObjLock(obj);
+    if ((backend = virStorageBackendForType(obj->def->type)) == NULL)
+        goto cleanup;
 
-        virStoragePoolObjLock(obj);
-        storagePoolUpdateState(obj);
-        virStoragePoolObjUnlock(obj);
+    if (obj->autostart &&
+        !virStoragePoolObjIsActive(obj)) {
+        if (backend->startPool &&
+            backend->startPool(conn, obj) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to autostart storage pool '%s': %s"),
+                           obj->def->name, virGetLastErrorMessage());
+            goto cleanup;
+        }
+        started = true;
     }
+
+    if (started) {
+        char *stateFile;
+
+        virStoragePoolObjClearVols(obj);
+        stateFile = virFileBuildPath(driver->stateDir,
+                                     obj->def->name, ".xml");
+        if (!stateFile ||
+            virStoragePoolSaveState(stateFile, obj->def) < 0 ||
+            backend->refreshPool(conn, obj) < 0) {
+            if (stateFile)
+                unlink(stateFile);
+            if (backend->stopPool)
+                backend->stopPool(conn, obj);
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to autostart storage pool '%s': %s"),
+                           obj->def->name, virGetLastErrorMessage());
+        } else {
+            obj->active = true;
+        }
+        VIR_FREE(stateFile);
+    }
+
+ cleanup:
+    virStoragePoolObjUnlock(obj);
 }
 
 static void
 storageDriverAutostart(void)
 {
-    size_t i;
     virConnectPtr conn = NULL;
 
     /* XXX Remove hardcoding of QEMU URI */
@@ -185,53 +242,9 @@ storageDriverAutostart(void)
         conn = virConnectOpen("qemu:///session");
     /* Ignoring NULL conn - let backends decide */
 
-    for (i = 0; i < driver->pools.count; i++) {
-        virStoragePoolObjPtr obj = driver->pools.objs[i];
-        virStorageBackendPtr backend;
-        bool started = false;
-
-        virStoragePoolObjLock(obj);
-        if ((backend = virStorageBackendForType(obj->def->type)) == NULL) {
-            virStoragePoolObjUnlock(obj);
-            continue;
-        }
-
-        if (obj->autostart &&
-            !virStoragePoolObjIsActive(obj)) {
-            if (backend->startPool &&
-                backend->startPool(conn, obj) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Failed to autostart storage pool '%s': %s"),
-                               obj->def->name, virGetLastErrorMessage());
-                virStoragePoolObjUnlock(obj);
-                continue;
-            }
-            started = true;
-        }
-
-        if (started) {
-            char *stateFile;
-
-            virStoragePoolObjClearVols(obj);
-            stateFile = virFileBuildPath(driver->stateDir,
-                                         obj->def->name, ".xml");
-            if (!stateFile ||
-                virStoragePoolSaveState(stateFile, obj->def) < 0 ||
-                backend->refreshPool(conn, obj) < 0) {
-                if (stateFile)
-                    unlink(stateFile);
-                if (backend->stopPool)
-                    backend->stopPool(conn, obj);
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Failed to autostart storage pool '%s': %s"),
-                               obj->def->name, virGetLastErrorMessage());
-            } else {
-                obj->active = true;
-            }
-            VIR_FREE(stateFile);
-        }
-        virStoragePoolObjUnlock(obj);
-    }
+    virStoragePoolObjListForEach(driver->pools,
+                                 storageDriverAutostartCallback,
+                                 conn);
 
     virObjectUnref(conn);
 }
@@ -283,6 +296,9 @@ storageStateInitialize(bool privileged,
     }
     driver->privileged = privileged;
 
+    if (!(driver->pools = virStoragePoolObjListNew()))
+        goto error;
+
     if (virFileMakePath(driver->stateDir) < 0) {
         virReportError(errno,
                        _("cannot create directory %s"),
@@ -290,11 +306,11 @@ storageStateInitialize(bool privileged,
         goto error;
     }
 
-    if (virStoragePoolObjLoadAllState(&driver->pools,
+    if (virStoragePoolObjLoadAllState(driver->pools,
                                       driver->stateDir) < 0)
         goto error;
 
-    if (virStoragePoolObjLoadAllConfigs(&driver->pools,
+    if (virStoragePoolObjLoadAllConfigs(driver->pools,
                                         driver->configDir,
                                         driver->autostartDir) < 0)
         goto error;
@@ -346,9 +362,9 @@ storageStateReload(void)
         return -1;
 
     storageDriverLock();
-    virStoragePoolObjLoadAllState(&driver->pools,
+    virStoragePoolObjLoadAllState(driver->pools,
                                   driver->stateDir);
-    virStoragePoolObjLoadAllConfigs(&driver->pools,
+    virStoragePoolObjLoadAllConfigs(driver->pools,
                                     driver->configDir,
                                     driver->autostartDir);
     storageDriverAutostart();
@@ -374,7 +390,7 @@ storageStateCleanup(void)
     virObjectUnref(driver->storageEventState);
 
     /* free inactive pools */
-    virStoragePoolObjListFree(&driver->pools);
+    virObjectUnref(driver->pools);
 
     VIR_FREE(driver->configDir);
     VIR_FREE(driver->autostartDir);
@@ -394,7 +410,7 @@ storagePoolObjFindByUUID(const unsigned char *uuid,
     virStoragePoolObjPtr obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if (!(obj = virStoragePoolObjFindByUUID(&driver->pools, uuid))) {
+    if (!(obj = virStoragePoolObjFindByUUID(driver->pools, uuid))) {
         virUUIDFormat(uuid, uuidstr);
         if (name)
             virReportError(VIR_ERR_NO_STORAGE_POOL,
@@ -429,7 +445,7 @@ storagePoolObjFindByName(const char *name)
     virStoragePoolObjPtr obj;
 
     storageDriverLock();
-    if (!(obj = virStoragePoolObjFindByName(&driver->pools, name)))
+    if (!(obj = virStoragePoolObjFindByName(driver->pools, name)))
         virReportError(VIR_ERR_NO_STORAGE_POOL,
                        _("no storage pool with matching name '%s'"), name);
     storageDriverUnlock();
@@ -510,7 +526,7 @@ storageConnectNumOfStoragePools(virConnectPtr conn)
         return -1;
 
     storageDriverLock();
-    nactive = virStoragePoolObjNumOfStoragePools(&driver->pools, conn, true,
+    nactive = virStoragePoolObjNumOfStoragePools(driver->pools, conn, true,
                                                  virConnectNumOfStoragePoolsCheckACL);
     storageDriverUnlock();
 
@@ -529,7 +545,7 @@ storageConnectListStoragePools(virConnectPtr conn,
         return -1;
 
     storageDriverLock();
-    got = virStoragePoolObjGetNames(&driver->pools, conn, true,
+    got = virStoragePoolObjGetNames(driver->pools, conn, true,
                                     virConnectListStoragePoolsCheckACL,
                                     names, maxnames);
     storageDriverUnlock();
@@ -545,7 +561,7 @@ storageConnectNumOfDefinedStoragePools(virConnectPtr conn)
         return -1;
 
     storageDriverLock();
-    nactive = virStoragePoolObjNumOfStoragePools(&driver->pools, conn, false,
+    nactive = virStoragePoolObjNumOfStoragePools(driver->pools, conn, false,
                                                  virConnectNumOfDefinedStoragePoolsCheckACL);
     storageDriverUnlock();
 
@@ -564,7 +580,7 @@ storageConnectListDefinedStoragePools(virConnectPtr conn,
         return -1;
 
     storageDriverLock();
-    got = virStoragePoolObjGetNames(&driver->pools, conn, false,
+    got = virStoragePoolObjGetNames(driver->pools, conn, false,
                                     virConnectListDefinedStoragePoolsCheckACL,
                                     names, maxnames);
     storageDriverUnlock();
@@ -678,16 +694,16 @@ storagePoolCreateXML(virConnectPtr conn,
     if (virStoragePoolCreateXMLEnsureACL(conn, def) < 0)
         goto cleanup;
 
-    if (virStoragePoolObjIsDuplicate(&driver->pools, def, 1) < 0)
+    if (virStoragePoolObjIsDuplicate(driver->pools, def, 1) < 0)
         goto cleanup;
 
-    if (virStoragePoolObjSourceFindDuplicate(conn, &driver->pools, def) < 0)
+    if (virStoragePoolObjSourceFindDuplicate(conn, driver->pools, def) < 0)
         goto cleanup;
 
     if ((backend = virStorageBackendForType(def->type)) == NULL)
         goto cleanup;
 
-    if (!(obj = virStoragePoolObjAssignDef(&driver->pools, def)))
+    if (!(obj = virStoragePoolObjAssignDef(driver->pools, def)))
         goto cleanup;
     def = NULL;
 
@@ -700,7 +716,7 @@ storagePoolCreateXML(virConnectPtr conn,
         if (build_flags ||
             (flags & VIR_STORAGE_POOL_CREATE_WITH_BUILD)) {
             if (backend->buildPool(conn, obj, build_flags) < 0) {
-                virStoragePoolObjRemove(&driver->pools, obj);
+                virStoragePoolObjRemove(driver->pools, obj);
                 obj = NULL;
                 goto cleanup;
             }
@@ -709,7 +725,7 @@ storagePoolCreateXML(virConnectPtr conn,
 
     if (backend->startPool &&
         backend->startPool(conn, obj) < 0) {
-        virStoragePoolObjRemove(&driver->pools, obj);
+        virStoragePoolObjRemove(driver->pools, obj);
         obj = NULL;
         goto cleanup;
     }
@@ -724,7 +740,7 @@ storagePoolCreateXML(virConnectPtr conn,
             unlink(stateFile);
         if (backend->stopPool)
             backend->stopPool(conn, obj);
-        virStoragePoolObjRemove(&driver->pools, obj);
+        virStoragePoolObjRemove(driver->pools, obj);
         obj = NULL;
         goto cleanup;
     }
@@ -772,20 +788,20 @@ storagePoolDefineXML(virConnectPtr conn,
     if (virStoragePoolDefineXMLEnsureACL(conn, def) < 0)
         goto cleanup;
 
-    if (virStoragePoolObjIsDuplicate(&driver->pools, def, 0) < 0)
+    if (virStoragePoolObjIsDuplicate(driver->pools, def, 0) < 0)
         goto cleanup;
 
-    if (virStoragePoolObjSourceFindDuplicate(conn, &driver->pools, def) < 0)
+    if (virStoragePoolObjSourceFindDuplicate(conn, driver->pools, def) < 0)
         goto cleanup;
 
     if (virStorageBackendForType(def->type) == NULL)
         goto cleanup;
 
-    if (!(obj = virStoragePoolObjAssignDef(&driver->pools, def)))
+    if (!(obj = virStoragePoolObjAssignDef(driver->pools, def)))
         goto cleanup;
 
     if (virStoragePoolObjSaveDef(driver, obj, def) < 0) {
-        virStoragePoolObjRemove(&driver->pools, obj);
+        virStoragePoolObjRemove(driver->pools, obj);
         def = NULL;
         obj = NULL;
         goto cleanup;
@@ -858,7 +874,7 @@ storagePoolUndefine(virStoragePoolPtr pool)
                                             0);
 
     VIR_INFO("Undefining storage pool '%s'", obj->def->name);
-    virStoragePoolObjRemove(&driver->pools, obj);
+    virStoragePoolObjRemove(driver->pools, obj);
     obj = NULL;
     ret = 0;
 
@@ -1148,7 +1164,8 @@ storagePoolRefresh(virStoragePoolPtr pool,
         goto cleanup;
     }
 
-    virStoragePoolObjClearVols(obj);
+    if (!backend->refreshPoolIncremental)
+        virStoragePoolObjClearVols(obj);
     if (backend->refreshPool(pool->conn, obj) < 0) {
         if (backend->stopPool)
             backend->stopPool(pool->conn, obj);
@@ -1448,125 +1465,116 @@ storageVolLookupByName(virStoragePoolPtr pool,
 }
 
 
+static bool
+storageVolLookupByKeyCallback(virStoragePoolObjPtr obj,
+                              void *opaque)
+{
+    const char *key = opaque;
+
+    return virStoragePoolObjIsActive(obj) &&
+        virStorageVolDefFindByKey(obj, key);
+}
+
 static virStorageVolPtr
 storageVolLookupByKey(virConnectPtr conn,
                       const char *key)
 {
-    size_t i;
+    virStoragePoolObjPtr obj;
+    virStorageVolDefPtr voldef;
     virStorageVolPtr vol = NULL;
 
-    storageDriverLock();
-    for (i = 0; i < driver->pools.count && !vol; i++) {
-        virStoragePoolObjLock(driver->pools.objs[i]);
-        if (virStoragePoolObjIsActive(driver->pools.objs[i])) {
-            virStorageVolDefPtr voldef =
-                virStorageVolDefFindByKey(driver->pools.objs[i], key);
-
-            if (voldef) {
-                virStoragePoolDefPtr def = driver->pools.objs[i]->def;
-                if (virStorageVolLookupByKeyEnsureACL(conn, def, voldef) < 0) {
-                    virStoragePoolObjUnlock(driver->pools.objs[i]);
-                    goto cleanup;
-                }
-
-                vol = virGetStorageVol(conn,
-                                       def->name,
-                                       voldef->name,
-                                       voldef->key,
-                                       NULL, NULL);
-            }
-        }
-        virStoragePoolObjUnlock(driver->pools.objs[i]);
-    }
-
-    if (!vol)
+    if (!(obj = virStoragePoolObjListSearch(driver->pools,
+                                            storageVolLookupByKeyCallback,
+                                            (void *) key))) {
         virReportError(VIR_ERR_NO_STORAGE_VOL,
                        _("no storage vol with matching key %s"), key);
+        return NULL;
+    }
+
+    voldef = virStorageVolDefFindByKey(obj, key);
+
+    if (virStorageVolLookupByKeyEnsureACL(conn, obj->def, voldef) < 0)
+        goto cleanup;
+
+    vol = virGetStorageVol(conn, obj->def->name,
+                           voldef->name, voldef->key,
+                           NULL, NULL);
 
  cleanup:
-    storageDriverUnlock();
+    virStoragePoolObjUnlock(obj);
     return vol;
 }
 
+struct storageVolLookupByPathData {
+    const char *path;
+    const char *cleanpath;
+    virStorageVolDefPtr voldef;
+};
+
+static bool
+storageVolLookupByPathCallback(virStoragePoolObjPtr obj,
+                               void *opaque)
+{
+    struct storageVolLookupByPathData *data = opaque;
+    char *stable_path = NULL;
+
+    if (!virStoragePoolObjIsActive(obj))
+        return false;
+
+    switch ((virStoragePoolType) obj->def->type) {
+        case VIR_STORAGE_POOL_DIR:
+        case VIR_STORAGE_POOL_FS:
+        case VIR_STORAGE_POOL_NETFS:
+        case VIR_STORAGE_POOL_LOGICAL:
+        case VIR_STORAGE_POOL_DISK:
+        case VIR_STORAGE_POOL_ISCSI:
+        case VIR_STORAGE_POOL_SCSI:
+        case VIR_STORAGE_POOL_MPATH:
+        case VIR_STORAGE_POOL_VSTORAGE:
+            stable_path = virStorageBackendStablePath(obj,
+                                                      data->cleanpath,
+                                                      false);
+            if (stable_path == NULL) {
+                /* Don't break the whole lookup process if it fails on
+                 * getting the stable path for some of the pools.
+                 */
+                VIR_WARN("Failed to get stable path for pool '%s'",
+                         obj->def->name);
+                return false;
+            }
+            data->voldef = virStorageVolDefFindByPath(obj, stable_path);
+            VIR_FREE(stable_path);
+            break;
+
+        case VIR_STORAGE_POOL_GLUSTER:
+        case VIR_STORAGE_POOL_RBD:
+        case VIR_STORAGE_POOL_SHEEPDOG:
+        case VIR_STORAGE_POOL_ZFS:
+        case VIR_STORAGE_POOL_LAST:
+            data->voldef = virStorageVolDefFindByPath(obj, data->path);
+            break;
+    }
+
+    return !!data->voldef;
+}
+
 static virStorageVolPtr
 storageVolLookupByPath(virConnectPtr conn,
                        const char *path)
 {
-    size_t i;
+    struct storageVolLookupByPathData data = { path, NULL, NULL };
+    virStoragePoolObjPtr obj;
     virStorageVolPtr vol = NULL;
     char *cleanpath;
 
     cleanpath = virFileSanitizePath(path);
     if (!cleanpath)
         return NULL;
+    data.cleanpath = cleanpath;
 
-    storageDriverLock();
-    for (i = 0; i < driver->pools.count && !vol; i++) {
-        virStoragePoolObjPtr obj = driver->pools.objs[i];
-        virStorageVolDefPtr voldef;
-        char *stable_path = NULL;
-
-        virStoragePoolObjLock(obj);
-
-        if (!virStoragePoolObjIsActive(obj)) {
-           virStoragePoolObjUnlock(obj);
-           continue;
-        }
-
-        switch ((virStoragePoolType) obj->def->type) {
-            case VIR_STORAGE_POOL_DIR:
-            case VIR_STORAGE_POOL_FS:
-            case VIR_STORAGE_POOL_NETFS:
-            case VIR_STORAGE_POOL_LOGICAL:
-            case VIR_STORAGE_POOL_DISK:
-            case VIR_STORAGE_POOL_ISCSI:
-            case VIR_STORAGE_POOL_SCSI:
-            case VIR_STORAGE_POOL_MPATH:
-            case VIR_STORAGE_POOL_VSTORAGE:
-                stable_path = virStorageBackendStablePath(obj,
-                                                          cleanpath,
-                                                          false);
-                if (stable_path == NULL) {
-                    /* Don't break the whole lookup process if it fails on
-                     * getting the stable path for some of the pools.
-                     */
-                    VIR_WARN("Failed to get stable path for pool '%s'",
-                             obj->def->name);
-                    virStoragePoolObjUnlock(obj);
-                    continue;
-                }
-                break;
-
-            case VIR_STORAGE_POOL_GLUSTER:
-            case VIR_STORAGE_POOL_RBD:
-            case VIR_STORAGE_POOL_SHEEPDOG:
-            case VIR_STORAGE_POOL_ZFS:
-            case VIR_STORAGE_POOL_LAST:
-                if (VIR_STRDUP(stable_path, path) < 0) {
-                     virStoragePoolObjUnlock(obj);
-                    goto cleanup;
-                }
-                break;
-        }
-
-        voldef = virStorageVolDefFindByPath(obj, stable_path);
-        VIR_FREE(stable_path);
-
-        if (voldef) {
-            if (virStorageVolLookupByPathEnsureACL(conn, obj->def, voldef) < 0) {
-                virStoragePoolObjUnlock(obj);
-                goto cleanup;
-            }
-
-            vol = virGetStorageVol(conn, obj->def->name,
-                                   voldef->name, voldef->key,
-                                   NULL, NULL);
-        }
-
-        virStoragePoolObjUnlock(obj);
-    }
-
-    if (!vol) {
+    if (!(obj = virStoragePoolObjListSearch(driver->pools,
+                                            storageVolLookupByPathCallback,
+                                            &data))) {
         if (STREQ(path, cleanpath)) {
             virReportError(VIR_ERR_NO_STORAGE_VOL,
                            _("no storage vol with matching path '%s'"), path);
@@ -1575,19 +1583,36 @@ storageVolLookupByPath(virConnectPtr conn,
                            _("no storage vol with matching path '%s' (%s)"),
                            path, cleanpath);
         }
+        goto cleanup;
     }
 
+    if (virStorageVolLookupByPathEnsureACL(conn, obj->def, data.voldef) == 0)
+        vol = virGetStorageVol(conn, obj->def->name,
+                               data.voldef->name, data.voldef->key,
+                               NULL, NULL);
+
+    virStoragePoolObjUnlock(obj);
+
  cleanup:
     VIR_FREE(cleanpath);
-    storageDriverUnlock();
     return vol;
 }
 
+static bool
+storagePoolLookupByTargetPathCallback(virStoragePoolObjPtr obj,
+                                      void *opaque)
+{
+    const char *path = opaque;
+
+    return virStoragePoolObjIsActive(obj) &&
+        STREQ(path, obj->def->target.path);
+}
+
 virStoragePoolPtr
 storagePoolLookupByTargetPath(virConnectPtr conn,
                               const char *path)
 {
-    size_t i;
+    virStoragePoolObjPtr obj;
     virStoragePoolPtr pool = NULL;
     char *cleanpath;
 
@@ -1595,25 +1620,13 @@ storagePoolLookupByTargetPath(virConnectPtr conn,
     if (!cleanpath)
         return NULL;
 
-    storageDriverLock();
-    for (i = 0; i < driver->pools.count && !pool; i++) {
-        virStoragePoolObjPtr obj = driver->pools.objs[i];
-
-        virStoragePoolObjLock(obj);
-
-        if (!virStoragePoolObjIsActive(obj)) {
-            virStoragePoolObjUnlock(obj);
-            continue;
-        }
-
-        if (STREQ(path, obj->def->target.path)) {
-            pool = virGetStoragePool(conn, obj->def->name, obj->def->uuid,
-                                     NULL, NULL);
-        }
-
+    if ((obj = virStoragePoolObjListSearch(driver->pools,
+                                           storagePoolLookupByTargetPathCallback,
+                                           (void *) path))) {
+        pool = virGetStoragePool(conn, obj->def->name, obj->def->uuid,
+                                 NULL, NULL);
         virStoragePoolObjUnlock(obj);
     }
-    storageDriverUnlock();
 
     if (!pool) {
         virReportError(VIR_ERR_NO_STORAGE_VOL,
@@ -1626,25 +1639,6 @@ storagePoolLookupByTargetPath(virConnectPtr conn,
 }
 
 
-static void
-storageVolRemoveFromPool(virStoragePoolObjPtr obj,
-                         virStorageVolDefPtr voldef)
-{
-    size_t i;
-
-    for (i = 0; i < obj->volumes.count; i++) {
-        if (obj->volumes.objs[i] == voldef) {
-            VIR_INFO("Deleting volume '%s' from storage pool '%s'",
-                     voldef->name, obj->def->name);
-            virStorageVolDefFree(voldef);
-
-            VIR_DELETE_ELEMENT(obj->volumes.objs, i, obj->volumes.count);
-            break;
-        }
-    }
-}
-
-
 static int
 storageVolDeleteInternal(virStorageVolPtr vol,
                          virStorageBackendPtr backend,
@@ -1676,7 +1670,7 @@ storageVolDeleteInternal(virStorageVolPtr vol,
         }
     }
 
-    storageVolRemoveFromPool(obj, voldef);
+    virStoragePoolObjRemoveVol(obj, voldef);
     ret = 0;
 
  cleanup:
@@ -1763,6 +1757,26 @@ storageVolDelete(virStorageVolPtr vol,
 }
 
 
+/* Best effort removal of a volume created by the backend which could not
+ * be added to the pool, keeping the original error */
+static void
+storageVolCreateRollback(virConnectPtr conn,
+                         virStorageBackendPtr backend,
+                         virStoragePoolObjPtr obj,
+                         virStorageVolDefPtr voldef)
+{
+    virErrorPtr save_err;
+
+    if (!backend->deleteVol)
+        return;
+
+    save_err = virSaveLastError();
+    ignore_value(backend->deleteVol(conn, obj, voldef, 0));
+    virSetError(save_err);
+    virFreeError(save_err);
+}
+
+
 static virStorageVolPtr
 storageVolCreateXML(virStoragePoolPtr pool,
                     const char *xmldesc,
@@ -1815,21 +1829,22 @@ storageVolCreateXML(virStoragePoolPtr pool,
         goto cleanup;
     }
 
-    if (VIR_REALLOC_N(obj->volumes.objs,
-                      obj->volumes.count + 1) < 0)
-        goto cleanup;
-
     /* Wipe any key the user may have suggested, as volume creation
      * will generate the canonical key.  */
     VIR_FREE(voldef->key);
     if (backend->createVol(pool->conn, obj, voldef) < 0)
         goto cleanup;
 
-    obj->volumes.objs[obj->volumes.count++] = voldef;
+    if (virStoragePoolObjAddVol(obj, voldef) < 0) {
+        storageVolCreateRollback(pool->conn, backend, obj, voldef);
+        goto cleanup;
+    }
+
     newvol = virGetStorageVol(pool->conn, obj->def->name, voldef->name,
                               voldef->key, NULL, NULL);
     if (!newvol) {
-        obj->volumes.count--;
+        virStoragePoolObjRemoveVol(obj, voldef);
+        voldef = NULL;
         goto cleanup;
     }
 
@@ -1867,7 +1882,7 @@ storageVolCreateXML(virStoragePoolPtr pool,
 
         if (buildret < 0) {
             /* buildVol handles deleting volume on failure */
-            storageVolRemoveFromPool(obj, voldef);
+            virStoragePoolObjRemoveVol(obj, voldef);
             voldef = NULL;
             goto cleanup;
         }
@@ -1925,10 +1940,10 @@ storageVolCreateXMLFrom(virStoragePoolPtr pool,
                   NULL);
 
     storageDriverLock();
-    obj = virStoragePoolObjFindByUUID(&driver->pools, pool->uuid);
+    obj = virStoragePoolObjFindByUUID(driver->pools, pool->uuid);
     if (obj && STRNEQ(pool->name, volsrc->pool)) {
         virStoragePoolObjUnlock(obj);
-        objsrc = virStoragePoolObjFindByName(&driver->pools, volsrc->pool);
+        objsrc = virStoragePoolObjFindByName(driver->pools, volsrc->pool);
         virStoragePoolObjLock(obj);
     }
     storageDriverUnlock();
@@ -2018,7 +2033,7 @@ storageVolCreateXMLFrom(virStoragePoolPtr pool,
         backend->refreshVol(pool->conn, obj, voldefsrc) < 0)
         goto cleanup;
 
-    if (VIR_REALLOC_N(obj->volumes.objs, obj->volumes.count + 1) < 0)
+    if (VIR_ALLOC(shadowvol) < 0)
         goto cleanup;
 
     /* 'Define' the new volume so we get async progress reporting.
@@ -2032,16 +2047,18 @@ storageVolCreateXMLFrom(virStoragePoolPtr pool,
      * original allocation value will change as the user polls 'info',
      * but we only need the initial requested values
      */
-    if (VIR_ALLOC(shadowvol) < 0)
-        goto cleanup;
-
     memcpy(shadowvol, voldef, sizeof(*voldef));
 
-    obj->volumes.objs[obj->volumes.count++] = voldef;
+    if (virStoragePoolObjAddVol(obj, voldef) < 0) {
+        storageVolCreateRollback(pool->conn, backend, obj, voldef);
+        goto cleanup;
+    }
+
     newvol = virGetStorageVol(pool->conn, obj->def->name, voldef->name,
                               voldef->key, NULL, NULL);
     if (!newvol) {
-        obj->volumes.count--;
+        virStoragePoolObjRemoveVol(obj, voldef);
+        voldef = NULL;
         goto cleanup;
     }
 
@@ -2227,7 +2244,7 @@ virStorageVolPoolRefreshThread(void *opaque)
         if (virStorageBackendPloopRestoreDesc(cbdata->vol_path) < 0)
             goto cleanup;
     }
-    if (!(obj = virStoragePoolObjFindByName(&driver->pools,
+    if (!(obj = virStoragePoolObjFindByName(driver->pools,
                                             cbdata->pool_name)))
         goto cleanup;
 
@@ -2623,7 +2640,7 @@ storageConnectListAllStoragePools(virConnectPtr conn,
         goto cleanup;
 
     storageDriverLock();
-    ret = virStoragePoolObjListExport(conn, &driver->pools, pools,
+    ret = virStoragePoolObjListExport(conn, driver->pools, pools,
                                       virConnectListAllStoragePoolsCheckACL,
                                       flags);
     storageDriverUnlock();
@@ -3028,7 +3045,7 @@ virStoragePoolObjFindPoolByUUID(const unsigned char *uuid)
     virStoragePoolObjPtr obj;
 
     storageDriverLock();
-    obj = virStoragePoolObjFindByUUID(&driver->pools, uuid);
+    obj = virStoragePoolObjFindByUUID(driver->pools, uuid);
     storageDriverUnlock();
     return obj;
 }
@@ -31,6 +31,9 @@
 #include "virlog.h"
 #include "virstring.h"
 #include "virhash.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "stat-time.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -389,6 +392,166 @@ virStorageFileChown(const virStorageSource *src,
 }
 
 
+/*
+ * Headers of local image files read while looking up backing chains.
+ * Usually many domains share the same base images, so the cache is
+ * shared by the whole process. The headers are keyed by device and
+ * inode of the file and are only valid while its modification time and
+ * size stay the same, so that a file rewritten in place is read again.
+ * The key also contains the user and group the file is read as, so that
+ * a header is never handed out to one which could not read the file.
+ */
+typedef struct _virStorageFileHeader virStorageFileHeader;
+typedef virStorageFileHeader *virStorageFileHeaderPtr;
+struct _virStorageFileHeader {
+    struct timespec mtime;
+    off_t size;
+    char *buf;
+    size_t len;
+};
+
+/* Maximum number of cached headers, each up to VIR_STORAGE_MAX_HEADER */
+#define VIR_STORAGE_FILE_HEADER_CACHE_MAX 512
+
+/* Files modified less than this many milliseconds ago are not cached as
+ * their timestamp may not change on a subsequent write on filesystems
+ * with coarse timestamps */
+#define VIR_STORAGE_FILE_HEADER_CACHE_SETTLE 2000
+
+static virMutex virStorageFileHeaderCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virStorageFileHeaderCache;
+
+
+static void
+virStorageFileHeaderFree(void *payload,
+                         const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageFileHeaderPtr header = payload;
+
+    if (!header)
+        return;
+
+    VIR_FREE(header->buf);
+    VIR_FREE(header);
+}
+
+
+/* Returns the key of @sb in the header cache or NULL if the file the
+ * header of @src is read from must not be cached */
+static char *
+virStorageFileHeaderCacheKey(virStorageSourcePtr src,
+                             struct stat *sb)
+{
+    struct timespec mtime;
+    unsigned long long now;
+    char *key = NULL;
+
+    if (virStorageSourceGetActualType(src) != VIR_STORAGE_TYPE_FILE ||
+        virStorageFileStat(src, sb) < 0 ||
+        !S_ISREG(sb->st_mode) ||
+        virTimeMillisNow(&now) < 0) {
+        virResetLastError();
+        return NULL;
+    }
+
+    mtime = get_stat_mtime(sb);
+    if ((unsigned long long) mtime.tv_sec * 1000 + mtime.tv_nsec / 1000000 +
+        VIR_STORAGE_FILE_HEADER_CACHE_SETTLE > now)
+        return NULL;
+
+    ignore_value(virAsprintf(&key, "%llu:%llu:%u:%u",
+                             (unsigned long long) sb->st_dev,
+                             (unsigned long long) sb->st_ino,
+                             (unsigned int) src->drv->uid,
+                             (unsigned int) src->drv->gid));
+    return key;
+}
+
+
+/**
+ * virStorageFileReadHeader:
+ * @src: file structure pointing to the file
+ * @buf: filled with the header of the file
+ *
+ * Reads up to VIR_STORAGE_MAX_HEADER bytes from the beginning of @src,
+ * or copies them from the header cache if the file was read before and
+ * has not changed since.
+ *
+ * Returns the count of bytes read on success, -1 on failure with a
+ * libvirt error reported.
+ */
+static ssize_t
+virStorageFileReadHeader(virStorageSourcePtr src,
+                         char **buf)
+{
+    virStorageFileHeaderPtr header = NULL;
+    struct stat sb;
+    struct timespec mtime;
+    char *key = NULL;
+    ssize_t ret = -1;
+
+    if (!(key = virStorageFileHeaderCacheKey(src, &sb)))
+        return virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf);
+
+    mtime = get_stat_mtime(&sb);
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+    if (virStorageFileHeaderCache &&
+        (header = virHashLookup(virStorageFileHeaderCache, key)) &&
+        header->mtime.tv_sec == mtime.tv_sec &&
+        header->mtime.tv_nsec == mtime.tv_nsec &&
+        header->size == sb.st_size) {
+        VIR_DEBUG("using cached header of '%s'", src->path);
+        if (VIR_ALLOC_N(*buf, header->len + 1) == 0) {
+            memcpy(*buf, header->buf, header->len);
+            ret = header->len;
+        }
+        virMutexUnlock(&virStorageFileHeaderCacheLock);
+        VIR_FREE(key);
+        return ret;
+    }
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+    header = NULL;
+
+    if ((ret = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
+        goto cleanup;
+
+    /* A failure to cache the header is not fatal */
+    if (VIR_ALLOC(header) < 0 ||
+        VIR_ALLOC_N(header->buf, ret + 1) < 0) {
+        virResetLastError();
+        goto cleanup;
+    }
+
+    memcpy(header->buf, *buf, ret);
+    header->len = ret;
+    header->mtime = mtime;
+    header->size = sb.st_size;
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+    if (!virStorageFileHeaderCache) {
+        virStorageFileHeaderCache = virHashCreate(VIR_STORAGE_FILE_HEADER_CACHE_MAX / 8,
+                                                  virStorageFileHeaderFree);
+    } else if (virHashSize(virStorageFileHeaderCache) >=
+               VIR_STORAGE_FILE_HEADER_CACHE_MAX) {
+        virHashRemoveAll(virStorageFileHeaderCache);
+    }
+
+    if (virStorageFileHeaderCache &&
+        virHashUpdateEntry(virStorageFileHeaderCache, key, header) == 0)
+        header = NULL;
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+
+    if (header)
+        virResetLastError();
+
+ cleanup:
+    virStorageFileHeaderFree(header, NULL);
+    VIR_FREE(key);
+    return ret;
+}
+
+
 /* Recursive workhorse for virStorageFileGetMetadata.  */
 static int
 virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
@@ -447,8 +610,7 @@ virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
     if (virHashAddEntry(cycle, uniqueName, (void *)1) < 0)
         goto cleanup;
 
-    if ((headerLen = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER,
-                                        &buf)) < 0)
+    if ((headerLen = virStorageFileReadHeader(src, &buf)) < 0)
         goto cleanup;
 
     if (virStorageFileGetMetadataInternal(src, buf, headerLen,
@@ -568,8 +730,7 @@ virStorageFileGetBackingStoreStr(virStorageSourcePtr src)
     if (virStorageFileAccess(src, F_OK) < 0)
         return NULL;
 
-    if ((headerLen = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER,
-                                        &buf)) < 0)
+    if ((headerLen = virStorageFileReadHeader(src, &buf)) < 0)
         return NULL;
 
     if (!(tmp = virStorageSourceCopy(src, false)))
@@ -68,6 +68,7 @@
 #include "virstring.h"
 #include "virxml.h"
 #include "virfdstream.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -3516,28 +3517,281 @@ storageBackendProbeTarget(virStorageSourcePtr target,
 }
 
 
+/* Maximum number of threads probing the volumes of a local pool */
+#define VIR_STORAGE_REFRESH_LOCAL_WORKERS 16
+
+typedef struct _virStorageBackendRefreshLocalData virStorageBackendRefreshLocalData;
+typedef virStorageBackendRefreshLocalData *virStorageBackendRefreshLocalDataPtr;
+struct _virStorageBackendRefreshLocalData {
+    virMutex lock;
+    virCond cond;
+
+    size_t pending; /* number of probes not finished yet */
+    virErrorPtr error; /* first error reported by any of the probes */
+};
+
+typedef struct _virStorageBackendRefreshLocalEntry virStorageBackendRefreshLocalEntry;
+typedef virStorageBackendRefreshLocalEntry *virStorageBackendRefreshLocalEntryPtr;
+struct _virStorageBackendRefreshLocalEntry {
+    virStorageVolDefPtr vol;
+    bool probe; /* false if @vol is reused from the previous refresh */
+    int rc; /* 0 on success, -2 if the entry is not a volume, -1 on error */
+};
+
+
+static void
+storageBackendRefreshVolBackingStore(virStorageVolDefPtr vol)
+{
+    if (!vol->target.backingStore)
+        return;
+
+    ignore_value(storageBackendUpdateVolTargetInfo(VIR_STORAGE_VOL_FILE,
+                                                   vol->target.backingStore,
+                                                   false,
+                                                   VIR_STORAGE_VOL_OPEN_DEFAULT, 0));
+    /* If this failed, the backing file is currently unavailable,
+     * the capacity, allocation, owner, group and mode are unknown.
+     * An error message was raised, but we just continue. */
+}
+
+
+/*
+ * Returns 0 on success, -2 if @vol turns out not to be a volume
+ * and -1 on error.
+ */
+static int
+storageBackendRefreshProbeVol(virStorageVolDefPtr vol)
+{
+    int err;
+
+    if ((err = storageBackendProbeTarget(&vol->target,
+                                         &vol->target.encryption)) < 0) {
+        if (err == -2) {
+            /* Silently ignore non-regular files,
+             * eg 'lost+found', dangling symbolic link */
+            return -2;
+        } else if (err == -3) {
+            /* The backing file is currently unavailable, its format is not
+             * explicitly specified, the probe to auto detect the format
+             * failed: continue with faked RAW format, since AUTO will
+             * break virStorageVolTargetDefFormat() generating the line
+             * <format type='...'/>. */
+        } else {
+            return -1;
+        }
+    }
+
+    /* directory based volume */
+    if (vol->target.format == VIR_STORAGE_FILE_DIR)
+        vol->type = VIR_STORAGE_VOL_DIR;
+
+    if (vol->target.format == VIR_STORAGE_FILE_PLOOP)
+        vol->type = VIR_STORAGE_VOL_PLOOP;
+
+    storageBackendRefreshVolBackingStore(vol);
+
+    return 0;
+}
+
+
+static void
+storageBackendRefreshProbeWorker(void *jobdata,
+                                 void *opaque)
+{
+    virStorageBackendRefreshLocalEntryPtr entry = jobdata;
+    virStorageBackendRefreshLocalDataPtr data = opaque;
+    virErrorPtr err = NULL;
+    bool skip;
+
+    virMutexLock(&data->lock);
+    skip = !!data->error;
+    virMutexUnlock(&data->lock);
+
+    /* don't bother probing if the refresh is going to fail anyway */
+    if (skip)
+        entry->rc = -1;
+    else if ((entry->rc = storageBackendRefreshProbeVol(entry->vol)) == -1)
+        err = virSaveLastError();
+
+    virMutexLock(&data->lock);
+    if (err && !data->error) {
+        data->error = err;
+        err = NULL;
+    }
+    data->pending--;
+    virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+
+    virFreeError(err);
+}
+
+
+/*
+ * Probes the volumes of the @entries which need it, in parallel if
+ * there are several of them.
+ */
+static int
+storageBackendRefreshProbeVols(virStorageBackendRefreshLocalEntryPtr entries,
+                               size_t nentries,
+                               size_t nprobes)
+{
+    virStorageBackendRefreshLocalData data;
+    virThreadPoolPtr workers = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (nprobes <= 1) {
+        for (i = 0; i < nentries; i++) {
+            if (entries[i].probe &&
+                (entries[i].rc = storageBackendRefreshProbeVol(entries[i].vol)) == -1)
+                return -1;
+        }
+        return 0;
+    }
+
+    memset(&data, 0, sizeof(data));
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        return -1;
+    }
+
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    if (!(workers = virThreadPoolNew(0, MIN(nprobes,
+                                            VIR_STORAGE_REFRESH_LOCAL_WORKERS),
+                                     0, storageBackendRefreshProbeWorker,
+                                     &data)))
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+
+    for (i = 0; i < nentries; i++) {
+        if (!entries[i].probe)
+            continue;
+
+        if (virThreadPoolSendJob(workers, 0, &entries[i]) < 0)
+            break;
+
+        data.pending++;
+    }
+
+    if (i == nentries)
+        ret = 0;
+
+    /* Even on failure we have to wait for the probes which were
+     * already submitted as they reference @data and @entries */
+    while (data.pending > 0)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+
+    virMutexUnlock(&data.lock);
+
+    if (data.error) {
+        virSetError(data.error);
+        virFreeError(data.error);
+        ret = -1;
+    }
+
+ cleanup:
+    virThreadPoolFree(workers);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+static void
+storageBackendRefreshVolStamp(virStorageVolProbeStampPtr stamp,
+                              const struct stat *sb)
+{
+    stamp->dev = sb->st_dev;
+    stamp->ino = sb->st_ino;
+    stamp->size = sb->st_size;
+    stamp->mtime = get_stat_mtime(sb);
+    stamp->ctime = get_stat_ctime(sb);
+}
+
+
+static bool
+storageBackendRefreshVolUnchanged(virStorageVolDefPtr vol,
+                                  const struct stat *sb)
+{
+    virStorageVolProbeStamp stamp;
+
+    storageBackendRefreshVolStamp(&stamp, sb);
+
+    return vol->probed.ino != 0 &&
+        vol->probed.dev == stamp.dev &&
+        vol->probed.ino == stamp.ino &&
+        vol->probed.size == stamp.size &&
+        vol->probed.mtime.tv_sec == stamp.mtime.tv_sec &&
+        vol->probed.mtime.tv_nsec == stamp.mtime.tv_nsec &&
+        vol->probed.ctime.tv_sec == stamp.ctime.tv_sec &&
+        vol->probed.ctime.tv_nsec == stamp.ctime.tv_nsec;
+}
+
+
+static void
+storageBackendRefreshVolFree(void *payload,
+                             const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageVolDefFree(payload);
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * Volumes already present in the pool, as left by the previous
+ * refresh, are reused as long as the device, inode, size and change
+ * times of their file stay the same. The remaining entries are probed
+ * by a pool of worker threads.
  */
 int
 virStorageBackendRefreshLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
                               virStoragePoolObjPtr pool)
 {
-    DIR *dir;
+    DIR *dir = NULL;
     struct dirent *ent;
     struct statvfs sb;
     struct stat statbuf;
     virStorageVolDefPtr vol = NULL;
     virStorageSourcePtr target = NULL;
+    virHashTablePtr oldvols = NULL;
+    virStorageBackendRefreshLocalEntryPtr entries = NULL;
+    size_t nentries = 0;
+    size_t nprobes = 0;
+    size_t i;
     int direrr;
     int fd = -1, ret = -1;
 
+    if (!(oldvols = virHashCreate(pool->volumes.count + 1,
+                                  storageBackendRefreshVolFree)))
+        goto cleanup;
+
+    for (i = 0; i < pool->volumes.count; i++) {
+        vol = pool->volumes.objs[i];
+        pool->volumes.objs[i] = NULL;
+        if (virHashAddEntry(oldvols, vol->name, vol) < 0)
+            goto cleanup;
+    }
+    vol = NULL;
+    virStoragePoolObjClearVols(pool);
+
     if (virDirOpen(&dir, pool->def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, pool->def->target.path)) > 0) {
-        int err;
+        virStorageBackendRefreshLocalEntry entry = { NULL, false, 0 };
+        virStorageVolDefPtr old;
+        struct stat st;
+        bool stamped;
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file with control characters under '%s'",
@@ -3548,63 +3802,68 @@ virStorageBackendRefreshLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
         if (VIR_ALLOC(vol) < 0)
             goto cleanup;
 
-        if (VIR_STRDUP(vol->name, ent->d_name) < 0)
-            goto cleanup;
-
-        vol->type = VIR_STORAGE_VOL_FILE;
-        vol->target.format = VIR_STORAGE_FILE_RAW; /* Real value is filled in during probe */
         if (virAsprintf(&vol->target.path, "%s/%s",
                         pool->def->target.path,
-                        vol->name) < 0)
+                        ent->d_name) < 0)
             goto cleanup;
 
-        if (VIR_STRDUP(vol->key, vol->target.path) < 0)
-            goto cleanup;
+        stamped = stat(vol->target.path, &st) == 0;
 
-        if ((err = storageBackendProbeTarget(&vol->target,
-                                             &vol->target.encryption)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            } else if (err == -3) {
-                /* The backing file is currently unavailable, its format is not
-                 * explicitly specified, the probe to auto detect the format
-                 * failed: continue with faked RAW format, since AUTO will
-                 * break virStorageVolTargetDefFormat() generating the line
-                 * <format type='...'/>. */
-            } else {
+        if (stamped &&
+            (old = virHashLookup(oldvols, ent->d_name)) &&
+            storageBackendRefreshVolUnchanged(old, &st)) {
+            ignore_value(virHashSteal(oldvols, ent->d_name));
+            entry.vol = old;
+            if (VIR_APPEND_ELEMENT(entries, nentries, entry) < 0) {
+                virStorageVolDefFree(old);
                 goto cleanup;
             }
+            virStorageVolDefFree(vol);
+            vol = NULL;
+            continue;
         }
 
-        /* directory based volume */
-        if (vol->target.format == VIR_STORAGE_FILE_DIR)
-            vol->type = VIR_STORAGE_VOL_DIR;
-
-        if (vol->target.format == VIR_STORAGE_FILE_PLOOP)
-            vol->type = VIR_STORAGE_VOL_PLOOP;
-
-        if (vol->target.backingStore) {
-            ignore_value(storageBackendUpdateVolTargetInfo(VIR_STORAGE_VOL_FILE,
-                                                           vol->target.backingStore,
-                                                           false,
-                                                           VIR_STORAGE_VOL_OPEN_DEFAULT, 0));
-            /* If this failed, the backing file is currently unavailable,
-             * the capacity, allocation, owner, group and mode are unknown.
-             * An error message was raised, but we just continue. */
-        }
+        if (VIR_STRDUP(vol->name, ent->d_name) < 0)
+            goto cleanup;
 
-        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
+        vol->type = VIR_STORAGE_VOL_FILE;
+        vol->target.format = VIR_STORAGE_FILE_RAW; /* Real value is filled in during probe */
+
+        if (VIR_STRDUP(vol->key, vol->target.path) < 0)
             goto cleanup;
+
+        if (stamped)
+            storageBackendRefreshVolStamp(&vol->probed, &st);
+
+        entry.vol = vol;
+        entry.probe = true;
+        if (VIR_APPEND_ELEMENT(entries, nentries, entry) < 0)
+            goto cleanup;
+        vol = NULL;
+        nprobes++;
     }
     if (direrr < 0)
         goto cleanup;
     VIR_DIR_CLOSE(dir);
     vol = NULL;
 
+    if (storageBackendRefreshProbeVols(entries, nentries, nprobes) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nentries; i++) {
+        if (entries[i].probe) {
+            if (entries[i].rc == -2)
+                continue;
+        } else {
+            /* Its backing file might have changed on its own */
+            storageBackendRefreshVolBackingStore(entries[i].vol);
+        }
+
+        if (virStoragePoolObjAddVol(pool, entries[i].vol) < 0)
+            goto cleanup;
+        entries[i].vol = NULL;
+    }
+
     if (VIR_ALLOC(target))
         goto cleanup;
 
@@ -3652,6 +3911,10 @@ virStorageBackendRefreshLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
     VIR_FORCE_CLOSE(fd);
     virStorageVolDefFree(vol);
     virStorageSourceFree(target);
+    for (i = 0; i < nentries; i++)
+        virStorageVolDefFree(entries[i].vol);
+    VIR_FREE(entries);
+    virHashFree(oldvols);
     if (ret < 0)
         virStoragePoolObjClearVols(pool);
     return ret;
@@ -3785,7 +4048,7 @@ virStorageBackendSCSINewLun(virStoragePoolObjPtr pool,
     pool->def->capacity += vol->target.capacity;
     pool->def->allocation += vol->target.allocation;
 
-    if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
+    if (virStoragePoolObjAddVol(pool, vol) < 0)
         goto cleanup;
 
     vol = NULL;
@@ -100,7 +100,7 @@ struct _testDriver {
     virInterfaceObjListPtr ifaces;
     bool transaction_running;
     virInterfaceObjListPtr backupIfaces;
-    virStoragePoolObjList pools;
+    virStoragePoolObjListPtr pools;
     virNodeDeviceObjListPtr devs;
     int numCells;
     testCell cells[MAX_CELLS];
@@ -155,7 +155,7 @@ testDriverFree(testDriverPtr driver)
     virNodeDeviceObjListFree(driver->devs);
     virObjectUnref(driver->networks);
     virInterfaceObjListFree(driver->ifaces);
-    virStoragePoolObjListFree(&driver->pools);
+    virObjectUnref(driver->pools);
     virObjectUnref(driver->eventState);
     virMutexUnlock(&driver->lock);
     virMutexDestroy(&driver->lock);
@@ -419,7 +419,8 @@ testDriverNew(void)
         !(ret->ifaces = virInterfaceObjListNew()) ||
         !(ret->domains = virDomainObjListNew()) ||
         !(ret->networks = virNetworkObjListNew()) ||
-        !(ret->devs = virNodeDeviceObjListNew()))
+        !(ret->devs = virNodeDeviceObjListNew()) ||
+        !(ret->pools = virStoragePoolObjListNew()))
         goto error;
 
     virAtomicIntSet(&ret->nextDomID, 1);
@@ -643,10 +644,12 @@ testDomainGenerateIfnames(virDomainDefPtr domdef)
 
 
 static void
-testDomainShutdownState(virDomainPtr domain,
+testDomainShutdownState(testDriverPtr privconn,
+                        virDomainPtr domain,
                         virDomainObjPtr privdom,
                         virDomainShutoffReason reason)
 {
+    virDomainObjListSetID(privconn->domains, privdom, -1);
     virDomainObjRemoveTransientDef(privdom);
     virDomainObjSetState(privdom, VIR_DOMAIN_SHUTOFF, reason);
 
@@ -663,7 +666,8 @@ testDomainStartState(testDriverPtr privconn,
     int ret = -1;
 
     virDomainObjSetState(dom, VIR_DOMAIN_RUNNING, reason);
-    dom->def->id = virAtomicIntAdd(&privconn->nextDomID, 1);
+    virDomainObjListSetID(privconn->domains, dom,
+                          virAtomicIntAdd(&privconn->nextDomID, 1));
 
     if (virDomainObjSetDefTransient(privconn->caps,
                                     privconn->xmlopt,
@@ -675,7 +679,7 @@ testDomainStartState(testDriverPtr privconn,
     ret = 0;
  cleanup:
     if (ret < 0)
-        testDomainShutdownState(NULL, dom, VIR_DOMAIN_SHUTOFF_FAILED);
+        testDomainShutdownState(privconn, NULL, dom, VIR_DOMAIN_SHUTOFF_FAILED);
     return ret;
 }
 
@@ -945,7 +949,7 @@ testParseDomains(testDriverPtr privconn,
                 goto error;
             }
         } else {
-            testDomainShutdownState(NULL, obj, 0);
+            testDomainShutdownState(privconn, NULL, obj, 0);
         }
         virDomainObjSetState(obj, nsdata->runstate, 0);
 
@@ -1079,7 +1083,7 @@ testOpenVolumesForPool(const char *file,
 
         if (!def->key && VIR_STRDUP(def->key, def->target.path) < 0)
             goto error;
-        if (VIR_APPEND_ELEMENT_COPY(obj->volumes.objs, obj->volumes.count, def) < 0)
+        if (virStoragePoolObjAddVol(obj, def) < 0)
             goto error;
 
         obj->def->allocation += def->target.allocation;
@@ -1120,7 +1124,7 @@ testParseStorage(testDriverPtr privconn,
         if (!def)
             goto error;
 
-        if (!(obj = virStoragePoolObjAssignDef(&privconn->pools,
+        if (!(obj = virStoragePoolObjAssignDef(privconn->pools,
                                                 def))) {
             virStoragePoolDefFree(def);
             goto error;
@@ -1775,7 +1779,8 @@ static int testDomainDestroy(virDomainPtr domain)
         goto cleanup;
     }
 
-    testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_DESTROYED);
+    testDomainShutdownState(privconn, domain, privdom,
+                            VIR_DOMAIN_SHUTOFF_DESTROYED);
     event = virDomainEventLifecycleNewFromObj(privdom,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_DESTROYED);
@@ -1869,7 +1874,8 @@ static int testDomainShutdownFlags(virDomainPtr domain,
         goto cleanup;
     }
 
-    testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_SHUTDOWN);
+    testDomainShutdownState(privconn, domain, privdom,
+                            VIR_DOMAIN_SHUTOFF_SHUTDOWN);
     event = virDomainEventLifecycleNewFromObj(privdom,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_SHUTDOWN);
@@ -1939,7 +1945,8 @@ static int testDomainReboot(virDomainPtr domain,
     }
 
     if (virDomainObjGetState(privdom, NULL) == VIR_DOMAIN_SHUTOFF) {
-        testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_SHUTDOWN);
+        testDomainShutdownState(privconn, domain, privdom,
+                                VIR_DOMAIN_SHUTOFF_SHUTDOWN);
         event = virDomainEventLifecycleNewFromObj(privdom,
                                          VIR_DOMAIN_EVENT_STOPPED,
                                          VIR_DOMAIN_EVENT_STOPPED_SHUTDOWN);
@@ -2078,7 +2085,8 @@ testDomainSaveFlags(virDomainPtr domain, const char *path,
     }
     fd = -1;
 
-    testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_SAVED);
+    testDomainShutdownState(privconn, domain, privdom,
+                            VIR_DOMAIN_SHUTOFF_SAVED);
     event = virDomainEventLifecycleNewFromObj(privdom,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_SAVED);
@@ -2265,7 +2273,8 @@ static int testDomainCoreDumpWithFormat(virDomainPtr domain,
     }
 
     if (flags & VIR_DUMP_CRASH) {
-        testDomainShutdownState(domain, privdom, VIR_DOMAIN_SHUTOFF_CRASHED);
+        testDomainShutdownState(privconn, domain, privdom,
+                                VIR_DOMAIN_SHUTOFF_CRASHED);
         event = virDomainEventLifecycleNewFromObj(privdom,
                                          VIR_DOMAIN_EVENT_STOPPED,
                                          VIR_DOMAIN_EVENT_STOPPED_CRASHED);
@@ -4071,7 +4080,7 @@ testStoragePoolObjFindByName(testDriverPtr privconn,
     virStoragePoolObjPtr obj;
 
     testDriverLock(privconn);
-    obj = virStoragePoolObjFindByName(&privconn->pools, name);
+    obj = virStoragePoolObjFindByName(privconn->pools, name);
     testDriverUnlock(privconn);
 
     if (!obj)
@@ -4131,7 +4140,7 @@ testStoragePoolObjFindByUUID(testDriverPtr privconn,
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
     testDriverLock(privconn);
-    obj = virStoragePoolObjFindByUUID(&privconn->pools, uuid);
+    obj = virStoragePoolObjFindByUUID(privconn->pools, uuid);
     testDriverUnlock(privconn);
 
     if (!obj) {
@@ -4197,7 +4206,7 @@ testConnectNumOfStoragePools(virConnectPtr conn)
     int numActive = 0;
 
     testDriverLock(privconn);
-    numActive = virStoragePoolObjNumOfStoragePools(&privconn->pools, conn,
+    numActive = virStoragePoolObjNumOfStoragePools(privconn->pools, conn,
                                                    true, NULL);
     testDriverUnlock(privconn);
 
@@ -4214,7 +4223,7 @@ testConnectListStoragePools(virConnectPtr conn,
     int n = 0;
 
     testDriverLock(privconn);
-    n = virStoragePoolObjGetNames(&privconn->pools, conn, true, NULL,
+    n = virStoragePoolObjGetNames(privconn->pools, conn, true, NULL,
                                   names, maxnames);
     testDriverUnlock(privconn);
 
@@ -4229,7 +4238,7 @@ testConnectNumOfDefinedStoragePools(virConnectPtr conn)
     int numInactive = 0;
 
     testDriverLock(privconn);
-    numInactive = virStoragePoolObjNumOfStoragePools(&privconn->pools, conn,
+    numInactive = virStoragePoolObjNumOfStoragePools(privconn->pools, conn,
                                                      false, NULL);
     testDriverUnlock(privconn);
 
@@ -4246,7 +4255,7 @@ testConnectListDefinedStoragePools(virConnectPtr conn,
     int n = 0;
 
     testDriverLock(privconn);
-    n = virStoragePoolObjGetNames(&privconn->pools, conn, false, NULL,
+    n = virStoragePoolObjGetNames(privconn->pools, conn, false, NULL,
                                   names, maxnames);
     testDriverUnlock(privconn);
 
@@ -4265,7 +4274,7 @@ testConnectListAllStoragePools(virConnectPtr conn,
     virCheckFlags(VIR_CONNECT_LIST_STORAGE_POOLS_FILTERS_ALL, -1);
 
     testDriverLock(privconn);
-    ret = virStoragePoolObjListExport(conn, &privconn->pools, pools,
+    ret = virStoragePoolObjListExport(conn, privconn->pools, pools,
                                       NULL, flags);
     testDriverUnlock(privconn);
 
@@ -4432,16 +4441,16 @@ testStoragePoolCreateXML(virConnectPtr conn,
     if (!(def = virStoragePoolDefParseString(xml)))
         goto cleanup;
 
-    obj = virStoragePoolObjFindByUUID(&privconn->pools, def->uuid);
+    obj = virStoragePoolObjFindByUUID(privconn->pools, def->uuid);
     if (!obj)
-        obj = virStoragePoolObjFindByName(&privconn->pools, def->name);
+        obj = virStoragePoolObjFindByName(privconn->pools, def->name);
     if (obj) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        "%s", _("storage pool already exists"));
         goto cleanup;
     }
 
-    if (!(obj = virStoragePoolObjAssignDef(&privconn->pools, def)))
+    if (!(obj = virStoragePoolObjAssignDef(privconn->pools, def)))
         goto cleanup;
     def = NULL;
 
@@ -4453,14 +4462,14 @@ testStoragePoolCreateXML(virConnectPtr conn,
         if (testCreateVport(privconn,
                             obj->def->source.adapter.data.fchost.wwnn,
                             obj->def->source.adapter.data.fchost.wwpn) < 0) {
-            virStoragePoolObjRemove(&privconn->pools, obj);
+            virStoragePoolObjRemove(privconn->pools, obj);
             obj = NULL;
             goto cleanup;
         }
     }
 
     if (testStoragePoolObjSetDefaults(obj) == -1) {
-        virStoragePoolObjRemove(&privconn->pools, obj);
+        virStoragePoolObjRemove(privconn->pools, obj);
         obj = NULL;
         goto cleanup;
     }
@@ -4509,7 +4518,7 @@ testStoragePoolDefineXML(virConnectPtr conn,
     def->allocation = defaultPoolAlloc;
     def->available = defaultPoolCap - defaultPoolAlloc;
 
-    if (!(obj = virStoragePoolObjAssignDef(&privconn->pools, def)))
+    if (!(obj = virStoragePoolObjAssignDef(privconn->pools, def)))
         goto cleanup;
     def = NULL;
 
@@ -4518,7 +4527,7 @@ testStoragePoolDefineXML(virConnectPtr conn,
                                             0);
 
     if (testStoragePoolObjSetDefaults(obj) == -1) {
-        virStoragePoolObjRemove(&privconn->pools, obj);
+        virStoragePoolObjRemove(privconn->pools, obj);
         obj = NULL;
         goto cleanup;
     }
@@ -4549,7 +4558,7 @@ testStoragePoolUndefine(virStoragePoolPtr pool)
                                             VIR_STORAGE_POOL_EVENT_UNDEFINED,
                                             0);
 
-    virStoragePoolObjRemove(&privconn->pools, obj);
+    virStoragePoolObjRemove(privconn->pools, obj);
 
     testObjectEventQueue(privconn, event);
     return 0;
@@ -4634,7 +4643,7 @@ testStoragePoolDestroy(virStoragePoolPtr pool)
                                             0);
 
     if (obj->configFile == NULL) {
-        virStoragePoolObjRemove(&privconn->pools, obj);
+        virStoragePoolObjRemove(privconn->pools, obj);
         obj = NULL;
     }
     ret = 0;
@@ -4882,75 +4891,81 @@ testStorageVolLookupByName(virStoragePoolPtr pool,
 }
 
 
+static bool
+testStorageVolLookupByKeyCallback(virStoragePoolObjPtr obj,
+                                  void *opaque)
+{
+    return virStoragePoolObjIsActive(obj) &&
+        virStorageVolDefFindByKey(obj, opaque);
+}
+
+
 static virStorageVolPtr
 testStorageVolLookupByKey(virConnectPtr conn,
                           const char *key)
 {
     testDriverPtr privconn = conn->privateData;
-    size_t i;
+    virStoragePoolObjPtr obj;
+    virStorageVolDefPtr privvol;
     virStorageVolPtr ret = NULL;
 
     testDriverLock(privconn);
-    for (i = 0; i < privconn->pools.count; i++) {
-        virStoragePoolObjLock(privconn->pools.objs[i]);
-        if (virStoragePoolObjIsActive(privconn->pools.objs[i])) {
-            virStorageVolDefPtr privvol =
-                virStorageVolDefFindByKey(privconn->pools.objs[i], key);
-
-            if (privvol) {
-                ret = virGetStorageVol(conn,
-                                       privconn->pools.objs[i]->def->name,
-                                       privvol->name,
-                                       privvol->key,
-                                       NULL, NULL);
-                virStoragePoolObjUnlock(privconn->pools.objs[i]);
-                break;
-            }
-        }
-        virStoragePoolObjUnlock(privconn->pools.objs[i]);
-    }
+    obj = virStoragePoolObjListSearch(privconn->pools,
+                                      testStorageVolLookupByKeyCallback,
+                                      (void *) key);
     testDriverUnlock(privconn);
 
-    if (!ret)
+    if (!obj) {
         virReportError(VIR_ERR_NO_STORAGE_VOL,
                        _("no storage vol with matching key '%s'"), key);
+        return NULL;
+    }
+
+    privvol = virStorageVolDefFindByKey(obj, key);
+    ret = virGetStorageVol(conn, obj->def->name,
+                           privvol->name, privvol->key,
+                           NULL, NULL);
+    virStoragePoolObjUnlock(obj);
 
     return ret;
 }
 
 
+static bool
+testStorageVolLookupByPathCallback(virStoragePoolObjPtr obj,
+                                   void *opaque)
+{
+    return virStoragePoolObjIsActive(obj) &&
+        virStorageVolDefFindByPath(obj, opaque);
+}
+
+
 static virStorageVolPtr
 testStorageVolLookupByPath(virConnectPtr conn,
                            const char *path)
 {
     testDriverPtr privconn = conn->privateData;
-    size_t i;
+    virStoragePoolObjPtr obj;
+    virStorageVolDefPtr privvol;
     virStorageVolPtr ret = NULL;
 
     testDriverLock(privconn);
-    for (i = 0; i < privconn->pools.count; i++) {
-        virStoragePoolObjLock(privconn->pools.objs[i]);
-        if (virStoragePoolObjIsActive(privconn->pools.objs[i])) {
-            virStorageVolDefPtr privvol =
-                virStorageVolDefFindByPath(privconn->pools.objs[i], path);
-
-            if (privvol) {
-                ret = virGetStorageVol(conn,
-                                       privconn->pools.objs[i]->def->name,
-                                       privvol->name,
-                                       privvol->key,
-                                       NULL, NULL);
-                virStoragePoolObjUnlock(privconn->pools.objs[i]);
-                break;
-            }
-        }
-        virStoragePoolObjUnlock(privconn->pools.objs[i]);
-    }
+    obj = virStoragePoolObjListSearch(privconn->pools,
+                                      testStorageVolLookupByPathCallback,
+                                      (void *) path);
     testDriverUnlock(privconn);
 
-    if (!ret)
+    if (!obj) {
         virReportError(VIR_ERR_NO_STORAGE_VOL,
                        _("no storage vol with matching path '%s'"), path);
+        return NULL;
+    }
+
+    privvol = virStorageVolDefFindByPath(obj, path);
+    ret = virGetStorageVol(conn, obj->def->name,
+                           privvol->name, privvol->key,
+                           NULL, NULL);
+    virStoragePoolObjUnlock(obj);
 
     return ret;
 }
@@ -4995,8 +5010,7 @@ testStorageVolCreateXML(virStoragePoolPtr pool,
         goto cleanup;
 
     if (VIR_STRDUP(privvol->key, privvol->target.path) < 0 ||
-        VIR_APPEND_ELEMENT_COPY(obj->volumes.objs,
-                                obj->volumes.count, privvol) < 0)
+        virStoragePoolObjAddVol(obj, privvol) < 0)
         goto cleanup;
 
     obj->def->allocation += privvol->target.allocation;
@@ -5063,8 +5077,7 @@ testStorageVolCreateXMLFrom(virStoragePoolPtr pool,
         goto cleanup;
 
     if (VIR_STRDUP(privvol->key, privvol->target.path) < 0 ||
-        VIR_APPEND_ELEMENT_COPY(obj->volumes.objs,
-                                obj->volumes.count, privvol) < 0)
+        virStoragePoolObjAddVol(obj, privvol) < 0)
         goto cleanup;
 
     obj->def->allocation += privvol->target.allocation;
@@ -5089,7 +5102,6 @@ testStorageVolDelete(virStorageVolPtr vol,
     testDriverPtr privconn = vol->conn->privateData;
     virStoragePoolObjPtr obj;
     virStorageVolDefPtr privvol;
-    size_t i;
     int ret = -1;
 
     virCheckFlags(0, -1);
@@ -5103,14 +5115,7 @@ testStorageVolDelete(virStorageVolPtr vol,
     obj->def->allocation -= privvol->target.allocation;
     obj->def->available = (obj->def->capacity - obj->def->allocation);
 
-    for (i = 0; i < obj->volumes.count; i++) {
-        if (obj->volumes.objs[i] == privvol) {
-            virStorageVolDefFree(privvol);
-
-            VIR_DELETE_ELEMENT(obj->volumes.objs, i, obj->volumes.count);
-            break;
-        }
-    }
+    virStoragePoolObjRemoveVol(obj, privvol);
     ret = 0;
 
  cleanup:
@@ -5825,7 +5830,7 @@ testDomainManagedSave(virDomainPtr dom, unsigned int flags)
         goto cleanup;
     }
 
-    testDomainShutdownState(dom, vm, VIR_DOMAIN_SHUTOFF_SAVED);
+    testDomainShutdownState(privconn, dom, vm, VIR_DOMAIN_SHUTOFF_SAVED);
     event = virDomainEventLifecycleNewFromObj(vm,
                                      VIR_DOMAIN_EVENT_STOPPED,
                                      VIR_DOMAIN_EVENT_STOPPED_SAVED);
@@ -6327,7 +6332,7 @@ testDomainSnapshotCreateXML(virDomainPtr domain,
 
         if ((flags & VIR_DOMAIN_SNAPSHOT_CREATE_HALT) &&
             virDomainObjIsActive(vm)) {
-            testDomainShutdownState(domain, vm,
+            testDomainShutdownState(privconn, domain, vm,
                                     VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT);
             event = virDomainEventLifecycleNewFromObj(vm, VIR_DOMAIN_EVENT_STOPPED,
                                     VIR_DOMAIN_EVENT_STOPPED_FROM_SNAPSHOT);
@@ -6587,7 +6592,7 @@ testDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
                 }
 
                 virResetError(err);
-                testDomainShutdownState(snapshot->domain, vm,
+                testDomainShutdownState(privconn, snapshot->domain, vm,
                                         VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT);
                 event = virDomainEventLifecycleNewFromObj(vm,
                             VIR_DOMAIN_EVENT_STOPPED,
@@ -6659,7 +6664,7 @@ testDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
 
         if (virDomainObjIsActive(vm)) {
             /* Transitions 4, 7 */
-            testDomainShutdownState(snapshot->domain, vm,
+            testDomainShutdownState(privconn, snapshot->domain, vm,
                                     VIR_DOMAIN_SHUTOFF_FROM_SNAPSHOT);
             event = virDomainEventLifecycleNewFromObj(vm,
                                     VIR_DOMAIN_EVENT_STOPPED,
@@ -34,6 +34,7 @@
 #include "viralloc.h"
 #include "virerror.h"
 #include "virstring.h"
+#include "virutil.h"
 
 
 /* If adding more fields, ensure to edit buf.h to match
@@ -125,19 +126,24 @@ virBufferGetIndent(const virBuffer *buf, bool dynamic)
     return buf->indent;
 }
 
+/* Size of the first allocation done for a buffer */
+#define VIR_BUFFER_MIN_SIZE 1024
+
 /**
  * virBufferGrow:
  * @buf: the buffer
  * @len: the minimum free size to allocate on top of existing used space
  *
- * Grow the available space of a buffer to at least @len bytes.
+ * Grow the available space of a buffer to at least @len bytes.  The
+ * allocation is at least doubled each time so that building a large
+ * document piece by piece doesn't copy it over and over again.
  *
  * Returns zero on success or -1 on error
  */
 static int
 virBufferGrow(virBufferPtr buf, unsigned int len)
 {
-    int size;
+    unsigned int size;
 
     if (buf->error)
         return -1;
@@ -145,7 +151,14 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     if ((len + buf->use) < buf->size)
         return 0;
 
-    size = buf->use + len + 1000;
+    if (len >= UINT_MAX - buf->use) {
+        virBufferSetError(buf, ENOMEM);
+        return -1;
+    }
+
+    size = MAX(buf->use + len + 1, VIR_BUFFER_MIN_SIZE);
+    if (buf->size <= UINT_MAX / 2)
+        size = MAX(size, buf->size * 2);
 
     if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
         virBufferSetError(buf, errno);
@@ -155,6 +168,25 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     return 0;
 }
 
+/**
+ * virBufferReserve:
+ * @buf: the buffer
+ * @len: number of bytes about to be added
+ *
+ * Make sure there's room for at least @len more bytes in @buf so that
+ * callers which know the (approximate) size of what they're going to
+ * format can avoid intermediate reallocations.  This is merely a hint,
+ * the buffer still grows as needed.
+ */
+void
+virBufferReserve(virBufferPtr buf, unsigned int len)
+{
+    if (!buf)
+        return;
+
+    ignore_value(virBufferGrow(buf, len));
+}
+
 /**
  * virBufferAdd:
  * @buf: the buffer to append to
@@ -174,13 +206,22 @@ virBufferAdd(virBufferPtr buf, const char *str, int len)
     if (!str || !buf || (len == 0 && buf->indent == 0))
         return;
 
+    if (len < 0)
+        len = strlen(str);
+
+    /* Fast path for additions which fit and need no indentation */
+    if (buf->indent == 0 && !buf->error &&
+        buf->size - buf->use > (unsigned int) len + 1) {
+        memcpy(&buf->content[buf->use], str, len);
+        buf->use += len;
+        buf->content[buf->use] = '\0';
+        return;
+    }
+
     indent = virBufferGetIndent(buf, true);
     if (indent < 0)
         return;
 
-    if (len < 0)
-        len = strlen(str);
-
     needSize = buf->use + indent + len + 2;
     if (virBufferGrow(buf, needSize - buf->use) < 0)
         return;
@@ -239,6 +280,13 @@ virBufferAddBuffer(virBufferPtr buf, virBufferPtr toadd)
 void
 virBufferAddChar(virBufferPtr buf, char c)
 {
+    if (buf && buf->indent == 0 && !buf->error &&
+        buf->size - buf->use > 2) {
+        buf->content[buf->use++] = c;
+        buf->content[buf->use] = '\0';
+        return;
+    }
+
     virBufferAdd(buf, &c, 1);
 }
 
@@ -41,6 +41,9 @@
 #if defined(WITH_SECDRIVER_APPARMOR)
 # include <sys/apparmor.h>
 #endif
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
 
 #define __VIR_COMMAND_PRIV_H_ALLOW__
 #include "vircommandpriv.h"
@@ -52,6 +55,7 @@
 #include "virpidfile.h"
 #include "virprocess.h"
 #include "virbuffer.h"
+#include "virbitmap.h"
 #include "virthread.h"
 #include "virstring.h"
 
@@ -59,6 +63,17 @@
 
 VIR_LOG_INIT("util.command");
 
+#ifdef __linux__
+/*
+ * Workaround older glibc and kernel headers. Unlike most
+ * syscalls, close_range has the same number on all
+ * architectures. Kernels which don't know it fail with ENOSYS.
+ */
+# ifndef __NR_close_range
+#  define __NR_close_range 436
+# endif
+#endif
+
 /* Flags for virExec */
 enum {
     VIR_EXEC_NONE       = 0,
@@ -499,6 +514,194 @@ virExecCommon(virCommandPtr cmd)
     return ret;
 }
 
+/*
+ * virCommandFDIsKept:
+ * @cmd: the command
+ * @fd: FD to test
+ * @childin, @childout, @childerr: FDs to become child's stdio
+ *
+ * Check whether @fd is to stay open in the child.
+ */
+static bool
+virCommandFDIsKept(virCommandPtr cmd,
+                   int fd,
+                   int childin,
+                   int childout,
+                   int childerr)
+{
+    return fd == childin || fd == childout || fd == childerr ||
+        virCommandFDIsSet(cmd, fd);
+}
+
+
+# ifdef __linux__
+/*
+ * virCommandMassCloseRange:
+ *
+ * Close all FDs above stderr but those the child is to keep
+ * by as few close_range() calls as there are FDs kept.
+ *
+ * Returns 0 on success, -1 with errno set if the kernel
+ * doesn't support close_range().
+ */
+static int
+virCommandMassCloseRange(virCommandPtr cmd,
+                         int childin,
+                         int childout,
+                         int childerr)
+{
+    unsigned int from = 3;
+
+    for (;;) {
+        int next = -1;
+        size_t i;
+
+        /* The lowest kept FD not below @from */
+        for (i = 0; i < cmd->npassfd; i++) {
+            int fd = cmd->passfd[i].fd;
+            if (fd >= (int) from && (next < 0 || fd < next))
+                next = fd;
+        }
+        if (childin >= (int) from && (next < 0 || childin < next))
+            next = childin;
+        if (childout >= (int) from && (next < 0 || childout < next))
+            next = childout;
+        if (childerr >= (int) from && (next < 0 || childerr < next))
+            next = childerr;
+
+        if (next < 0)
+            return syscall(__NR_close_range, from, ~0U, 0) < 0 ? -1 : 0;
+
+        if (next > (int) from &&
+            syscall(__NR_close_range, from, next - 1, 0) < 0)
+            return -1;
+
+        from = next + 1;
+    }
+}
+
+
+/*
+ * virCommandMassCloseProc:
+ *
+ * Close all FDs above stderr but those the child is to keep,
+ * looking up which FDs are open in /proc/self/fd rather than
+ * trying every possible FD.
+ *
+ * Returns 0 on success, -1 if /proc is not available.
+ */
+static int
+virCommandMassCloseProc(virCommandPtr cmd,
+                        int childin,
+                        int childout,
+                        int childerr)
+{
+    const char *dirName = "/proc/self/fd";
+    virBitmapPtr fds = NULL;
+    DIR *dp = NULL;
+    struct dirent *entry;
+    ssize_t fd;
+    int rc;
+    int ret = -1;
+
+    if (virDirOpenQuiet(&dp, dirName) < 0)
+        return -1;
+
+    if (!(fds = virBitmapNew(64)))
+        goto cleanup;
+
+    /* The directory FD is listed too, so collect the FDs first
+     * and close them once we're done reading */
+    while ((rc = virDirRead(dp, &entry, dirName)) > 0) {
+        unsigned int num;
+
+        if (virStrToLong_uip(entry->d_name, NULL, 10, &num) < 0 ||
+            virBitmapSetBitExpand(fds, num) < 0)
+            goto cleanup;
+    }
+    if (rc < 0)
+        goto cleanup;
+    VIR_DIR_CLOSE(dp);
+
+    fd = 2;
+    while ((fd = virBitmapNextSetBit(fds, fd)) >= 0) {
+        int tmpfd = fd;
+
+        if (!virCommandFDIsKept(cmd, fd, childin, childout, childerr))
+            VIR_MASS_CLOSE(tmpfd);
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dp);
+    virBitmapFree(fds);
+    return ret;
+}
+# endif /* __linux__ */
+
+
+/*
+ * virCommandMassClose:
+ * @cmd: the command
+ * @childin, @childout, @childerr: FDs to become child's stdio
+ *
+ * Close all FDs in the child but stdio, @childin, @childout,
+ * @childerr and those passed with virCommandPassFD() which are
+ * made inheritable instead. With a high RLIMIT_NOFILE trying
+ * each FD up to _SC_OPEN_MAX costs as many syscalls, so on Linux
+ * close_range() or the list of open FDs are used if possible.
+ *
+ * Returns 0 on success, -1 on error (error is reported).
+ */
+static int
+virCommandMassClose(virCommandPtr cmd,
+                    int childin,
+                    int childout,
+                    int childerr)
+{
+    int openmax;
+    int fd;
+    size_t i;
+
+# ifdef __linux__
+    if (virCommandMassCloseRange(cmd, childin, childout, childerr) == 0 ||
+        virCommandMassCloseProc(cmd, childin, childout, childerr) == 0)
+        goto inherit;
+    virResetLastError();
+# endif
+
+    openmax = sysconf(_SC_OPEN_MAX);
+    if (openmax < 0) {
+        virReportSystemError(errno,  "%s",
+                             _("sysconf(_SC_OPEN_MAX) failed"));
+        return -1;
+    }
+    for (fd = 3; fd < openmax; fd++) {
+        int tmpfd = fd;
+
+        if (!virCommandFDIsKept(cmd, fd, childin, childout, childerr))
+            VIR_MASS_CLOSE(tmpfd);
+    }
+
+# ifdef __linux__
+ inherit:
+# endif
+    for (i = 0; i < cmd->npassfd; i++) {
+        fd = cmd->passfd[i].fd;
+
+        if (fd < 3 || fd == childin || fd == childout || fd == childerr)
+            continue;
+        if (virSetInherit(fd, true) < 0) {
+            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 /*
  * virExec:
  * @cmd virCommandPtr containing all information about the program to
@@ -508,13 +711,12 @@ static int
 virExec(virCommandPtr cmd)
 {
     pid_t pid;
-    int null = -1, fd, openmax;
+    int null = -1;
     int pipeout[2] = {-1, -1};
     int pipeerr[2] = {-1, -1};
     int childin = cmd->infd;
     int childout = -1;
     int childerr = -1;
-    int tmpfd;
     char *binarystr = NULL;
     const char *binary = NULL;
     int ret;
@@ -617,23 +819,8 @@ virExec(virCommandPtr cmd)
     if (cmd->mask)
         umask(cmd->mask);
     ret = EXIT_CANCELED;
-    openmax = sysconf(_SC_OPEN_MAX);
-    if (openmax < 0) {
-        virReportSystemError(errno,  "%s",
-                             _("sysconf(_SC_OPEN_MAX) failed"));
+    if (virCommandMassClose(cmd, childin, childout, childerr) < 0)
         goto fork_error;
-    }
-    for (fd = 3; fd < openmax; fd++) {
-        if (fd == childin || fd == childout || fd == childerr)
-            continue;
-        if (!virCommandFDIsSet(cmd, fd)) {
-            tmpfd = fd;
-            VIR_MASS_CLOSE(tmpfd);
-        } else if (virSetInherit(fd, true) < 0) {
-            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
-            goto fork_error;
-        }
-    }
 
     if (prepareStdFd(childin, STDIN_FILENO) < 0) {
         virReportSystemError(errno,
@@ -30,6 +30,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 
 #include "virthread.h"
 #include "virlog.h"
@@ -47,6 +50,10 @@
 
 VIR_LOG_INIT("util.eventpoll");
 
+VIR_ENUM_IMPL(virEventPollBackend, VIR_EVENT_POLL_BACKEND_LAST,
+              "poll",
+              "epoll");
+
 static int virEventPollInterruptLocked(void);
 
 /* State for a single file handle being monitored */
@@ -65,28 +72,64 @@ struct virEventPollTimeout {
     int timer;
     int frequency;
     unsigned long long expiresAt;
+    unsigned int generation;
     virEventTimeoutCallback cb;
     virFreeCallback ff;
     void *opaque;
     int deleted;
 };
 
+/* An entry in the heap of scheduled timers. Entries are never
+ * updated in place, rescheduling a timer pushes a new entry and
+ * bumps the timer's generation instead, making the old one stale */
+struct virEventPollTimerEntry {
+    unsigned long long expiresAt;
+    int timer;
+    unsigned int generation;
+};
+
+/* Watches registered for a single file descriptor. Only used
+ * by the epoll backend which monitors each fd just once */
+struct virEventPollFDInfo {
+    size_t nwatches;
+    int *watches;
+    int events; /* native events currently in the epoll set */
+    bool registered; /* whether the fd is in the epoll set */
+    bool noepoll; /* fd doesn't support epoll, e.g. a regular file */
+};
+
 /* Allocate extra slots for virEventPollHandle/virEventPollTimeout
    records in this multiple */
 #define EVENT_ALLOC_EXTENT 10
 
+/* Maximum number of events fetched by a single epoll_wait() call */
+#define EVENT_EPOLL_MAX_EVENTS 1024
+
 /* State for the main event loop */
 struct virEventPollLoop {
     virMutex lock;
     int running;
     virThread leader;
     int wakeupfd[2];
+    virEventPollBackend backend;
+    /* Sorted by watch, as new handles are only ever appended */
     size_t handlesCount;
     size_t handlesAlloc;
     struct virEventPollHandle *handles;
+    /* Sorted by timer, as new timeouts are only ever appended */
     size_t timeoutsCount;
     size_t timeoutsAlloc;
     struct virEventPollTimeout *timeouts;
+    /* Min-heap ordered by expiresAt */
+    size_t timerHeapCount;
+    size_t timerHeapAlloc;
+    struct virEventPollTimerEntry *timerHeap;
+    /* epoll backend state, @fdInfo is indexed by fd */
+    int epollfd;
+    size_t nfdInfo;
+    struct virEventPollFDInfo *fdInfo;
+    size_t nregistered;
+    size_t nnoepoll;
 };
 
 /* Only have one event loop */
@@ -98,6 +141,389 @@ static int nextWatch = 1;
 /* Unique ID for the next timer to be registered */
 static int nextTimer = 1;
 
+
+/* Find the index of @watch in the handles array using binary search.
+ * Returns -1 if not found */
+static ssize_t
+virEventPollFindHandle(int watch)
+{
+    size_t lo = 0;
+    size_t hi = eventLoop.handlesCount;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (eventLoop.handles[mid].watch == watch)
+            return mid;
+        if (eventLoop.handles[mid].watch < watch)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+
+/* Find the index of @timer in the timeouts array using binary search.
+ * Returns -1 if not found */
+static ssize_t
+virEventPollFindTimeout(int timer)
+{
+    size_t lo = 0;
+    size_t hi = eventLoop.timeoutsCount;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (eventLoop.timeouts[mid].timer == timer)
+            return mid;
+        if (eventLoop.timeouts[mid].timer < timer)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return -1;
+}
+
+
+static void
+virEventPollTimerHeapSwap(size_t a, size_t b)
+{
+    struct virEventPollTimerEntry tmp = eventLoop.timerHeap[a];
+    eventLoop.timerHeap[a] = eventLoop.timerHeap[b];
+    eventLoop.timerHeap[b] = tmp;
+}
+
+
+static int
+virEventPollTimerHeapPush(struct virEventPollTimeout *t)
+{
+    size_t i;
+
+    if (VIR_RESIZE_N(eventLoop.timerHeap, eventLoop.timerHeapAlloc,
+                     eventLoop.timerHeapCount, 1) < 0)
+        return -1;
+
+    i = eventLoop.timerHeapCount++;
+    eventLoop.timerHeap[i].expiresAt = t->expiresAt;
+    eventLoop.timerHeap[i].timer = t->timer;
+    eventLoop.timerHeap[i].generation = t->generation;
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (eventLoop.timerHeap[parent].expiresAt <=
+            eventLoop.timerHeap[i].expiresAt)
+            break;
+
+        virEventPollTimerHeapSwap(i, parent);
+        i = parent;
+    }
+
+    return 0;
+}
+
+
+static void
+virEventPollTimerHeapPop(void)
+{
+    size_t i = 0;
+
+    if (eventLoop.timerHeapCount == 0)
+        return;
+
+    eventLoop.timerHeap[0] = eventLoop.timerHeap[--eventLoop.timerHeapCount];
+
+    while (true) {
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        size_t smallest = i;
+
+        if (left < eventLoop.timerHeapCount &&
+            eventLoop.timerHeap[left].expiresAt <
+            eventLoop.timerHeap[smallest].expiresAt)
+            smallest = left;
+        if (right < eventLoop.timerHeapCount &&
+            eventLoop.timerHeap[right].expiresAt <
+            eventLoop.timerHeap[smallest].expiresAt)
+            smallest = right;
+
+        if (smallest == i)
+            break;
+
+        virEventPollTimerHeapSwap(i, smallest);
+        i = smallest;
+    }
+}
+
+
+/* Returns the timeout a heap entry refers to, or NULL if the entry
+ * is stale because the timer was deleted, disabled or rescheduled */
+static struct virEventPollTimeout *
+virEventPollTimerHeapEntryGet(struct virEventPollTimerEntry *entry)
+{
+    ssize_t idx = virEventPollFindTimeout(entry->timer);
+    struct virEventPollTimeout *t;
+
+    if (idx < 0)
+        return NULL;
+
+    t = &eventLoop.timeouts[idx];
+    if (t->deleted || t->frequency < 0 ||
+        t->generation != entry->generation)
+        return NULL;
+
+    return t;
+}
+
+
+/* Drop stale entries from the top of the heap so that the first entry,
+ * if any, is the next timer to expire */
+static void
+virEventPollTimerHeapPrune(void)
+{
+    while (eventLoop.timerHeapCount > 0 &&
+           !virEventPollTimerHeapEntryGet(&eventLoop.timerHeap[0]))
+        virEventPollTimerHeapPop();
+}
+
+
+/* Rebuild the heap from scratch once stale entries pile up */
+static int
+virEventPollTimerHeapCompact(void)
+{
+    size_t i;
+
+    if (eventLoop.timerHeapCount <= 2 * eventLoop.timeoutsCount + EVENT_ALLOC_EXTENT)
+        return 0;
+
+    EVENT_DEBUG("Compacting timer heap of %zu entries for %zu timers",
+                eventLoop.timerHeapCount, eventLoop.timeoutsCount);
+
+    VIR_FREE(eventLoop.timerHeap);
+    eventLoop.timerHeapCount = eventLoop.timerHeapAlloc = 0;
+
+    for (i = 0; i < eventLoop.timeoutsCount; i++) {
+        struct virEventPollTimeout *t = &eventLoop.timeouts[i];
+
+        if (t->deleted || t->frequency < 0)
+            continue;
+
+        if (virEventPollTimerHeapPush(t) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/* (Re)schedule @t according to its frequency, invalidating any
+ * entry previously pushed to the heap */
+static int
+virEventPollScheduleTimeout(struct virEventPollTimeout *t,
+                            unsigned long long now)
+{
+    t->generation++;
+    t->expiresAt = t->frequency >= 0 ? t->frequency + now : 0;
+
+    if (t->frequency < 0)
+        return 0;
+
+    return virEventPollTimerHeapPush(t);
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+static int
+virEventPollToEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & POLLIN)
+        ret |= EPOLLIN;
+    if (events & POLLOUT)
+        ret |= EPOLLOUT;
+    if (events & POLLERR)
+        ret |= EPOLLERR;
+    if (events & POLLHUP)
+        ret |= EPOLLHUP;
+    return ret;
+}
+
+
+static int
+virEventPollFromEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & EPOLLIN)
+        ret |= POLLIN;
+    if (events & EPOLLOUT)
+        ret |= POLLOUT;
+    if (events & EPOLLERR)
+        ret |= POLLERR;
+    if (events & EPOLLHUP)
+        ret |= POLLHUP;
+    return ret;
+}
+
+
+/* Bring the epoll set in line with the union of events requested by
+ * all live watches on @fd */
+static void
+virEventPollEpollSyncFD(int fd)
+{
+    struct virEventPollFDInfo *info;
+    struct epoll_event ev;
+    char ebuf[1024];
+    int events = 0;
+    size_t i;
+
+    if (fd < 0 || fd >= eventLoop.nfdInfo)
+        return;
+
+    info = &eventLoop.fdInfo[fd];
+
+    for (i = 0; i < info->nwatches; i++) {
+        ssize_t idx = virEventPollFindHandle(info->watches[i]);
+
+        if (idx < 0 || eventLoop.handles[idx].deleted)
+            continue;
+
+        events |= eventLoop.handles[idx].events;
+    }
+
+    if (info->noepoll) {
+        if (events == 0) {
+            info->noepoll = false;
+            eventLoop.nnoepoll--;
+        }
+        info->events = events;
+        return;
+    }
+
+    if (info->registered && info->events == events)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = virEventPollToEpollEvents(events);
+    ev.data.fd = fd;
+
+    if (events == 0) {
+        if (info->registered) {
+            /* The fd might have been closed already, which removes it
+             * from the epoll set implicitly */
+            if (epoll_ctl(eventLoop.epollfd, EPOLL_CTL_DEL, fd, &ev) < 0 &&
+                errno != EBADF && errno != ENOENT)
+                VIR_WARN("Unable to remove fd %d from epoll set: %s",
+                         fd, virStrerror(errno, ebuf, sizeof(ebuf)));
+            info->registered = false;
+            eventLoop.nregistered--;
+        }
+        info->events = 0;
+        return;
+    }
+
+    if (info->registered) {
+        if (epoll_ctl(eventLoop.epollfd, EPOLL_CTL_MOD, fd, &ev) == 0)
+            goto done;
+
+        /* The fd was closed and reused behind our back */
+        if (errno != ENOENT)
+            goto error;
+        info->registered = false;
+        eventLoop.nregistered--;
+    }
+
+    if (epoll_ctl(eventLoop.epollfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if (errno == EEXIST &&
+            epoll_ctl(eventLoop.epollfd, EPOLL_CTL_MOD, fd, &ev) == 0)
+            goto added;
+
+        /* Regular files and some character devices can't be watched
+         * by epoll. Just like poll() does, treat them as always ready */
+        if (errno == EPERM) {
+            info->noepoll = true;
+            info->events = events;
+            eventLoop.nnoepoll++;
+            return;
+        }
+        goto error;
+    }
+
+ added:
+    info->registered = true;
+    eventLoop.nregistered++;
+ done:
+    info->events = events;
+    return;
+
+ error:
+    VIR_WARN("Unable to watch fd %d with epoll: %s",
+             fd, virStrerror(errno, ebuf, sizeof(ebuf)));
+}
+
+
+static int
+virEventPollEpollAddWatch(int fd, int watch)
+{
+    struct virEventPollFDInfo *info;
+
+    if (fd >= eventLoop.nfdInfo &&
+        VIR_EXPAND_N(eventLoop.fdInfo, eventLoop.nfdInfo,
+                     fd + 1 - eventLoop.nfdInfo) < 0)
+        return -1;
+
+    info = &eventLoop.fdInfo[fd];
+    if (VIR_APPEND_ELEMENT_COPY(info->watches, info->nwatches, watch) < 0)
+        return -1;
+
+    virEventPollEpollSyncFD(fd);
+    return 0;
+}
+
+
+static void
+virEventPollEpollRemoveWatch(int fd, int watch)
+{
+    struct virEventPollFDInfo *info;
+    size_t i;
+
+    if (fd < 0 || fd >= eventLoop.nfdInfo)
+        return;
+
+    info = &eventLoop.fdInfo[fd];
+    for (i = 0; i < info->nwatches; i++) {
+        if (info->watches[i] == watch) {
+            VIR_DELETE_ELEMENT(info->watches, i, info->nwatches);
+            break;
+        }
+    }
+
+    virEventPollEpollSyncFD(fd);
+}
+#else /* !HAVE_SYS_EPOLL_H */
+static void
+virEventPollEpollSyncFD(int fd ATTRIBUTE_UNUSED)
+{
+}
+
+
+static int
+virEventPollEpollAddWatch(int fd ATTRIBUTE_UNUSED,
+                          int watch ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+
+static void
+virEventPollEpollRemoveWatch(int fd ATTRIBUTE_UNUSED,
+                             int watch ATTRIBUTE_UNUSED)
+{
+}
+#endif /* !HAVE_SYS_EPOLL_H */
+
 /*
  * Register a callback for monitoring file handle events.
  * NB, it *must* be safe to call this from within a callback
@@ -120,6 +546,12 @@ int virEventPollAddHandle(int fd, int events,
         }
     }
 
+    if (eventLoop.backend == VIR_EVENT_POLL_BACKEND_EPOLL &&
+        virEventPollEpollAddWatch(fd, nextWatch) < 0) {
+        virMutexUnlock(&eventLoop.lock);
+        return -1;
+    }
+
     watch = nextWatch++;
 
     eventLoop.handles[eventLoop.handlesCount].watch = watch;
@@ -133,6 +565,9 @@ int virEventPollAddHandle(int fd, int events,
 
     eventLoop.handlesCount++;
 
+    if (eventLoop.backend == VIR_EVENT_POLL_BACKEND_EPOLL)
+        virEventPollEpollSyncFD(fd);
+
     virEventPollInterruptLocked();
 
     PROBE(EVENT_POLL_ADD_HANDLE,
@@ -145,7 +580,7 @@ int virEventPollAddHandle(int fd, int events,
 
 void virEventPollUpdateHandle(int watch, int events)
 {
-    size_t i;
+    ssize_t i;
     bool found = false;
     PROBE(EVENT_POLL_UPDATE_HANDLE,
           "watch=%d events=%d",
@@ -157,14 +592,13 @@ void virEventPollUpdateHandle(int watch, int events)
     }
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].watch == watch) {
-            eventLoop.handles[i].events =
-                    virEventPollToNativeEvents(events);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    if ((i = virEventPollFindHandle(watch)) >= 0) {
+        eventLoop.handles[i].events =
+                virEventPollToNativeEvents(events);
+        if (eventLoop.backend == VIR_EVENT_POLL_BACKEND_EPOLL)
+            virEventPollEpollSyncFD(eventLoop.handles[i].fd);
+        virEventPollInterruptLocked();
+        found = true;
     }
     virMutexUnlock(&eventLoop.lock);
 
@@ -180,7 +614,7 @@ void virEventPollUpdateHandle(int watch, int events)
  */
 int virEventPollRemoveHandle(int watch)
 {
-    size_t i;
+    ssize_t i;
     PROBE(EVENT_POLL_REMOVE_HANDLE,
           "watch=%d",
           watch);
@@ -191,17 +625,15 @@ int virEventPollRemoveHandle(int watch)
     }
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].deleted)
-            continue;
-
-        if (eventLoop.handles[i].watch == watch) {
-            EVENT_DEBUG("mark delete %zu %d", i, eventLoop.handles[i].fd);
-            eventLoop.handles[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    if ((i = virEventPollFindHandle(watch)) >= 0 &&
+        !eventLoop.handles[i].deleted) {
+        EVENT_DEBUG("mark delete %zd %d", i, eventLoop.handles[i].fd);
+        eventLoop.handles[i].deleted = 1;
+        if (eventLoop.backend == VIR_EVENT_POLL_BACKEND_EPOLL)
+            virEventPollEpollSyncFD(eventLoop.handles[i].fd);
+        virEventPollInterruptLocked();
+        virMutexUnlock(&eventLoop.lock);
+        return 0;
     }
     virMutexUnlock(&eventLoop.lock);
     return -1;
@@ -235,17 +667,22 @@ int virEventPollAddTimeout(int frequency,
         }
     }
 
-    eventLoop.timeouts[eventLoop.timeoutsCount].timer = nextTimer++;
+    eventLoop.timeouts[eventLoop.timeoutsCount].timer = nextTimer;
     eventLoop.timeouts[eventLoop.timeoutsCount].frequency = frequency;
     eventLoop.timeouts[eventLoop.timeoutsCount].cb = cb;
     eventLoop.timeouts[eventLoop.timeoutsCount].ff = ff;
     eventLoop.timeouts[eventLoop.timeoutsCount].opaque = opaque;
     eventLoop.timeouts[eventLoop.timeoutsCount].deleted = 0;
-    eventLoop.timeouts[eventLoop.timeoutsCount].expiresAt =
-        frequency >= 0 ? frequency + now : 0;
+    eventLoop.timeouts[eventLoop.timeoutsCount].generation = 0;
+
+    if (virEventPollScheduleTimeout(&eventLoop.timeouts[eventLoop.timeoutsCount],
+                                    now) < 0) {
+        virMutexUnlock(&eventLoop.lock);
+        return -1;
+    }
 
     eventLoop.timeoutsCount++;
-    ret = nextTimer-1;
+    ret = nextTimer++;
     virEventPollInterruptLocked();
 
     PROBE(EVENT_POLL_ADD_TIMEOUT,
@@ -258,7 +695,7 @@ int virEventPollAddTimeout(int frequency,
 void virEventPollUpdateTimeout(int timer, int frequency)
 {
     unsigned long long now;
-    size_t i;
+    ssize_t i;
     bool found = false;
     PROBE(EVENT_POLL_UPDATE_TIMEOUT,
           "timer=%d frequency=%d",
@@ -273,17 +710,14 @@ void virEventPollUpdateTimeout(int timer, int frequency)
         return;
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].frequency = frequency;
-            eventLoop.timeouts[i].expiresAt =
-                frequency >= 0 ? frequency + now : 0;
-            VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
-                      eventLoop.timeouts[i].expiresAt);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    if ((i = virEventPollFindTimeout(timer)) >= 0) {
+        eventLoop.timeouts[i].frequency = frequency;
+        if (virEventPollScheduleTimeout(&eventLoop.timeouts[i], now) < 0)
+            VIR_WARN("Unable to schedule timer %d", timer);
+        VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
+                  eventLoop.timeouts[i].expiresAt);
+        virEventPollInterruptLocked();
+        found = true;
     }
     virMutexUnlock(&eventLoop.lock);
 
@@ -299,7 +733,7 @@ void virEventPollUpdateTimeout(int timer, int frequency)
  */
 int virEventPollRemoveTimeout(int timer)
 {
-    size_t i;
+    ssize_t i;
     PROBE(EVENT_POLL_REMOVE_TIMEOUT,
           "timer=%d",
           timer);
@@ -310,23 +744,19 @@ int virEventPollRemoveTimeout(int timer)
     }
 
     virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    if ((i = virEventPollFindTimeout(timer)) >= 0 &&
+        !eventLoop.timeouts[i].deleted) {
+        eventLoop.timeouts[i].deleted = 1;
+        virEventPollInterruptLocked();
+        virMutexUnlock(&eventLoop.lock);
+        return 0;
     }
     virMutexUnlock(&eventLoop.lock);
     return -1;
 }
 
-/* Iterates over all registered timeouts and determine which
- * will be the first to expire.
+/* Determine which of the registered timeouts will be the first
+ * to expire by looking at the top of the timer heap.
  * @timeout: filled with expiry time of soonest timer, or -1 if
  *           no timeout is pending
  * returns: 0 on success, -1 on error
@@ -334,19 +764,14 @@ int virEventPollRemoveTimeout(int timer)
 static int virEventPollCalculateTimeout(int *timeout)
 {
     unsigned long long then = 0;
-    size_t i;
     EVENT_DEBUG("Calculate expiry of %zu timers", eventLoop.timeoutsCount);
-    /* Figure out if we need a timeout */
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-        if (eventLoop.timeouts[i].frequency < 0)
-            continue;
 
-        EVENT_DEBUG("Got a timeout scheduled for %llu", eventLoop.timeouts[i].expiresAt);
-        if (then == 0 ||
-            eventLoop.timeouts[i].expiresAt < then)
-            then = eventLoop.timeouts[i].expiresAt;
+    virEventPollTimerHeapPrune();
+
+    /* Figure out if we need a timeout */
+    if (eventLoop.timerHeapCount > 0) {
+        then = eventLoop.timerHeap[0].expiresAt;
+        EVENT_DEBUG("Got a timeout scheduled for %llu", then);
     }
 
     /* Calculate how long we should wait for a timeout if needed */
@@ -412,7 +837,7 @@ static struct pollfd *virEventPollMakePollFDs(int *nfds) {
 
 
 /*
- * Iterate over all timers and determine if any have expired.
+ * Pop all timers which have expired off the timer heap.
  * Invoke the user supplied callback for each timer whose
  * expiry time is met, and schedule the next timeout. Does
  * not try to 'catch up' on time if the actual expiry time
@@ -426,39 +851,62 @@ static struct pollfd *virEventPollMakePollFDs(int *nfds) {
 static int virEventPollDispatchTimeouts(void)
 {
     unsigned long long now;
+    struct virEventPollTimerEntry *expired = NULL;
+    size_t nexpired = 0;
     size_t i;
-    /* Save this now - it may be changed during dispatch */
-    int ntimeouts = eventLoop.timeoutsCount;
-    VIR_DEBUG("Dispatch %d", ntimeouts);
+    int ret = -1;
+    VIR_DEBUG("Dispatch %zu", eventLoop.timerHeapCount);
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    for (i = 0; i < ntimeouts; i++) {
-        if (eventLoop.timeouts[i].deleted || eventLoop.timeouts[i].frequency < 0)
+    /* Collect the expired timers first, so that timers rescheduled
+     * with zero frequency don't fire more than once per iteration.
+     *
+     * Add 20ms fuzz so we don't pointlessly spin doing
+     * <10ms sleeps, particularly on kernels with low HZ
+     * it is fine that a timer expires 20ms earlier than
+     * requested
+     */
+    virEventPollTimerHeapPrune();
+    while (eventLoop.timerHeapCount > 0 &&
+           eventLoop.timerHeap[0].expiresAt <= (now+20)) {
+        if (VIR_APPEND_ELEMENT_COPY(expired, nexpired,
+                                    eventLoop.timerHeap[0]) < 0)
+            goto cleanup;
+        virEventPollTimerHeapPop();
+        virEventPollTimerHeapPrune();
+    }
+
+    for (i = 0; i < nexpired; i++) {
+        struct virEventPollTimeout *t;
+        virEventTimeoutCallback cb;
+        int timer;
+        void *opaque;
+
+        /* An earlier callback might have changed the timer */
+        if (!(t = virEventPollTimerHeapEntryGet(&expired[i])))
             continue;
 
-        /* Add 20ms fuzz so we don't pointlessly spin doing
-         * <10ms sleeps, particularly on kernels with low HZ
-         * it is fine that a timer expires 20ms earlier than
-         * requested
-         */
-        if (eventLoop.timeouts[i].expiresAt <= (now+20)) {
-            virEventTimeoutCallback cb = eventLoop.timeouts[i].cb;
-            int timer = eventLoop.timeouts[i].timer;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            eventLoop.timeouts[i].expiresAt =
-                now + eventLoop.timeouts[i].frequency;
+        cb = t->cb;
+        timer = t->timer;
+        opaque = t->opaque;
+        if (virEventPollScheduleTimeout(t, now) < 0)
+            goto cleanup;
 
-            PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
-                  "timer=%d",
-                  timer);
-            virMutexUnlock(&eventLoop.lock);
-            (cb)(timer, opaque);
-            virMutexLock(&eventLoop.lock);
-        }
+        PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
+              "timer=%d",
+              timer);
+        virMutexUnlock(&eventLoop.lock);
+        (cb)(timer, opaque);
+        virMutexLock(&eventLoop.lock);
     }
-    return 0;
+
+    ret = virEventPollTimerHeapCompact();
+
+ cleanup:
+    VIR_FREE(expired);
+    return ret;
 }
 
 
@@ -514,6 +962,82 @@ static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
 }
 
 
+#ifdef HAVE_SYS_EPOLL_H
+/* Dispatch @revents (in native poll format) which occurred on @fd
+ * to all live watches interested in them */
+static void virEventPollEpollDispatchFD(int fd, int revents)
+{
+    size_t nwatches;
+    size_t i;
+
+    if (fd < 0 || fd >= eventLoop.nfdInfo)
+        return;
+
+    /* NB, new watches registered by a callback are appended
+     * to the list, they are not dispatched in this iteration */
+    nwatches = eventLoop.fdInfo[fd].nwatches;
+
+    for (i = 0; i < nwatches && i < eventLoop.fdInfo[fd].nwatches; i++) {
+        int watch = eventLoop.fdInfo[fd].watches[i];
+        ssize_t idx = virEventPollFindHandle(watch);
+        virEventHandleCallback cb;
+        void *opaque;
+        int hEvents;
+
+        if (idx < 0 ||
+            eventLoop.handles[idx].deleted ||
+            eventLoop.handles[idx].events == 0) {
+            EVENT_DEBUG("Skip w=%d f=%d", watch, fd);
+            continue;
+        }
+
+        /* Like poll(), report errors and hangups unconditionally */
+        hEvents = revents & (eventLoop.handles[idx].events | POLLERR | POLLHUP);
+        if (!hEvents)
+            continue;
+
+        cb = eventLoop.handles[idx].cb;
+        opaque = eventLoop.handles[idx].opaque;
+        hEvents = virEventPollFromNativeEvents(hEvents);
+        PROBE(EVENT_POLL_DISPATCH_HANDLE,
+              "watch=%d events=%d",
+              watch, hEvents);
+        virMutexUnlock(&eventLoop.lock);
+        (cb)(watch, fd, hEvents, opaque);
+        virMutexLock(&eventLoop.lock);
+    }
+}
+
+
+/* Dispatch the events returned by epoll_wait(). File descriptors
+ * which can't be monitored by epoll are always reported as ready.
+ */
+static int virEventPollEpollDispatchHandles(int nevents,
+                                            struct epoll_event *events,
+                                            bool noepoll)
+{
+    size_t i;
+    VIR_DEBUG("Dispatch %d", nevents);
+
+    for (i = 0; i < nevents; i++)
+        virEventPollEpollDispatchFD(events[i].data.fd,
+                                    virEventPollFromEpollEvents(events[i].events));
+
+    if (noepoll) {
+        for (i = 0; i < eventLoop.nfdInfo; i++) {
+            if (!eventLoop.fdInfo[i].noepoll)
+                continue;
+
+            virEventPollEpollDispatchFD(i, eventLoop.fdInfo[i].events &
+                                        (POLLIN | POLLOUT));
+        }
+    }
+
+    return 0;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
 /* Used post dispatch to actually remove any timers that
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
@@ -585,6 +1109,9 @@ static void virEventPollCleanupHandles(void)
         PROBE(EVENT_POLL_PURGE_HANDLE,
               "watch=%d",
               eventLoop.handles[i].watch);
+        if (eventLoop.backend == VIR_EVENT_POLL_BACKEND_EPOLL)
+            virEventPollEpollRemoveWatch(eventLoop.handles[i].fd,
+                                         eventLoop.handles[i].watch);
         if (eventLoop.handles[i].ff) {
             virFreeCallback ff = eventLoop.handles[i].ff;
             void *opaque = eventLoop.handles[i].opaque;
@@ -616,7 +1143,7 @@ static void virEventPollCleanupHandles(void)
  * Run a single iteration of the event loop, blocking until
  * at least one file handle has an event, or a timer expires
  */
-int virEventPollRunOnce(void)
+static int virEventPollRunOncePoll(void)
 {
     struct pollfd *fds = NULL;
     int ret, timeout, nfds;
@@ -673,6 +1200,89 @@ int virEventPollRunOnce(void)
 }
 
 
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * Same as virEventPollRunOncePoll, but the set of file handles
+ * is kept in the kernel so it doesn't need to be rebuilt on
+ * every iteration.
+ */
+static int virEventPollRunOnceEpoll(void)
+{
+    struct epoll_event *events = NULL;
+    int ret, timeout;
+    size_t maxevents;
+    bool noepoll;
+
+    virMutexLock(&eventLoop.lock);
+    eventLoop.running = 1;
+    virThreadSelf(&eventLoop.leader);
+
+    virEventPollCleanupTimeouts();
+    virEventPollCleanupHandles();
+
+    maxevents = MIN(MAX(eventLoop.nregistered, 1), EVENT_EPOLL_MAX_EVENTS);
+    if (VIR_ALLOC_N(events, maxevents) < 0 ||
+        virEventPollCalculateTimeout(&timeout) < 0)
+        goto error;
+
+    /* Handles not supported by epoll are always ready */
+    noepoll = eventLoop.nnoepoll > 0;
+    if (noepoll)
+        timeout = 0;
+
+    virMutexUnlock(&eventLoop.lock);
+
+ retry:
+    PROBE(EVENT_POLL_RUN,
+          "nhandles=%zu timeout=%d",
+          maxevents, timeout);
+    ret = epoll_wait(eventLoop.epollfd, events, maxevents, timeout);
+    if (ret < 0) {
+        EVENT_DEBUG("Poll got error event %d", errno);
+        if (errno == EINTR || errno == EAGAIN)
+            goto retry;
+        virReportSystemError(errno, "%s",
+                             _("Unable to poll on file handles"));
+        goto error_unlocked;
+    }
+    EVENT_DEBUG("Poll got %d event(s)", ret);
+
+    virMutexLock(&eventLoop.lock);
+    if (virEventPollDispatchTimeouts() < 0)
+        goto error;
+
+    if ((ret > 0 || noepoll) &&
+        virEventPollEpollDispatchHandles(ret, events, noepoll) < 0)
+        goto error;
+
+    virEventPollCleanupTimeouts();
+    virEventPollCleanupHandles();
+
+    eventLoop.running = 0;
+    virMutexUnlock(&eventLoop.lock);
+    VIR_FREE(events);
+    return 0;
+
+ error:
+    virMutexUnlock(&eventLoop.lock);
+ error_unlocked:
+    VIR_FREE(events);
+    return -1;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
+int virEventPollRunOnce(void)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (eventLoop.backend == VIR_EVENT_POLL_BACKEND_EPOLL)
+        return virEventPollRunOnceEpoll();
+#endif
+
+    return virEventPollRunOncePoll();
+}
+
+
 static void virEventPollHandleWakeup(int watch ATTRIBUTE_UNUSED,
                                      int fd,
                                      int events ATTRIBUTE_UNUSED,
@@ -684,18 +1294,49 @@ static void virEventPollHandleWakeup(int watch ATTRIBUTE_UNUSED,
     virMutexUnlock(&eventLoop.lock);
 }
 
-int virEventPollInit(void)
+int virEventPollInitBackend(virEventPollBackend backend)
 {
+    eventLoop.epollfd = -1;
+
+    switch (backend) {
+    case VIR_EVENT_POLL_BACKEND_POLL:
+        break;
+
+    case VIR_EVENT_POLL_BACKEND_EPOLL:
+#ifdef HAVE_SYS_EPOLL_H
+        if ((eventLoop.epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create epoll instance"));
+            return -1;
+        }
+        break;
+#else
+        virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                       _("epoll event loop is not supported on this platform"));
+        return -1;
+#endif
+
+    case VIR_EVENT_POLL_BACKEND_LAST:
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unexpected event loop backend %d"), backend);
+        return -1;
+    }
+
+    eventLoop.backend = backend;
+    VIR_DEBUG("Using %s event loop backend",
+              virEventPollBackendTypeToString(backend));
+
     if (virMutexInit(&eventLoop.lock) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to initialize mutex"));
-        return -1;
+        goto error;
     }
 
     if (pipe2(eventLoop.wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to setup wakeup pipe"));
-        return -1;
+        goto error;
     }
 
     if (virEventPollAddHandle(eventLoop.wakeupfd[0],
@@ -706,10 +1347,35 @@ int virEventPollInit(void)
                        eventLoop.wakeupfd[0]);
         VIR_FORCE_CLOSE(eventLoop.wakeupfd[0]);
         VIR_FORCE_CLOSE(eventLoop.wakeupfd[1]);
-        return -1;
+        goto error;
     }
 
     return 0;
+
+ error:
+    VIR_FORCE_CLOSE(eventLoop.epollfd);
+    return -1;
+}
+
+
+/*
+ * Initialize the event loop with the backend requested by the
+ * LIBVIRT_EVENT_POLL_BACKEND environment variable, falling
+ * back to poll() if unset.
+ */
+int virEventPollInit(void)
+{
+    const char *env = virGetEnvAllowSUID("LIBVIRT_EVENT_POLL_BACKEND");
+    int backend = VIR_EVENT_POLL_BACKEND_POLL;
+
+    if (env && *env &&
+        (backend = virEventPollBackendTypeFromString(env)) < 0) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unknown event loop backend '%s'"), env);
+        return -1;
+    }
+
+    return virEventPollInitBackend(backend);
 }
 
 static int virEventPollInterruptLocked(void)
@@ -25,6 +25,16 @@
 # define __VIR_EVENT_POLL_H__
 
 # include "internal.h"
+# include "virutil.h"
+
+typedef enum {
+    VIR_EVENT_POLL_BACKEND_POLL = 0,
+    VIR_EVENT_POLL_BACKEND_EPOLL,
+
+    VIR_EVENT_POLL_BACKEND_LAST
+} virEventPollBackend;
+
+VIR_ENUM_DECL(virEventPollBackend)
 
 /**
  * virEventPollAddHandle: register a callback for monitoring file handle events
@@ -103,10 +113,22 @@ int virEventPollRemoveTimeout(int timer);
 /**
  * virEventPollInit: Initialize the event loop
  *
+ * The backend is taken from the LIBVIRT_EVENT_POLL_BACKEND
+ * environment variable, defaulting to poll()
+ *
  * returns -1 if initialization failed
  */
 int virEventPollInit(void);
 
+/**
+ * virEventPollInitBackend: Initialize the event loop
+ *
+ * @backend: the system call used to wait for events
+ *
+ * returns -1 if initialization failed
+ */
+int virEventPollInitBackend(virEventPollBackend backend);
+
 /**
  * virEventPollRunOnce: run a single iteration of the event loop.
  *
@@ -49,6 +49,10 @@ struct _virFileCache {
 
     virHashTablePtr table;
 
+    /* names of the data being created by some thread right now */
+    virHashTablePtr pending;
+    virCond cond;
+
     char *dir;
     char *suffix;
 
@@ -78,6 +82,8 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->pending);
+    virCondDestroy(&cache->cond);
 
     virFileCachePrivFree(cache);
 }
@@ -257,9 +263,18 @@ virFileCacheNew(const char *dir,
     if (!(cache = virObjectNew(virFileCacheClass)))
         return NULL;
 
+    if (virCondInit(&cache->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        goto cleanup;
+    }
+
     if (!(cache->table = virHashCreate(10, virObjectFreeHashData)))
         goto cleanup;
 
+    if (!(cache->pending = virHashCreate(10, NULL)))
+        goto cleanup;
+
     if (VIR_STRDUP(cache->dir, dir) < 0)
         goto cleanup;
 
@@ -289,9 +304,28 @@ virFileCacheValidate(virFileCachePtr cache,
         *data = NULL;
     }
 
+    /* Only one thread creates the data for a given name, the others
+     * wait for it to finish */
+    while (!*data && name && virHashLookup(cache->pending, name)) {
+        VIR_DEBUG("Waiting for data for '%s'", name);
+        ignore_value(virCondWait(&cache->cond, &cache->object.lock));
+        *data = virHashLookup(cache->table, name);
+    }
+
     if (!*data && name) {
         VIR_DEBUG("Creating data for '%s'", name);
+        if (virHashAddEntry(cache->pending, name, (void *) 1) < 0)
+            return;
+
+        /* Creating new data may take long (e.g. probing a QEMU binary),
+         * don't block lookups of other names meanwhile */
+        virObjectUnlock(cache);
         *data = virFileCacheNewData(cache, name);
+        virObjectLock(cache);
+
+        virHashRemoveEntry(cache->pending, name);
+        virCondBroadcast(&cache->cond);
+
         if (*data) {
             VIR_DEBUG("Caching data '%p' for '%s'", *data, name);
             if (virHashAddEntry(cache->table, name, *data) < 0) {
@@ -312,6 +346,10 @@ virFileCacheValidate(virFileCachePtr cache,
  * cached data, if it doesn't exist or is no longer valid new data
  * is created.
  *
+ * Data for different names may be created by several threads at once,
+ * a lookup of a name whose data is being created waits for the other
+ * thread to finish.
+ *
  * Returns data object or NULL on error.  The caller is responsible for
  * unrefing the data.
  */
@@ -333,6 +371,48 @@ virFileCacheLookup(virFileCachePtr cache,
 }
 
 
+/**
+ * virFileCacheLookupCached:
+ * @cache: existing cache object
+ * @name: name of the data stored in a cache
+ *
+ * Similar to virFileCacheLookup() except it never creates new data,
+ * only valid data already cached in memory or in a file is returned.
+ *
+ * Returns data object or NULL if there is no valid cached data or on
+ * error.  The caller is responsible for unrefing the data.
+ */
+void *
+virFileCacheLookupCached(virFileCachePtr cache,
+                         const char *name)
+{
+    void *data = NULL;
+
+    virObjectLock(cache);
+
+    data = virHashLookup(cache->table, name);
+    if (data && !cache->handlers.isValid(data, cache->priv)) {
+        VIR_DEBUG("Cached data '%p' no longer valid for '%s'", data, name);
+        virHashRemoveEntry(cache->table, name);
+        data = NULL;
+    }
+
+    if (!data && !virHashLookup(cache->pending, name) &&
+        virFileCacheLoad(cache, name, &data) > 0) {
+        VIR_DEBUG("Caching data '%p' for '%s'", data, name);
+        if (virHashAddEntry(cache->table, name, data) < 0) {
+            virObjectUnref(data);
+            data = NULL;
+        }
+    }
+
+    virObjectRef(data);
+    virObjectUnlock(cache);
+
+    return data;
+}
+
+
 /**
  * virFileCacheLookupByFunc:
  * @cache: existing cache object
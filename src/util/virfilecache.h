@@ -117,6 +117,10 @@ void *
 virFileCacheLookup(virFileCachePtr cache,
                    const char *name);
 
+void *
+virFileCacheLookupCached(virFileCachePtr cache,
+                         const char *name);
+
 void *
 virFileCacheLookupByFunc(virFileCachePtr cache,
                          virHashSearcher iter,
@@ -0,0 +1,510 @@
+/*
+ * virfilejournal.c: journal of changes to a file
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virfilejournal.h"
+#include "virhashcode.h"
+#include "stat-time.h"
+#include "virlog.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.filejournal")
+
+/*
+ * Instead of rewriting a whole file on every change, the changes can
+ * be appended to a journal kept next to it, named after the file with
+ * a ".journal" suffix. The file itself is only rewritten once the
+ * journal grows too large, at which point the journal is removed.
+ *
+ * The journal starts with a header identifying the file it applies
+ * to by its inode, modification time, length and hash, so that a
+ * journal left behind by a crash in the middle of rewriting the file
+ * is ignored. The content
+ * tracked by the journal is the tail of the file of the given length,
+ * which allows the file to start with a comment not passed to us.
+ *
+ * Every record replaces all but the first @prefix and the last
+ * @suffix bytes of the content with its @len bytes of data. Records
+ * carry a hash over themselves so that a torn write at the end of the
+ * journal is detected and ignored, leaving the content as of the last
+ * complete record.
+ */
+
+#define VIR_FILE_JOURNAL_MAGIC "LVJRNL01"
+#define VIR_FILE_JOURNAL_RECORD_MAGIC 0x4c56524a
+
+/* Both the file and its journal are read whole */
+#define VIR_FILE_JOURNAL_MAX_LEN (64 * 1024 * 1024)
+
+/* The file is rewritten once its journal would be larger than this or
+ * the content itself, whichever is more */
+#define VIR_FILE_JOURNAL_MIN_SIZE (64 * 1024)
+
+typedef struct _virFileJournalHeader virFileJournalHeader;
+struct _virFileJournalHeader {
+    char magic[8];
+    uint64_t ino;
+    uint64_t mtime; /* in nanoseconds */
+    uint64_t filelen;
+    uint64_t len; /* length of the content at the end of the file */
+    uint32_t filehash;
+    uint32_t hash;
+};
+
+typedef struct _virFileJournalRecord virFileJournalRecord;
+struct _virFileJournalRecord {
+    uint32_t magic;
+    uint32_t hash;
+    uint64_t prefix;
+    uint64_t suffix;
+    uint64_t len;
+};
+
+struct _virFileJournal {
+    char *content; /* content as of the last change, NULL if unknown */
+    size_t len;
+
+    virFileJournalHeader header; /* identifies the current file */
+    size_t size; /* size of the journal, 0 if it does not exist yet */
+};
+
+
+virFileJournalPtr
+virFileJournalNew(void)
+{
+    virFileJournalPtr journal;
+
+    if (VIR_ALLOC(journal) < 0)
+        return NULL;
+
+    return journal;
+}
+
+
+void
+virFileJournalFree(virFileJournalPtr journal)
+{
+    if (!journal)
+        return;
+
+    VIR_FREE(journal->content);
+    VIR_FREE(journal);
+}
+
+
+static char *
+virFileJournalPath(const char *path)
+{
+    char *ret;
+
+    ignore_value(virAsprintf(&ret, "%s.journal", path));
+    return ret;
+}
+
+
+static uint64_t
+virFileJournalMtime(struct stat *sb)
+{
+    struct timespec mtime = get_stat_mtime(sb);
+
+    return mtime.tv_sec * 1000000000ULL + mtime.tv_nsec;
+}
+
+
+static uint32_t
+virFileJournalHeaderHash(virFileJournalHeader header)
+{
+    header.hash = 0;
+    return virHashCodeGen(&header, sizeof(header), 0);
+}
+
+
+static uint32_t
+virFileJournalRecordHash(virFileJournalRecord record,
+                         const char *data)
+{
+    record.hash = 0;
+    return virHashCodeGen(data, record.len,
+                          virHashCodeGen(&record, sizeof(record), 0));
+}
+
+
+/**
+ * virFileJournalAppend:
+ * @journal: journal of the file
+ * @path: path of the file
+ * @content: new content of the file
+ *
+ * Records the change of the content tracked by @journal to @content
+ * in the journal of @path and syncs it to disk.
+ *
+ * Returns 0 if the change was recorded (or there was none), 1 if the
+ * caller has to rewrite the file and call virFileJournalReset instead,
+ * and -1 on error, after which the file has to be rewritten too.
+ */
+int
+virFileJournalAppend(virFileJournalPtr journal,
+                     const char *path,
+                     const char *content)
+{
+    size_t len = strlen(content);
+    size_t common = MIN(len, journal->len);
+    size_t prefix = 0;
+    size_t suffix = 0;
+    size_t size;
+    char *buf = NULL;
+    char *jpath = NULL;
+    char *newcontent = NULL;
+    virFileJournalRecord *record;
+    struct stat sb;
+    int fd = -1;
+    int ret = -1;
+
+    if (!journal->content)
+        return 1;
+
+    /* The file was replaced by someone else */
+    if (stat(path, &sb) < 0 ||
+        sb.st_ino != journal->header.ino ||
+        virFileJournalMtime(&sb) != journal->header.mtime) {
+        VIR_FREE(journal->content);
+        return 1;
+    }
+
+    while (prefix < common && journal->content[prefix] == content[prefix])
+        prefix++;
+    while (suffix < common - prefix &&
+           journal->content[journal->len - suffix - 1] == content[len - suffix - 1])
+        suffix++;
+
+    if (prefix == len && len == journal->len)
+        return 0;
+
+    size = sizeof(*record) + len - prefix - suffix;
+    if (!journal->size)
+        size += sizeof(journal->header);
+
+    /* Rewrite the file rather than appending a change to most of it */
+    if (len - prefix - suffix > len / 2 ||
+        journal->size + size > MAX(journal->header.len,
+                                   VIR_FILE_JOURNAL_MIN_SIZE))
+        return 1;
+
+    if (VIR_ALLOC_N(buf, size) < 0 ||
+        VIR_ALLOC_N(newcontent, len + 1) < 0 ||
+        !(jpath = virFileJournalPath(path)))
+        goto cleanup;
+
+    record = (virFileJournalRecord *)buf;
+    if (!journal->size) {
+        memcpy(buf, &journal->header, sizeof(journal->header));
+        record = (virFileJournalRecord *)(buf + sizeof(journal->header));
+    }
+
+    record->magic = VIR_FILE_JOURNAL_RECORD_MAGIC;
+    record->prefix = prefix;
+    record->suffix = suffix;
+    record->len = len - prefix - suffix;
+    memcpy(record + 1, content + prefix, record->len);
+    record->hash = virFileJournalRecordHash(*record, (char *)(record + 1));
+
+    if ((fd = open(jpath,
+                   O_WRONLY | (journal->size ? O_APPEND : O_CREAT | O_TRUNC),
+                   S_IRUSR | S_IWUSR)) < 0) {
+        virReportSystemError(errno, _("cannot open journal '%s'"), jpath);
+        goto cleanup;
+    }
+
+    if (safewrite(fd, buf, size) < 0) {
+        virReportSystemError(errno, _("cannot write journal '%s'"), jpath);
+        goto cleanup;
+    }
+
+    if (fdatasync(fd) < 0) {
+        virReportSystemError(errno, _("cannot sync journal '%s'"), jpath);
+        goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0) {
+        virReportSystemError(errno, _("cannot save journal '%s'"), jpath);
+        goto cleanup;
+    }
+
+    memcpy(newcontent, content, len + 1);
+    VIR_FREE(journal->content);
+    journal->content = newcontent;
+    newcontent = NULL;
+    journal->len = len;
+    journal->size += size;
+
+    ret = 0;
+
+ cleanup:
+    /* The journal may end with a partial record now */
+    if (ret < 0)
+        VIR_FREE(journal->content);
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(newcontent);
+    VIR_FREE(jpath);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+/**
+ * virFileJournalReset:
+ * @journal: journal of the file
+ * @path: path of the file
+ * @content: content the file was just rewritten with
+ *
+ * Removes the journal of @path after the file was rewritten so that
+ * it ends with @content. Further changes can then be appended to the
+ * journal again.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFileJournalReset(virFileJournalPtr journal,
+                    const char *path,
+                    const char *content)
+{
+    size_t len = strlen(content);
+    char *buf = NULL;
+    struct stat sb;
+    int buflen;
+    int fd = -1;
+    int ret = -1;
+
+    VIR_FREE(journal->content);
+    journal->size = 0;
+
+    if (virFileJournalRemove(path) < 0)
+        return -1;
+
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        fstat(fd, &sb) < 0 ||
+        (buflen = virFileReadLimFD(fd, VIR_FILE_JOURNAL_MAX_LEN, &buf)) < 0) {
+        virReportSystemError(errno, _("cannot read file '%s'"), path);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+    /* Keep rewriting a file which was not written as expected */
+    if ((size_t)buflen < len || memcmp(buf + buflen - len, content, len) != 0)
+        goto cleanup;
+
+    if (VIR_STRDUP(journal->content, content) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+    journal->len = len;
+
+    memset(&journal->header, 0, sizeof(journal->header));
+    memcpy(journal->header.magic, VIR_FILE_JOURNAL_MAGIC,
+           sizeof(journal->header.magic));
+    journal->header.ino = sb.st_ino;
+    journal->header.mtime = virFileJournalMtime(&sb);
+    journal->header.filelen = buflen;
+    journal->header.len = len;
+    journal->header.filehash = virHashCodeGen(buf, buflen, 0);
+    journal->header.hash = virFileJournalHeaderHash(journal->header);
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+/**
+ * virFileJournalRead:
+ * @path: path of the file
+ * @content: filled with the content of the file
+ *
+ * Applies the changes recorded in the journal of @path to the content
+ * at the end of the file. If the journal does not exist or does not
+ * belong to the file, @path is to be read directly.
+ *
+ * Returns 1 if @content was filled in, 0 if there is no journal to
+ * apply and -1 on error.
+ */
+int
+virFileJournalRead(const char *path,
+                   char **content)
+{
+    char *jpath = NULL;
+    char *jbuf = NULL;
+    char *buf = NULL;
+    char *cur = NULL;
+    size_t curlen;
+    virFileJournalHeader header;
+    struct stat sb;
+    size_t off;
+    int jlen;
+    int buflen;
+    int fd = -1;
+    int ret = -1;
+
+    *content = NULL;
+
+    if (!(jpath = virFileJournalPath(path)))
+        return -1;
+
+    if ((jlen = virFileReadAllQuiet(jpath, VIR_FILE_JOURNAL_MAX_LEN,
+                                    &jbuf)) < 0) {
+        if (jlen == -ENOENT) {
+            ret = 0;
+        } else {
+            virReportSystemError(-jlen, _("cannot read journal '%s'"),
+                                 jpath);
+        }
+        goto cleanup;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0 ||
+        fstat(fd, &sb) < 0 ||
+        (buflen = virFileReadLimFD(fd, VIR_FILE_JOURNAL_MAX_LEN, &buf)) < 0) {
+        virReportSystemError(errno, _("cannot read file '%s'"), path);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+    if (jlen < sizeof(header)) {
+        VIR_WARN("Ignoring truncated journal '%s'", jpath);
+        goto cleanup;
+    }
+
+    memcpy(&header, jbuf, sizeof(header));
+    if (memcmp(header.magic, VIR_FILE_JOURNAL_MAGIC,
+               sizeof(header.magic)) != 0 ||
+        header.hash != virFileJournalHeaderHash(header)) {
+        VIR_WARN("Ignoring corrupted journal '%s'", jpath);
+        goto cleanup;
+    }
+
+    if (header.ino != sb.st_ino ||
+        header.mtime != virFileJournalMtime(&sb) ||
+        header.filelen != buflen ||
+        header.len > buflen ||
+        header.filehash != virHashCodeGen(buf, buflen, 0)) {
+        VIR_DEBUG("Ignoring journal '%s' of a previous version of the file",
+                  jpath);
+        goto cleanup;
+    }
+
+    curlen = header.len;
+    if (VIR_ALLOC_N(cur, curlen + 1) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+    memcpy(cur, buf + buflen - curlen, curlen);
+
+    for (off = sizeof(header); off < jlen;) {
+        virFileJournalRecord record;
+        const char *data;
+        char *next;
+        size_t nextlen;
+
+        if (jlen - off < sizeof(record))
+            break;
+
+        memcpy(&record, jbuf + off, sizeof(record));
+        data = jbuf + off + sizeof(record);
+
+        if (record.magic != VIR_FILE_JOURNAL_RECORD_MAGIC ||
+            record.len > jlen - off - sizeof(record) ||
+            record.prefix > curlen ||
+            record.suffix > curlen - record.prefix ||
+            record.hash != virFileJournalRecordHash(record, data))
+            break;
+
+        nextlen = record.prefix + record.len + record.suffix;
+        if (VIR_ALLOC_N(next, nextlen + 1) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+        memcpy(next, cur, record.prefix);
+        memcpy(next + record.prefix, data, record.len);
+        memcpy(next + record.prefix + record.len,
+               cur + curlen - record.suffix, record.suffix);
+
+        VIR_FREE(cur);
+        cur = next;
+        curlen = nextlen;
+        off += sizeof(record) + record.len;
+    }
+
+    if (off < jlen)
+        VIR_WARN("Ignoring %zu bytes at the end of journal '%s'",
+                 jlen - off, jpath);
+
+    *content = cur;
+    cur = NULL;
+    ret = 1;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(cur);
+    VIR_FREE(buf);
+    VIR_FREE(jbuf);
+    VIR_FREE(jpath);
+    return ret;
+}
+
+
+/**
+ * virFileJournalRemove:
+ * @path: path of the file
+ *
+ * Removes the journal of @path, if there is any.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFileJournalRemove(const char *path)
+{
+    char *jpath;
+    int ret = 0;
+
+    if (!(jpath = virFileJournalPath(path)))
+        return -1;
+
+    if (unlink(jpath) < 0 && errno != ENOENT) {
+        virReportSystemError(errno, _("cannot remove journal '%s'"), jpath);
+        ret = -1;
+    }
+
+    VIR_FREE(jpath);
+    return ret;
+}
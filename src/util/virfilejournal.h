@@ -0,0 +1,48 @@
+/*
+ * virfilejournal.h: journal of changes to a file
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_FILE_JOURNAL_H__
+# define __VIR_FILE_JOURNAL_H__
+
+# include "internal.h"
+
+typedef struct _virFileJournal virFileJournal;
+typedef virFileJournal *virFileJournalPtr;
+
+virFileJournalPtr virFileJournalNew(void);
+void virFileJournalFree(virFileJournalPtr journal);
+
+int virFileJournalAppend(virFileJournalPtr journal,
+                         const char *path,
+                         const char *content)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
+int virFileJournalReset(virFileJournalPtr journal,
+                        const char *path,
+                        const char *content)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
+int virFileJournalRead(const char *path,
+                       char **content)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+int virFileJournalRemove(const char *path)
+    ATTRIBUTE_NONNULL(1);
+
+#endif /* __VIR_FILE_JOURNAL_H__ */
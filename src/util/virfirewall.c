@@ -55,6 +55,9 @@ VIR_ENUM_DECL(virFirewallLayerFirewallD)
 VIR_ENUM_IMPL(virFirewallLayerFirewallD, VIR_FIREWALL_LAYER_LAST,
               "eb", "ipv4", "ipv6")
 
+#define IPTABLES_RESTORE_PATH IPTABLES_PATH "-restore"
+#define IP6TABLES_RESTORE_PATH IP6TABLES_PATH "-restore"
+
 
 struct _virFirewallRule {
     virFirewallLayer layer;
@@ -109,12 +112,24 @@ static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
 
+static bool iptablesUseRestore;
+static bool ip6tablesUseRestore;
+static bool restoreOverride; /* true to avoid iptables-restore probes */
+
 void
 virFirewallSetLockOverride(bool avoid)
 {
     lockOverride = avoid;
 }
 
+void
+virFirewallSetRestoreOverride(bool useRestore)
+{
+    restoreOverride = true;
+    iptablesUseRestore = useRestore;
+    ip6tablesUseRestore = useRestore;
+}
+
 static void
 virFirewallCheckUpdateLock(bool *lockflag,
                            const char *const*args)
@@ -152,6 +167,50 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+static void
+virFirewallCheckUpdateRestore(bool *restoreflag,
+                              const char *bin,
+                              bool useLock)
+{
+    int status; /* Ignore failed commands without logging them */
+    virCommandPtr cmd;
+
+    /* Running an empty transaction in test mode verifies both that
+     * --noflush is understood and, if iptables itself supports locking,
+     * that the restore binary takes the lock too. We'd rather keep
+     * applying rules one by one than give up on locking. */
+    if (!virFileIsExecutable(bin)) {
+        VIR_INFO("%s not available", bin);
+        return;
+    }
+
+    cmd = virCommandNewArgList(bin, NULL);
+    if (useLock)
+        virCommandAddArg(cmd, "-w");
+    virCommandAddArgList(cmd, "--noflush", "--test", NULL);
+
+    if (virCommandRun(cmd, &status) < 0 || status) {
+        VIR_INFO("batching rules not supported by %s", bin);
+    } else {
+        VIR_INFO("using %s to batch rules", bin);
+        *restoreflag = true;
+    }
+    virCommandFree(cmd);
+}
+
+static void
+virFirewallCheckUpdateRestoring(void)
+{
+    if (lockOverride || restoreOverride)
+        return;
+    virFirewallCheckUpdateRestore(&iptablesUseRestore,
+                                  IPTABLES_RESTORE_PATH,
+                                  iptablesUseLock);
+    virFirewallCheckUpdateRestore(&ip6tablesUseRestore,
+                                  IP6TABLES_RESTORE_PATH,
+                                  ip6tablesUseLock);
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
@@ -201,6 +260,9 @@ virFirewallValidateBackend(virFirewallBackend backend)
 
     virFirewallCheckUpdateLocking();
 
+    if (backend == VIR_FIREWALL_BACKEND_DIRECT)
+        virFirewallCheckUpdateRestoring();
+
     return 0;
 }
 
@@ -860,6 +922,256 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return ret;
 }
 
+/*
+ * Whether @rule can be applied as a line of iptables-restore input.
+ * That's only the case for rules whose failure must abort the
+ * transaction, which don't produce output somebody waits for, and
+ * whose arguments don't need iptables-restore's quoting rules beyond
+ * plain double quotes.
+ */
+static bool
+virFirewallRuleCanRestore(virFirewallRulePtr rule,
+                          bool ignoreErrors)
+{
+    size_t i;
+
+    if (currentBackend != VIR_FIREWALL_BACKEND_DIRECT ||
+        ignoreErrors || rule->ignoreErrors || rule->queryCB)
+        return false;
+
+    switch (rule->layer) {
+    case VIR_FIREWALL_LAYER_IPV4:
+        if (!iptablesUseRestore)
+            return false;
+        break;
+    case VIR_FIREWALL_LAYER_IPV6:
+        if (!ip6tablesUseRestore)
+            return false;
+        break;
+    case VIR_FIREWALL_LAYER_ETHERNET:
+    case VIR_FIREWALL_LAYER_LAST:
+        return false;
+    }
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if (!*arg || strpbrk(arg, "\"'\\\n"))
+            return false;
+
+        if (STREQ(arg, "-L") || STREQ(arg, "--list") ||
+            STREQ(arg, "-S") || STREQ(arg, "--list-rules") ||
+            STREQ(arg, "-C") || STREQ(arg, "--check"))
+            return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Appends @rule to the iptables-restore input in @buf. The table the
+ * rule operates on is taken out of its arguments; whenever it differs
+ * from @table the current one is committed and a new one is started.
+ * @line counts the lines of the input and is left at the one of @rule.
+ */
+static void
+virFirewallRuleFormatRestore(virFirewallRulePtr rule,
+                             virBufferPtr buf,
+                             const char **table,
+                             size_t *line)
+{
+    const char *ruleTable = "filter";
+    bool first = true;
+    size_t i;
+
+    for (i = 0; i + 1 < rule->argsLen; i++) {
+        if (STREQ(rule->args[i], "-t") ||
+            STREQ(rule->args[i], "--table"))
+            ruleTable = rule->args[i + 1];
+    }
+
+    if (!*table || STRNEQ(*table, ruleTable)) {
+        if (*table) {
+            virBufferAddLit(buf, "COMMIT\n");
+            (*line)++;
+        }
+        virBufferAsprintf(buf, "*%s\n", ruleTable);
+        (*line)++;
+        *table = ruleTable;
+    }
+    (*line)++;
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        /* the lock is taken by iptables-restore itself */
+        if (i == 0 && STREQ(arg, "-w"))
+            continue;
+
+        if ((STREQ(arg, "-t") || STREQ(arg, "--table")) &&
+            i + 1 < rule->argsLen) {
+            i++;
+            continue;
+        }
+
+        if (!first)
+            virBufferAddChar(buf, ' ');
+        first = false;
+
+        if (strpbrk(arg, " \t"))
+            virBufferAsprintf(buf, "\"%s\"", arg);
+        else
+            virBufferAdd(buf, arg, -1);
+    }
+    virBufferAddChar(buf, '\n');
+}
+
+
+/*
+ * Finds the rule iptables-restore complained about in @error, given
+ * the input lines of @rules in @lines.
+ */
+static virFirewallRulePtr
+virFirewallRestoreFailedRule(virFirewallRulePtr *rules,
+                             size_t *lines,
+                             size_t nrules,
+                             const char *error)
+{
+    const char *tmp = error;
+    char *end;
+    unsigned int line;
+    size_t i;
+
+    /* depending on the version the error ends with either
+     * "line N failed" or "Error occurred at line: N" */
+    while (tmp && (tmp = strstr(tmp, "line"))) {
+        tmp += strlen("line");
+        if (*tmp == ':')
+            tmp++;
+        virSkipSpaces(&tmp);
+
+        if (virStrToLong_ui(tmp, &end, 10, &line) < 0)
+            continue;
+
+        for (i = 0; i < nrules; i++) {
+            if (lines[i] == line)
+                return rules[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Applies @nrules rules of the same layer by a single iptables-restore
+ * run rather than one iptables run per rule. As each table is committed
+ * atomically, a failure leaves at most the rules of the tables already
+ * committed in place, which the rollback rules take care of as they do
+ * for rules applied one by one.
+ */
+static int
+virFirewallApplyRulesRestore(virFirewallRulePtr *rules,
+                             size_t nrules)
+{
+    virFirewallLayer layer = rules[0]->layer;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virCommandPtr cmd = NULL;
+    const char *table = NULL;
+    size_t *lines = NULL;
+    size_t line = 0;
+    char *input = NULL;
+    char *error = NULL;
+    int status;
+    int ret = -1;
+    size_t i;
+
+    if (VIR_ALLOC_N(lines, nrules) < 0)
+        return -1;
+
+    for (i = 0; i < nrules; i++) {
+        char *str = virFirewallRuleToString(rules[i]);
+        VIR_INFO("Applying rule '%s'", NULLSTR(str));
+        VIR_FREE(str);
+
+        virFirewallRuleFormatRestore(rules[i], &buf, &table, &line);
+        lines[i] = line;
+    }
+    virBufferAddLit(&buf, "COMMIT\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+    input = virBufferContentAndReset(&buf);
+
+    if (layer == VIR_FIREWALL_LAYER_IPV4) {
+        cmd = virCommandNewArgList(IPTABLES_RESTORE_PATH, NULL);
+        if (iptablesUseLock)
+            virCommandAddArg(cmd, "-w");
+    } else {
+        cmd = virCommandNewArgList(IP6TABLES_RESTORE_PATH, NULL);
+        if (ip6tablesUseLock)
+            virCommandAddArg(cmd, "-w");
+    }
+    virCommandAddArg(cmd, "--noflush");
+
+    VIR_DEBUG("Applying %zu rules in one transaction:\n%s", nrules, input);
+
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        goto cleanup;
+
+    if (status != 0) {
+        virFirewallRulePtr rule;
+        char *args;
+
+        /* report the rule which failed as if it was run by itself */
+        if ((rule = virFirewallRestoreFailedRule(rules, lines, nrules, error)))
+            args = virFirewallRuleToString(rule);
+        else
+            args = virCommandToString(cmd);
+
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules %s: %s"),
+                       NULLSTR(args), NULLSTR(error));
+        VIR_FREE(args);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(lines);
+    VIR_FREE(input);
+    VIR_FREE(error);
+    virCommandFree(cmd);
+    return ret;
+}
+
+
+/*
+ * Returns the number of rules starting at @idx in the actions of @group
+ * which can be applied together by iptables-restore.
+ */
+static size_t
+virFirewallGroupCountRestorable(virFirewallGroupPtr group,
+                                size_t idx,
+                                bool ignoreErrors)
+{
+    size_t i;
+
+    for (i = idx; i < group->naction; i++) {
+        if (group->action[i]->layer != group->action[idx]->layer ||
+            !virFirewallRuleCanRestore(group->action[i], ignoreErrors))
+            break;
+    }
+
+    return i - idx;
+}
+
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
@@ -867,16 +1179,27 @@ virFirewallApplyGroup(virFirewallPtr firewall,
     virFirewallGroupPtr group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
     size_t i;
+    size_t n;
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
-    for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
-            return -1;
+    for (i = 0; i < group->naction; i += n) {
+        /* Query callbacks may append rules to the group, so the rules
+         * can only be looked at as we get to them */
+        n = virFirewallGroupCountRestorable(group, i, ignoreErrors);
+
+        if (n > 1) {
+            if (virFirewallApplyRulesRestore(group->action + i, n) < 0)
+                return -1;
+        } else {
+            n = 1;
+            if (virFirewallApplyRule(firewall,
+                                     group->action[i],
+                                     ignoreErrors) < 0)
+                return -1;
+        }
     }
     return 0;
 }
@@ -116,4 +116,6 @@ int virFirewallApply(virFirewallPtr firewall);
 
 void virFirewallSetLockOverride(bool avoid);
 
+void virFirewallSetRestoreOverride(bool useRestore);
+
 #endif /* __VIR_FIREWALL_H__ */
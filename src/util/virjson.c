@@ -23,12 +23,17 @@
 
 #include <config.h>
 
+#include <stdio.h>
+
 #include "virjson.h"
 #include "viralloc.h"
 #include "virerror.h"
 #include "virlog.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virhashcode.h"
+#include "virrandom.h"
+#include "intprops.h"
 
 #if WITH_YAJL
 # include <yajl/yajl_gen.h>
@@ -65,7 +70,25 @@ struct _virJSONParser {
     virJSONParserStatePtr state;
     size_t nstate;
     int wrap;
+    /* non-NULL when driven by virJSONStreamParserFeed */
+    virJSONStreamParserPtr stream;
+};
+
+#if WITH_YAJL
+struct _virJSONStreamParser {
+    virJSONParser parser;
+    yajl_handle handle;
+
+    virJSONStreamParserValueFunc valueFunc;
+    virJSONStreamParserFilterFunc filterFunc;
+    void *opaque; /* of the virJSONStreamParserFeed call in progress */
+
+    char *member; /* member of the top level object being parsed */
+    size_t skip; /* nesting of the filtered out value being skipped */
+    bool skipNext; /* the filter rejected the last key */
+    bool failed; /* valueFunc reported an error */
 };
+#endif
 
 
 /**
@@ -355,6 +378,7 @@ virJSONValueFree(virJSONValuePtr value)
             virJSONValueFree(value->data.object.pairs[i].value);
         }
         VIR_FREE(value->data.object.pairs);
+        VIR_FREE(value->data.object.index);
         break;
     case VIR_JSON_TYPE_ARRAY:
         for (i = 0; i < value->data.array.nvalues; i++)
@@ -365,7 +389,8 @@ virJSONValueFree(virJSONValuePtr value)
         VIR_FREE(value->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        VIR_FREE(value->data.number);
+        if (value->data.number.type == VIR_JSON_NUMBER_TEXT)
+            VIR_FREE(value->data.number.data.text);
         break;
     case VIR_JSON_TYPE_BOOLEAN:
     case VIR_JSON_TYPE_NULL:
@@ -428,7 +453,7 @@ virJSONValueNewStringLen(const char *data,
 
 
 static virJSONValuePtr
-virJSONValueNewNumber(const char *data)
+virJSONValueNewNumber(virJSONNumberType type)
 {
     virJSONValuePtr val;
 
@@ -436,7 +461,62 @@ virJSONValueNewNumber(const char *data)
         return NULL;
 
     val->type = VIR_JSON_TYPE_NUMBER;
-    if (VIR_STRDUP(val->data.number, data) < 0) {
+    val->data.number.type = type;
+
+    return val;
+}
+
+
+/* Numbers are stored natively whenever formatting them back yields
+ * exactly @data, i.e. for integers in canonical form that fit 64 bits.
+ * Anything else (fractions, exponents, "-0", huge values) keeps its
+ * lexical form so that nothing is lost.  @data need not be terminated. */
+static virJSONValuePtr
+virJSONValueNewNumberLexical(const char *data,
+                             size_t length)
+{
+    virJSONValuePtr val;
+    unsigned long long ul = 0;
+    bool negative = false;
+    size_t i = 0;
+
+    if (length > 0 && data[0] == '-') {
+        negative = true;
+        i++;
+    }
+
+    if (i == length || (data[i] == '0' && length - i > 1))
+        goto text;
+
+    for (; i < length; i++) {
+        unsigned int digit = data[i] - '0';
+
+        if (digit > 9 || ul > (ULLONG_MAX - digit) / 10)
+            goto text;
+
+        ul = ul * 10 + digit;
+    }
+
+    if (!negative) {
+        if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_ULONG)))
+            return NULL;
+        val->data.number.data.ul = ul;
+        return val;
+    }
+
+    if (ul == 0 || ul - 1 > LLONG_MAX)
+        goto text;
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_LONG)))
+        return NULL;
+    val->data.number.data.l = -(long long) (ul - 1) - 1;
+    return val;
+
+ text:
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_TEXT)))
+        return NULL;
+
+    if (VIR_STRNDUP(val->data.number.data.text, data, length) < 0) {
         VIR_FREE(val);
         return NULL;
     }
@@ -448,38 +528,29 @@ virJSONValueNewNumber(const char *data)
 virJSONValuePtr
 virJSONValueNewNumberInt(int data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%i", data) < 0)
-        return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
-    return val;
+    return virJSONValueNewNumberLong(data);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberUint(unsigned int data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%u", data) < 0)
-        return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
-    return val;
+    return virJSONValueNewNumberUlong(data);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberLong(long long data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%lld", data) < 0)
+    virJSONValuePtr val;
+
+    if (data >= 0)
+        return virJSONValueNewNumberUlong(data);
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_LONG)))
         return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+
+    val->data.number.data.l = data;
     return val;
 }
 
@@ -487,12 +558,12 @@ virJSONValueNewNumberLong(long long data)
 virJSONValuePtr
 virJSONValueNewNumberUlong(unsigned long long data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virAsprintf(&str, "%llu", data) < 0)
+    virJSONValuePtr val;
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_ULONG)))
         return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+
+    val->data.number.data.ul = data;
     return val;
 }
 
@@ -500,12 +571,12 @@ virJSONValueNewNumberUlong(unsigned long long data)
 virJSONValuePtr
 virJSONValueNewNumberDouble(double data)
 {
-    virJSONValuePtr val = NULL;
-    char *str;
-    if (virDoubleToStr(&str, data) < 0)
+    virJSONValuePtr val;
+
+    if (!(val = virJSONValueNewNumber(VIR_JSON_NUMBER_DOUBLE)))
         return NULL;
-    val = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+
+    val->data.number.data.d = data;
     return val;
 }
 
@@ -567,6 +638,127 @@ virJSONValueNewObject(void)
 }
 
 
+/* Objects with fewer keys than this are searched linearly; larger ones
+ * get an open-addressing table mapping keys to their offset in @pairs.
+ * The table is only an accelerator: it is built on the first lookup
+ * past the threshold, and dropped whenever a removal shifts @pairs. */
+#define VIR_JSON_OBJECT_INDEX_THRESHOLD 16
+
+struct _virJSONObjectIndex {
+    uint32_t seed;
+    size_t nslots; /* power of two, at least twice the number of pairs */
+    size_t slots[]; /* offset into @pairs plus one, 0 for empty slots */
+};
+
+
+static void
+virJSONObjectIndexInsert(virJSONObjectIndexPtr index,
+                         const char *key,
+                         size_t n)
+{
+    size_t mask = index->nslots - 1;
+    size_t h = virHashCodeGen(key, strlen(key), index->seed) & mask;
+
+    while (index->slots[h])
+        h = (h + 1) & mask;
+
+    index->slots[h] = n + 1;
+}
+
+
+static void
+virJSONObjectIndexBuild(virJSONObjectPtr object)
+{
+    virJSONObjectIndexPtr index;
+    size_t nslots = VIR_JSON_OBJECT_INDEX_THRESHOLD * 2;
+    size_t i;
+
+    while (nslots < object->npairs * 2)
+        nslots *= 2;
+
+    /* Failing to build the index merely leaves lookups linear */
+    if (VIR_ALLOC_VAR_QUIET(index, size_t, nslots) < 0)
+        return;
+
+    index->seed = virRandomBits(32);
+    index->nslots = nslots;
+
+    for (i = 0; i < object->npairs; i++)
+        virJSONObjectIndexInsert(index, object->pairs[i].key, i);
+
+    object->index = index;
+}
+
+
+/* Record the freshly appended pair @n in the index of @object, if
+ * there is one.  When the table gets too full it's thrown away and
+ * rebuilt at twice the size by the next lookup.  */
+static void
+virJSONObjectIndexAdd(virJSONObjectPtr object,
+                      size_t n)
+{
+    if (!object->index)
+        return;
+
+    if (object->npairs * 2 > object->index->nslots) {
+        VIR_FREE(object->index);
+        return;
+    }
+
+    virJSONObjectIndexInsert(object->index, object->pairs[n].key, n);
+}
+
+
+/* Returns the offset of @key in @object's pairs, or -1 if missing.  */
+static ssize_t
+virJSONObjectFind(virJSONObjectPtr object,
+                  const char *key)
+{
+    size_t i;
+
+    if (!object->index &&
+        object->npairs >= VIR_JSON_OBJECT_INDEX_THRESHOLD)
+        virJSONObjectIndexBuild(object);
+
+    if (object->index) {
+        virJSONObjectIndexPtr index = object->index;
+        size_t mask = index->nslots - 1;
+        size_t h = virHashCodeGen(key, strlen(key), index->seed) & mask;
+
+        while ((i = index->slots[h])) {
+            if (STREQ(object->pairs[i - 1].key, key))
+                return i - 1;
+            h = (h + 1) & mask;
+        }
+
+        return -1;
+    }
+
+    for (i = 0; i < object->npairs; i++) {
+        if (STREQ(object->pairs[i].key, key))
+            return i;
+    }
+
+    return -1;
+}
+
+
+/* Drop pair @n from @object, handing its value back to the caller.  */
+static virJSONValuePtr
+virJSONObjectDelete(virJSONObjectPtr object,
+                    size_t n)
+{
+    virJSONValuePtr value = NULL;
+
+    VIR_STEAL_PTR(value, object->pairs[n].value);
+    VIR_FREE(object->pairs[n].key);
+    VIR_DELETE_ELEMENT(object->pairs, n, object->npairs);
+    VIR_FREE(object->index);
+
+    return value;
+}
+
+
 int
 virJSONValueObjectAppend(virJSONValuePtr object,
                          const char *key,
@@ -593,6 +785,9 @@ virJSONValueObjectAppend(virJSONValuePtr object,
     object->data.object.pairs[object->data.object.npairs].value = value;
     object->data.object.npairs++;
 
+    virJSONObjectIndexAdd(&object->data.object,
+                          object->data.object.npairs - 1);
+
     return 0;
 }
 
@@ -746,17 +941,10 @@ int
 virJSONValueObjectHasKey(virJSONValuePtr object,
                          const char *key)
 {
-    size_t i;
-
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return 1;
-    }
-
-    return 0;
+    return virJSONObjectFind(&object->data.object, key) >= 0;
 }
 
 
@@ -764,17 +952,15 @@ virJSONValuePtr
 virJSONValueObjectGet(virJSONValuePtr object,
                       const char *key)
 {
-    size_t i;
+    ssize_t i;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return object->data.object.pairs[i].value;
-    }
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return NULL;
 
-    return NULL;
+    return object->data.object.pairs[i].value;
 }
 
 
@@ -782,23 +968,15 @@ static virJSONValuePtr
 virJSONValueObjectSteal(virJSONValuePtr object,
                         const char *key)
 {
-    size_t i;
-    virJSONValuePtr obj = NULL;
+    ssize_t i;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            VIR_STEAL_PTR(obj, object->data.object.pairs[i].value);
-            VIR_FREE(object->data.object.pairs[i].key);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            break;
-        }
-    }
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return NULL;
 
-    return obj;
+    return virJSONObjectDelete(&object->data.object, i);
 }
 
 
@@ -864,7 +1042,8 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
                             const char *key,
                             virJSONValuePtr *value)
 {
-    size_t i;
+    ssize_t i;
+    virJSONValuePtr removed;
 
     if (value)
         *value = NULL;
@@ -872,21 +1051,16 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            if (value) {
-                *value = object->data.object.pairs[i].value;
-                object->data.object.pairs[i].value = NULL;
-            }
-            VIR_FREE(object->data.object.pairs[i].key);
-            virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            return 1;
-        }
-    }
+    if ((i = virJSONObjectFind(&object->data.object, key)) < 0)
+        return 0;
 
-    return 0;
+    removed = virJSONObjectDelete(&object->data.object, i);
+    if (value)
+        *value = removed;
+    else
+        virJSONValueFree(removed);
+
+    return 1;
 }
 
 
@@ -1032,14 +1206,37 @@ virJSONValueGetString(virJSONValuePtr string)
 }
 
 
+/* The getters below accept exactly what virStrToLong_* and
+ * virStrToDouble would accept if given the formatted number.  Formatted
+ * doubles always contain a radix character, so they never pass for an
+ * integer.  */
 int
 virJSONValueGetNumberInt(virJSONValuePtr number,
                          int *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_i(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberType) num->type) {
+    case VIR_JSON_NUMBER_LONG:
+        if (num->data.l < INT_MIN)
+            return -1;
+        *value = num->data.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        if (num->data.ul > INT_MAX)
+            return -1;
+        *value = num->data.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+        return -1;
+    case VIR_JSON_NUMBER_TEXT:
+        return virStrToLong_i(num->data.text, NULL, 10, value);
+    }
+
+    return -1;
 }
 
 
@@ -1047,10 +1244,30 @@ int
 virJSONValueGetNumberUint(virJSONValuePtr number,
                           unsigned int *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ui(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberType) num->type) {
+    case VIR_JSON_NUMBER_LONG:
+        /* "-1" is accepted as UINT_MAX, see virStrToLong_ui */
+        if (-(unsigned long long) num->data.l > UINT_MAX)
+            return -1;
+        *value = num->data.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        if (num->data.ul > UINT_MAX)
+            return -1;
+        *value = num->data.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+        return -1;
+    case VIR_JSON_NUMBER_TEXT:
+        return virStrToLong_ui(num->data.text, NULL, 10, value);
+    }
+
+    return -1;
 }
 
 
@@ -1058,10 +1275,27 @@ int
 virJSONValueGetNumberLong(virJSONValuePtr number,
                           long long *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ll(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberType) num->type) {
+    case VIR_JSON_NUMBER_LONG:
+        *value = num->data.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        if (num->data.ul > LLONG_MAX)
+            return -1;
+        *value = num->data.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+        return -1;
+    case VIR_JSON_NUMBER_TEXT:
+        return virStrToLong_ll(num->data.text, NULL, 10, value);
+    }
+
+    return -1;
 }
 
 
@@ -1069,10 +1303,26 @@ int
 virJSONValueGetNumberUlong(virJSONValuePtr number,
                            unsigned long long *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ull(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberType) num->type) {
+    case VIR_JSON_NUMBER_LONG:
+        /* negative numbers wrap around, see virStrToLong_ull */
+        *value = num->data.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        *value = num->data.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+        return -1;
+    case VIR_JSON_NUMBER_TEXT:
+        return virStrToLong_ull(num->data.text, NULL, 10, value);
+    }
+
+    return -1;
 }
 
 
@@ -1080,10 +1330,90 @@ int
 virJSONValueGetNumberDouble(virJSONValuePtr number,
                             double *value)
 {
+    virJSONNumberPtr num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToDouble(number->data.number, NULL, value);
+    switch ((virJSONNumberType) num->type) {
+    case VIR_JSON_NUMBER_LONG:
+        *value = num->data.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        *value = num->data.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+        *value = num->data.d;
+        return 0;
+    case VIR_JSON_NUMBER_TEXT:
+        return virStrToDouble(num->data.text, NULL, value);
+    }
+
+    return -1;
+}
+
+
+/* Format @num into @buf, which must be large enough for any 64 bit
+ * integer.  Doubles are formatted into a newly allocated string which
+ * is returned via @tmp and must be freed by the caller.  */
+static const char *
+virJSONNumberFormat(virJSONNumberPtr num,
+                    char *buf,
+                    size_t buflen,
+                    char **tmp)
+{
+    *tmp = NULL;
+
+    switch ((virJSONNumberType) num->type) {
+    case VIR_JSON_NUMBER_LONG:
+        snprintf(buf, buflen, "%lld", num->data.l);
+        return buf;
+    case VIR_JSON_NUMBER_ULONG:
+        snprintf(buf, buflen, "%llu", num->data.ul);
+        return buf;
+    case VIR_JSON_NUMBER_DOUBLE:
+        if (virDoubleToStr(tmp, num->data.d) < 0)
+            return NULL;
+        return *tmp;
+    case VIR_JSON_NUMBER_TEXT:
+        return num->data.text;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * virJSONValueGetNumberString:
+ * @number: JSON number
+ *
+ * Returns a newly allocated string holding the number exactly as it
+ * would be formatted into JSON, or NULL on error.
+ */
+char *
+virJSONValueGetNumberString(virJSONValuePtr number)
+{
+    char buf[INT_BUFSIZE_BOUND(long long)];
+    const char *str;
+    char *tmp;
+    char *ret = NULL;
+
+    if (number->type != VIR_JSON_TYPE_NUMBER) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("JSON value is not a number"));
+        return NULL;
+    }
+
+    if (!(str = virJSONNumberFormat(&number->data.number,
+                                    buf, sizeof(buf), &tmp)))
+        return NULL;
+
+    if (tmp)
+        VIR_STEAL_PTR(ret, tmp);
+    else
+        ignore_value(VIR_STRDUP(ret, str));
+
+    return ret;
 }
 
 
@@ -1134,10 +1464,23 @@ virJSONValueGetArrayAsBitmap(const virJSONValue *val,
     for (i = 0; i < val->data.array.nvalues; i++) {
         elem = val->data.array.values[i];
 
-        if (elem->type != VIR_JSON_TYPE_NUMBER ||
-            virStrToLong_ullp(elem->data.number, NULL, 10, &elems[i]) < 0)
+        if (elem->type != VIR_JSON_TYPE_NUMBER)
             goto cleanup;
 
+        switch ((virJSONNumberType) elem->data.number.type) {
+        case VIR_JSON_NUMBER_ULONG:
+            elems[i] = elem->data.number.data.ul;
+            break;
+        case VIR_JSON_NUMBER_TEXT:
+            if (virStrToLong_ullp(elem->data.number.data.text,
+                                  NULL, 10, &elems[i]) < 0)
+                goto cleanup;
+            break;
+        case VIR_JSON_NUMBER_LONG:
+        case VIR_JSON_NUMBER_DOUBLE:
+            goto cleanup;
+        }
+
         if (elems[i] > maxelem)
             maxelem = elems[i];
     }
@@ -1404,7 +1747,12 @@ virJSONValueCopy(const virJSONValue *in)
         out = virJSONValueNewString(in->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        out = virJSONValueNewNumber(in->data.number);
+        if (in->data.number.type == VIR_JSON_NUMBER_TEXT) {
+            const char *text = in->data.number.data.text;
+            out = virJSONValueNewNumberLexical(text, strlen(text));
+        } else if ((out = virJSONValueNewNumber(in->data.number.type))) {
+            out->data.number = in->data.number;
+        }
         break;
     case VIR_JSON_TYPE_BOOLEAN:
         out = virJSONValueNewBoolean(in->data.boolean);
@@ -1474,11 +1822,93 @@ virJSONParserInsertValue(virJSONParserPtr parser,
 }
 
 
+/* Returns true if a scalar value is to be dropped by the stream filter */
+static bool
+virJSONParserSkipScalar(virJSONParserPtr parser)
+{
+    virJSONStreamParserPtr stream = parser->stream;
+
+    if (!stream)
+        return false;
+
+    if (stream->skip > 0)
+        return true;
+
+    if (stream->skipNext) {
+        stream->skipNext = false;
+        return true;
+    }
+
+    return false;
+}
+
+
+/* Returns true if a map or array is to be dropped by the stream filter */
+static bool
+virJSONParserSkipStart(virJSONParserPtr parser)
+{
+    virJSONStreamParserPtr stream = parser->stream;
+
+    if (!stream)
+        return false;
+
+    if (stream->skip > 0 || stream->skipNext) {
+        stream->skipNext = false;
+        stream->skip++;
+        return true;
+    }
+
+    return false;
+}
+
+
+/* Returns true if the end of a map or array belongs to a dropped value */
+static bool
+virJSONParserSkipEnd(virJSONParserPtr parser)
+{
+    virJSONStreamParserPtr stream = parser->stream;
+
+    if (!stream || stream->skip == 0)
+        return false;
+
+    stream->skip--;
+    return true;
+}
+
+
+/* Hands a complete top level value over to the stream consumer */
+static int
+virJSONParserValueDone(virJSONParserPtr parser)
+{
+    virJSONStreamParserPtr stream = parser->stream;
+    virJSONValuePtr value;
+
+    if (!stream || parser->nstate != 0 || !parser->head)
+        return 1;
+
+    value = parser->head;
+    parser->head = NULL;
+    VIR_FREE(stream->member);
+
+    if (stream->valueFunc(value, stream->opaque) < 0) {
+        stream->failed = true;
+        return 0;
+    }
+
+    return 1;
+}
+
+
 static int
 virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value;
+
+    if (virJSONParserSkipScalar(parser))
+        return 1;
+
+    value = virJSONValueNewNull();
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1490,7 +1920,7 @@ virJSONParserHandleNull(void *ctx)
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1499,7 +1929,12 @@ virJSONParserHandleBoolean(void *ctx,
                            int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value;
+
+    if (virJSONParserSkipScalar(parser))
+        return 1;
+
+    value = virJSONValueNewBoolean(boolean_);
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
@@ -1511,7 +1946,7 @@ virJSONParserHandleBoolean(void *ctx,
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1521,15 +1956,14 @@ virJSONParserHandleNumber(void *ctx,
                           yajl_size_t l)
 {
     virJSONParserPtr parser = ctx;
-    char *str;
     virJSONValuePtr value;
 
-    if (VIR_STRNDUP(str, s, l) < 0)
-        return -1;
-    value = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+    if (virJSONParserSkipScalar(parser))
+        return 1;
+
+    value = virJSONValueNewNumberLexical(s, l);
 
-    VIR_DEBUG("parser=%p str=%s", parser, str);
+    VIR_DEBUG("parser=%p str=%.*s", parser, (int) l, s);
 
     if (!value)
         return 0;
@@ -1539,7 +1973,7 @@ virJSONParserHandleNumber(void *ctx,
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1549,8 +1983,12 @@ virJSONParserHandleString(void *ctx,
                           yajl_size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value;
+
+    if (virJSONParserSkipScalar(parser))
+        return 1;
+
+    value = virJSONValueNewStringLen((const char *)stringVal, stringLen);
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
@@ -1562,7 +2000,7 @@ virJSONParserHandleString(void *ctx,
         return 0;
     }
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1573,9 +2011,13 @@ virJSONParserHandleMapKey(void *ctx,
 {
     virJSONParserPtr parser = ctx;
     virJSONParserStatePtr state;
+    virJSONStreamParserPtr stream = parser->stream;
 
     VIR_DEBUG("parser=%p key=%p", parser, (const char *)stringVal);
 
+    if (stream && stream->skip > 0)
+        return 1;
+
     if (!parser->nstate)
         return 0;
 
@@ -1584,6 +2026,24 @@ virJSONParserHandleMapKey(void *ctx,
         return 0;
     if (VIR_STRNDUP(state->key, (const char *)stringVal, stringLen) < 0)
         return 0;
+
+    if (stream && stream->filterFunc) {
+        const char *member = parser->nstate > 1 ? stream->member : NULL;
+
+        if (!stream->filterFunc(parser->state[0].value, member, state->key,
+                                parser->nstate, stream->opaque)) {
+            VIR_FREE(state->key);
+            stream->skipNext = true;
+            return 1;
+        }
+    }
+
+    if (stream && parser->nstate == 1) {
+        VIR_FREE(stream->member);
+        if (VIR_STRDUP(stream->member, state->key) < 0)
+            return 0;
+    }
+
     return 1;
 }
 
@@ -1592,7 +2052,12 @@ static int
 virJSONParserHandleStartMap(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value;
+
+    if (virJSONParserSkipStart(parser))
+        return 1;
+
+    value = virJSONValueNewObject();
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1625,6 +2090,9 @@ virJSONParserHandleEndMap(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (virJSONParserSkipEnd(parser))
+        return 1;
+
     if (!parser->nstate)
         return 0;
 
@@ -1636,7 +2104,7 @@ virJSONParserHandleEndMap(void *ctx)
 
     VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1644,7 +2112,12 @@ static int
 virJSONParserHandleStartArray(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
+    virJSONValuePtr value;
+
+    if (virJSONParserSkipStart(parser))
+        return 1;
+
+    value = virJSONValueNewArray();
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1676,6 +2149,9 @@ virJSONParserHandleEndArray(void *ctx)
 
     VIR_DEBUG("parser=%p", parser);
 
+    if (virJSONParserSkipEnd(parser))
+        return 1;
+
     if (!(parser->nstate - parser->wrap))
         return 0;
 
@@ -1687,7 +2163,7 @@ virJSONParserHandleEndArray(void *ctx)
 
     VIR_DELETE_ELEMENT(parser->state, parser->nstate - 1, parser->nstate);
 
-    return 1;
+    return virJSONParserValueDone(parser);
 }
 
 
@@ -1711,7 +2187,7 @@ virJSONValuePtr
 virJSONValueFromString(const char *jsonstring)
 {
     yajl_handle hand;
-    virJSONParser parser = { NULL, NULL, 0, 0 };
+    virJSONParser parser = { NULL, NULL, 0, 0, NULL };
     virJSONValuePtr ret = NULL;
     int rc;
     size_t len = strlen(jsonstring);
@@ -1806,6 +2282,10 @@ virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
 {
     size_t i;
+    char buf[INT_BUFSIZE_BOUND(long long)];
+    const char *str;
+    char *tmp = NULL;
+    yajl_gen_status rc;
 
     VIR_DEBUG("object=%p type=%d gen=%p", object, object->type, g);
 
@@ -1843,8 +2323,12 @@ virJSONValueToStringOne(virJSONValuePtr object,
         break;
 
     case VIR_JSON_TYPE_NUMBER:
-        if (yajl_gen_number(g, object->data.number,
-                            strlen(object->data.number)) != yajl_gen_status_ok)
+        if (!(str = virJSONNumberFormat(&object->data.number,
+                                        buf, sizeof(buf), &tmp)))
+            return -1;
+        rc = yajl_gen_number(g, str, strlen(str));
+        VIR_FREE(tmp);
+        if (rc != yajl_gen_status_ok)
             return -1;
         break;
 
@@ -1917,6 +2401,7 @@ virJSONValueToString(virJSONValuePtr object,
 }
 
 
+
 #else
 virJSONValuePtr
 virJSONValueFromString(const char *jsonstring ATTRIBUTE_UNUSED)
@@ -1938,6 +2423,152 @@ virJSONValueToString(virJSONValuePtr object ATTRIBUTE_UNUSED,
 #endif
 
 
+#ifdef WITH_YAJL2
+/**
+ * virJSONStreamParserNew:
+ * @valueFunc: callback invoked for every complete top level value
+ * @filterFunc: optional callback deciding which object members to keep
+ *
+ * Creates a push parser for a stream of JSON values, e.g. the replies and
+ * events sent over a QMP socket. Data is fed via virJSONStreamParserFeed
+ * in arbitrary chunks as it arrives and @valueFunc is called (taking
+ * ownership of the value) as soon as a top level value is complete, so
+ * the caller does not need to find message boundaries first.
+ *
+ * If @filterFunc is provided, it is called for every object key with the
+ * top level object parsed so far (holding only the members which precede
+ * the key), the name of the member of the top level object the key is
+ * nested in (NULL for the keys of the top level object itself) and the
+ * nesting @depth (1 for the keys of the top level object, each object or
+ * array adds 1). Members for which @filterFunc returns false are skipped
+ * without ever being allocated.
+ *
+ * Returns the parser or NULL on error.
+ */
+virJSONStreamParserPtr
+virJSONStreamParserNew(virJSONStreamParserValueFunc valueFunc,
+                       virJSONStreamParserFilterFunc filterFunc)
+{
+    virJSONStreamParserPtr stream;
+
+    if (VIR_ALLOC(stream) < 0)
+        return NULL;
+
+    stream->parser.stream = stream;
+    stream->valueFunc = valueFunc;
+    stream->filterFunc = filterFunc;
+
+    if (!(stream->handle = yajl_alloc(&parserCallbacks, NULL,
+                                      &stream->parser))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to create JSON parser"));
+        VIR_FREE(stream);
+        return NULL;
+    }
+
+    yajl_config(stream->handle, yajl_allow_multiple_values, 1);
+
+    return stream;
+}
+
+
+/**
+ * virJSONStreamParserFeed:
+ * @stream: the parser
+ * @data: chunk of the stream
+ * @len: length of @data
+ * @opaque: data passed to the callbacks
+ *
+ * Parses @data, invoking the callbacks of @stream for every complete value.
+ * Incomplete values are kept in @stream until the rest of the data arrives.
+ *
+ * Returns 0 on success, -1 on error. Once an error was reported the
+ * parser refuses any further data.
+ */
+int
+virJSONStreamParserFeed(virJSONStreamParserPtr stream,
+                        const char *data,
+                        size_t len,
+                        void *opaque)
+{
+    unsigned char *errstr;
+    int rc;
+
+    if (stream->failed) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("JSON stream parser is in error state"));
+        return -1;
+    }
+
+    stream->opaque = opaque;
+    rc = yajl_parse(stream->handle, (const unsigned char *)data, len);
+    stream->opaque = NULL;
+
+    if (VIR_YAJL_STATUS_OK(rc))
+        return 0;
+
+    /* errors from the callback are already reported */
+    if (!stream->failed) {
+        errstr = yajl_get_error(stream->handle, 1,
+                                (const unsigned char *)data, len);
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse json stream: %s"),
+                       (const char *)errstr);
+        yajl_free_error(stream->handle, errstr);
+        stream->failed = true;
+    }
+
+    return -1;
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParserPtr stream)
+{
+    size_t i;
+
+    if (!stream)
+        return;
+
+    yajl_free(stream->handle);
+
+    for (i = 0; i < stream->parser.nstate; i++)
+        VIR_FREE(stream->parser.state[i].key);
+    VIR_FREE(stream->parser.state);
+    virJSONValueFree(stream->parser.head);
+    VIR_FREE(stream->member);
+    VIR_FREE(stream);
+}
+#else
+virJSONStreamParserPtr
+virJSONStreamParserNew(virJSONStreamParserValueFunc valueFunc ATTRIBUTE_UNUSED,
+                       virJSONStreamParserFilterFunc filterFunc ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("incremental JSON parsing requires yajl 2"));
+    return NULL;
+}
+
+
+int
+virJSONStreamParserFeed(virJSONStreamParserPtr stream ATTRIBUTE_UNUSED,
+                        const char *data ATTRIBUTE_UNUSED,
+                        size_t len ATTRIBUTE_UNUSED,
+                        void *opaque ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("incremental JSON parsing requires yajl 2"));
+    return -1;
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParserPtr stream ATTRIBUTE_UNUSED)
+{
+}
+#endif /* WITH_YAJL2 */
+
+
 /**
  * virJSONStringReformat:
  * @jsonstr: string to reformat
@@ -48,9 +48,15 @@ typedef virJSONObject *virJSONObjectPtr;
 typedef struct _virJSONObjectPair virJSONObjectPair;
 typedef virJSONObjectPair *virJSONObjectPairPtr;
 
+typedef struct _virJSONObjectIndex virJSONObjectIndex;
+typedef virJSONObjectIndex *virJSONObjectIndexPtr;
+
 typedef struct _virJSONArray virJSONArray;
 typedef virJSONArray *virJSONArrayPtr;
 
+typedef struct _virJSONNumber virJSONNumber;
+typedef virJSONNumber *virJSONNumberPtr;
+
 
 struct _virJSONObjectPair {
     char *key;
@@ -60,6 +66,8 @@ struct _virJSONObjectPair {
 struct _virJSONObject {
     size_t npairs;
     virJSONObjectPairPtr pairs;
+    virJSONObjectIndexPtr index; /* key lookup table, built lazily once
+                                    the object grows large */
 };
 
 struct _virJSONArray {
@@ -67,6 +75,23 @@ struct _virJSONArray {
     virJSONValuePtr *values;
 };
 
+typedef enum {
+    VIR_JSON_NUMBER_LONG, /* negative integer */
+    VIR_JSON_NUMBER_ULONG, /* non-negative integer */
+    VIR_JSON_NUMBER_DOUBLE,
+    VIR_JSON_NUMBER_TEXT, /* anything else, kept in its lexical form */
+} virJSONNumberType;
+
+struct _virJSONNumber {
+    int type; /* enum virJSONNumberType */
+    union {
+        long long l;
+        unsigned long long ul;
+        double d;
+        char *text;
+    } data;
+};
+
 struct _virJSONValue {
     int type; /* enum virJSONType */
     bool protect; /* prevents deletion when embedded in another object */
@@ -75,7 +100,7 @@ struct _virJSONValue {
         virJSONObject object;
         virJSONArray array;
         char *string;
-        char *number; /* int/float/etc format is context defined so we can't parse it here :-( */
+        virJSONNumber number;
         int boolean;
     } data;
 };
@@ -137,6 +162,7 @@ int virJSONValueGetNumberUint(virJSONValuePtr object, unsigned int *value);
 int virJSONValueGetNumberLong(virJSONValuePtr object, long long *value);
 int virJSONValueGetNumberUlong(virJSONValuePtr object, unsigned long long *value);
 int virJSONValueGetNumberDouble(virJSONValuePtr object, double *value);
+char *virJSONValueGetNumberString(virJSONValuePtr number);
 int virJSONValueGetBoolean(virJSONValuePtr object, bool *value);
 int virJSONValueGetArrayAsBitmap(const virJSONValue *val, virBitmapPtr *bitmap)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -174,6 +200,28 @@ virJSONValuePtr virJSONValueFromString(const char *jsonstring);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
 
+typedef struct _virJSONStreamParser virJSONStreamParser;
+typedef virJSONStreamParser *virJSONStreamParserPtr;
+
+typedef int (*virJSONStreamParserValueFunc)(virJSONValuePtr value,
+                                            void *opaque);
+typedef bool (*virJSONStreamParserFilterFunc)(virJSONValuePtr object,
+                                              const char *member,
+                                              const char *key,
+                                              size_t depth,
+                                              void *opaque);
+
+virJSONStreamParserPtr
+virJSONStreamParserNew(virJSONStreamParserValueFunc valueFunc,
+                       virJSONStreamParserFilterFunc filterFunc)
+    ATTRIBUTE_NONNULL(1);
+int virJSONStreamParserFeed(virJSONStreamParserPtr stream,
+                            const char *data,
+                            size_t len,
+                            void *opaque)
+    ATTRIBUTE_NONNULL(1);
+void virJSONStreamParserFree(virJSONStreamParserPtr stream);
+
 typedef int (*virJSONValueObjectIteratorFunc)(const char *key,
                                               virJSONValuePtr value,
                                               void *opaque);
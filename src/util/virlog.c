@@ -47,6 +47,7 @@
 #include "virutil.h"
 #include "virbuffer.h"
 #include "virthread.h"
+#include "viratomic.h"
 #include "virfile.h"
 #include "virtime.h"
 #include "intprops.h"
@@ -118,6 +119,7 @@ static virLogPriority virLogDefaultPriority = VIR_LOG_DEFAULT;
 
 static void virLogResetFilters(void);
 static void virLogResetOutputs(void);
+static void virLogResetAsync(void);
 static void virLogOutputToFd(virLogSourcePtr src,
                              virLogPriority priority,
                              const char *filename,
@@ -136,6 +138,85 @@ static void virLogOutputToFd(virLogSourcePtr src,
  */
 virMutex virLogMutex;
 
+static bool virLogInitMessageStderr = true;
+
+/*
+ * Messages are formatted into a buffer private to the emitting
+ * thread, which is grown as needed and reused for later messages
+ */
+typedef struct _virLogBuffer virLogBuffer;
+typedef virLogBuffer *virLogBufferPtr;
+struct _virLogBuffer {
+    char *buf;
+    size_t size;
+};
+
+static virThreadLocal virLogThreadBuffer;
+
+#define VIR_LOG_BUFFER_MIN 1024
+
+/*
+ * In the asynchronous mode the emitting threads only copy their
+ * message into a record which they push onto a bounded queue, and
+ * a dedicated writer thread pushes the records to the outputs.
+ */
+typedef struct _virLogRecord virLogRecord;
+typedef virLogRecord *virLogRecordPtr;
+struct _virLogRecord {
+    virLogSourcePtr source;
+    virLogPriority priority;
+    const char *filename;
+    int linenr;
+    const char *funcname;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    virLogMetadataPtr metadata;
+    unsigned int flags;
+    const char *str;
+    const char *msg;
+};
+
+/*
+ * The queue is a ring of slots whose sequence numbers tell producers
+ * whether a slot is free for the position they claimed and the writer
+ * whether it has been filled, so that pushing a record only takes an
+ * atomic compare and exchange on the head position. It must be sized
+ * to a power of 2.
+ */
+#define VIR_LOG_QUEUE_SIZE 4096
+#define VIR_LOG_QUEUE_MASK (VIR_LOG_QUEUE_SIZE - 1)
+
+/* Maximum number of records written out under a single virLogLock */
+#define VIR_LOG_QUEUE_BATCH 64
+
+typedef struct _virLogQueueSlot virLogQueueSlot;
+struct _virLogQueueSlot {
+    volatile int seq;
+    virLogRecordPtr record;
+};
+
+static virLogQueueSlot virLogQueue[VIR_LOG_QUEUE_SIZE];
+static volatile int virLogQueueHead;
+static unsigned int virLogQueueTail; /* only used by the consumer */
+static volatile int virLogQueueDropped;
+
+/* Read without locks by the emitting threads */
+static volatile int virLogAsyncEnabled;
+
+/* Number of emitting threads between checking virLogAsyncEnabled and
+ * having queued their message */
+static volatile int virLogAsyncProducers;
+
+/* virLogAsyncControl serializes switching the mode on and off */
+static virMutex virLogAsyncControl;
+static virThread virLogAsyncThread;
+static pid_t virLogAsyncPid;
+
+/* virLogAsyncLock guards the writer going to sleep and waking up */
+static virMutex virLogAsyncLock;
+static virCond virLogAsyncCond;
+static bool virLogAsyncQuit;
+static volatile int virLogAsyncSleeping;
+
 void
 virLogLock(void)
 {
@@ -257,10 +338,59 @@ virLogPriorityString(virLogPriority lvl)
 }
 
 
+static void
+virLogBufferFree(void *opaque)
+{
+    virLogBufferPtr lb = opaque;
+
+    if (!lb)
+        return;
+    VIR_FREE(lb->buf);
+    VIR_FREE(lb);
+}
+
+
+static void
+virLogQueueInit(void)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_LOG_QUEUE_SIZE; i++) {
+        virLogQueue[i].seq = i;
+        virLogQueue[i].record = NULL;
+    }
+    virLogQueueHead = 0;
+    virLogQueueTail = 0;
+    virLogQueueDropped = 0;
+}
+
+
+static int
+virLogAsyncInit(void)
+{
+    if (virMutexInit(&virLogAsyncLock) < 0)
+        return -1;
+    if (virCondInit(&virLogAsyncCond) < 0) {
+        virMutexDestroy(&virLogAsyncLock);
+        return -1;
+    }
+    virLogAsyncQuit = false;
+    virLogAsyncSleeping = 0;
+    virLogAsyncProducers = 0;
+    virLogQueueInit();
+    return 0;
+}
+
+
 static int
 virLogOnceInit(void)
 {
-    if (virMutexInit(&virLogMutex) < 0)
+    if (virMutexInit(&virLogMutex) < 0 ||
+        virMutexInit(&virLogAsyncControl) < 0 ||
+        virLogAsyncInit() < 0)
+        return -1;
+
+    if (virThreadLocalInit(&virLogThreadBuffer, virLogBufferFree) < 0)
         return -1;
 
     virLogLock();
@@ -291,6 +421,8 @@ virLogReset(void)
     if (virLogInitialize() < 0)
         return -1;
 
+    virLogResetAsync();
+
     virLogLock();
     virLogResetFilters();
     virLogResetOutputs();
@@ -423,7 +555,8 @@ virLogOutputListFree(virLogOutputPtr *list, int count)
 
 
 static int
-virLogFormatString(char **msg,
+virLogFormatString(char *buf,
+                   size_t size,
                    int linenr,
                    const char *funcname,
                    virLogPriority priority,
@@ -439,24 +572,122 @@ virLogFormatString(char **msg,
      * to just grep for it to find the right place.
      */
     if ((funcname != NULL)) {
-        ret = virAsprintfQuiet(msg, "%llu: %s : %s:%d : %s\n",
-                               virThreadSelfID(), virLogPriorityString(priority),
-                               funcname, linenr, str);
+        ret = snprintf(buf, size, "%llu: %s : %s:%d : %s\n",
+                       virThreadSelfID(), virLogPriorityString(priority),
+                       funcname, linenr, str);
     } else {
-        ret = virAsprintfQuiet(msg, "%llu: %s : %s\n",
-                               virThreadSelfID(), virLogPriorityString(priority),
-                               str);
+        ret = snprintf(buf, size, "%llu: %s : %s\n",
+                       virThreadSelfID(), virLogPriorityString(priority),
+                       str);
     }
     return ret;
 }
 
 
+static int
+virLogFormatStringAlloc(char **msg,
+                        int linenr,
+                        const char *funcname,
+                        virLogPriority priority,
+                        const char *str)
+{
+    int len;
+
+    if ((len = virLogFormatString(NULL, 0, linenr, funcname,
+                                  priority, str)) < 0 ||
+        VIR_ALLOC_N_QUIET(*msg, len + 1) < 0)
+        return -1;
+
+    return virLogFormatString(*msg, len + 1, linenr, funcname, priority, str);
+}
+
+
+static int
+virLogBufferReserve(virLogBufferPtr lb,
+                    size_t size)
+{
+    size_t newsize = MAX(lb->size * 2, VIR_LOG_BUFFER_MIN);
+
+    if (size <= lb->size)
+        return 0;
+
+    newsize = MAX(newsize, size);
+    if (VIR_REALLOC_N_QUIET(lb->buf, newsize) < 0)
+        return -1;
+    lb->size = newsize;
+    return 0;
+}
+
+
+/*
+ * Formats the message and its decorated form, as passed to the
+ * outputs, into the buffer of the calling thread. On success @str
+ * and @msg point into the buffer and remain valid until the thread
+ * formats its next message.
+ */
+static int
+virLogFormatMessage(int linenr,
+                    const char *funcname,
+                    virLogPriority priority,
+                    const char *fmt,
+                    va_list vargs,
+                    const char **str,
+                    size_t *strsize,
+                    const char **msg,
+                    size_t *msgsize)
+{
+    virLogBufferPtr lb = virThreadLocalGet(&virLogThreadBuffer);
+    va_list ap;
+    int len;
+    int msglen;
+
+    if (!lb) {
+        if (VIR_ALLOC_QUIET(lb) < 0)
+            return -1;
+        if (virThreadLocalSet(&virLogThreadBuffer, lb) < 0) {
+            VIR_FREE(lb);
+            return -1;
+        }
+    }
+
+    for (;;) {
+        va_copy(ap, vargs);
+        len = vsnprintf(lb->buf, lb->size, fmt, ap);
+        va_end(ap);
+        if (len < 0)
+            return -1;
+        if ((size_t)len < lb->size)
+            break;
+        if (virLogBufferReserve(lb, len + 1) < 0)
+            return -1;
+    }
+
+    for (;;) {
+        msglen = virLogFormatString(lb->buf + len + 1, lb->size - len - 1,
+                                    linenr, funcname, priority, lb->buf);
+        if (msglen < 0)
+            return -1;
+        if ((size_t)msglen < lb->size - len - 1)
+            break;
+        if (virLogBufferReserve(lb, len + 1 + msglen + 1) < 0)
+            return -1;
+    }
+
+    *str = lb->buf;
+    *strsize = len + 1;
+    *msg = lb->buf + len + 1;
+    *msgsize = msglen + 1;
+    return 0;
+}
+
+
 static int
 virLogVersionString(const char **rawmsg,
                     char **msg)
 {
     *rawmsg = VIR_LOG_VERSION_STRING;
-    return virLogFormatString(msg, 0, NULL, VIR_LOG_INFO, VIR_LOG_VERSION_STRING);
+    return virLogFormatStringAlloc(msg, 0, NULL, VIR_LOG_INFO,
+                                   VIR_LOG_VERSION_STRING);
 }
 
 /* Similar to virGetHostname() but avoids use of error
@@ -478,7 +709,7 @@ virLogHostnameString(char **rawmsg,
     }
     VIR_FREE(hostname);
 
-    if (virLogFormatString(msg, 0, NULL, VIR_LOG_INFO, hoststr) < 0) {
+    if (virLogFormatStringAlloc(msg, 0, NULL, VIR_LOG_INFO, hoststr) < 0) {
         VIR_FREE(hoststr);
         return -1;
     }
@@ -511,6 +742,447 @@ virLogSourceUpdate(virLogSourcePtr source)
     virLogUnlock();
 }
 
+/*
+ * Pushes the message to the outputs defined, if none exist then
+ * use stderr. Must be called with virLogLock held.
+ */
+static void
+virLogOutputMessage(virLogSourcePtr source,
+                    virLogPriority priority,
+                    const char *filename,
+                    int linenr,
+                    const char *funcname,
+                    const char *timestamp,
+                    virLogMetadataPtr metadata,
+                    unsigned int flags,
+                    const char *str,
+                    const char *msg)
+{
+    size_t i;
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        if (priority >= virLogOutputs[i]->priority) {
+            if (virLogOutputs[i]->logInitMessage) {
+                const char *rawinitmsg;
+                char *hoststr = NULL;
+                char *initmsg = NULL;
+                if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
+                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
+                                       __FILE__, __LINE__, __func__,
+                                       timestamp, NULL, 0, rawinitmsg, initmsg,
+                                       virLogOutputs[i]->data);
+                VIR_FREE(initmsg);
+                if (virLogHostnameString(&hoststr, &initmsg) >= 0)
+                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
+                                       __FILE__, __LINE__, __func__,
+                                       timestamp, NULL, 0, hoststr, initmsg,
+                                       virLogOutputs[i]->data);
+                VIR_FREE(hoststr);
+                VIR_FREE(initmsg);
+                virLogOutputs[i]->logInitMessage = false;
+            }
+            virLogOutputs[i]->f(source, priority,
+                               filename, linenr, funcname,
+                               timestamp, metadata, flags,
+                               str, msg, virLogOutputs[i]->data);
+        }
+    }
+    if (virLogNbOutputs == 0) {
+        if (virLogInitMessageStderr) {
+            const char *rawinitmsg;
+            char *hoststr = NULL;
+            char *initmsg = NULL;
+            if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
+                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
+                                 __FILE__, __LINE__, __func__,
+                                 timestamp, NULL, 0, rawinitmsg, initmsg,
+                                 (void *) STDERR_FILENO);
+            VIR_FREE(initmsg);
+            if (virLogHostnameString(&hoststr, &initmsg) >= 0)
+                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
+                                 __FILE__, __LINE__, __func__,
+                                 timestamp, NULL, 0, hoststr, initmsg,
+                                 (void *) STDERR_FILENO);
+            VIR_FREE(hoststr);
+            VIR_FREE(initmsg);
+            virLogInitMessageStderr = false;
+        }
+        virLogOutputToFd(source, priority,
+                         filename, linenr, funcname,
+                         timestamp, metadata, flags,
+                         str, msg, (void *) STDERR_FILENO);
+    }
+}
+
+
+static const char *
+virLogRecordCopyString(char **dst,
+                       const char *src,
+                       size_t size)
+{
+    char *ret = *dst;
+
+    memcpy(ret, src, size);
+    *dst += size;
+    return ret;
+}
+
+
+/*
+ * Copies the message along with everything the outputs need into
+ * a single allocation, which is freed once the record is written.
+ */
+static virLogRecordPtr
+virLogRecordNew(virLogSourcePtr source,
+                virLogPriority priority,
+                const char *filename,
+                int linenr,
+                const char *funcname,
+                const char *timestamp,
+                virLogMetadataPtr metadata,
+                unsigned int flags,
+                const char *str,
+                size_t strsize,
+                const char *msg,
+                size_t msgsize)
+{
+    virLogRecordPtr record;
+    size_t filenamesize = filename ? strlen(filename) + 1 : 0;
+    size_t funcnamesize = funcname ? strlen(funcname) + 1 : 0;
+    size_t nmetadata = 0;
+    size_t size = strsize + msgsize + filenamesize + funcnamesize;
+    char *p;
+    size_t i;
+
+    if (metadata) {
+        for (; metadata[nmetadata].key; nmetadata++) {
+            size += strlen(metadata[nmetadata].key) + 1;
+            if (metadata[nmetadata].s)
+                size += strlen(metadata[nmetadata].s) + 1;
+        }
+        size += (nmetadata + 1) * sizeof(*metadata);
+    }
+
+    if (VIR_ALLOC_VAR_QUIET(record, char, size) < 0)
+        return NULL;
+
+    record->source = source;
+    record->priority = priority;
+    record->linenr = linenr;
+    record->flags = flags;
+    memcpy(record->timestamp, timestamp, sizeof(record->timestamp));
+
+    p = (char *)(record + 1);
+    if (metadata) {
+        record->metadata = (virLogMetadataPtr)(record + 1);
+        p += (nmetadata + 1) * sizeof(*metadata);
+        for (i = 0; i < nmetadata; i++) {
+            record->metadata[i].key =
+                virLogRecordCopyString(&p, metadata[i].key,
+                                       strlen(metadata[i].key) + 1);
+            if (metadata[i].s)
+                record->metadata[i].s =
+                    virLogRecordCopyString(&p, metadata[i].s,
+                                           strlen(metadata[i].s) + 1);
+            record->metadata[i].iv = metadata[i].iv;
+        }
+    }
+    if (filename)
+        record->filename = virLogRecordCopyString(&p, filename, filenamesize);
+    if (funcname)
+        record->funcname = virLogRecordCopyString(&p, funcname, funcnamesize);
+    record->str = virLogRecordCopyString(&p, str, strsize);
+    record->msg = virLogRecordCopyString(&p, msg, msgsize);
+
+    return record;
+}
+
+
+/*
+ * Claims the next free slot of the queue and publishes @record in
+ * it. Returns -1 if the queue is full.
+ */
+static int
+virLogQueuePush(virLogRecordPtr record)
+{
+    unsigned int pos = virAtomicIntGet(&virLogQueueHead);
+    virLogQueueSlot *slot;
+
+    for (;;) {
+        int diff;
+
+        slot = &virLogQueue[pos & VIR_LOG_QUEUE_MASK];
+        diff = (int)((unsigned int)virAtomicIntGet(&slot->seq) - pos);
+
+        if (diff == 0) {
+            if (virAtomicIntCompareExchange(&virLogQueueHead, pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            /* The writer has not consumed the slot from the last lap */
+            return -1;
+        }
+        pos = virAtomicIntGet(&virLogQueueHead);
+    }
+
+    slot->record = record;
+    virAtomicIntSet(&slot->seq, pos + 1);
+    return 0;
+}
+
+
+static bool
+virLogQueueIsEmpty(void)
+{
+    virLogQueueSlot *slot = &virLogQueue[virLogQueueTail & VIR_LOG_QUEUE_MASK];
+
+    return (unsigned int)virAtomicIntGet(&slot->seq) != virLogQueueTail + 1;
+}
+
+
+static virLogRecordPtr
+virLogQueuePop(void)
+{
+    virLogQueueSlot *slot = &virLogQueue[virLogQueueTail & VIR_LOG_QUEUE_MASK];
+    virLogRecordPtr record;
+
+    if (virLogQueueIsEmpty())
+        return NULL;
+
+    record = slot->record;
+    slot->record = NULL;
+    virAtomicIntSet(&slot->seq, virLogQueueTail + VIR_LOG_QUEUE_SIZE);
+    virLogQueueTail++;
+    return record;
+}
+
+
+static void
+virLogAsyncWakeup(void)
+{
+    if (!virAtomicIntGet(&virLogAsyncSleeping))
+        return;
+
+    virMutexLock(&virLogAsyncLock);
+    virCondSignal(&virLogAsyncCond);
+    virMutexUnlock(&virLogAsyncLock);
+}
+
+
+static void
+virLogQueueMessage(virLogSourcePtr source,
+                   virLogPriority priority,
+                   const char *filename,
+                   int linenr,
+                   const char *funcname,
+                   const char *timestamp,
+                   virLogMetadataPtr metadata,
+                   unsigned int flags,
+                   const char *str,
+                   size_t strsize,
+                   const char *msg,
+                   size_t msgsize)
+{
+    virLogRecordPtr record;
+
+    if (!(record = virLogRecordNew(source, priority, filename, linenr,
+                                   funcname, timestamp, metadata, flags,
+                                   str, strsize, msg, msgsize)) ||
+        virLogQueuePush(record) < 0) {
+        VIR_FREE(record);
+        virAtomicIntInc(&virLogQueueDropped);
+        return;
+    }
+
+    virLogAsyncWakeup();
+}
+
+
+/*
+ * Writes out the queued records in batches, taking virLogLock once
+ * per batch, and reports the number of messages dropped meanwhile.
+ * Must only be called by the writer thread, or once it is gone.
+ */
+static void
+virLogAsyncFlush(void)
+{
+    virLogRecordPtr records[VIR_LOG_QUEUE_BATCH];
+    size_t nrecords;
+    size_t i;
+    int dropped;
+
+    do {
+        for (nrecords = 0; nrecords < VIR_LOG_QUEUE_BATCH; nrecords++) {
+            if (!(records[nrecords] = virLogQueuePop()))
+                break;
+        }
+
+        if (nrecords) {
+            virLogLock();
+            for (i = 0; i < nrecords; i++) {
+                virLogRecordPtr record = records[i];
+
+                virLogOutputMessage(record->source, record->priority,
+                                    record->filename, record->linenr,
+                                    record->funcname, record->timestamp,
+                                    record->metadata, record->flags,
+                                    record->str, record->msg);
+            }
+            virLogUnlock();
+
+            for (i = 0; i < nrecords; i++)
+                VIR_FREE(records[i]);
+        }
+    } while (nrecords == VIR_LOG_QUEUE_BATCH);
+
+    do {
+        dropped = virAtomicIntGet(&virLogQueueDropped);
+    } while (dropped &&
+             !virAtomicIntCompareExchange(&virLogQueueDropped, dropped, 0));
+
+    if (dropped)
+        VIR_WARN("%d log messages dropped, the log queue was full", dropped);
+}
+
+
+static void
+virLogAsyncWorker(void *opaque ATTRIBUTE_UNUSED)
+{
+    for (;;) {
+        virLogAsyncFlush();
+
+        virMutexLock(&virLogAsyncLock);
+        if (virLogAsyncQuit) {
+            virMutexUnlock(&virLogAsyncLock);
+            break;
+        }
+
+        /* Emitting threads only signal us once they see the flag set,
+         * so the queue has to be checked again after setting it */
+        virAtomicIntSet(&virLogAsyncSleeping, 1);
+        if (virLogQueueIsEmpty())
+            ignore_value(virCondWait(&virLogAsyncCond, &virLogAsyncLock));
+        virAtomicIntSet(&virLogAsyncSleeping, 0);
+        virMutexUnlock(&virLogAsyncLock);
+    }
+
+    virLogAsyncFlush();
+}
+
+
+/* Must be called with virLogAsyncControl held */
+static void
+virLogAsyncStop(void)
+{
+    virAtomicIntSet(&virLogAsyncEnabled, 0);
+
+    /* Threads which saw the mode still enabled may be about to queue
+     * their messages, the last flush must not happen before they do */
+    while (virAtomicIntGet(&virLogAsyncProducers))
+        usleep(100);
+
+    virMutexLock(&virLogAsyncLock);
+    virLogAsyncQuit = true;
+    virCondSignal(&virLogAsyncCond);
+    virMutexUnlock(&virLogAsyncLock);
+
+    virThreadJoin(&virLogAsyncThread);
+
+    virLogAsyncFlush();
+}
+
+
+/*
+ * A child forked while the mode was enabled has no writer thread and
+ * may have inherited the queue and its locks in the middle of being
+ * used by other threads, start over.
+ */
+static void
+virLogAsyncForget(void)
+{
+    virAtomicIntSet(&virLogAsyncEnabled, 0);
+    ignore_value(virMutexInit(&virLogAsyncControl));
+    ignore_value(virLogAsyncInit());
+}
+
+
+static bool
+virLogAsyncIsForeign(void)
+{
+    return virAtomicIntGet(&virLogAsyncEnabled) &&
+        virLogAsyncPid != getpid();
+}
+
+
+/**
+ * virLogSetAsync:
+ * @async: whether to write messages out asynchronously
+ *
+ * In the asynchronous mode the threads emitting messages only queue
+ * them and a dedicated thread writes them to the outputs, so that
+ * they are not held up by slow outputs or each other. If the queue
+ * fills up, new messages are dropped and their count is logged once
+ * the writer catches up. Messages which are to be logged with a stack
+ * trace are always written out synchronously.
+ *
+ * Switching the mode off writes out the messages queued so far.
+ *
+ * Returns 0 if successful, -1 in case of error.
+ */
+int
+virLogSetAsync(bool async)
+{
+    int ret = -1;
+
+    if (virLogInitialize() < 0)
+        return -1;
+
+    if (virLogAsyncIsForeign())
+        virLogAsyncForget();
+
+    virMutexLock(&virLogAsyncControl);
+
+    if (!!virAtomicIntGet(&virLogAsyncEnabled) == async) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (async) {
+        virLogAsyncQuit = false;
+        if (virThreadCreate(&virLogAsyncThread, true,
+                            virLogAsyncWorker, NULL) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create log writer thread"));
+            goto cleanup;
+        }
+        virLogAsyncPid = getpid();
+        virAtomicIntSet(&virLogAsyncEnabled, 1);
+    } else {
+        virLogAsyncStop();
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virLogAsyncControl);
+    return ret;
+}
+
+
+static void
+virLogResetAsync(void)
+{
+    if (!virAtomicIntGet(&virLogAsyncEnabled))
+        return;
+
+    if (virLogAsyncIsForeign()) {
+        virLogAsyncForget();
+        return;
+    }
+
+    ignore_value(virLogSetAsync(false));
+}
+
+
 /**
  * virLogMessage:
  * @source: where is that message coming from
@@ -543,6 +1215,30 @@ virLogMessage(virLogSourcePtr source,
 }
 
 
+/**
+ * virLogSourceEnabled:
+ * @source: where the message would be coming from
+ * @priority: the priority level
+ *
+ * Allows callers to skip formatting data which would only be passed
+ * to the logger.
+ *
+ * Returns true if messages of @priority from @source are not filtered out.
+ */
+bool
+virLogSourceEnabled(virLogSourcePtr source,
+                    virLogPriority priority)
+{
+    if (virLogInitialize() < 0)
+        return false;
+
+    if (source->serial < virLogFiltersSerial)
+        virLogSourceUpdate(source);
+
+    return priority >= source->priority;
+}
+
+
 /**
  * virLogVMessage:
  * @source: where is that message coming from
@@ -567,12 +1263,11 @@ virLogVMessage(virLogSourcePtr source,
                const char *fmt,
                va_list vargs)
 {
-    static bool logInitMessageStderr = true;
-    char *str = NULL;
-    char *msg = NULL;
+    const char *str;
+    const char *msg;
+    size_t strsize;
+    size_t msgsize;
     char timestamp[VIR_TIME_STRING_BUFLEN];
-    int ret;
-    size_t i;
     int saved_errno = errno;
     unsigned int filterflags = 0;
 
@@ -599,79 +1294,45 @@ virLogVMessage(virLogSourcePtr source,
     /*
      * serialize the error message, add level and timestamp
      */
-    if (virVasprintfQuiet(&str, fmt, vargs) < 0)
-        goto cleanup;
-
-    ret = virLogFormatString(&msg, linenr, funcname, priority, str);
-    if (ret < 0)
+    if (virLogFormatMessage(linenr, funcname, priority, fmt, vargs,
+                            &str, &strsize, &msg, &msgsize) < 0)
         goto cleanup;
 
     if (virTimeStringNowRaw(timestamp) < 0)
         timestamp[0] = '\0';
 
-    virLogLock();
-
-    /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
-     */
-    for (i = 0; i < virLogNbOutputs; i++) {
-        if (priority >= virLogOutputs[i]->priority) {
-            if (virLogOutputs[i]->logInitMessage) {
-                const char *rawinitmsg;
-                char *hoststr = NULL;
-                char *initmsg = NULL;
-                if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                       __FILE__, __LINE__, __func__,
-                                       timestamp, NULL, 0, rawinitmsg, initmsg,
-                                       virLogOutputs[i]->data);
-                VIR_FREE(initmsg);
-                if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                       __FILE__, __LINE__, __func__,
-                                       timestamp, NULL, 0, hoststr, initmsg,
-                                       virLogOutputs[i]->data);
-                VIR_FREE(hoststr);
-                VIR_FREE(initmsg);
-                virLogOutputs[i]->logInitMessage = false;
-            }
-            virLogOutputs[i]->f(source, priority,
-                               filename, linenr, funcname,
+    /* Stack traces have to be taken by the emitting thread. The writer
+     * thread writes out its own messages, such as the count of dropped
+     * ones, so that they can't be lost in a full queue. The mode is
+     * checked again once counted as a producer so that switching it off
+     * can wait for the messages being queued. Children forked with the
+     * mode enabled have no writer thread and write out their messages
+     * synchronously. */
+    if (virAtomicIntGet(&virLogAsyncEnabled) &&
+        !(filterflags & VIR_LOG_STACK_TRACE) &&
+        !virThreadIsSelf(&virLogAsyncThread)) {
+        bool queued = false;
+
+        virAtomicIntInc(&virLogAsyncProducers);
+        if (virAtomicIntGet(&virLogAsyncEnabled) &&
+            virLogAsyncPid == getpid()) {
+            virLogQueueMessage(source, priority, filename, linenr, funcname,
                                timestamp, metadata, filterflags,
-                               str, msg, virLogOutputs[i]->data);
-        }
-    }
-    if (virLogNbOutputs == 0) {
-        if (logInitMessageStderr) {
-            const char *rawinitmsg;
-            char *hoststr = NULL;
-            char *initmsg = NULL;
-            if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, rawinitmsg, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(initmsg);
-            if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, hoststr, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(hoststr);
-            VIR_FREE(initmsg);
-            logInitMessageStderr = false;
+                               str, strsize, msg, msgsize);
+            queued = true;
         }
-        virLogOutputToFd(source, priority,
-                         filename, linenr, funcname,
-                         timestamp, metadata, filterflags,
-                         str, msg, (void *) STDERR_FILENO);
+        ignore_value(virAtomicIntDecAndTest(&virLogAsyncProducers));
+
+        if (queued)
+            goto cleanup;
     }
+
+    virLogLock();
+    virLogOutputMessage(source, priority, filename, linenr, funcname,
+                        timestamp, metadata, filterflags, str, msg);
     virLogUnlock();
 
  cleanup:
-    VIR_FREE(str);
-    VIR_FREE(msg);
     errno = saved_errno;
 }
 
@@ -191,6 +191,7 @@ int virLogSetOutputs(const char *outputs);
 int virLogSetFilters(const char *filters);
 char *virLogGetDefaultOutput(void);
 int virLogSetDefaultOutput(const char *fname, bool godaemon, bool privileged);
+int virLogSetAsync(bool async);
 
 /*
  * Internal logging API
@@ -217,6 +218,9 @@ void virLogVMessage(virLogSourcePtr source,
                     const char *fmt,
                     va_list vargs) ATTRIBUTE_FMT_PRINTF(7, 0);
 
+bool virLogSourceEnabled(virLogSourcePtr source,
+                         virLogPriority priority);
+
 bool virLogProbablyLogMessage(const char *str);
 virLogOutputPtr virLogOutputNew(virLogOutputFunc f,
                                 virLogCloseFunc c,
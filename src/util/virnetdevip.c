@@ -1071,6 +1071,47 @@ virNetDevIPInfoClear(virNetDevIPInfoPtr ip)
 }
 
 
+/**
+ * virNetDevIPInfoCopy:
+ * @dst: where to store the copy, assumed to be cleared
+ * @src: IP config info to copy
+ *
+ * Returns: 0 on success, -1 (and error reported) on failure, in
+ * which case @dst has to be cleared by the caller.
+ */
+int
+virNetDevIPInfoCopy(virNetDevIPInfoPtr dst,
+                    const virNetDevIPInfo *src)
+{
+    size_t i;
+
+    if (src->nips && VIR_ALLOC_N(dst->ips, src->nips) < 0)
+        return -1;
+
+    for (i = 0; i < src->nips; i++) {
+        if (VIR_ALLOC(dst->ips[i]) < 0)
+            return -1;
+        dst->nips++;
+        *dst->ips[i] = *src->ips[i];
+    }
+
+    if (src->nroutes && VIR_ALLOC_N(dst->routes, src->nroutes) < 0)
+        return -1;
+
+    for (i = 0; i < src->nroutes; i++) {
+        if (VIR_ALLOC(dst->routes[i]) < 0)
+            return -1;
+        dst->nroutes++;
+        *dst->routes[i] = *src->routes[i];
+        dst->routes[i]->family = NULL;
+        if (VIR_STRDUP(dst->routes[i]->family, src->routes[i]->family) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 /**
  * virNetDevIPInfoAddToDev:
  * @ifname: name of device to operate on
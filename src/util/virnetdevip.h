@@ -94,6 +94,9 @@ virSocketAddrPtr virNetDevIPRouteGetGateway(virNetDevIPRoutePtr def);
 
 /* virNetDevIPInfo object */
 void virNetDevIPInfoClear(virNetDevIPInfoPtr ip);
+int virNetDevIPInfoCopy(virNetDevIPInfoPtr dst,
+                        const virNetDevIPInfo *src)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 int virNetDevIPInfoAddToDev(const char *ifname,
                             virNetDevIPInfo const *ipInfo);
 
@@ -27,19 +27,31 @@
 #include <config.h>
 
 #include <stdio.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "virnetdevopenvswitch.h"
 #include "vircommand.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virfile.h"
+#include "virjson.h"
 #include "virmacaddr.h"
 #include "virstring.h"
 #include "virlog.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 VIR_LOG_INIT("util.netdevopenvswitch");
 
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
 /*
  * Set openvswitch default timout
  */
@@ -325,18 +337,615 @@ int virNetDevOpenvswitchSetMigrateData(char *migrate, const char *ifname)
     return ret;
 }
 
+/*-------------------- OVSDB session --------------------*/
+/* Statistics are read straight from the Open vSwitch database using its
+ * JSON-RPC protocol (RFC 7047) over a persistent connection, rather than
+ * by running ovs-vsctl for each counter of each interface.
+ */
+
+/* Open vSwitch keeps its database socket in its run directory, which
+ * can be overridden by OVS_RUNDIR the same way ovs-vsctl allows it, and
+ * which otherwise is assumed to live under the same local state
+ * directory as ours. */
+#define VIR_NETDEV_OVS_DB_SOCKET_NAME "db.sock"
+#define VIR_NETDEV_OVS_DB_RUNDIR LOCALSTATEDIR "/run/openvswitch"
+#define VIR_NETDEV_OVS_DB_NAME "Open_vSwitch"
+
+typedef struct _virNetDevOpenvswitchDB virNetDevOpenvswitchDB;
+typedef virNetDevOpenvswitchDB *virNetDevOpenvswitchDBPtr;
+struct _virNetDevOpenvswitchDB {
+    virMutex lock;
+
+    char *path; /* NULL for the default socket */
+    int fd;
+    virJSONStreamParserPtr parser;
+    unsigned int serial;
+
+    /* messages received, but not processed yet */
+    virJSONValuePtr *msgs;
+    size_t nmsgs;
+};
+
+static virNetDevOpenvswitchDB virNetDevOpenvswitchDBConn = {
+    .lock = VIR_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+
+static void
+virNetDevOpenvswitchDBClose(virNetDevOpenvswitchDBPtr db)
+{
+    size_t i;
+
+    VIR_FORCE_CLOSE(db->fd);
+    virJSONStreamParserFree(db->parser);
+    db->parser = NULL;
+
+    for (i = 0; i < db->nmsgs; i++)
+        virJSONValueFree(db->msgs[i]);
+    VIR_FREE(db->msgs);
+    db->nmsgs = 0;
+}
+
+
 /**
- * virNetDevOpenvswitchInterfaceStats:
- * @ifname: the name of the interface
- * @stats: the retreived domain interface stat
+ * virNetDevOpenvswitchSetDBSocket:
+ * @path: path of the database socket, NULL for the default
  *
- * Retrieves the OVS interfaces stats
+ * Set the unix socket the Open vSwitch database server listens on. Any
+ * connection to the previous socket is closed.
  *
- * Returns 0 in case of success or -1 in case of failure
+ * Returns 0 on success, -1 on error.
  */
 int
-virNetDevOpenvswitchInterfaceStats(const char *ifname,
-                                   virDomainInterfaceStatsPtr stats)
+virNetDevOpenvswitchSetDBSocket(const char *path)
+{
+    virNetDevOpenvswitchDBPtr db = &virNetDevOpenvswitchDBConn;
+    char *tmp;
+
+    if (VIR_STRDUP(tmp, path) < 0)
+        return -1;
+
+    virMutexLock(&db->lock);
+    virNetDevOpenvswitchDBClose(db);
+    VIR_FREE(db->path);
+    db->path = tmp;
+    virMutexUnlock(&db->lock);
+
+    return 0;
+}
+
+
+static int
+virNetDevOpenvswitchDBQueueMessage(virJSONValuePtr value,
+                                   void *opaque)
+{
+    virNetDevOpenvswitchDBPtr db = opaque;
+
+    if (VIR_APPEND_ELEMENT(db->msgs, db->nmsgs, value) < 0) {
+        virJSONValueFree(value);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virNetDevOpenvswitchDBOpen(virNetDevOpenvswitchDBPtr db)
+{
+    const char *path = db->path;
+    char *defpath = NULL;
+    struct sockaddr_un addr;
+    int ret = -1;
+
+    if (!path) {
+        const char *rundir = virGetEnvBlockSUID("OVS_RUNDIR");
+
+        if (virAsprintf(&defpath, "%s/%s",
+                        rundir ? rundir : VIR_NETDEV_OVS_DB_RUNDIR,
+                        VIR_NETDEV_OVS_DB_SOCKET_NAME) < 0)
+            return -1;
+        path = defpath;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (virStrcpyStatic(addr.sun_path, path) == NULL) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Socket path %s too long"), path);
+        goto cleanup;
+    }
+
+    if ((db->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create unix socket"));
+        goto error;
+    }
+
+    if (virSetCloseExec(db->fd) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set close-on-exec flag"));
+        goto error;
+    }
+
+    if (connect(db->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to connect to Open vSwitch database "
+                               "at %s"), path);
+        goto error;
+    }
+
+    if (virSetNonBlock(db->fd) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set non-blocking mode"));
+        goto error;
+    }
+
+    if (!(db->parser = virJSONStreamParserNew(virNetDevOpenvswitchDBQueueMessage,
+                                              NULL)))
+        goto error;
+
+    VIR_DEBUG("Connected to Open vSwitch database at %s", path);
+    ret = 0;
+
+ error:
+    if (ret < 0)
+        virNetDevOpenvswitchDBClose(db);
+ cleanup:
+    VIR_FREE(defpath);
+    return ret;
+}
+
+
+static int
+virNetDevOpenvswitchDBWait(virNetDevOpenvswitchDBPtr db,
+                           short events,
+                           unsigned long long deadline)
+{
+    struct pollfd pfd = { .fd = db->fd, .events = events };
+    unsigned long long now;
+    int rc;
+
+    for (;;) {
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+
+        if (now >= deadline) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("Timed out talking to the Open vSwitch database"));
+            return -1;
+        }
+
+        if ((rc = poll(&pfd, 1, deadline - now)) > 0)
+            return 0;
+
+        if (rc < 0 && errno != EINTR) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to poll Open vSwitch database "
+                                   "socket"));
+            return -1;
+        }
+    }
+}
+
+
+static int
+virNetDevOpenvswitchDBSend(virNetDevOpenvswitchDBPtr db,
+                           virJSONValuePtr msg,
+                           unsigned long long deadline)
+{
+    char *str;
+    size_t len;
+    size_t done = 0;
+    ssize_t rc;
+    int ret = -1;
+
+    if (!(str = virJSONValueToString(msg, false)))
+        return -1;
+
+    len = strlen(str);
+
+    while (done < len) {
+        if ((rc = send(db->fd, str + done, len - done, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (virNetDevOpenvswitchDBWait(db, POLLOUT, deadline) < 0)
+                    goto cleanup;
+                continue;
+            }
+
+            virReportSystemError(errno, "%s",
+                                 _("Unable to write to Open vSwitch "
+                                   "database socket"));
+            goto cleanup;
+        }
+
+        done += rc;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(str);
+    return ret;
+}
+
+
+static virJSONValuePtr
+virNetDevOpenvswitchDBRecv(virNetDevOpenvswitchDBPtr db,
+                           unsigned long long deadline)
+{
+    char buf[4096];
+    virJSONValuePtr msg;
+    ssize_t rc;
+
+    while (db->nmsgs == 0) {
+        if ((rc = read(db->fd, buf, sizeof(buf))) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (virNetDevOpenvswitchDBWait(db, POLLIN, deadline) < 0)
+                    return NULL;
+                continue;
+            }
+
+            virReportSystemError(errno, "%s",
+                                 _("Unable to read from Open vSwitch "
+                                   "database socket"));
+            return NULL;
+        }
+
+        if (rc == 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Open vSwitch database closed the connection"));
+            return NULL;
+        }
+
+        if (virJSONStreamParserFeed(db->parser, buf, rc, db) < 0)
+            return NULL;
+    }
+
+    msg = db->msgs[0];
+    VIR_DELETE_ELEMENT(db->msgs, 0, db->nmsgs);
+    return msg;
+}
+
+
+/* Appends @value to @array, freeing it on failure. @value may be NULL
+ * after a failed allocation. */
+static int
+virNetDevOpenvswitchJSONAppend(virJSONValuePtr array,
+                               virJSONValuePtr value)
+{
+    if (!value || virJSONValueArrayAppend(array, value) < 0) {
+        virJSONValueFree(value);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virNetDevOpenvswitchJSONAppendObject(virJSONValuePtr object,
+                                     const char *key,
+                                     virJSONValuePtr value)
+{
+    if (!value || virJSONValueObjectAppend(object, key, value) < 0) {
+        virJSONValueFree(value);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* The server probes idle connections with "echo" requests and drops
+ * those which don't answer. */
+static int
+virNetDevOpenvswitchDBHandleRequest(virNetDevOpenvswitchDBPtr db,
+                                    virJSONValuePtr msg,
+                                    unsigned long long deadline)
+{
+    const char *method = virJSONValueObjectGetString(msg, "method");
+    virJSONValuePtr id = virJSONValueObjectGet(msg, "id");
+    virJSONValuePtr params = virJSONValueObjectGet(msg, "params");
+    virJSONValuePtr reply = NULL;
+    int ret = -1;
+
+    /* notifications don't expect any reply */
+    if (STRNEQ_NULLABLE(method, "echo") || !id || virJSONValueIsNull(id))
+        return 0;
+
+    if (!(reply = virJSONValueNewObject()) ||
+        virNetDevOpenvswitchJSONAppendObject(reply, "id",
+                                             virJSONValueCopy(id)) < 0 ||
+        virNetDevOpenvswitchJSONAppendObject(reply, "result",
+                                             params ? virJSONValueCopy(params) :
+                                             virJSONValueNewArray()) < 0 ||
+        virJSONValueObjectAppendNull(reply, "error") < 0)
+        goto cleanup;
+
+    ret = virNetDevOpenvswitchDBSend(db, reply, deadline);
+
+ cleanup:
+    virJSONValueFree(reply);
+    return ret;
+}
+
+
+/*
+ * Runs the "transact" method with @ops (a JSON array of operations, not
+ * consumed) over the current connection and returns the array of their
+ * results.
+ */
+static virJSONValuePtr
+virNetDevOpenvswitchDBTransact(virNetDevOpenvswitchDBPtr db,
+                               virJSONValuePtr ops)
+{
+    virJSONValuePtr params;
+    virJSONValuePtr msg = NULL;
+    virJSONValuePtr result = NULL;
+    virJSONValuePtr error;
+    unsigned long long deadline;
+    unsigned int serial = ++db->serial;
+    unsigned int id;
+    char *errstr = NULL;
+    size_t i;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return NULL;
+    deadline += virNetDevOpenvswitchTimeout * 1000ull;
+
+    if (!(msg = virJSONValueNewObject()) ||
+        virJSONValueObjectAppendString(msg, "method", "transact") < 0 ||
+        !(params = virJSONValueNewArray()) ||
+        virNetDevOpenvswitchJSONAppendObject(msg, "params", params) < 0 ||
+        virNetDevOpenvswitchJSONAppend(params,
+                                       virJSONValueNewString(VIR_NETDEV_OVS_DB_NAME)) < 0 ||
+        virJSONValueObjectAppendNumberUint(msg, "id", serial) < 0)
+        goto cleanup;
+
+    for (i = 0; i < virJSONValueArraySize(ops); i++) {
+        if (virNetDevOpenvswitchJSONAppend(params,
+                                           virJSONValueCopy(virJSONValueArrayGet(ops, i))) < 0)
+            goto cleanup;
+    }
+
+    if (virNetDevOpenvswitchDBSend(db, msg, deadline) < 0)
+        goto cleanup;
+
+    for (;;) {
+        virJSONValueFree(msg);
+        if (!(msg = virNetDevOpenvswitchDBRecv(db, deadline)))
+            goto cleanup;
+
+        if (virJSONValueObjectHasKey(msg, "method")) {
+            if (virNetDevOpenvswitchDBHandleRequest(db, msg, deadline) < 0)
+                goto cleanup;
+            continue;
+        }
+
+        /* replies to a request which timed out earlier */
+        if (virJSONValueObjectGetNumberUint(msg, "id", &id) < 0 ||
+            id != serial)
+            continue;
+
+        break;
+    }
+
+    if ((error = virJSONValueObjectGet(msg, "error")) &&
+        !virJSONValueIsNull(error)) {
+        errstr = virJSONValueToString(error, false);
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Open vSwitch database transaction failed: %s"),
+                       NULLSTR(errstr));
+        goto cleanup;
+    }
+
+    if (!(result = virJSONValueObjectStealArray(msg, "result")) ||
+        virJSONValueArraySize(result) != virJSONValueArraySize(ops)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed reply from Open vSwitch database"));
+        virJSONValueFree(result);
+        result = NULL;
+        goto cleanup;
+    }
+
+ cleanup:
+    virJSONValueFree(msg);
+    VIR_FREE(errstr);
+    return result;
+}
+
+
+/*
+ * Runs a transaction with @ops, connecting to the database first if
+ * needed. A connection which was idle since the last call may have been
+ * closed by the server meanwhile, so the transaction is retried once on a
+ * fresh connection if it fails on a reused one.
+ */
+static virJSONValuePtr
+virNetDevOpenvswitchDBRun(virJSONValuePtr ops)
+{
+    virNetDevOpenvswitchDBPtr db = &virNetDevOpenvswitchDBConn;
+    virJSONValuePtr result = NULL;
+    bool reused;
+
+    virMutexLock(&db->lock);
+
+    reused = db->fd >= 0;
+
+    if (!reused && virNetDevOpenvswitchDBOpen(db) < 0)
+        goto cleanup;
+
+    if (!(result = virNetDevOpenvswitchDBTransact(db, ops))) {
+        virNetDevOpenvswitchDBClose(db);
+
+        if (!reused)
+            goto cleanup;
+
+        VIR_DEBUG("Reconnecting to Open vSwitch database: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+
+        if (virNetDevOpenvswitchDBOpen(db) < 0)
+            goto cleanup;
+
+        if (!(result = virNetDevOpenvswitchDBTransact(db, ops)))
+            virNetDevOpenvswitchDBClose(db);
+    }
+
+ cleanup:
+    virMutexUnlock(&db->lock);
+    return result;
+}
+
+
+/*
+ * Fills @stats from a row of the Interface table. The TX/RX fields
+ * appear to be swapped here because this is the host view. Counters
+ * not reported by OVS are set to -1.
+ */
+static void
+virNetDevOpenvswitchParseStats(virJSONValuePtr row,
+                               virDomainInterfaceStatsPtr stats)
+{
+    virJSONValuePtr map;
+    virJSONValuePtr pairs;
+    size_t i;
+
+    stats->rx_bytes = stats->rx_packets = -1;
+    stats->rx_errs = stats->rx_drop = -1;
+    stats->tx_bytes = stats->tx_packets = -1;
+    stats->tx_errs = stats->tx_drop = -1;
+
+    /* maps are encoded as ["map", [[key, value], ...]] */
+    if (!row ||
+        !(map = virJSONValueObjectGetArray(row, "statistics")) ||
+        virJSONValueArraySize(map) != 2 ||
+        STRNEQ_NULLABLE(virJSONValueGetString(virJSONValueArrayGet(map, 0)),
+                        "map") ||
+        !(pairs = virJSONValueArrayGet(map, 1)) ||
+        !virJSONValueIsArray(pairs))
+        return;
+
+    for (i = 0; i < virJSONValueArraySize(pairs); i++) {
+        virJSONValuePtr pair = virJSONValueArrayGet(pairs, i);
+        const char *name;
+        long long value;
+
+        if (!virJSONValueIsArray(pair) ||
+            virJSONValueArraySize(pair) != 2 ||
+            !(name = virJSONValueGetString(virJSONValueArrayGet(pair, 0))) ||
+            virJSONValueGetNumberLong(virJSONValueArrayGet(pair, 1),
+                                      &value) < 0)
+            continue;
+
+        if (STREQ(name, "rx_bytes"))
+            stats->tx_bytes = value;
+        else if (STREQ(name, "rx_packets"))
+            stats->tx_packets = value;
+        else if (STREQ(name, "rx_errors"))
+            stats->tx_errs = value;
+        else if (STREQ(name, "rx_dropped"))
+            stats->tx_drop = value;
+        else if (STREQ(name, "tx_bytes"))
+            stats->rx_bytes = value;
+        else if (STREQ(name, "tx_packets"))
+            stats->rx_packets = value;
+        else if (STREQ(name, "tx_errors"))
+            stats->rx_errs = value;
+        else if (STREQ(name, "tx_dropped"))
+            stats->rx_drop = value;
+    }
+}
+
+
+static int
+virNetDevOpenvswitchInterfaceStatsDB(const char *const *ifnames,
+                                     size_t nifnames,
+                                     virDomainInterfaceStatsPtr stats)
+{
+    virJSONValuePtr ops = NULL;
+    virJSONValuePtr result = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(ops = virJSONValueNewArray()))
+        goto cleanup;
+
+    /* one select per interface, all of them in a single transaction:
+     * {"op": "select", "table": "Interface",
+     *  "where": [["name", "==", IFNAME]], "columns": ["statistics"]} */
+    for (i = 0; i < nifnames; i++) {
+        virJSONValuePtr op;
+        virJSONValuePtr where;
+        virJSONValuePtr cond;
+        virJSONValuePtr columns;
+
+        if (!(op = virJSONValueNewObject()) ||
+            virNetDevOpenvswitchJSONAppend(ops, op) < 0 ||
+            virJSONValueObjectAppendString(op, "op", "select") < 0 ||
+            virJSONValueObjectAppendString(op, "table", "Interface") < 0 ||
+            !(where = virJSONValueNewArray()) ||
+            virNetDevOpenvswitchJSONAppendObject(op, "where", where) < 0 ||
+            !(cond = virJSONValueNewArray()) ||
+            virNetDevOpenvswitchJSONAppend(where, cond) < 0 ||
+            virNetDevOpenvswitchJSONAppend(cond, virJSONValueNewString("name")) < 0 ||
+            virNetDevOpenvswitchJSONAppend(cond, virJSONValueNewString("==")) < 0 ||
+            virNetDevOpenvswitchJSONAppend(cond, virJSONValueNewString(ifnames[i])) < 0 ||
+            !(columns = virJSONValueNewArray()) ||
+            virNetDevOpenvswitchJSONAppendObject(op, "columns", columns) < 0 ||
+            virNetDevOpenvswitchJSONAppend(columns,
+                                           virJSONValueNewString("statistics")) < 0)
+            goto cleanup;
+    }
+
+    if (!(result = virNetDevOpenvswitchDBRun(ops)))
+        goto cleanup;
+
+    for (i = 0; i < nifnames; i++) {
+        virJSONValuePtr rows;
+
+        rows = virJSONValueObjectGetArray(virJSONValueArrayGet(result, i),
+                                          "rows");
+
+        virNetDevOpenvswitchParseStats(rows ? virJSONValueArrayGet(rows, 0) : NULL,
+                                       &stats[i]);
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(ops);
+    virJSONValueFree(result);
+    return ret;
+}
+
+
+static bool
+virNetDevOpenvswitchStatsEmpty(virDomainInterfaceStatsPtr stats)
+{
+    return stats->rx_bytes < 0 && stats->rx_packets < 0 &&
+           stats->rx_errs < 0 && stats->rx_drop < 0 &&
+           stats->tx_bytes < 0 && stats->tx_packets < 0 &&
+           stats->tx_errs < 0 && stats->tx_drop < 0;
+}
+
+
+/*
+ * Retrieves the stats of @ifname using ovs-vsctl, which costs one
+ * command per counter. Only used if the database can't be talked to
+ * directly.
+ */
+static int
+virNetDevOpenvswitchInterfaceStatsCommand(const char *ifname,
+                                          virDomainInterfaceStatsPtr stats)
 {
     virCommandPtr cmd = NULL;
     char *output;
@@ -404,6 +1013,76 @@ virNetDevOpenvswitchInterfaceStats(const char *ifname,
     return ret;
 }
 
+
+/**
+ * virNetDevOpenvswitchInterfaceStats:
+ * @ifname: the name of the interface
+ * @stats: the retreived domain interface stat
+ *
+ * Retrieves the OVS interfaces stats
+ *
+ * Returns 0 in case of success or -1 in case of failure
+ */
+int
+virNetDevOpenvswitchInterfaceStats(const char *ifname,
+                                   virDomainInterfaceStatsPtr stats)
+{
+    if (virNetDevOpenvswitchInterfaceStatsDB(&ifname, 1, stats) < 0) {
+        VIR_DEBUG("Falling back to ovs-vsctl: %s", virGetLastErrorMessage());
+        virResetLastError();
+        return virNetDevOpenvswitchInterfaceStatsCommand(ifname, stats);
+    }
+
+    if (virNetDevOpenvswitchStatsEmpty(stats)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Interface not found"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virNetDevOpenvswitchInterfaceStatsList:
+ * @ifnames: the names of the interfaces
+ * @nifnames: number of items in @ifnames
+ * @stats: array of @nifnames stats to fill
+ *
+ * Retrieves the stats of several OVS interfaces (e.g. all those of a
+ * domain) at once. Counters which are not available, including all those
+ * of interfaces unknown to OVS, are set to -1.
+ *
+ * Returns 0 in case of success or -1 in case of failure
+ */
+int
+virNetDevOpenvswitchInterfaceStatsList(const char *const *ifnames,
+                                       size_t nifnames,
+                                       virDomainInterfaceStatsPtr stats)
+{
+    size_t i;
+
+    if (nifnames == 0)
+        return 0;
+
+    if (virNetDevOpenvswitchInterfaceStatsDB(ifnames, nifnames, stats) == 0)
+        return 0;
+
+    VIR_DEBUG("Falling back to ovs-vsctl: %s", virGetLastErrorMessage());
+    virResetLastError();
+
+    for (i = 0; i < nifnames; i++) {
+        if (virNetDevOpenvswitchInterfaceStatsCommand(ifnames[i],
+                                                      &stats[i]) < 0) {
+            virResetLastError();
+            memset(&stats[i], -1, sizeof(stats[i]));
+        }
+    }
+
+    return 0;
+}
+
+
 /**
  * virNetDevOpenvswitchVhostuserGetIfname:
  * @path: the path of the unix socket
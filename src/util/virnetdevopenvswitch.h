@@ -35,6 +35,8 @@
 
 void virNetDevOpenvswitchSetTimeout(unsigned int timeout);
 
+int virNetDevOpenvswitchSetDBSocket(const char *path);
+
 int virNetDevOpenvswitchAddPort(const char *brname,
                                 const char *ifname,
                                 const virMacAddr *macaddr,
@@ -57,6 +59,11 @@ int virNetDevOpenvswitchInterfaceStats(const char *ifname,
                                        virDomainInterfaceStatsPtr stats)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
+int virNetDevOpenvswitchInterfaceStatsList(const char *const *ifnames,
+                                           size_t nifnames,
+                                           virDomainInterfaceStatsPtr stats)
+    ATTRIBUTE_RETURN_CHECK;
+
 int virNetDevOpenvswitchGetVhostuserIfname(const char *path,
                                            char **ifname)
     ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK ATTRIBUTE_NOINLINE;
@@ -30,9 +30,12 @@
 #include "virnetdevopenvswitch.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "viralloc.h"
 #include "virlog.h"
+#include "virnetlink.h"
 #include "virstring.h"
+#include "virutil.h"
 #include "datatypes.h"
 
 #include <stdlib.h>
@@ -680,14 +683,176 @@ int virNetDevTapCreateInBridgePort(const char *brname,
  * NB. Caller must check that libvirt user is trying to query
  * the interface of a domain they own.  We do no such checking.
  */
-#ifdef __linux__
+
+struct _virNetDevTapStats {
+    virHashTablePtr ifaces; /* ifname -> virDomainInterfaceStatsPtr */
+};
+
+
+static int
+virNetDevTapStatsAdd(virNetDevTapStatsPtr snapshot,
+                     const char *ifname,
+                     const virDomainInterfaceStatsStruct *stats)
+{
+    virDomainInterfaceStatsPtr copy;
+
+    if (VIR_ALLOC(copy) < 0)
+        return -1;
+
+    *copy = *stats;
+
+    if (virHashUpdateEntry(snapshot->ifaces, ifname, copy) < 0) {
+        VIR_FREE(copy);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+/* IMPORTANT NOTE!
+ * The kernel sees the network from the point of view of the host.  So
+ * bytes TRANSMITTED by the host are bytes RECEIVED by the domain.  That's
+ * why the TX/RX fields appear to be swapped here.  Dropped and missed
+ * packets are summed up the same way /proc/net/dev does.
+ */
+static int
+virNetDevTapParseLinkStats(struct nlattr **tb,
+                           virDomainInterfaceStatsPtr stats)
+{
+    if (tb[IFLA_STATS64]) {
+        struct rtnl_link_stats64 s64;
+
+        memset(&s64, 0, sizeof(s64));
+        memcpy(&s64, nla_data(tb[IFLA_STATS64]),
+               MIN(sizeof(s64), nla_len(tb[IFLA_STATS64])));
+
+        stats->rx_bytes = s64.tx_bytes;
+        stats->rx_packets = s64.tx_packets;
+        stats->rx_errs = s64.tx_errors;
+        stats->rx_drop = s64.tx_dropped;
+        stats->tx_bytes = s64.rx_bytes;
+        stats->tx_packets = s64.rx_packets;
+        stats->tx_errs = s64.rx_errors;
+        stats->tx_drop = s64.rx_dropped + s64.rx_missed_errors;
+    } else if (tb[IFLA_STATS]) {
+        struct rtnl_link_stats s32;
+
+        memset(&s32, 0, sizeof(s32));
+        memcpy(&s32, nla_data(tb[IFLA_STATS]),
+               MIN(sizeof(s32), nla_len(tb[IFLA_STATS])));
+
+        stats->rx_bytes = s32.tx_bytes;
+        stats->rx_packets = s32.tx_packets;
+        stats->rx_errs = s32.tx_errors;
+        stats->rx_drop = s32.tx_dropped;
+        stats->tx_bytes = s32.rx_bytes;
+        stats->tx_packets = s32.rx_packets;
+        stats->tx_errs = s32.rx_errors;
+        stats->tx_drop = s32.rx_dropped + s32.rx_missed_errors;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+
 int
 virNetDevTapInterfaceStats(const char *ifname,
                            virDomainInterfaceStatsPtr stats)
 {
-    int ifname_len;
+    void *nlData = NULL;
+    struct nlattr *tb[IFLA_MAX + 1] = {NULL, };
+    int ret = -1;
+
+    if (virNetlinkDumpLink(ifname, -1, &nlData, tb, 0, 0) < 0)
+        goto cleanup;
+
+    if (virNetDevTapParseLinkStats(tb, stats) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("no statistics reported for interface '%s'"),
+                       ifname);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(nlData);
+    return ret;
+}
+
+
+static int
+virNetDevTapStatsDumpCallback(const struct nlmsghdr *resp,
+                              void *opaque)
+{
+    virNetDevTapStatsPtr snapshot = opaque;
+    struct nlattr *tb[IFLA_MAX + 1] = {NULL, };
+    virDomainInterfaceStatsStruct stats;
+
+    if (resp->nlmsg_type != RTM_NEWLINK)
+        return 0;
+
+    if (nlmsg_parse((struct nlmsghdr *)resp, sizeof(struct ifinfomsg),
+                    tb, IFLA_MAX, NULL) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed netlink response message"));
+        return -1;
+    }
+
+    if (!tb[IFLA_IFNAME] ||
+        virNetDevTapParseLinkStats(tb, &stats) < 0)
+        return 0;
+
+    return virNetDevTapStatsAdd(snapshot, nla_data(tb[IFLA_IFNAME]), &stats);
+}
+
+
+/* Fetch the counters of all host interfaces with a single RTM_GETLINK
+ * dump instead of one request per interface. */
+static int
+virNetDevTapStatsFill(virNetDevTapStatsPtr snapshot)
+{
+    struct nl_msg *nlmsg = NULL;
+    struct ifinfomsg ifinfo;
+    int ret = -1;
+
+    if (!(nlmsg = nlmsg_alloc_simple(RTM_GETLINK,
+                                     NLM_F_REQUEST | NLM_F_DUMP))) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    memset(&ifinfo, 0, sizeof(ifinfo));
+    ifinfo.ifi_family = AF_UNSPEC;
+
+    if (nlmsg_append(nlmsg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        goto cleanup;
+    }
+
+    if (virNetlinkDumpCommand(nlmsg, virNetDevTapStatsDumpCallback,
+                              0, 0, NETLINK_ROUTE, 0, snapshot) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    nlmsg_free(nlmsg);
+    return ret;
+}
+#elif defined(__linux__)
+static int
+virNetDevTapStatsFill(virNetDevTapStatsPtr snapshot)
+{
     FILE *fp;
     char line[256], *colon;
+    const char *name;
+    int ret = -1;
 
     fp = fopen("/proc/net/dev", "r");
     if (!fp) {
@@ -696,8 +861,6 @@ virNetDevTapInterfaceStats(const char *ifname,
         return -1;
     }
 
-    ifname_len = strlen(ifname);
-
     while (fgets(line, sizeof(line), fp)) {
         long long dummy;
         long long rx_bytes;
@@ -708,6 +871,7 @@ virNetDevTapInterfaceStats(const char *ifname,
         long long tx_packets;
         long long tx_errs;
         long long tx_drop;
+        virDomainInterfaceStatsStruct stats;
 
         /* The line looks like:
          *   "   eth0:..."
@@ -716,45 +880,45 @@ virNetDevTapInterfaceStats(const char *ifname,
         colon = strchr(line, ':');
         if (!colon) continue;
         *colon = '\0';
-        if (colon-ifname_len >= line &&
-            STREQ(colon-ifname_len, ifname)) {
-            /* IMPORTANT NOTE!
-             * /proc/net/dev vif<domid>.nn sees the network from the point
-             * of view of dom0 / hypervisor.  So bytes TRANSMITTED by dom0
-             * are bytes RECEIVED by the domain.  That's why the TX/RX fields
-             * appear to be swapped here.
-             */
-            if (sscanf(colon+1,
-                       "%lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld",
-                       &tx_bytes, &tx_packets, &tx_errs, &tx_drop,
-                       &dummy, &dummy, &dummy, &dummy,
-                       &rx_bytes, &rx_packets, &rx_errs, &rx_drop,
-                       &dummy, &dummy, &dummy, &dummy) != 16)
-                continue;
-
-            stats->rx_bytes = rx_bytes;
-            stats->rx_packets = rx_packets;
-            stats->rx_errs = rx_errs;
-            stats->rx_drop = rx_drop;
-            stats->tx_bytes = tx_bytes;
-            stats->tx_packets = tx_packets;
-            stats->tx_errs = tx_errs;
-            stats->tx_drop = tx_drop;
-            VIR_FORCE_FCLOSE(fp);
-
-            return 0;
-        }
+        name = line;
+        virSkipSpaces(&name);
+
+        /* IMPORTANT NOTE!
+         * /proc/net/dev vif<domid>.nn sees the network from the point
+         * of view of dom0 / hypervisor.  So bytes TRANSMITTED by dom0
+         * are bytes RECEIVED by the domain.  That's why the TX/RX fields
+         * appear to be swapped here.
+         */
+        if (sscanf(colon+1,
+                   "%lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld",
+                   &tx_bytes, &tx_packets, &tx_errs, &tx_drop,
+                   &dummy, &dummy, &dummy, &dummy,
+                   &rx_bytes, &rx_packets, &rx_errs, &rx_drop,
+                   &dummy, &dummy, &dummy, &dummy) != 16)
+            continue;
+
+        stats.rx_bytes = rx_bytes;
+        stats.rx_packets = rx_packets;
+        stats.rx_errs = rx_errs;
+        stats.rx_drop = rx_drop;
+        stats.tx_bytes = tx_bytes;
+        stats.tx_packets = tx_packets;
+        stats.tx_errs = tx_errs;
+        stats.tx_drop = tx_drop;
+
+        if (virNetDevTapStatsAdd(snapshot, name, &stats) < 0)
+            goto cleanup;
     }
-    VIR_FORCE_FCLOSE(fp);
 
-    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                   _("/proc/net/dev: Interface not found"));
-    return -1;
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_FCLOSE(fp);
+    return ret;
 }
 #elif defined(HAVE_GETIFADDRS) && defined(AF_LINK)
-int
-virNetDevTapInterfaceStats(const char *ifname,
-                           virDomainInterfaceStatsPtr stats)
+static int
+virNetDevTapStatsFill(virNetDevTapStatsPtr snapshot)
 {
     struct ifaddrs *ifap, *ifa;
     struct if_data *ifd;
@@ -767,47 +931,132 @@ virNetDevTapInterfaceStats(const char *ifname,
     }
 
     for (ifa = ifap; ifa; ifa = ifa->ifa_next) {
+        virDomainInterfaceStatsStruct stats;
+
         if (!ifa->ifa_addr)
             continue;
 
         if (ifa->ifa_addr->sa_family != AF_LINK)
             continue;
 
-        if (STREQ(ifa->ifa_name, ifname)) {
-            ifd = (struct if_data *)ifa->ifa_data;
-            stats->tx_bytes = ifd->ifi_ibytes;
-            stats->tx_packets = ifd->ifi_ipackets;
-            stats->tx_errs = ifd->ifi_ierrors;
-            stats->tx_drop = ifd->ifi_iqdrops;
-            stats->rx_bytes = ifd->ifi_obytes;
-            stats->rx_packets = ifd->ifi_opackets;
-            stats->rx_errs = ifd->ifi_oerrors;
+        ifd = (struct if_data *)ifa->ifa_data;
+        stats.tx_bytes = ifd->ifi_ibytes;
+        stats.tx_packets = ifd->ifi_ipackets;
+        stats.tx_errs = ifd->ifi_ierrors;
+        stats.tx_drop = ifd->ifi_iqdrops;
+        stats.rx_bytes = ifd->ifi_obytes;
+        stats.rx_packets = ifd->ifi_opackets;
+        stats.rx_errs = ifd->ifi_oerrors;
 # ifdef HAVE_STRUCT_IF_DATA_IFI_OQDROPS
-            stats->rx_drop = ifd->ifi_oqdrops;
+        stats.rx_drop = ifd->ifi_oqdrops;
 # else
-            stats->rx_drop = 0;
+        stats.rx_drop = 0;
 # endif
 
-            ret = 0;
-            break;
-        }
+        if (virNetDevTapStatsAdd(snapshot, ifa->ifa_name, &stats) < 0)
+            goto cleanup;
     }
 
-    if (ret < 0)
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Interface not found"));
+    ret = 0;
 
+ cleanup:
     freeifaddrs(ifap);
     return ret;
 }
 #else
-int
-virNetDevTapInterfaceStats(const char *ifname ATTRIBUTE_UNUSED,
-                           virDomainInterfaceStatsPtr stats ATTRIBUTE_UNUSED)
+static int
+virNetDevTapStatsFill(virNetDevTapStatsPtr snapshot ATTRIBUTE_UNUSED)
 {
     virReportError(VIR_ERR_OPERATION_INVALID, "%s",
                    _("interface stats not implemented on this platform"));
     return -1;
 }
-
 #endif /* __linux__ */
+
+
+/**
+ * virNetDevTapStatsNew:
+ *
+ * Take a snapshot of the traffic counters of all host interfaces at
+ * once, so that callers interested in many interfaces (e.g. a bulk
+ * stats query over all domains) don't have to query the kernel for
+ * each of them separately.  Use virNetDevTapStatsGet() to look up
+ * individual interfaces.
+ *
+ * Returns the snapshot on success, NULL on error.
+ */
+virNetDevTapStatsPtr
+virNetDevTapStatsNew(void)
+{
+    virNetDevTapStatsPtr snapshot;
+
+    if (VIR_ALLOC(snapshot) < 0)
+        return NULL;
+
+    if (!(snapshot->ifaces = virHashCreate(32, virHashValueFree)) ||
+        virNetDevTapStatsFill(snapshot) < 0) {
+        virNetDevTapStatsFree(snapshot);
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+
+/**
+ * virNetDevTapStatsGet:
+ * @snapshot: snapshot taken by virNetDevTapStatsNew()
+ * @ifname: name of the interface
+ * @stats: filled with the counters of @ifname
+ *
+ * The snapshot is not modified, so it can be shared by several threads.
+ *
+ * Returns 0 on success, -1 (with an error reported) if @ifname was not
+ * present when the snapshot was taken.
+ */
+int
+virNetDevTapStatsGet(virNetDevTapStatsPtr snapshot,
+                     const char *ifname,
+                     virDomainInterfaceStatsPtr stats)
+{
+    virDomainInterfaceStatsPtr found;
+
+    if (!(found = virHashLookup(snapshot->ifaces, ifname))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Interface '%s' not found"), ifname);
+        return -1;
+    }
+
+    *stats = *found;
+    return 0;
+}
+
+
+void
+virNetDevTapStatsFree(virNetDevTapStatsPtr snapshot)
+{
+    if (!snapshot)
+        return;
+
+    virHashFree(snapshot->ifaces);
+    VIR_FREE(snapshot);
+}
+
+
+#if !defined(__linux__) || !defined(HAVE_LIBNL)
+int
+virNetDevTapInterfaceStats(const char *ifname,
+                           virDomainInterfaceStatsPtr stats)
+{
+    virNetDevTapStatsPtr snapshot;
+    int ret;
+
+    if (!(snapshot = virNetDevTapStatsNew()))
+        return -1;
+
+    ret = virNetDevTapStatsGet(snapshot, ifname, stats);
+
+    virNetDevTapStatsFree(snapshot);
+    return ret;
+}
+#endif
@@ -95,4 +95,17 @@ int virNetDevTapInterfaceStats(const char *ifname,
                                virDomainInterfaceStatsPtr stats)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
+typedef struct _virNetDevTapStats virNetDevTapStats;
+typedef virNetDevTapStats *virNetDevTapStatsPtr;
+
+virNetDevTapStatsPtr virNetDevTapStatsNew(void);
+
+int virNetDevTapStatsGet(virNetDevTapStatsPtr snapshot,
+                         const char *ifname,
+                         virDomainInterfaceStatsPtr stats)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_RETURN_CHECK;
+
+void virNetDevTapStatsFree(virNetDevTapStatsPtr snapshot);
+
 #endif /* __VIR_NETDEV_TAP_H__ */
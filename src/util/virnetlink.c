@@ -361,6 +361,12 @@ virNetlinkDumpCommand(struct nl_msg *nl_msg,
 
     while (!end) {
         len = nl_recv(nlhandle, &nladdr, (unsigned char **)&resp, NULL);
+        if (len <= 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("failed to receive netlink dump response"));
+            goto cleanup;
+        }
+
         VIR_WARNINGS_NO_CAST_ALIGN
         for (msg = resp; NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
             VIR_WARNINGS_RESET
@@ -373,11 +379,15 @@ virNetlinkDumpCommand(struct nl_msg *nl_msg,
             if (callback(msg, opaque) < 0)
                 goto cleanup;
         }
+
+        /* a large dump, e.g. of all links, spans several responses */
+        VIR_FREE(resp);
     }
 
     ret = 0;
 
  cleanup:
+    VIR_FREE(resp);
     virNetlinkFree(nlhandle);
     return ret;
 }
@@ -90,11 +90,16 @@
         PROBE_EXPAND(LIBVIRT_ ## NAME,                       \
                      VIR_ADD_CASTS(__VA_ARGS__));            \
     }
+#  define PROBE_ENABLED(NAME)                                \
+    (virLogSourceEnabled(&virLogSelf, VIR_LOG_INFO) ||      \
+     LIBVIRT_ ## NAME ## _ENABLED())
 # else
 #  define PROBE(NAME, FMT, ...)                              \
     VIR_INFO_INT(&virLogSelf,                                \
                  __FILE__, __LINE__, __func__,               \
                  #NAME ": " FMT, __VA_ARGS__);
+#  define PROBE_ENABLED(NAME)                                \
+    virLogSourceEnabled(&virLogSelf, VIR_LOG_INFO)
 # endif
 
 #endif /* __VIR_PROBE_H__ */
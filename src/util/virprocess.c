@@ -1075,6 +1075,102 @@ int virProcessGetStartTime(pid_t pid,
 #endif
 
 
+/**
+ * virProcessParseStat:
+ * @data: contents of a /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat file
+ * @usertime: filled with the time spent in user mode, in clock ticks
+ * @systime: filled with the time spent in kernel mode, in clock ticks
+ * @rss: filled with the resident set size, in pages
+ * @cpu: filled with the CPU the process last ran on
+ *
+ * Picks the fields needed for statistics out of @data without allocating.
+ * The command name may contain spaces and parentheses, so the fields are
+ * looked for after its last ')'. See 'man proc' for all the fields.
+ *
+ * Returns 0 on success, -1 if @data can't be parsed. No error is reported.
+ */
+int
+virProcessParseStat(const char *data,
+                    unsigned long long *usertime,
+                    unsigned long long *systime,
+                    long *rss,
+                    int *cpu)
+{
+    const char *comm;
+
+    if (!(comm = strrchr(data, ')')) ||
+        sscanf(comm + 1,
+               /* state -> stime */
+               " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
+               /* cutime -> endcode */
+               "%*d %*d %*d %*d %*d %*d %*u %*u %ld %*u %*u %*u"
+               /* startstack -> processor */
+               "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
+               usertime, systime, rss, cpu) != 4)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virProcessParseSchedWait:
+ * @data: contents of a /proc/<pid>/sched or /proc/<pid>/task/<tid>/sched
+ *        file
+ * @waitTime: filled with the time spent waiting for a CPU, in nanoseconds
+ *
+ * Picks the wait time out of @data without allocating. @waitTime is set to 0
+ * if the kernel doesn't account it (it needs CONFIG_SCHEDSTATS).
+ *
+ * Returns 0 on success, -1 with an error reported if @data is malformed.
+ */
+int
+virProcessParseSchedWait(const char *data,
+                         unsigned long long *waitTime)
+{
+    const char *line;
+    char *end;
+    double val;
+
+    *waitTime = 0;
+
+    for (line = data; line; line = strchr(line, '\n')) {
+        if (*line == '\n')
+            line++;
+
+        /* The second check is the old name the kernel used in past */
+        if (STRPREFIX(line, "se.statistics.wait_sum") ||
+            STRPREFIX(line, "se.wait_sum")) {
+            size_t len = strcspn(line, "\n");
+            const char *sep = memchr(line, ':', len);
+
+            if (!sep) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Missing separator in sched info '%.*s'"),
+                               (int) len, line);
+                return -1;
+            }
+            sep++;
+            while (*sep == ' ')
+                sep++;
+
+            if (virStrToDouble(sep, &end, &val) < 0 ||
+                (*end != '\n' && *end != '\0')) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Unable to parse sched info value '%.*s'"),
+                               (int) (line + len - sep), sep);
+                return -1;
+            }
+
+            *waitTime = (unsigned long long)(val * 1000000);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
 static int virProcessNamespaceHelper(int errfd,
                                      pid_t pid,
                                      virProcessNamespaceCallback cb,
@@ -148,6 +148,7 @@ virQEMUBuildCommandLineJSONRecurse(const char *key,
     struct virQEMUCommandLineJSONIteratorData data = { key, buf, arrayFunc };
     virJSONValuePtr elem;
     size_t i;
+    char *number;
 
     if (!key && value->type != VIR_JSON_TYPE_OBJECT) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -163,7 +164,10 @@ virQEMUBuildCommandLineJSONRecurse(const char *key,
         break;
 
     case VIR_JSON_TYPE_NUMBER:
-        virBufferAsprintf(buf, "%s=%s,", key, value->data.number);
+        if (!(number = virJSONValueGetNumberString(value)))
+            return -1;
+        virBufferAsprintf(buf, "%s=%s,", key, number);
+        VIR_FREE(number);
         break;
 
     case VIR_JSON_TYPE_BOOLEAN:
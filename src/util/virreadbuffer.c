@@ -0,0 +1,159 @@
+/*
+ * virreadbuffer.c: growable buffer for data read from a file descriptor
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "virreadbuffer.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define VIR_READ_BUFFER_MIN 1024
+
+
+/**
+ * virReadBufferReserve:
+ * @buf: the buffer
+ * @len: number of bytes
+ *
+ * Makes sure at least @len bytes can be appended to @buf while keeping
+ * space for the terminating NUL. The allocation at least doubles each
+ * time it has to grow, so filling the buffer with a large message costs
+ * a logarithmic number of reallocations.
+ *
+ * Returns 0 on success, -1 on OOM (with error reported).
+ */
+int
+virReadBufferReserve(virReadBufferPtr buf,
+                     size_t len)
+{
+    size_t want;
+    size_t size;
+
+    if (buf->size - buf->used > len)
+        return 0;
+
+    if (len >= SIZE_MAX - buf->used) {
+        virReportOOMError();
+        return -1;
+    }
+    want = buf->used + len + 1;
+
+    size = MAX(buf->size, VIR_READ_BUFFER_MIN);
+    while (size < want) {
+        if (size > SIZE_MAX / 2) {
+            size = want;
+            break;
+        }
+        size *= 2;
+    }
+
+    if (VIR_REALLOC_N(buf->data, size) < 0)
+        return -1;
+
+    buf->size = size;
+    buf->data[buf->used] = '\0';
+    return 0;
+}
+
+
+/**
+ * virReadBufferTail:
+ * @buf: the buffer
+ * @avail: filled with the number of bytes that can be stored
+ *
+ * Returns pointer to the free space at the end of @buf. The caller
+ * is supposed to call virReadBufferReserve first and to report the
+ * amount of data it stored via virReadBufferAdvance.
+ */
+char *
+virReadBufferTail(virReadBufferPtr buf,
+                  size_t *avail)
+{
+    if (buf->size <= buf->used) {
+        *avail = 0;
+        return NULL;
+    }
+
+    /* keep space for the terminating NUL */
+    *avail = buf->size - buf->used - 1;
+    return buf->data + buf->used;
+}
+
+
+/**
+ * virReadBufferAdvance:
+ * @buf: the buffer
+ * @len: number of bytes stored at virReadBufferTail
+ *
+ * Appends @len bytes stored at the tail to the data in @buf.
+ */
+void
+virReadBufferAdvance(virReadBufferPtr buf,
+                     size_t len)
+{
+    buf->used += len;
+    buf->data[buf->used] = '\0';
+}
+
+
+/**
+ * virReadBufferConsume:
+ * @buf: the buffer
+ * @len: number of bytes to drop
+ *
+ * Drops the first @len bytes of data from @buf. Once the buffer is
+ * empty, the memory is released only if it grew above
+ * VIR_READ_BUFFER_RETAIN so that the high-water mark of a single large
+ * reply isn't kept around forever while regular traffic does not
+ * reallocate the buffer for every message.
+ */
+void
+virReadBufferConsume(virReadBufferPtr buf,
+                     size_t len)
+{
+    if (len == 0)
+        return;
+
+    if (len < buf->used) {
+        memmove(buf->data, buf->data + len, buf->used - len);
+        buf->used -= len;
+        buf->data[buf->used] = '\0';
+        return;
+    }
+
+    buf->used = 0;
+    if (buf->size > VIR_READ_BUFFER_RETAIN)
+        virReadBufferFree(buf);
+    else if (buf->data)
+        buf->data[0] = '\0';
+}
+
+
+void
+virReadBufferFree(virReadBufferPtr buf)
+{
+    if (!buf)
+        return;
+
+    VIR_FREE(buf->data);
+    buf->used = buf->size = 0;
+}
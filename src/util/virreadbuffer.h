@@ -0,0 +1,59 @@
+/*
+ * virreadbuffer.h: growable buffer for data read from a file descriptor
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_READ_BUFFER_H__
+# define __VIR_READ_BUFFER_H__
+
+# include "internal.h"
+
+/**
+ * virReadBuffer:
+ *
+ * Buffer accumulating data received from a peer until it is consumed.
+ * The data is always NUL terminated. The buffer grows geometrically
+ * and is kept allocated between messages unless it grew past
+ * VIR_READ_BUFFER_RETAIN bytes.
+ */
+typedef struct _virReadBuffer virReadBuffer;
+typedef virReadBuffer *virReadBufferPtr;
+
+struct _virReadBuffer {
+    char *data;
+    size_t used;
+    size_t size;
+};
+
+/* Buffers up to this size are kept for reuse once emptied */
+# define VIR_READ_BUFFER_RETAIN (64 * 1024)
+
+int virReadBufferReserve(virReadBufferPtr buf,
+                         size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+char *virReadBufferTail(virReadBufferPtr buf,
+                        size_t *avail)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void virReadBufferAdvance(virReadBufferPtr buf,
+                          size_t len)
+    ATTRIBUTE_NONNULL(1);
+void virReadBufferConsume(virReadBufferPtr buf,
+                          size_t len)
+    ATTRIBUTE_NONNULL(1);
+void virReadBufferFree(virReadBufferPtr buf);
+
+#endif /* __VIR_READ_BUFFER_H__ */
@@ -84,6 +84,31 @@ virSecurityDeviceLabelDefNew(const char *model)
 }
 
 
+virSecurityLabelDefPtr
+virSecurityLabelDefCopy(const virSecurityLabelDef *src)
+{
+    virSecurityLabelDefPtr ret;
+
+    if (VIR_ALLOC(ret) < 0)
+        return NULL;
+
+    ret->type = src->type;
+    ret->relabel = src->relabel;
+    ret->implicit = src->implicit;
+
+    if (VIR_STRDUP(ret->model, src->model) < 0 ||
+        VIR_STRDUP(ret->label, src->label) < 0 ||
+        VIR_STRDUP(ret->imagelabel, src->imagelabel) < 0 ||
+        VIR_STRDUP(ret->baselabel, src->baselabel) < 0)
+        goto error;
+
+    return ret;
+
+ error:
+    virSecurityLabelDefFree(ret);
+    return NULL;
+}
+
 virSecurityDeviceLabelDefPtr
 virSecurityDeviceLabelDefCopy(const virSecurityDeviceLabelDef *src)
 {
@@ -0,0 +1,147 @@
+/*
+ * virstartuptime.c: timing of the daemon startup phases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#include "virstartuptime.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virtypedparam.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.startuptime");
+
+typedef struct _virStartupTimePhase virStartupTimePhase;
+typedef virStartupTimePhase *virStartupTimePhasePtr;
+struct _virStartupTimePhase {
+    char *name;
+    unsigned long long start; /* milliseconds since the epoch */
+    unsigned long long duration; /* milliseconds */
+};
+
+static virMutex virStartupTimeLock = VIR_MUTEX_INITIALIZER;
+static virStartupTimePhasePtr virStartupTimePhases;
+static size_t virStartupTimeNphases;
+
+
+/**
+ * virStartupTimeAdd:
+ * @phase: name of the phase
+ * @start: time the phase started at, as returned by virTimeMillisNow
+ *
+ * Records that the startup phase @phase started at @start and finished
+ * now. A phase may be recorded several times, e.g. once per driver.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virStartupTimeAdd(const char *phase,
+                  unsigned long long start)
+{
+    virStartupTimePhase tmp = { .start = start };
+    unsigned long long now;
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    if (now > start)
+        tmp.duration = now - start;
+
+    if (VIR_STRDUP(tmp.name, phase) < 0)
+        return -1;
+
+    VIR_DEBUG("phase=%s start=%llu duration=%llu",
+              phase, tmp.start, tmp.duration);
+
+    virMutexLock(&virStartupTimeLock);
+    if (VIR_APPEND_ELEMENT(virStartupTimePhases,
+                           virStartupTimeNphases, tmp) == 0)
+        ret = 0;
+    virMutexUnlock(&virStartupTimeLock);
+
+    VIR_FREE(tmp.name);
+    return ret;
+}
+
+
+/**
+ * virStartupTimeGetParams:
+ * @params: filled with the recorded phases
+ * @nparams: filled with the number of @params
+ *
+ * Fills @params with the "phase.count" parameter and the
+ * "phase.<num>.name", "phase.<num>.start" and "phase.<num>.duration"
+ * parameters of each recorded phase in the order they finished.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virStartupTimeGetParams(virTypedParameterPtr *params,
+                        int *nparams)
+{
+    virTypedParameterPtr par = NULL;
+    int npar = 0;
+    int maxpar = 0;
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+    int ret = -1;
+
+    virMutexLock(&virStartupTimeLock);
+
+    if (virTypedParamsAddUInt(&par, &npar, &maxpar, "phase.count",
+                              virStartupTimeNphases) < 0)
+        goto cleanup;
+
+    for (i = 0; i < virStartupTimeNphases; i++) {
+        virStartupTimePhasePtr phase = &virStartupTimePhases[i];
+
+        snprintf(field, sizeof(field), "phase.%zu.name", i);
+        if (virTypedParamsAddString(&par, &npar, &maxpar, field,
+                                    phase->name) < 0)
+            goto cleanup;
+
+        snprintf(field, sizeof(field), "phase.%zu.start", i);
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    phase->start) < 0)
+            goto cleanup;
+
+        snprintf(field, sizeof(field), "phase.%zu.duration", i);
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    phase->duration) < 0)
+            goto cleanup;
+    }
+
+    *params = par;
+    *nparams = npar;
+    par = NULL;
+    npar = 0;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virStartupTimeLock);
+    virTypedParamsFree(par, npar);
+    return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ * virstartuptime.h: timing of the daemon startup phases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_STARTUP_TIME_H__
+# define __VIR_STARTUP_TIME_H__
+
+# include "internal.h"
+
+int virStartupTimeAdd(const char *phase,
+                      unsigned long long start)
+    ATTRIBUTE_NONNULL(1);
+
+int virStartupTimeGetParams(virTypedParameterPtr *params,
+                            int *nparams)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+#endif /* __VIR_STARTUP_TIME_H__ */
@@ -89,7 +89,11 @@ virStorageEncryptionSecretCopy(const virStorageEncryptionSecret *src)
     if (VIR_ALLOC(ret) < 0)
         return NULL;
 
-    memcpy(ret, src, sizeof(*src));
+    ret->type = src->type;
+    if (virSecretLookupDefCopy(&ret->seclookupdef, &src->seclookupdef) < 0) {
+        virStorageEncryptionSecretFree(ret);
+        return NULL;
+    }
 
     return ret;
 }
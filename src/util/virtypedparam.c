@@ -23,6 +23,7 @@
 #include "virtypedparam.h"
 
 #include <stdarg.h>
+#include <stdio.h>
 
 #include "viralloc.h"
 #include "virutil.h"
@@ -1563,3 +1564,338 @@ virTypedParamsSerialize(virTypedParameterPtr params,
     virTypedParamsRemoteFree(params_val, nparams);
     return rv;
 }
+
+
+/**
+ * virTypedParamListClear:
+ * @list: typed parameter list
+ *
+ * Frees all parameters stored in @list, but not @list itself. The list can
+ * be reused afterwards.
+ */
+void
+virTypedParamListClear(virTypedParamListPtr list)
+{
+    if (!list)
+        return;
+
+    virTypedParamsFree(list->par, list->npar);
+    list->par = NULL;
+    list->npar = 0;
+    list->par_alloc = 0;
+}
+
+
+/**
+ * virTypedParamListFree:
+ * @list: typed parameter list
+ *
+ * Frees all parameters stored in @list as well as @list itself.
+ */
+void
+virTypedParamListFree(virTypedParamListPtr list)
+{
+    virTypedParamListClear(list);
+    VIR_FREE(list);
+}
+
+
+/**
+ * virTypedParamListReserve:
+ * @list: typed parameter list
+ * @n: number of parameters the caller is about to add
+ *
+ * Makes sure @list can hold @n more parameters without reallocating. Callers
+ * which know (or can estimate) the number of parameters up front should use
+ * this so that the array is allocated just once instead of being grown
+ * repeatedly.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListReserve(virTypedParamListPtr list,
+                         size_t n)
+{
+    if (list->npar + n <= list->par_alloc)
+        return 0;
+
+    return VIR_EXPAND_N(list->par, list->par_alloc,
+                        list->npar + n - list->par_alloc);
+}
+
+
+/**
+ * virTypedParamListStealParams:
+ * @list: typed parameter list
+ * @params: filled with the parameters stored in @list
+ *
+ * Transfers ownership of the parameters stored in @list to the caller and
+ * empties @list. The result has to be freed using virTypedParamsFree.
+ *
+ * Returns the number of parameters stored in @params.
+ */
+size_t
+virTypedParamListStealParams(virTypedParamListPtr list,
+                             virTypedParameterPtr *params)
+{
+    size_t ret = list->npar;
+
+    *params = list->par;
+    list->par = NULL;
+    list->npar = 0;
+    list->par_alloc = 0;
+
+    return ret;
+}
+
+
+/* Returns the next free slot of @list with its name formatted from @namefmt,
+ * or NULL on error. The slot is not counted in @list->npar until the caller
+ * sets its value. */
+static virTypedParameterPtr
+ATTRIBUTE_FMT_PRINTF(2, 0)
+virTypedParamListExtend(virTypedParamListPtr list,
+                        const char *namefmt,
+                        va_list ap)
+{
+    virTypedParameterPtr par;
+    int len;
+
+    if (VIR_RESIZE_N(list->par, list->par_alloc, list->npar, 1) < 0)
+        return NULL;
+
+    par = list->par + list->npar;
+
+    len = vsnprintf(par->field, VIR_TYPED_PARAM_FIELD_LENGTH, namefmt, ap);
+    if (len < 0 || len >= VIR_TYPED_PARAM_FIELD_LENGTH) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Field name '%s' too long"), par->field);
+        return NULL;
+    }
+
+    return par;
+}
+
+
+/* Each of the virTypedParamListAdd* functions takes the name format as its
+ * last fixed argument; this reserves the slot for the new parameter. */
+#define VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt)                    \
+    do {                                                                   \
+        va_list _ap;                                                       \
+        va_start(_ap, namefmt);                                            \
+        par = virTypedParamListExtend(list, namefmt, _ap);                 \
+        va_end(_ap);                                                       \
+    } while (0)
+
+
+/**
+ * virTypedParamListAddInt:
+ * @list: typed parameter list
+ * @value: the value to store
+ * @namefmt: printf-style format of the parameter name
+ *
+ * Appends a new int parameter to @list. The name is formatted directly
+ * into the parameter, so callers don't need a temporary buffer for it.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddInt(virTypedParamListPtr list,
+                        int value,
+                        const char *namefmt,
+                        ...)
+{
+    virTypedParameterPtr par;
+
+    VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt);
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_INT;
+    par->value.i = value;
+    list->npar++;
+    return 0;
+}
+
+
+/**
+ * virTypedParamListAddUInt:
+ * @list: typed parameter list
+ * @value: the value to store
+ * @namefmt: printf-style format of the parameter name
+ *
+ * Appends a new unsigned int parameter to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddUInt(virTypedParamListPtr list,
+                         unsigned int value,
+                         const char *namefmt,
+                         ...)
+{
+    virTypedParameterPtr par;
+
+    VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt);
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_UINT;
+    par->value.ui = value;
+    list->npar++;
+    return 0;
+}
+
+
+/**
+ * virTypedParamListAddLLong:
+ * @list: typed parameter list
+ * @value: the value to store
+ * @namefmt: printf-style format of the parameter name
+ *
+ * Appends a new long long int parameter to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddLLong(virTypedParamListPtr list,
+                          long long value,
+                          const char *namefmt,
+                          ...)
+{
+    virTypedParameterPtr par;
+
+    VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt);
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_LLONG;
+    par->value.l = value;
+    list->npar++;
+    return 0;
+}
+
+
+/**
+ * virTypedParamListAddULLong:
+ * @list: typed parameter list
+ * @value: the value to store
+ * @namefmt: printf-style format of the parameter name
+ *
+ * Appends a new unsigned long long int parameter to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddULLong(virTypedParamListPtr list,
+                           unsigned long long value,
+                           const char *namefmt,
+                           ...)
+{
+    virTypedParameterPtr par;
+
+    VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt);
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_ULLONG;
+    par->value.ul = value;
+    list->npar++;
+    return 0;
+}
+
+
+/**
+ * virTypedParamListAddDouble:
+ * @list: typed parameter list
+ * @value: the value to store
+ * @namefmt: printf-style format of the parameter name
+ *
+ * Appends a new double parameter to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddDouble(virTypedParamListPtr list,
+                           double value,
+                           const char *namefmt,
+                           ...)
+{
+    virTypedParameterPtr par;
+
+    VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt);
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_DOUBLE;
+    par->value.d = value;
+    list->npar++;
+    return 0;
+}
+
+
+/**
+ * virTypedParamListAddBoolean:
+ * @list: typed parameter list
+ * @value: the value to store
+ * @namefmt: printf-style format of the parameter name
+ *
+ * Appends a new boolean parameter to @list.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddBoolean(virTypedParamListPtr list,
+                            bool value,
+                            const char *namefmt,
+                            ...)
+{
+    virTypedParameterPtr par;
+
+    VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt);
+    if (!par)
+        return -1;
+
+    par->type = VIR_TYPED_PARAM_BOOLEAN;
+    par->value.b = value;
+    list->npar++;
+    return 0;
+}
+
+
+/**
+ * virTypedParamListAddString:
+ * @list: typed parameter list
+ * @value: the value to store, copied
+ * @namefmt: printf-style format of the parameter name
+ *
+ * Appends a new string parameter to @list. A NULL @value is stored as an
+ * empty string.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virTypedParamListAddString(virTypedParamListPtr list,
+                           const char *value,
+                           const char *namefmt,
+                           ...)
+{
+    virTypedParameterPtr par;
+    char *str = NULL;
+
+    if (VIR_STRDUP(str, value ? value : "") < 0)
+        return -1;
+
+    VIR_TYPED_PARAM_LIST_EXTEND(par, list, namefmt);
+    if (!par) {
+        VIR_FREE(str);
+        return -1;
+    }
+
+    par->type = VIR_TYPED_PARAM_STRING;
+    par->value.s = str;
+    list->npar++;
+    return 0;
+}
+
+#undef VIR_TYPED_PARAM_LIST_EXTEND
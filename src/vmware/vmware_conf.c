@@ -174,7 +174,8 @@ vmwareLoadDomains(struct vmware_driver *driver)
 
         vmwareDomainConfigDisplay(pDomain, vmdef);
 
-        if ((vm->def->id = vmwareExtractPid(vmxPath)) < 0)
+        virDomainObjListSetID(driver->domains, vm, vmwareExtractPid(vmxPath));
+        if (vm->def->id < 0)
             goto cleanup;
         /* vmrun list only reports running vms */
         virDomainObjSetState(vm, VIR_DOMAIN_RUNNING,
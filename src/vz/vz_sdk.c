@@ -1395,7 +1395,8 @@ prlsdkAddVNCInfo(PRL_HANDLE sdkdom, virDomainDefPtr def)
 }
 
 static void
-prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
+prlsdkConvertDomainState(vzDriverPtr driver,
+                         VIRTUAL_MACHINE_STATE domainState,
                          PRL_UINT32 envId,
                          virDomainObjPtr dom)
 {
@@ -1404,7 +1405,7 @@ prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
     case VMS_MOUNTED:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTOFF,
                              VIR_DOMAIN_SHUTOFF_SHUTDOWN);
-        dom->def->id = -1;
+        virDomainObjListSetID(driver->domains, dom, -1);
         break;
     case VMS_STARTING:
     case VMS_COMPACTING:
@@ -1414,60 +1415,60 @@ prlsdkConvertDomainState(VIRTUAL_MACHINE_STATE domainState,
     case VMS_RUNNING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_BOOTED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_PAUSED:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_USER);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_SUSPENDED:
     case VMS_DELETING_STATE:
     case VMS_SUSPENDING_SYNC:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTOFF,
                              VIR_DOMAIN_SHUTOFF_SAVED);
-        dom->def->id = -1;
+        virDomainObjListSetID(driver->domains, dom, -1);
         break;
     case VMS_STOPPING:
         virDomainObjSetState(dom, VIR_DOMAIN_SHUTDOWN,
                              VIR_DOMAIN_SHUTDOWN_USER);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_SNAPSHOTING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_SNAPSHOT);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_MIGRATING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_MIGRATION);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_SUSPENDING:
         virDomainObjSetState(dom, VIR_DOMAIN_PAUSED,
                              VIR_DOMAIN_PAUSED_SAVE);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_RESTORING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_RESTORED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_CONTINUING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_UNPAUSED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_RESUMING:
         virDomainObjSetState(dom, VIR_DOMAIN_RUNNING,
                              VIR_DOMAIN_RUNNING_RESTORED);
-        dom->def->id = envId;
+        virDomainObjListSetID(driver->domains, dom, envId);
         break;
     case VMS_UNKNOWN:
     default:
         virDomainObjSetState(dom, VIR_DOMAIN_NOSTATE,
                              VIR_DOMAIN_NOSTATE_UNKNOWN);
-        dom->def->id = -1;
+        virDomainObjListSetID(driver->domains, dom, -1);
         break;
     }
 }
@@ -1982,7 +1983,9 @@ prlsdkLoadDomain(vzDriverPtr driver,
     } else {
         /* assign new virDomainDef without any checks
          * we can't use virDomainObjAssignDef, because it checks
-         * for state and domain name */
+         * for state and domain name. Keep the ID for now, so that
+         * prlsdkConvertDomainState can update the domain list index. */
+        def->id = dom->def->id;
         virDomainDefFree(dom->def);
         dom->def = def;
     }
@@ -1990,7 +1993,7 @@ prlsdkLoadDomain(vzDriverPtr driver,
     pdom = dom->privateData;
     pdom->id = envId;
 
-    prlsdkConvertDomainState(domainState, envId, dom);
+    prlsdkConvertDomainState(driver, domainState, envId, dom);
 
     if (autostart == PAO_VM_START_ON_LOAD)
         dom->autostart = 1;
@@ -2161,7 +2164,7 @@ prlsdkHandleVmStateEvent(vzDriverPtr driver,
 
     pdom = dom->privateData;
 
-    prlsdkConvertDomainState(domainState, pdom->id, dom);
+    prlsdkConvertDomainState(driver, domainState, pdom->id, dom);
 
     prlsdkNewStateToEvent(domainState,
                           &lvEventType,
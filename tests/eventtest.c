@@ -333,7 +333,15 @@ mymain(void)
         return EXIT_FAILURE;
     }
 
+#ifdef EVENT_TEST_EPOLL
+# ifndef HAVE_SYS_EPOLL_H
+    return EXIT_AM_SKIP;
+# endif
+    if (virEventPollInitBackend(VIR_EVENT_POLL_BACKEND_EPOLL) < 0)
+        return EXIT_FAILURE;
+#else
     virEventPollInit();
+#endif
 
     for (i = 0; i < NUM_FDS; i++) {
         handles[i].delete = -1;
@@ -53,7 +53,7 @@ static int testCompareXMLToArgvFiles(const char *xml,
     virNetworkDefPtr def = NULL;
     int ret = -1;
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    virCommandSetDryRun(&buf, virTestCommandDryRunInput, &buf);
 
     if (!(def = virNetworkDefParseFile(xml)))
         goto cleanup;
@@ -137,6 +137,7 @@ mymain(void)
     } while (0)
 
     virFirewallSetLockOverride(true);
+    virFirewallSetRestoreOverride(true);
 
     if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0) {
         if (!hasNetfilterTools()) {
@@ -94,18 +94,20 @@ static const char *commonRules[] = {
     "iptables -D FORWARD -j libvirt-out\n"
     "iptables -D FORWARD -j libvirt-in-post\n"
     "iptables -D INPUT -j libvirt-host-in\n"
-    "iptables -I FORWARD 1 -j libvirt-in\n"
-    "iptables -I FORWARD 2 -j libvirt-out\n"
-    "iptables -I FORWARD 3 -j libvirt-in-post\n"
-    "iptables -I INPUT 1 -j libvirt-host-in\n"
-    "iptables -N FP-vnet0\n"
-    "iptables -N FJ-vnet0\n"
-    "iptables -N HJ-vnet0\n"
-    "iptables -A libvirt-out -m physdev --physdev-is-bridged --physdev-out vnet0 -g FP-vnet0\n"
-    "iptables -A libvirt-in -m physdev --physdev-in vnet0 -g FJ-vnet0\n"
-    "iptables -A libvirt-host-in -m physdev --physdev-in vnet0 -g HJ-vnet0\n"
-    "iptables -D libvirt-in-post -m physdev --physdev-in vnet0 -j ACCEPT\n"
-    "iptables -A libvirt-in-post -m physdev --physdev-in vnet0 -j ACCEPT\n",
+    "iptables-restore --noflush\n"
+    "*filter\n"
+    "-I FORWARD 1 -j libvirt-in\n"
+    "-I FORWARD 2 -j libvirt-out\n"
+    "-I FORWARD 3 -j libvirt-in-post\n"
+    "-I INPUT 1 -j libvirt-host-in\n"
+    "-N FP-vnet0\n"
+    "-N FJ-vnet0\n"
+    "-N HJ-vnet0\n"
+    "-A libvirt-out -m physdev --physdev-is-bridged --physdev-out vnet0 -g FP-vnet0\n"
+    "-A libvirt-in -m physdev --physdev-in vnet0 -g FJ-vnet0\n"
+    "-A libvirt-host-in -m physdev --physdev-in vnet0 -g HJ-vnet0\n"
+    "COMMIT\n"
+    "iptables -D libvirt-in-post -m physdev --physdev-in vnet0 -j ACCEPT\n",
 
     /* Dropping ip6tables rules */
     "ip6tables -D libvirt-out -m physdev --physdev-is-bridged --physdev-out vnet0 -g FP-vnet0\n"
@@ -128,18 +130,20 @@ static const char *commonRules[] = {
     "ip6tables -D FORWARD -j libvirt-out\n"
     "ip6tables -D FORWARD -j libvirt-in-post\n"
     "ip6tables -D INPUT -j libvirt-host-in\n"
-    "ip6tables -I FORWARD 1 -j libvirt-in\n"
-    "ip6tables -I FORWARD 2 -j libvirt-out\n"
-    "ip6tables -I FORWARD 3 -j libvirt-in-post\n"
-    "ip6tables -I INPUT 1 -j libvirt-host-in\n"
-    "ip6tables -N FP-vnet0\n"
-    "ip6tables -N FJ-vnet0\n"
-    "ip6tables -N HJ-vnet0\n"
-    "ip6tables -A libvirt-out -m physdev --physdev-is-bridged --physdev-out vnet0 -g FP-vnet0\n"
-    "ip6tables -A libvirt-in -m physdev --physdev-in vnet0 -g FJ-vnet0\n"
-    "ip6tables -A libvirt-host-in -m physdev --physdev-in vnet0 -g HJ-vnet0\n"
-    "ip6tables -D libvirt-in-post -m physdev --physdev-in vnet0 -j ACCEPT\n"
-    "ip6tables -A libvirt-in-post -m physdev --physdev-in vnet0 -j ACCEPT\n",
+    "ip6tables-restore --noflush\n"
+    "*filter\n"
+    "-I FORWARD 1 -j libvirt-in\n"
+    "-I FORWARD 2 -j libvirt-out\n"
+    "-I FORWARD 3 -j libvirt-in-post\n"
+    "-I INPUT 1 -j libvirt-host-in\n"
+    "-N FP-vnet0\n"
+    "-N FJ-vnet0\n"
+    "-N HJ-vnet0\n"
+    "-A libvirt-out -m physdev --physdev-is-bridged --physdev-out vnet0 -g FP-vnet0\n"
+    "-A libvirt-in -m physdev --physdev-in vnet0 -g FJ-vnet0\n"
+    "-A libvirt-host-in -m physdev --physdev-in vnet0 -g HJ-vnet0\n"
+    "COMMIT\n"
+    "ip6tables -D libvirt-in-post -m physdev --physdev-in vnet0 -j ACCEPT\n",
 
     /* Inserting ebtables rules */
     "ebtables -t nat -A PREROUTING -i vnet0 -j libvirt-J-vnet0\n"
@@ -380,7 +384,7 @@ static int testCompareXMLToArgvFiles(const char *xml,
 
     memset(&inst, 0, sizeof(inst));
 
-    virCommandSetDryRun(&buf, NULL, NULL);
+    virCommandSetDryRun(&buf, virTestCommandDryRunInput, &buf);
 
     if (!vars)
         goto cleanup;
@@ -474,6 +478,7 @@ mymain(void)
     } while (0)
 
     virFirewallSetLockOverride(true);
+    virFirewallSetRestoreOverride(true);
 
     if (virFirewallSetBackend(VIR_FIREWALL_BACKEND_DIRECT) < 0) {
         if (!hasNetfilterTools()) {
@@ -53,27 +53,29 @@ qemuMonitorSend(qemuMonitorPtr mon,
 }
 
 
-static int (*realQemuMonitorJSONIOProcessLine)(qemuMonitorPtr mon,
-                                               const char *line,
-                                               qemuMonitorMessagePtr msg);
+static int (*realQemuMonitorJSONIOProcessValue)(qemuMonitorPtr mon,
+                                                virJSONValuePtr obj,
+                                                qemuMonitorMessagePtr msg);
 
 int
-qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
-                             const char *line,
-                             qemuMonitorMessagePtr msg)
+qemuMonitorJSONIOProcessValue(qemuMonitorPtr mon,
+                              virJSONValuePtr obj,
+                              qemuMonitorMessagePtr msg)
 {
     static bool first = true;
-    virJSONValuePtr value = NULL;
     char *json = NULL;
+    bool greeting;
     int ret;
 
-    REAL_SYM(realQemuMonitorJSONIOProcessLine);
+    REAL_SYM(realQemuMonitorJSONIOProcessValue);
 
-    ret = realQemuMonitorJSONIOProcessLine(mon, line, msg);
+    /* @obj is consumed by the real function */
+    json = virJSONValueToString(obj, 1);
+    greeting = virJSONValueObjectHasKey(obj, "QMP") == 1;
 
-    if (ret == 0 &&
-        (value = virJSONValueFromString(line)) &&
-        (json = virJSONValueToString(value, 1))) {
+    ret = realQemuMonitorJSONIOProcessValue(mon, obj, msg);
+
+    if (ret == 0 && json) {
         char *p;
         bool skip = false;
 
@@ -81,7 +83,7 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
             first = false;
         } else {
             /* Ignore QMP greeting if it's not the first one */
-            if (virJSONValueObjectHasKey(value, "QMP"))
+            if (greeting)
                 goto cleanup;
             putchar('\n');
         }
@@ -98,6 +100,5 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
  cleanup:
     VIR_FREE(json);
-    virJSONValueFree(value);
     return ret;
 }
@@ -1621,6 +1621,88 @@ testQemuMonitorJSONqemuMonitorJSONGetBlockInfo(const void *data)
     return ret;
 }
 
+struct testQemuMonitorJSONReplyData {
+    const char *command;
+    const char *reply;
+    bool id;            /* reply with the id of the command */
+    bool defer;         /* hold the reply back in @deferred */
+    char **deferred;    /* reply sent after the next one not held back */
+};
+
+
+/* Replies with @reply of the item's data instead of the verbatim string
+ * to be able to control the "id" and the order of the replies to
+ * pipelined commands */
+static int
+testQemuMonitorJSONReplyHandler(qemuMonitorTestPtr test,
+                                qemuMonitorTestItemPtr item,
+                                const char *cmdstr)
+{
+    struct testQemuMonitorJSONReplyData *data;
+    virJSONValuePtr cmd = NULL;
+    virJSONValuePtr reply = NULL;
+    const char *cmdname;
+    const char *id;
+    char *replystr = NULL;
+    int ret = -1;
+
+    data = qemuMonitorTestItemGetPrivateData(item);
+
+    if (!(cmd = virJSONValueFromString(cmdstr)) ||
+        !(reply = virJSONValueFromString(data->reply)))
+        goto cleanup;
+
+    if (!(cmdname = virJSONValueObjectGetString(cmd, "execute"))) {
+        ret = qemuMonitorReportError(test, "Missing command name in %s", cmdstr);
+        goto cleanup;
+    }
+
+    if (STRNEQ(cmdname, data->command)) {
+        ret = qemuMonitorTestAddInvalidCommandResponse(test, data->command,
+                                                       cmdname);
+        goto cleanup;
+    }
+
+    virJSONValueObjectRemoveKey(reply, "id", NULL);
+
+    if (data->id) {
+        if (!(id = virJSONValueObjectGetString(cmd, "id"))) {
+            ret = qemuMonitorReportError(test, "Missing id in %s", cmdstr);
+            goto cleanup;
+        }
+
+        if (virJSONValueObjectAppendString(reply, "id", id) < 0)
+            goto cleanup;
+    }
+
+    if (!(replystr = virJSONValueToString(reply, false)))
+        goto cleanup;
+
+    if (data->defer) {
+        VIR_STEAL_PTR(*data->deferred, replystr);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (qemuMonitorTestAddResponse(test, replystr) < 0)
+        goto cleanup;
+
+    if (data->deferred && *data->deferred &&
+        qemuMonitorTestAddResponse(test, *data->deferred) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (data->deferred && !data->defer)
+        VIR_FREE(*data->deferred);
+    virJSONValueFree(cmd);
+    virJSONValueFree(reply);
+    VIR_FREE(replystr);
+    return ret;
+}
+
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetBlockStatsInfo(const void *data)
 {
@@ -1628,6 +1710,8 @@ testQemuMonitorJSONqemuMonitorJSONGetBlockStatsInfo(const void *data)
     qemuMonitorTestPtr test = qemuMonitorTestNewSimple(true, xmlopt);
     virHashTablePtr blockstats = NULL;
     qemuBlockStatsPtr stats;
+    char *deferred = NULL;
+    size_t i;
     int ret = -1;
 
     const char *reply =
@@ -1717,16 +1801,75 @@ testQemuMonitorJSONqemuMonitorJSONGetBlockStatsInfo(const void *data)
         "    \"id\": \"libvirt-11\""
         "}";
 
+    const char *capacityReply =
+        "{"
+        "    \"return\": ["
+        "        {"
+        "            \"device\": \"drive-virtio-disk0\","
+        "            \"inserted\": {"
+        "                \"image\": {"
+        "                    \"virtual-size\": 10737418240,"
+        "                    \"filename\": \"/home/zippy/work/tmp/gentoo.qcow2\","
+        "                    \"format\": \"qcow2\","
+        "                    \"actual-size\": 3221225472"
+        "                },"
+        "                \"drv\": \"qcow2\","
+        "                \"file\": \"/home/zippy/work/tmp/gentoo.qcow2\""
+        "            }"
+        "        },"
+        "        {"
+        "            \"device\": \"drive-virtio-disk1\","
+        "            \"inserted\": {"
+        "                \"image\": {"
+        "                    \"virtual-size\": 1073741824,"
+        "                    \"filename\": \"/home/zippy/test.bin\","
+        "                    \"format\": \"raw\""
+        "                },"
+        "                \"drv\": \"raw\","
+        "                \"file\": \"/home/zippy/test.bin\""
+        "            }"
+        "        },"
+        "        {"
+        "            \"device\": \"drive-ide0-1-0\","
+        "            \"inserted\": {"
+        "                \"image\": {"
+        "                    \"virtual-size\": 367001600,"
+        "                    \"filename\": \"/home/zippy/tmp/install-amd64-minimal-20121210.iso\","
+        "                    \"format\": \"raw\","
+        "                    \"actual-size\": 367005696"
+        "                },"
+        "                \"drv\": \"raw\","
+        "                \"file\": \"/home/zippy/tmp/install-amd64-minimal-20121210.iso\""
+        "            }"
+        "        }"
+        "    ],"
+        "    \"id\": \"libvirt-10\""
+        "}";
+
+    /* The pipelined rounds get the replies in order with ids not
+     * matching any command, out of order with the ids of the
+     * commands and in order without ids */
+    struct testQemuMonitorJSONReplyData replies[] = {
+        { "query-blockstats", reply, true, true, &deferred },
+        { "query-block", capacityReply, true, false, &deferred },
+        { "query-blockstats", reply, false, false, NULL },
+        { "query-block", capacityReply, false, false, NULL },
+    };
+
     if (!test)
         return -1;
 
-    /* fill in seven times - we are gonna ask seven times later on */
     if (qemuMonitorTestAddItem(test, "query-blockstats", reply) < 0 ||
         qemuMonitorTestAddItem(test, "query-blockstats", reply) < 0 ||
-        qemuMonitorTestAddItem(test, "query-blockstats", reply) < 0 ||
-        qemuMonitorTestAddItem(test, "query-blockstats", reply) < 0)
+        qemuMonitorTestAddItem(test, "query-block", capacityReply) < 0)
         goto cleanup;
 
+    for (i = 0; i < ARRAY_CARDINALITY(replies); i++) {
+        if (qemuMonitorTestAddHandler(test, testQemuMonitorJSONReplyHandler,
+                                      &replies[i], NULL) < 0)
+            goto cleanup;
+    }
+
 #define CHECK0FULL(var, value, varformat, valformat) \
     if (stats->var != value) { \
         virReportError(VIR_ERR_INTERNAL_ERROR, \
@@ -1771,6 +1914,32 @@ testQemuMonitorJSONqemuMonitorJSONGetBlockStatsInfo(const void *data)
     CHECK("virtio-disk1", 85, 348160, 8232156, 0, 0, 0, 0, 0, 0ULL, true)
     CHECK("ide0-1-0", 16, 49250, 1004952, 0, 0, 0, 0, 0, 0ULL, false)
 
+    /* query-blockstats pipelined with query-block */
+    for (i = 0; i < 3; i++) {
+        virHashFree(blockstats);
+        blockstats = NULL;
+
+        if (qemuMonitorGetAllBlockStatsInfoCapacity(qemuMonitorTestGetMonitor(test),
+                                                    &blockstats, false) < 0)
+            goto cleanup;
+
+        if (!blockstats) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           "qemuMonitorGetAllBlockStatsInfoCapacity didn't return stats");
+            goto cleanup;
+        }
+
+        CHECK("virtio-disk0", 1279, 28505088, 640616474, 174, 2845696, 530699221, 0, 0, 5256018944ULL, true)
+        CHECK0FULL(capacity, 10737418240ULL, "%llu", "%llu")
+        CHECK0FULL(physical, 3221225472ULL, "%llu", "%llu")
+        CHECK("virtio-disk1", 85, 348160, 8232156, 0, 0, 0, 0, 0, 0ULL, true)
+        CHECK0FULL(capacity, 1073741824ULL, "%llu", "%llu")
+        CHECK0FULL(physical, 1073741824ULL, "%llu", "%llu")
+        CHECK("ide0-1-0", 16, 49250, 1004952, 0, 0, 0, 0, 0, 0ULL, false)
+        CHECK0FULL(capacity, 367001600ULL, "%llu", "%llu")
+        CHECK0FULL(physical, 367005696ULL, "%llu", "%llu")
+    }
+
     ret = 0;
 
 #undef CHECK
@@ -1780,6 +1949,7 @@ testQemuMonitorJSONqemuMonitorJSONGetBlockStatsInfo(const void *data)
  cleanup:
     qemuMonitorTestFree(test);
     virHashFree(blockstats);
+    VIR_FREE(deferred);
     return ret;
 }
 
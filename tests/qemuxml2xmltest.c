@@ -76,6 +76,46 @@ testXML2XMLInactive(const void *opaque)
 }
 
 
+/* A copy of the definition has to format the same as the original */
+static int
+testXML2XMLCopy(const void *opaque)
+{
+    const struct testInfo *info = opaque;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr copy = NULL;
+    char *actual = NULL;
+    int ret = -1;
+
+    if (!(def = virDomainDefParseFile(info->inName, driver.caps, driver.xmlopt,
+                                      NULL, VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+        goto cleanup;
+
+    if (!(copy = virDomainDefCopy(def, driver.caps, driver.xmlopt,
+                                  NULL, false)))
+        goto cleanup;
+
+    /* the copy mustn't share anything with the original */
+    virDomainDefFree(def);
+    def = NULL;
+
+    if (!(actual = virDomainDefFormat(copy, driver.caps,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE |
+                                      VIR_DOMAIN_DEF_FORMAT_INACTIVE)))
+        goto cleanup;
+
+    if (virTestCompareToFile(actual, info->outInactiveName) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virDomainDefFree(def);
+    virDomainDefFree(copy);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
 static const char testStatusXMLPrefixHeader[] =
 "<domstatus state='running' reason='booted' pid='3803518'>\n"
 "  <taint flag='high-privileges'/>\n"
@@ -141,6 +181,34 @@ testGetStatusXMLPrefix(const struct testInfo *data)
 }
 
 
+/* Formats @def once it went through the XML as an inactive definition,
+ * the way virDomainDefCopy used to copy it */
+static char *
+testFormatInactiveRoundTrip(virDomainDefPtr def)
+{
+    virDomainDefPtr tmp = NULL;
+    char *xml = NULL;
+    char *ret = NULL;
+
+    if (!(xml = virDomainDefFormat(def, driver.caps,
+                                   VIR_DOMAIN_DEF_FORMAT_SECURE |
+                                   VIR_DOMAIN_DEF_FORMAT_INACTIVE)))
+        goto cleanup;
+
+    if (!(tmp = virDomainDefParseString(xml, driver.caps, driver.xmlopt, NULL,
+                                        VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                        VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
+        goto cleanup;
+
+    ret = virDomainDefFormat(tmp, driver.caps, VIR_DOMAIN_DEF_FORMAT_SECURE);
+
+ cleanup:
+    virDomainDefFree(tmp);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
 static int
 testCompareStatusXMLToXMLFiles(const void *opaque)
 {
@@ -148,8 +216,11 @@ testCompareStatusXMLToXMLFiles(const void *opaque)
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     xmlDocPtr xml = NULL;
     virDomainObjPtr obj = NULL;
+    virDomainDefPtr copy = NULL;
     char *expect = NULL;
     char *actual = NULL;
+    char *expectCopy = NULL;
+    char *actualCopy = NULL;
     char *source = NULL;
     char *header = NULL;
     char *inFile = NULL, *outActiveFile = NULL;
@@ -215,14 +286,37 @@ testCompareStatusXMLToXMLFiles(const void *opaque)
         goto cleanup;
     }
 
+    /* A copy of the live definition has to look like the original once
+     * the live data is gone. Formatting and parsing back isn't lossless
+     * (e.g. it reorders some controllers), so both go through it. */
+    if (!(expectCopy = testFormatInactiveRoundTrip(obj->def)) ||
+        !(copy = virDomainDefCopy(obj->def, driver.caps, driver.xmlopt,
+                                  NULL, false)))
+        goto cleanup;
+
+    /* the copy mustn't share anything with the original */
+    virObjectUnref(obj);
+    obj = NULL;
+
+    if (!(actualCopy = testFormatInactiveRoundTrip(copy)))
+        goto cleanup;
+
+    if (STRNEQ(expectCopy, actualCopy)) {
+        virTestDifference(stderr, expectCopy, actualCopy);
+        goto cleanup;
+    }
+
     ret = 0;
 
  cleanup:
     xmlKeepBlanksDefault(keepBlanksDefault);
     xmlFreeDoc(xml);
     virObjectUnref(obj);
+    virDomainDefFree(copy);
     VIR_FREE(expect);
     VIR_FREE(actual);
+    VIR_FREE(expectCopy);
+    VIR_FREE(actualCopy);
     VIR_FREE(source);
     VIR_FREE(inFile);
     VIR_FREE(header);
@@ -346,6 +440,10 @@ mymain(void)
         if (info.outInactiveName) {                                            \
             if (virTestRun("QEMU XML-2-XML-inactive " name,                    \
                             testXML2XMLInactive, &info) < 0)                   \
+                ret = -1;                                                      \
+                                                                               \
+            if (virTestRun("QEMU XML-2-XML-copy " name,                        \
+                            testXML2XMLCopy, &info) < 0)                       \
                 ret = -1;                                                      \
         }                                                                      \
                                                                                \
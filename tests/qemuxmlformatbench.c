@@ -0,0 +1,154 @@
+/*
+ * qemuxmlformatbench.c: measure the time spent formatting domain XML
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "qemu/qemu_domain.h"
+#include "testutilsqemu.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* The largest domains in qemuxml2argvdata which parse without any special
+ * setup, used unless other test names are given on the command line. */
+static const char *defaultDomains[] = {
+    "pci-bridge-many-disks",
+    "pci-many",
+    "pcie-expander-bus",
+    "interface-server",
+};
+
+
+static int
+benchFormat(virQEMUDriverPtr driver,
+            const char *name,
+            unsigned long long iterations)
+{
+    virDomainDefPtr def = NULL;
+    char *path = NULL;
+    char *xml = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long i;
+    size_t len = 0;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/qemuxml2argvdata/qemuxml2argv-%s.xml",
+                    abs_srcdir, name) < 0)
+        goto cleanup;
+
+    if (!(def = virDomainDefParseFile(path, driver->caps, driver->xmlopt,
+                                      NULL, VIR_DOMAIN_DEF_PARSE_INACTIVE))) {
+        fprintf(stderr, "Failed to parse %s: %s\n",
+                path, virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < iterations; i++) {
+        if (!(xml = virDomainDefFormat(def, driver->caps,
+                                       VIR_DOMAIN_DEF_FORMAT_SECURE))) {
+            fprintf(stderr, "Failed to format %s: %s\n",
+                    name, virGetLastErrorMessage());
+            goto cleanup;
+        }
+        len = strlen(xml);
+        VIR_FREE(xml);
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    printf("%-30s %8zu bytes %8llu iterations %8llu ms %8.2f us/format\n",
+           name, len, iterations, end - start,
+           (end - start) * 1000.0 / iterations);
+
+    ret = 0;
+
+ cleanup:
+    virDomainDefFree(def);
+    VIR_FREE(path);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    virQEMUDriver driver;
+    virQEMUCapsPtr qemuCaps = NULL;
+    unsigned long long iterations = 1000;
+    int ret = EXIT_FAILURE;
+    size_t i;
+
+    if (virTestBenchInit(argv[0], "[ITERATIONS [TESTNAME...]]",
+                         argc < 2 ||
+                         virStrToLong_ullp(argv[1], NULL, 10,
+                                           &iterations) == 0) < 0)
+        return EXIT_FAILURE;
+
+    if (iterations == 0)
+        iterations = 1;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    if (!(qemuCaps = virQEMUCapsNew()))
+        goto cleanup;
+
+    virQEMUCapsSetList(qemuCaps,
+                       QEMU_CAPS_DEVICE_PCI_BRIDGE,
+                       QEMU_CAPS_DEVICE_CIRRUS_VGA,
+                       QEMU_CAPS_DEVICE_IOH3420,
+                       QEMU_CAPS_DEVICE_X3130_UPSTREAM,
+                       QEMU_CAPS_DEVICE_XIO3130_DOWNSTREAM,
+                       QEMU_CAPS_DEVICE_PXB_PCIE,
+                       QEMU_CAPS_LAST);
+
+    if (qemuTestCapsCacheInsert(driver.qemuCapsCache, qemuCaps) < 0)
+        goto cleanup;
+
+    ret = EXIT_SUCCESS;
+
+    if (argc > 2) {
+        for (i = 2; i < (size_t) argc; i++) {
+            if (benchFormat(&driver, argv[i], iterations) < 0)
+                ret = EXIT_FAILURE;
+        }
+    } else {
+        for (i = 0; i < ARRAY_CARDINALITY(defaultDomains); i++) {
+            if (benchFormat(&driver, defaultDomains[i], iterations) < 0)
+                ret = EXIT_FAILURE;
+        }
+    }
+
+ cleanup:
+    virObjectUnref(qemuCaps);
+    qemuTestDriverFree(&driver);
+    return ret;
+}
@@ -135,8 +135,12 @@ sub rewrap_line {
             # parameter.
             if ($bit =~ m,^-,) {
                 push @args, $bit;
-            } else {
+            } elsif (@args) {
                 $args[$#args] .= " " . $bit;
+            } else {
+                # A value following something which isn't a
+                # command, such as a line of iptables-restore input
+                $cmd .= " " . $bit;
             }
         }
     }
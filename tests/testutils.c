@@ -1130,6 +1130,32 @@ int virTestMain(int argc,
 }
 
 
+/*
+ * Common setup of the benchmark helpers, which take their parameters
+ * on the command line instead of running under virTestMain. The
+ * @usage synopsis of the arguments is printed if @argsValid is false.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virTestBenchInit(const char *argv0,
+                     const char *usage,
+                     bool argsValid)
+{
+    if (!argsValid) {
+        fprintf(stderr, "Usage: %s %s\n", argv0, usage);
+        return -1;
+    }
+
+    if (virThreadInitialize() < 0 ||
+        virInitialize() < 0) {
+        fprintf(stderr, "Failed to initialize libvirt\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /*
  * @cmdset contains a list of command line args, eg
  *
@@ -1181,6 +1207,27 @@ void virTestClearCommandPath(char *cmdset)
 }
 
 
+/*
+ * Dry run callback for virCommandSetDryRun, @opaque being the same
+ * buffer the command lines are formatted to. Commands such as
+ * iptables-restore get their data on the standard input, so add it
+ * to the output following the command itself.
+ */
+void virTestCommandDryRunInput(const char *const*args ATTRIBUTE_UNUSED,
+                               const char *const*env ATTRIBUTE_UNUSED,
+                               const char *input,
+                               char **output ATTRIBUTE_UNUSED,
+                               char **error ATTRIBUTE_UNUSED,
+                               int *status ATTRIBUTE_UNUSED,
+                               void *opaque)
+{
+    virBufferPtr buf = opaque;
+
+    if (input)
+        virBufferAdd(buf, input, -1);
+}
+
+
 virCapsPtr virTestGenericCapsInit(void)
 {
     virCapsPtr caps;
@@ -61,6 +61,13 @@ virJSONValuePtr virTestLoadFileJSON(const char *p, ...)
 int virTestCaptureProgramOutput(const char *const argv[], char **buf, int maxlen);
 
 void virTestClearCommandPath(char *cmdset);
+void virTestCommandDryRunInput(const char *const*args,
+                               const char *const*env,
+                               const char *input,
+                               char **output,
+                               char **error,
+                               int *status,
+                               void *opaque);
 
 int virTestDifference(FILE *stream,
                       const char *expect,
@@ -115,6 +122,10 @@ int virTestMain(int argc,
                 int (*func)(void),
                 ...);
 
+int virTestBenchInit(const char *argv0,
+                     const char *usage,
+                     bool argsValid);
+
 /* Setup, then call func() */
 # define VIR_TEST_MAIN(func)                            \
     int main(int argc, char **argv) {                   \
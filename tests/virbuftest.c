@@ -53,6 +53,56 @@ static int testBufInfiniteLoop(const void *data)
     return ret;
 }
 
+static int testBufGrow(const void *data ATTRIBUTE_UNUSED)
+{
+    virBuffer bufinit = VIR_BUFFER_INITIALIZER;
+    virBufferPtr buf = &bufinit;
+    char *result = NULL;
+    size_t i;
+    int ret = -1;
+
+    virBufferReserve(buf, 5000);
+    if (buf->a <= 5000) {
+        VIR_TEST_DEBUG("Reserve didn't allocate enough space");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 10000; i++) {
+        virBufferAddLit(buf, "abc");
+        virBufferAddChar(buf, 'd');
+        virBufferAsprintf(buf, "%05zu", i);
+        virBufferAdd(buf, "\n", 1);
+    }
+
+    if (virBufferError(buf) || virBufferUse(buf) != 10000 * 10) {
+        VIR_TEST_DEBUG("Unexpected buffer state");
+        goto cleanup;
+    }
+
+    result = virBufferContentAndReset(buf);
+    for (i = 0; i < 10000; i++) {
+        char expect[11];
+
+        snprintf(expect, sizeof(expect), "abcd%05zu\n", i);
+        if (STRNEQLEN(result + i * 10, expect, 10)) {
+            VIR_TEST_DEBUG("Wrong content at line %zu", i);
+            goto cleanup;
+        }
+    }
+
+    if (result[10000 * 10] != '\0') {
+        VIR_TEST_DEBUG("Content not terminated");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(buf);
+    VIR_FREE(result);
+    return ret;
+}
+
 static int testBufAutoIndent(const void *data ATTRIBUTE_UNUSED)
 {
     virBuffer bufinit = VIR_BUFFER_INITIALIZER;
@@ -480,6 +530,7 @@ mymain(void)
     DO_TEST("Trim", testBufTrim, 0);
     DO_TEST("AddBuffer", testBufAddBuffer, 0);
     DO_TEST("set indent", testBufSetIndent, 0);
+    DO_TEST("Grow", testBufGrow, 0);
 
 #define DO_TEST_ADD_STR(DATA, EXPECT)                                  \
     do {                                                               \
@@ -0,0 +1,181 @@
+/*
+ * virdomainobjlistbench.c: measure domain lookups by ID
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "virdomainobjlist.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+static int
+benchPopulate(virDomainObjListPtr doms,
+              virDomainXMLOptionPtr xmlopt,
+              unsigned int ndomains)
+{
+    virDomainDefPtr def = NULL;
+    virDomainObjPtr vm;
+    unsigned int i;
+
+    for (i = 0; i < ndomains; i++) {
+        if (!(def = virDomainDefNew()) ||
+            virAsprintf(&def->name, "bench-%u", i) < 0)
+            goto error;
+
+        def->id = -1;
+        memset(def->uuid, 0, sizeof(def->uuid));
+        def->uuid[0] = i & 0xff;
+        def->uuid[1] = (i >> 8) & 0xff;
+        def->uuid[2] = (i >> 16) & 0xff;
+        def->uuid[3] = (i >> 24) & 0xff;
+
+        if (!(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL)))
+            goto error;
+        def = NULL;
+
+        /* pretend the domain was started, the way drivers do it */
+        virDomainObjListSetID(doms, vm, i);
+        virObjectUnlock(vm);
+    }
+
+    return 0;
+
+ error:
+    virDomainDefFree(def);
+    return -1;
+}
+
+
+static int
+benchStop(virDomainObjListPtr doms,
+          unsigned int ndomains)
+{
+    virDomainObjPtr vm;
+    unsigned int i;
+
+    for (i = 0; i < ndomains; i++) {
+        if (!(vm = virDomainObjListFindByID(doms, i)))
+            return -1;
+
+        virDomainObjListSetID(doms, vm, -1);
+        virObjectUnlock(vm);
+    }
+
+    return 0;
+}
+
+
+static int
+benchLookup(virDomainObjListPtr doms,
+            const char *what,
+            unsigned int first,
+            unsigned int ndomains,
+            unsigned int rounds,
+            bool missing)
+{
+    unsigned long long start;
+    unsigned long long end;
+    unsigned int i;
+    unsigned int j;
+    virDomainObjPtr vm;
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    for (j = 0; j < rounds; j++) {
+        for (i = 0; i < ndomains; i++) {
+            int id = first + i;
+
+            vm = virDomainObjListFindByID(doms, id);
+            if (!!vm == missing) {
+                fprintf(stderr, "Unexpected result looking up ID %d\n", id);
+                if (vm)
+                    virObjectUnlock(vm);
+                return -1;
+            }
+
+            if (vm)
+                virObjectUnlock(vm);
+        }
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        return -1;
+
+    printf("%-20s %8u lookups %8llu ms %10.3f us/lookup\n",
+           what, ndomains * rounds, end - start,
+           (end - start) * 1000.0 / (ndomains * rounds));
+    return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    virDomainXMLOptionPtr xmlopt = NULL;
+    virDomainObjListPtr doms = NULL;
+    unsigned int ndomains = 10000;
+    unsigned int rounds = 100;
+    int ret = EXIT_FAILURE;
+
+    if (virTestBenchInit(argv[0], "[DOMAINS [ROUNDS]]",
+                         (argc < 2 ||
+                          virStrToLong_uip(argv[1], NULL, 10,
+                                           &ndomains) == 0) &&
+                         (argc < 3 ||
+                          virStrToLong_uip(argv[2], NULL, 10, &rounds) == 0) &&
+                         argc <= 3 && ndomains > 0 && rounds > 0) < 0)
+        return EXIT_FAILURE;
+
+    if (!(xmlopt = virDomainXMLOptionNew(NULL, NULL, NULL, NULL, NULL)) ||
+        !(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    if (benchPopulate(doms, xmlopt, ndomains) < 0) {
+        fprintf(stderr, "Failed to create domains: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (benchLookup(doms, "running", 0, ndomains, rounds, false) < 0 ||
+        benchLookup(doms, "missing ID", ndomains, ndomains, rounds, true) < 0)
+        goto cleanup;
+
+    if (benchStop(doms, ndomains) < 0) {
+        fprintf(stderr, "Failed to stop domains\n");
+        goto cleanup;
+    }
+
+    if (benchLookup(doms, "stopped", 0, ndomains, rounds, true) < 0)
+        goto cleanup;
+
+    ret = EXIT_SUCCESS;
+
+ cleanup:
+    virObjectUnref(doms);
+    virObjectUnref(xmlopt);
+    return ret;
+}
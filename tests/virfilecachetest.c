@@ -202,6 +202,54 @@ testFileCache(const void *opaque)
 }
 
 
+struct _testFileCacheCachedData {
+    virFileCachePtr cache;
+    const char *name;
+    const char *validData;
+    const char *expectData; /* NULL if no data is expected to be found */
+};
+typedef struct _testFileCacheCachedData testFileCacheCachedData;
+typedef testFileCacheCachedData *testFileCacheCachedDataPtr;
+
+
+static int
+testFileCacheCached(const void *opaque)
+{
+    int ret = -1;
+    const testFileCacheCachedData *data = opaque;
+    testFileCacheObjPtr obj = NULL;
+    testFileCachePrivPtr testPriv = virFileCacheGetPriv(data->cache);
+
+    testPriv->dataSaved = false;
+    testPriv->newData = "new\n";
+    testPriv->expectData = data->validData;
+
+    obj = virFileCacheLookupCached(data->cache, data->name);
+
+    if (!data->expectData) {
+        if (obj) {
+            fprintf(stderr, "Expect no data, got '%s'.\n", NULLSTR(obj->data));
+            goto cleanup;
+        }
+    } else if (!obj || !obj->data || STRNEQ(data->expectData, obj->data)) {
+        fprintf(stderr, "Expect data '%s', cached data '%s'.\n",
+                data->expectData, obj ? NULLSTR(obj->data) : "(none)");
+        goto cleanup;
+    }
+
+    if (testPriv->dataSaved) {
+        fprintf(stderr, "Expect data not to be created.\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(obj);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -230,6 +278,20 @@ mymain(void)
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
 
+#define TEST_RUN_CACHED(name, validData, expectData)                        \
+    do {                                                                    \
+        testFileCacheCachedData data = {                                    \
+            cache, name, validData, expectData                              \
+        };                                                                  \
+        if (virTestRun("cached " name, testFileCacheCached, &data) < 0)     \
+            ret = -1;                                                       \
+    } while (0)
+
+    TEST_RUN_CACHED("cacheValid", "aaa\n", "aaa\n");
+    TEST_RUN_CACHED("cacheMissing", "ccc\n", "ccc\n");
+    TEST_RUN_CACHED("cacheMissing", "ddd\n", NULL);
+    TEST_RUN_CACHED("cacheUnknown", "aaa\n", NULL);
+
     virObjectUnref(cache);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
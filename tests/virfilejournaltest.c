@@ -0,0 +1,343 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library;  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "virfilejournal.h"
+#include "virfile.h"
+#include "viralloc.h"
+#include "virstring.h"
+#include "virlog.h"
+#include "testutils.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.filejournaltest");
+
+#define FILENAME "virfilejournaldata.xml"
+#define JOURNAL FILENAME ".journal"
+
+#define COMMENT "<!--\nDo not edit\n-->\n"
+
+
+static void
+testFileJournalCleanup(void)
+{
+    unlink(FILENAME);
+    unlink(JOURNAL);
+}
+
+
+/* Rewrites the file the way virDomainSaveXML does */
+static int
+testFileJournalRewrite(virFileJournalPtr journal,
+                       const char *content)
+{
+    char *data = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&data, COMMENT "%s", content) < 0)
+        return -1;
+
+    if (virFileRewriteStr(FILENAME, S_IRUSR | S_IWUSR, data) < 0)
+        goto cleanup;
+
+    if (journal && virFileJournalReset(journal, FILENAME, content) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(data);
+    return ret;
+}
+
+
+static int
+testFileJournalSave(virFileJournalPtr journal,
+                    const char *content)
+{
+    int rc;
+
+    if ((rc = virFileJournalAppend(journal, FILENAME, content)) <= 0)
+        return rc;
+
+    return testFileJournalRewrite(journal, content);
+}
+
+
+/* Checks that reading the file gives @expect, or the file itself if
+ * @expect is NULL */
+static int
+testFileJournalCheck(const char *expect)
+{
+    char *content = NULL;
+    int rc;
+    int ret = -1;
+
+    if ((rc = virFileJournalRead(FILENAME, &content)) < 0)
+        return -1;
+
+    if (!expect) {
+        if (rc != 0) {
+            fprintf(stderr, "Journal should have been ignored\n");
+            goto cleanup;
+        }
+    } else if (rc != 1) {
+        fprintf(stderr, "Journal should have been applied\n");
+        goto cleanup;
+    } else if (STRNEQ(content, expect)) {
+        virTestDifference(stderr, expect, content);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static char *
+testFileJournalContent(size_t i)
+{
+    char *content = NULL;
+
+    ignore_value(virAsprintf(&content,
+                             "<domstatus state='running'>\n"
+                             "  <name>test</name>\n"
+                             "  <counter>%zu</counter>\n"
+                             "  <padding>%0500d</padding>\n"
+                             "</domstatus>\n", i, 0));
+    return content;
+}
+
+
+static int
+testFileJournalAppendReplay(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virFileJournalPtr journal = NULL;
+    char *content = NULL;
+    size_t i;
+    int ret = -1;
+
+    testFileJournalCleanup();
+
+    if (!(journal = virFileJournalNew()) ||
+        !(content = testFileJournalContent(0)) ||
+        testFileJournalRewrite(journal, content) < 0)
+        goto cleanup;
+
+    if (testFileJournalCheck(NULL) < 0)
+        goto cleanup;
+
+    for (i = 1; i < 10; i++) {
+        VIR_FREE(content);
+        if (!(content = testFileJournalContent(i)) ||
+            virFileJournalAppend(journal, FILENAME, content) != 0)
+            goto cleanup;
+
+        if (testFileJournalCheck(content) < 0)
+            goto cleanup;
+    }
+
+    /* Saving the same content again does not grow the journal */
+    if (virFileJournalAppend(journal, FILENAME, content) != 0 ||
+        testFileJournalCheck(content) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testFileJournalCleanup();
+    virFileJournalFree(journal);
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static int
+testFileJournalCompact(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virFileJournalPtr journal = NULL;
+    char *content = NULL;
+    size_t i;
+    int rc = 0;
+    int ret = -1;
+
+    testFileJournalCleanup();
+
+    if (!(journal = virFileJournalNew()) ||
+        !(content = testFileJournalContent(0)) ||
+        testFileJournalRewrite(journal, content) < 0)
+        goto cleanup;
+
+    /* The journal has to be compacted eventually */
+    for (i = 1; i < 100000 && rc == 0; i++) {
+        VIR_FREE(content);
+        if (!(content = testFileJournalContent(i)) ||
+            (rc = virFileJournalAppend(journal, FILENAME, content)) < 0)
+            goto cleanup;
+    }
+
+    if (rc != 1) {
+        fprintf(stderr, "Journal was never compacted\n");
+        goto cleanup;
+    }
+
+    if (testFileJournalRewrite(journal, content) < 0 ||
+        testFileJournalCheck(NULL) < 0)
+        goto cleanup;
+
+    VIR_FREE(content);
+    if (!(content = testFileJournalContent(i)) ||
+        virFileJournalAppend(journal, FILENAME, content) != 0 ||
+        testFileJournalCheck(content) < 0)
+        goto cleanup;
+
+    /* Replacing most of the content is not worth a journal record */
+    VIR_FREE(content);
+    if (virAsprintf(&content, "<domstatus>\n%01000d\n</domstatus>\n", 0) < 0 ||
+        virFileJournalAppend(journal, FILENAME, content) != 1)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testFileJournalCleanup();
+    virFileJournalFree(journal);
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static int
+testFileJournalTornWrite(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virFileJournalPtr journal = NULL;
+    char *first = NULL;
+    char *second = NULL;
+    char *third = NULL;
+    struct stat sb;
+    int ret = -1;
+
+    testFileJournalCleanup();
+
+    if (!(journal = virFileJournalNew()) ||
+        !(first = testFileJournalContent(1)) ||
+        !(second = testFileJournalContent(2)) ||
+        !(third = testFileJournalContent(3)) ||
+        testFileJournalRewrite(journal, first) < 0 ||
+        testFileJournalSave(journal, second) < 0)
+        goto cleanup;
+
+    if (stat(JOURNAL, &sb) < 0) {
+        fprintf(stderr, "Journal was not written\n");
+        goto cleanup;
+    }
+
+    /* A crash in the middle of appending the next record leaves the
+     * content as of the last complete one */
+    if (virFileJournalAppend(journal, FILENAME, third) != 0 ||
+        truncate(JOURNAL, sb.st_size + 10) < 0 ||
+        testFileJournalCheck(second) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testFileJournalCleanup();
+    virFileJournalFree(journal);
+    VIR_FREE(first);
+    VIR_FREE(second);
+    VIR_FREE(third);
+    return ret;
+}
+
+
+static int
+testFileJournalStale(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virFileJournalPtr journal = NULL;
+    char *content = NULL;
+    int ret = -1;
+
+    testFileJournalCleanup();
+
+    if (!(journal = virFileJournalNew()) ||
+        !(content = testFileJournalContent(0)) ||
+        testFileJournalRewrite(journal, content) < 0)
+        goto cleanup;
+
+    VIR_FREE(content);
+    if (!(content = testFileJournalContent(1)) ||
+        virFileJournalAppend(journal, FILENAME, content) != 0)
+        goto cleanup;
+
+    /* A crash after rewriting the file but before removing the journal
+     * must not apply the journal to the new file */
+    VIR_FREE(content);
+    if (!(content = testFileJournalContent(2)) ||
+        testFileJournalRewrite(NULL, content) < 0 ||
+        testFileJournalCheck(NULL) < 0)
+        goto cleanup;
+
+    /* Nor must a journal without a complete header be applied */
+    if (virFileJournalRemove(FILENAME) < 0 ||
+        virFileWriteStr(JOURNAL, "LVJRNL01", S_IRUSR | S_IWUSR) < 0 ||
+        testFileJournalCheck(NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testFileJournalCleanup();
+    virFileJournalFree(journal);
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("File journal append and replay",
+                   testFileJournalAppendReplay, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("File journal compaction",
+                   testFileJournalCompact, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("File journal torn write",
+                   testFileJournalTornWrite, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("File journal of a previous file",
+                   testFileJournalStale, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
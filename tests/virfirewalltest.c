@@ -1123,6 +1123,76 @@ testFirewallQuery(const void *opaque ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static void
+testFirewallRestoreErrorHook(const char *const*args,
+                             const char *const*env ATTRIBUTE_UNUSED,
+                             const char *input ATTRIBUTE_UNUSED,
+                             char **output ATTRIBUTE_UNUSED,
+                             char **error,
+                             int *status,
+                             void *opaque ATTRIBUTE_UNUSED)
+{
+    /* Fake failure on the third line of input, i.e. the second rule */
+    if (STREQ(args[0], IPTABLES_PATH "-restore")) {
+        ignore_value(VIR_STRDUP(*error, "iptables-restore: line 3 failed\n"));
+        *status = 1;
+    }
+}
+
+static int
+testFirewallRestoreError(const void *opaque)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *errmsg;
+    const char *expected =
+        IPTABLES_PATH " -A OUTPUT --source-host 192.168.122.255 --jump REJECT";
+    const struct testFirewallData *data = opaque;
+
+    fwDisabled = data->fwDisabled;
+    if (virFirewallSetBackend(data->tryBackend) < 0)
+        goto cleanup;
+
+    virFirewallSetRestoreOverride(true);
+    virCommandSetDryRun(&cmdbuf, testFirewallRestoreErrorHook, NULL);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "OUTPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "OUTPUT",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    if (virFirewallApply(fw) == 0) {
+        fprintf(stderr, "Firewall apply unexpectedly worked\n");
+        goto cleanup;
+    }
+
+    errmsg = virGetLastErrorMessage();
+    if (!strstr(errmsg, expected)) {
+        fprintf(stderr, "Expected rule '%s' in error '%s'\n",
+                expected, errmsg);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virResetLastError();
+    virBufferFreeAndReset(&cmdbuf);
+    virFirewallSetRestoreOverride(false);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallFree(fw);
+    return ret;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -1192,6 +1262,7 @@ mymain(void)
     RUN_TEST("many rollback", testFirewallManyRollback);
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
+    RUN_TEST_DIRECT("restore error", testFirewallRestoreError);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -7,6 +7,8 @@
 
 #include "internal.h"
 #include "virjson.h"
+#include "virbuffer.h"
+#include "virutil.h"
 #include "testutils.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -429,6 +431,287 @@ testJSONEscapeObj(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+/* Numbers are kept natively where possible; make sure the accessors
+ * still agree with parsing the textual form of the number.  */
+static int
+testJSONNumbers(const void *data ATTRIBUTE_UNUSED)
+{
+    const char *numbers[] = {
+        "0", "-0", "1", "-1", "42", "1.0", "1e3", "-2.5E-3",
+        "2147483647", "2147483648", "-2147483648", "-2147483649",
+        "4294967295", "4294967296", "-4294967295", "-4294967296",
+        "9223372036854775807", "9223372036854775808",
+        "-9223372036854775808", "-9223372036854775809",
+        "18446744073709551615", "18446744073709551616",
+        "123456789012345678901234567890",
+    };
+    virJSONValuePtr json = NULL;
+    virJSONValuePtr copy = NULL;
+    char *str = NULL;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(numbers); i++) {
+        const char *text = numbers[i];
+        int iv, iexp;
+        unsigned int uv, uexp;
+        long long lv, lexp;
+        unsigned long long ulv, ulexp;
+        double dv, dexp;
+
+        virJSONValueFree(json);
+        virJSONValueFree(copy);
+        VIR_FREE(str);
+
+        if (!(json = virJSONValueFromString(text)) ||
+            !(copy = virJSONValueCopy(json)) ||
+            !(str = virJSONValueToString(copy, false))) {
+            VIR_TEST_VERBOSE("failed to handle number %s\n", text);
+            goto cleanup;
+        }
+
+        if (STRNEQ(text, str)) {
+            virTestDifference(stderr, text, str);
+            goto cleanup;
+        }
+
+#define CHECK_NUMBER(func, conv, val, exp) \
+        do { \
+            int rc = func(json, &val); \
+            int rcexp = conv; \
+            if (rc != rcexp || (rc == 0 && val != exp)) { \
+                VIR_TEST_VERBOSE("%s mismatch for %s\n", #func, text); \
+                goto cleanup; \
+            } \
+        } while (0)
+
+        CHECK_NUMBER(virJSONValueGetNumberInt,
+                     virStrToLong_i(text, NULL, 10, &iexp), iv, iexp);
+        CHECK_NUMBER(virJSONValueGetNumberUint,
+                     virStrToLong_ui(text, NULL, 10, &uexp), uv, uexp);
+        CHECK_NUMBER(virJSONValueGetNumberLong,
+                     virStrToLong_ll(text, NULL, 10, &lexp), lv, lexp);
+        CHECK_NUMBER(virJSONValueGetNumberUlong,
+                     virStrToLong_ull(text, NULL, 10, &ulexp), ulv, ulexp);
+        CHECK_NUMBER(virJSONValueGetNumberDouble,
+                     virStrToDouble(text, NULL, &dexp), dv, dexp);
+
+#undef CHECK_NUMBER
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(json);
+    virJSONValueFree(copy);
+    VIR_FREE(str);
+    return ret;
+}
+
+
+/* Objects past a handful of keys get a hashed index; make sure lookups,
+ * removals and key order stay correct across index rebuilds.  */
+static int
+testJSONManyKeys(const void *data ATTRIBUTE_UNUSED)
+{
+    virJSONValuePtr json = NULL;
+    char key[32];
+    const char *nth;
+    size_t i;
+    size_t n;
+    unsigned int val;
+    int ret = -1;
+
+    if (!(json = virJSONValueNewObject()))
+        goto cleanup;
+
+    for (i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectAppendNumberUint(json, key, i) < 0) {
+            VIR_TEST_VERBOSE("failed to append %s\n", key);
+            goto cleanup;
+        }
+    }
+
+    if (virJSONValueObjectAppendNumberUint(json, "key42", 0) == 0) {
+        VIR_TEST_VERBOSE("%s", "duplicate key was appended\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 200; i += 3) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectRemoveKey(json, key, NULL) != 1) {
+            VIR_TEST_VERBOSE("failed to remove %s\n", key);
+            goto cleanup;
+        }
+    }
+
+    for (i = 200; i < 300; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectAppendNumberUint(json, key, i) < 0) {
+            VIR_TEST_VERBOSE("failed to append %s\n", key);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0, n = 0; i < 300; i++) {
+        bool removed = i < 200 && i % 3 == 0;
+
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectHasKey(json, key) != !removed) {
+            VIR_TEST_VERBOSE("unexpected presence of %s\n", key);
+            goto cleanup;
+        }
+
+        if (removed)
+            continue;
+
+        if (virJSONValueObjectGetNumberUint(json, key, &val) < 0 || val != i) {
+            VIR_TEST_VERBOSE("wrong value for %s\n", key);
+            goto cleanup;
+        }
+
+        if (!(nth = virJSONValueObjectGetKey(json, n++)) || STRNEQ(nth, key)) {
+            VIR_TEST_VERBOSE("%s is out of order\n", key);
+            goto cleanup;
+        }
+    }
+
+    if (virJSONValueObjectKeysNumber(json) != n) {
+        VIR_TEST_VERBOSE("%s", "unexpected number of keys\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(json);
+    return ret;
+}
+
+
+#ifdef WITH_YAJL2
+static int
+testJSONStreamCollect(virJSONValuePtr value,
+                      void *opaque)
+{
+    virBufferPtr buf = opaque;
+    char *str;
+
+    if (!(str = virJSONValueToString(value, false))) {
+        virJSONValueFree(value);
+        return -1;
+    }
+
+    virBufferAsprintf(buf, "%s\n", str);
+    VIR_FREE(str);
+    virJSONValueFree(value);
+    return 0;
+}
+
+
+static bool
+testJSONStreamFilter(virJSONValuePtr object,
+                     const char *member,
+                     const char *key,
+                     size_t depth ATTRIBUTE_UNUSED,
+                     void *opaque ATTRIBUTE_UNUSED)
+{
+    /* keep everything in replies whose "id" precedes "return" */
+    if (STREQ_NULLABLE(virJSONValueObjectGetString(object, "id"), "keep"))
+        return true;
+
+    /* drop "drop" keys anywhere within the "return" member */
+    return !(STREQ_NULLABLE(member, "return") && STREQ(key, "drop"));
+}
+
+
+static int
+testJSONStreamOne(const struct testInfo *info,
+                  size_t chunk,
+                  bool filter)
+{
+    virJSONStreamParserPtr stream;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t len = strlen(info->doc);
+    size_t i;
+    char *result = NULL;
+    int rc = 0;
+    int ret = -1;
+
+    if (!(stream = virJSONStreamParserNew(testJSONStreamCollect,
+                                          filter ? testJSONStreamFilter : NULL)))
+        return -1;
+
+    for (i = 0; i < len && rc == 0; i += chunk)
+        rc = virJSONStreamParserFeed(stream, info->doc + i,
+                                     MIN(chunk, len - i), &buf);
+
+    if (rc < 0) {
+        if (info->pass) {
+            VIR_TEST_VERBOSE("Fail to parse %s\n", info->doc);
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!info->pass) {
+        VIR_TEST_VERBOSE("Should not have parsed %s\n", info->doc);
+        goto cleanup;
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    result = virBufferContentAndReset(&buf);
+    if (STRNEQ_NULLABLE(info->expect, result)) {
+        virTestDifference(stderr, info->expect, NULLSTR(result));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONStreamParserFree(stream);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(result);
+    return ret;
+}
+
+
+static int
+testJSONStreamWithFilter(const void *data, bool filter)
+{
+    const size_t chunks[] = { 1, 3, 7, SIZE_MAX };
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(chunks); i++) {
+        if (testJSONStreamOne(data, chunks[i], filter) < 0) {
+            VIR_TEST_VERBOSE("failed with chunks of %zu bytes\n", chunks[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONStream(const void *data)
+{
+    return testJSONStreamWithFilter(data, false);
+}
+
+
+static int
+testJSONStreamFiltered(const void *data)
+{
+    return testJSONStreamWithFilter(data, true);
+}
+#endif /* WITH_YAJL2 */
+
+
 static int
 mymain(void)
 {
@@ -588,6 +871,36 @@ mymain(void)
                  NULL, true);
     DO_TEST_FULL("create object with nested json in attribute", EscapeObj,
                  NULL, NULL, true);
+    DO_TEST_FULL("object with many keys", ManyKeys, NULL, NULL, true);
+    DO_TEST_FULL("numbers", Numbers, NULL, NULL, true);
+
+#ifdef WITH_YAJL2
+    DO_TEST_FULL("stream of values", Stream,
+                 "{\"QMP\": {\"capabilities\": []}}\r\n"
+                 "{\"return\": {}, \"id\": \"libvirt-1\"}\r\n"
+                 "{\"event\": \"STOP\", \"data\": {\"a\": [1, 2.5, null]}}\r\n"
+                 "[true, false, \"str\"]\r\n",
+                 "{\"QMP\":{\"capabilities\":[]}}\n"
+                 "{\"return\":{},\"id\":\"libvirt-1\"}\n"
+                 "{\"event\":\"STOP\",\"data\":{\"a\":[1,2.5,null]}}\n"
+                 "[true,false,\"str\"]\n",
+                 true);
+    DO_TEST_FULL("stream with garbage", Stream,
+                 "{\"return\": {}}\r\n{\"return\" 1}\r\n", NULL, false);
+    DO_TEST_FULL("stream filter", StreamFiltered,
+                 "{\"return\": [{\"drop\": {\"a\": [1, {\"drop\": 2}]},"
+                 "\"keep\": 1}, {\"keep\": {\"drop\": \"x\", \"b\": 2}}],"
+                 "\"id\": \"libvirt-2\"}\r\n"
+                 "{\"event\": \"E\", \"data\": {\"drop\": 1}}\r\n"
+                 "{\"drop\": 3}\r\n"
+                 "{\"id\": \"keep\", \"return\": {\"drop\": 4}}\r\n",
+                 "{\"return\":[{\"keep\":1},{\"keep\":{\"b\":2}}],"
+                 "\"id\":\"libvirt-2\"}\n"
+                 "{\"event\":\"E\",\"data\":{\"drop\":1}}\n"
+                 "{\"drop\":3}\n"
+                 "{\"id\":\"keep\",\"return\":{\"drop\":4}}\n",
+                 true);
+#endif /* WITH_YAJL2 */
 
 #define DO_TEST_DEFLATTEN(name, pass) \
     DO_TEST_FULL(name, Deflatten, name, NULL, pass)
@@ -0,0 +1,330 @@
+/*
+ * virloghandlerbench.c: measure how virtlogd's handler copes with
+ * many guests writing to their log pipes at once
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "log_handler.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define BENCH_LINE_LEN 128
+
+typedef struct _benchGuest benchGuest;
+typedef benchGuest *benchGuestPtr;
+struct _benchGuest {
+    char *path;
+    int fd; /* write end of the log pipe */
+};
+
+typedef struct _benchWriter benchWriter;
+typedef benchWriter *benchWriterPtr;
+struct _benchWriter {
+    virThread thread;
+    benchGuestPtr guests;
+    size_t nguests;
+    size_t lines; /* per guest */
+    int ret;
+};
+
+static bool quit;
+
+
+static void
+benchInhibitor(bool inhibit ATTRIBUTE_UNUSED,
+               void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+benchWakeup(int timer ATTRIBUTE_UNUSED,
+            void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+benchEventLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    while (!quit) {
+        if (virEventRunDefaultImpl() < 0)
+            break;
+    }
+}
+
+
+/* Writes @lines lines to each of the guests, round robin */
+static void
+benchWrite(void *opaque)
+{
+    benchWriterPtr writer = opaque;
+    char line[BENCH_LINE_LEN];
+    size_t i;
+    size_t j;
+
+    memset(line, 'x', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\n';
+
+    for (j = 0; j < writer->lines; j++) {
+        for (i = 0; i < writer->nguests; i++) {
+            if (safewrite(writer->guests[i].fd, line, sizeof(line)) < 0) {
+                writer->ret = -1;
+                return;
+            }
+        }
+    }
+}
+
+
+/* Waits until the log of each guest has grown to @size bytes */
+static int
+benchWaitLogs(virLogHandlerPtr handler,
+              benchGuestPtr guests,
+              size_t nguests,
+              off_t size)
+{
+    size_t i;
+
+    for (i = 0; i < nguests; i++) {
+        ino_t inode;
+        off_t offset;
+
+        for (;;) {
+            if (virLogHandlerDomainGetLogFilePosition(handler,
+                                                      guests[i].path, 0,
+                                                      &inode, &offset) < 0)
+                return -1;
+            if (offset >= size)
+                break;
+            usleep(1000);
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Runs one round of @nwriters threads writing @lines lines to each
+ * of @nguests guests, the first @nchatty of which write @factor
+ * times as much as the rest. Reports the time it takes until the
+ * logs of the quiet guests and of all of them are complete.
+ */
+static int
+benchRound(virLogHandlerPtr handler,
+           const char *what,
+           benchGuestPtr guests,
+           size_t nguests,
+           size_t nchatty,
+           size_t factor,
+           size_t lines,
+           off_t *sizes)
+{
+    benchWriter writers[2];
+    size_t nwriters = 0;
+    unsigned long long start;
+    unsigned long long quiet;
+    unsigned long long end;
+    bool joined = false;
+    size_t i;
+    int ret = -1;
+
+    memset(writers, 0, sizeof(writers));
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    if (nchatty) {
+        writers[nwriters].guests = guests;
+        writers[nwriters].nguests = nchatty;
+        writers[nwriters].lines = lines * factor;
+        nwriters++;
+    }
+    if (nguests > nchatty) {
+        writers[nwriters].guests = guests + nchatty;
+        writers[nwriters].nguests = nguests - nchatty;
+        writers[nwriters].lines = lines;
+        nwriters++;
+    }
+
+    for (i = 0; i < nwriters; i++) {
+        if (virThreadCreate(&writers[i].thread, true,
+                            benchWrite, &writers[i]) < 0) {
+            fprintf(stderr, "Failed to create writer thread\n");
+            while (i-- > 0)
+                virThreadJoin(&writers[i].thread);
+            return -1;
+        }
+    }
+
+    /* The quiet guests' writer comes last, wait for it and for their
+     * logs first while the chatty guests may still be writing */
+    virThreadJoin(&writers[nwriters - 1].thread);
+    *sizes += lines * BENCH_LINE_LEN;
+    if (writers[nwriters - 1].ret == 0 &&
+        (benchWaitLogs(handler, guests + nchatty, nguests - nchatty,
+                       *sizes) < 0 ||
+         virTimeMillisNow(&quiet) < 0))
+        goto cleanup;
+
+    if (nwriters > 1)
+        virThreadJoin(&writers[0].thread);
+    joined = true;
+    for (i = 0; i < nwriters; i++) {
+        if (writers[i].ret < 0) {
+            fprintf(stderr, "Failed to write to log pipe\n");
+            goto cleanup;
+        }
+    }
+
+    if (benchWaitLogs(handler, guests, nchatty,
+                      *sizes + lines * (factor - 1) * BENCH_LINE_LEN) < 0 ||
+        virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    printf("%-12s %6zu guests %8llu ms quiet %8llu ms all %10.2f MiB/s\n",
+           what, nguests, quiet - start, end - start,
+           ((double)(nguests - nchatty) * lines +
+            (double)nchatty * lines * factor) * BENCH_LINE_LEN /
+           (1024.0 * 1024.0) / ((end - start) ? (end - start) : 1) * 1000);
+
+    ret = 0;
+
+ cleanup:
+    if (!joined && nwriters > 1)
+        virThreadJoin(&writers[0].thread);
+    return ret;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    virLogHandlerPtr handler = NULL;
+    benchGuestPtr guests = NULL;
+    unsigned int nguests = 500;
+    unsigned int lines = 1000;
+    char *dir = NULL;
+    virThread loop;
+    bool loopStarted = false;
+    int timer = -1;
+    off_t sizes = 0;
+    size_t i;
+    int ret = EXIT_FAILURE;
+
+    if (virTestBenchInit(argv[0], "[GUESTS [LINES]]",
+                         (argc < 2 ||
+                          virStrToLong_uip(argv[1], NULL, 10, &nguests) == 0) &&
+                         (argc < 3 ||
+                          virStrToLong_uip(argv[2], NULL, 10, &lines) == 0) &&
+                         argc <= 3 && nguests >= 2 && lines > 0) < 0)
+        return EXIT_FAILURE;
+
+    if (virEventRegisterDefaultImpl() < 0) {
+        fprintf(stderr, "Failed to register the event loop\n");
+        return EXIT_FAILURE;
+    }
+
+    if (VIR_STRDUP(dir, "/tmp/virloghandlerbench-XXXXXX") < 0 ||
+        !mkdtemp(dir)) {
+        fprintf(stderr, "Failed to create log directory\n");
+        VIR_FREE(dir);
+        return EXIT_FAILURE;
+    }
+
+    if (!(handler = virLogHandlerNew(false, 1024 * 1024 * 1024, 0,
+                                     benchInhibitor, NULL)) ||
+        VIR_ALLOC_N(guests, nguests) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nguests; i++)
+        guests[i].fd = -1;
+
+    for (i = 0; i < nguests; i++) {
+        unsigned char uuid[VIR_UUID_BUFLEN] = { 0 };
+        char *name = NULL;
+        ino_t inode;
+        off_t offset;
+
+        memcpy(uuid, &i, MIN(sizeof(i), sizeof(uuid)));
+        if (virAsprintf(&name, "bench-%zu", i) < 0 ||
+            virAsprintf(&guests[i].path, "%s/%s.log", dir, name) < 0) {
+            VIR_FREE(name);
+            goto cleanup;
+        }
+
+        guests[i].fd = virLogHandlerDomainOpenLogFile(handler, "bench",
+                                                      uuid, name,
+                                                      guests[i].path, true,
+                                                      &inode, &offset);
+        VIR_FREE(name);
+        if (guests[i].fd < 0)
+            goto cleanup;
+    }
+
+    if ((timer = virEventAddTimeout(-1, benchWakeup, NULL, NULL)) < 0 ||
+        virThreadCreate(&loop, true, benchEventLoop, NULL) < 0)
+        goto cleanup;
+    loopStarted = true;
+
+    /* A single chatty console shouldn't hold up the other guests
+     * much more than when they all write at the same pace */
+    if (benchRound(handler, "uniform", guests, nguests, 0, 1,
+                   lines, &sizes) < 0)
+        goto cleanup;
+
+    if (benchRound(handler, "one chatty", guests, nguests, 1, 100,
+                   lines, &sizes) < 0)
+        goto cleanup;
+
+    ret = EXIT_SUCCESS;
+
+ cleanup:
+    if (ret != EXIT_SUCCESS)
+        fprintf(stderr, "Benchmark failed: %s\n", virGetLastErrorMessage());
+    if (loopStarted) {
+        quit = true;
+        virEventUpdateTimeout(timer, 0);
+        virThreadJoin(&loop);
+    }
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+    for (i = 0; guests && i < nguests; i++) {
+        VIR_FORCE_CLOSE(guests[i].fd);
+        VIR_FREE(guests[i].path);
+    }
+    VIR_FREE(guests);
+    virObjectUnref(handler);
+    if (dir)
+        virFileDeleteTree(dir);
+    VIR_FREE(dir);
+    return ret;
+}
@@ -22,6 +22,13 @@
 #include "testutils.h"
 
 #include "virlog.h"
+#include "viralloc.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.logtest");
 
 struct testLogData {
     const char *str;
@@ -107,6 +114,293 @@ testLogParseFilters(const void *opaque)
     return ret;
 }
 
+
+/* Queued messages beyond which the asynchronous mode is sure to drop
+ * some, i.e. the size of its queue plus a batch taken by the writer */
+#define TEST_LOG_ASYNC_OVERFLOW (4096 + 64)
+
+#define TEST_LOG_ASYNC_PREFIX "async test "
+
+struct testLogCapture {
+    virMutex lock;
+    virCond cond;
+    bool gate;      /* hold the writer in the output while set */
+    bool blocked;   /* the writer is held in the output */
+    char **msgs;
+    size_t nmsgs;
+    unsigned int ndropped;
+};
+
+static void
+testLogCaptureOutput(virLogSourcePtr source ATTRIBUTE_UNUSED,
+                     virLogPriority priority ATTRIBUTE_UNUSED,
+                     const char *filename ATTRIBUTE_UNUSED,
+                     int linenr ATTRIBUTE_UNUSED,
+                     const char *funcname ATTRIBUTE_UNUSED,
+                     const char *timestamp ATTRIBUTE_UNUSED,
+                     virLogMetadataPtr metadata ATTRIBUTE_UNUSED,
+                     unsigned int flags ATTRIBUTE_UNUSED,
+                     const char *rawstr,
+                     const char *str ATTRIBUTE_UNUSED,
+                     void *data)
+{
+    struct testLogCapture *capture = data;
+    unsigned int dropped;
+    char *msg;
+
+    virMutexLock(&capture->lock);
+    if (capture->gate) {
+        capture->blocked = true;
+        virCondBroadcast(&capture->cond);
+        while (capture->gate)
+            ignore_value(virCondWait(&capture->cond, &capture->lock));
+    }
+
+    if (sscanf(rawstr, "%u log messages dropped", &dropped) == 1)
+        capture->ndropped += dropped;
+    else if (STRPREFIX(rawstr, TEST_LOG_ASYNC_PREFIX) &&
+             VIR_STRDUP_QUIET(msg, rawstr) >= 0 &&
+             VIR_APPEND_ELEMENT_QUIET(capture->msgs, capture->nmsgs, msg) < 0)
+        VIR_FREE(msg);
+    virMutexUnlock(&capture->lock);
+}
+
+
+static int
+testLogAsyncSetup(struct testLogCapture *capture)
+{
+    virLogOutputPtr output = NULL;
+    virLogOutputPtr *outputs = NULL;
+    size_t noutputs = 0;
+
+    memset(capture, 0, sizeof(*capture));
+    if (virMutexInit(&capture->lock) < 0)
+        return -1;
+    if (virCondInit(&capture->cond) < 0) {
+        virMutexDestroy(&capture->lock);
+        return -1;
+    }
+
+    if (!(output = virLogOutputNew(testLogCaptureOutput, NULL, capture,
+                                   VIR_LOG_DEBUG, VIR_LOG_TO_STDERR, NULL)) ||
+        VIR_APPEND_ELEMENT(outputs, noutputs, output) < 0 ||
+        virLogDefineOutputs(outputs, noutputs) < 0) {
+        virLogOutputFree(output);
+        virLogOutputListFree(outputs, noutputs);
+        return -1;
+    }
+
+    if (virLogSetDefaultPriority(VIR_LOG_INFO) < 0 ||
+        virLogSetAsync(true) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static void
+testLogAsyncCleanup(struct testLogCapture *capture)
+{
+    virLogReset();
+    virStringListFreeCount(capture->msgs, capture->nmsgs);
+    virCondDestroy(&capture->cond);
+    virMutexDestroy(&capture->lock);
+}
+
+
+/* Holds the writer thread in the output once it writes the next message,
+ * which is emitted here */
+static void
+testLogAsyncBlock(struct testLogCapture *capture)
+{
+    virMutexLock(&capture->lock);
+    capture->gate = true;
+    virMutexUnlock(&capture->lock);
+
+    VIR_INFO(TEST_LOG_ASYNC_PREFIX "0 0");
+
+    virMutexLock(&capture->lock);
+    while (!capture->blocked)
+        ignore_value(virCondWait(&capture->cond, &capture->lock));
+    virMutexUnlock(&capture->lock);
+}
+
+
+static void
+testLogAsyncUnblock(struct testLogCapture *capture)
+{
+    virMutexLock(&capture->lock);
+    capture->gate = false;
+    virCondBroadcast(&capture->cond);
+    virMutexUnlock(&capture->lock);
+}
+
+
+/*
+ * Checks that the messages emitted by each of @nthreads threads were
+ * written in order and that all of the @nmsgs messages of each thread
+ * were either written or reported as dropped, the latter only if @lossy.
+ */
+static int
+testLogAsyncCheck(struct testLogCapture *capture,
+                  unsigned int nthreads,
+                  unsigned int nmsgs,
+                  bool lossy)
+{
+    int *last = NULL;
+    unsigned int thread;
+    unsigned int seq;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(last, nthreads) < 0)
+        return -1;
+    for (thread = 0; thread < nthreads; thread++)
+        last[thread] = -1;
+
+    for (i = 0; i < capture->nmsgs; i++) {
+        if (sscanf(capture->msgs[i], TEST_LOG_ASYNC_PREFIX "%u %u",
+                   &thread, &seq) != 2 ||
+            thread >= nthreads || seq >= nmsgs) {
+            VIR_TEST_DEBUG("Unexpected message '%s'\n", capture->msgs[i]);
+            goto cleanup;
+        }
+
+        if ((int)seq <= last[thread]) {
+            VIR_TEST_DEBUG("Message %u of thread %u written after %d\n",
+                           seq, thread, last[thread]);
+            goto cleanup;
+        }
+        last[thread] = seq;
+    }
+
+    if (capture->nmsgs + capture->ndropped != nthreads * nmsgs) {
+        VIR_TEST_DEBUG("Expected %u messages, %zu written, %u dropped\n",
+                       nthreads * nmsgs, capture->nmsgs, capture->ndropped);
+        goto cleanup;
+    }
+
+    if (lossy != !!capture->ndropped) {
+        VIR_TEST_DEBUG("Expected %s messages to be dropped, got %u\n",
+                       lossy ? "some" : "no", capture->ndropped);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(last);
+    return ret;
+}
+
+
+struct testLogAsyncThreadData {
+    unsigned int id;
+    unsigned int first;
+    unsigned int nmsgs;
+};
+
+static void
+testLogAsyncEmit(void *opaque)
+{
+    struct testLogAsyncThreadData *data = opaque;
+    unsigned int i;
+
+    for (i = data->first; i < data->nmsgs; i++)
+        VIR_INFO(TEST_LOG_ASYNC_PREFIX "%u %u", data->id, i);
+}
+
+
+#define TEST_LOG_ASYNC_THREADS 4
+
+static int
+testLogAsyncOrder(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testLogCapture capture;
+    struct testLogAsyncThreadData data[TEST_LOG_ASYNC_THREADS];
+    virThread threads[TEST_LOG_ASYNC_THREADS];
+    size_t nthreads = 0;
+    size_t i;
+    int ret = -1;
+
+    if (testLogAsyncSetup(&capture) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_LOG_ASYNC_THREADS; i++) {
+        data[i].id = i;
+        data[i].first = 0;
+        data[i].nmsgs = 1000;
+        if (virThreadCreate(&threads[i], true, testLogAsyncEmit, &data[i]) < 0)
+            goto cleanup;
+        nthreads++;
+    }
+
+ cleanup:
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (virLogSetAsync(false) == 0 &&
+        nthreads == TEST_LOG_ASYNC_THREADS)
+        ret = testLogAsyncCheck(&capture, TEST_LOG_ASYNC_THREADS, 1000, false);
+
+    testLogAsyncCleanup(&capture);
+    return ret;
+}
+
+
+static int
+testLogAsyncDrop(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testLogCapture capture;
+    struct testLogAsyncThreadData data = {
+        0, 1, TEST_LOG_ASYNC_OVERFLOW + 100
+    };
+    int ret = -1;
+
+    if (testLogAsyncSetup(&capture) < 0)
+        goto cleanup;
+
+    /* With the writer held up, the queue fills up */
+    testLogAsyncBlock(&capture);
+    testLogAsyncEmit(&data);
+    testLogAsyncUnblock(&capture);
+
+    if (virLogSetAsync(false) < 0)
+        goto cleanup;
+
+    ret = testLogAsyncCheck(&capture, 1, data.nmsgs, true);
+
+ cleanup:
+    testLogAsyncCleanup(&capture);
+    return ret;
+}
+
+
+static int
+testLogAsyncFlush(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testLogCapture capture;
+    struct testLogAsyncThreadData data = { 0, 1, 1000 };
+    int ret = -1;
+
+    if (testLogAsyncSetup(&capture) < 0)
+        goto cleanup;
+
+    testLogAsyncBlock(&capture);
+    testLogAsyncEmit(&data);
+    testLogAsyncUnblock(&capture);
+
+    /* Switching the mode off must write out whatever is still queued */
+    if (virLogSetAsync(false) < 0)
+        goto cleanup;
+
+    ret = testLogAsyncCheck(&capture, 1, data.nmsgs, false);
+
+ cleanup:
+    testLogAsyncCleanup(&capture);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -151,6 +445,14 @@ mymain(void)
     TEST_PARSE_FILTERS_FAIL(":foo", 1);
     TEST_PARSE_FILTERS_FAIL("1:+", 1);
 
+    /* These replace the log outputs, run them last */
+    if (virTestRun("testLogAsyncOrder", testLogAsyncOrder, NULL) < 0)
+        ret = -1;
+    if (virTestRun("testLogAsyncDrop", testLogAsyncDrop, NULL) < 0)
+        ret = -1;
+    if (virTestRun("testLogAsyncFlush", testLogAsyncFlush, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
@@ -0,0 +1,468 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_YAJL2
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <unistd.h>
+
+# include "virbuffer.h"
+# include "virfile.h"
+# include "virjson.h"
+# include "virnetdevopenvswitch.h"
+# include "virstring.h"
+# include "virthread.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+/* A fake ovsdb-server which knows the statistics of a couple of
+ * interfaces and answers "transact" requests consisting of selects on
+ * the Interface table. */
+typedef struct _testOVSDB testOVSDB;
+struct _testOVSDB {
+    char *tmpdir;
+    char *path;
+    int listenfd;
+    virThread thread;
+    bool running;
+
+    virJSONValuePtr *msgs;
+    size_t nmsgs;
+
+    /* set by the test cases */
+    bool sendEcho;
+    bool closeAfterReply;
+
+    /* updated by the server */
+    size_t connections;
+    size_t transactions;
+    size_t lastops;
+    bool gotEchoReply;
+};
+
+static testOVSDB server;
+
+static const struct {
+    const char *name;
+    const char *reply;
+} testOVSDBInterfaces[] = {
+    { "vhu0",
+      "{\"rows\":[{\"statistics\":[\"map\",["
+      "[\"collisions\",0],"
+      "[\"rx_bytes\",100],[\"rx_dropped\",2],"
+      "[\"rx_errors\",1],[\"rx_packets\",10],"
+      "[\"tx_bytes\",200],[\"tx_dropped\",4],"
+      "[\"tx_errors\",3],[\"tx_packets\",20]]]}]}" },
+    { "vhu1",
+      "{\"rows\":[{\"statistics\":[\"map\",[[\"rx_bytes\",5]]]}]}" },
+};
+
+
+static int
+testOVSDBQueueMessage(virJSONValuePtr value,
+                      void *opaque ATTRIBUTE_UNUSED)
+{
+    return VIR_APPEND_ELEMENT(server.msgs, server.nmsgs, value);
+}
+
+
+static virJSONValuePtr
+testOVSDBRecv(int fd,
+              virJSONStreamParserPtr parser)
+{
+    char buf[1024];
+    virJSONValuePtr msg;
+    ssize_t rc;
+
+    while (server.nmsgs == 0) {
+        if ((rc = read(fd, buf, sizeof(buf))) <= 0)
+            return NULL;
+
+        if (virJSONStreamParserFeed(parser, buf, rc, NULL) < 0)
+            return NULL;
+    }
+
+    msg = server.msgs[0];
+    VIR_DELETE_ELEMENT(server.msgs, 0, server.nmsgs);
+    return msg;
+}
+
+
+static int
+testOVSDBSendString(int fd,
+                    const char *str)
+{
+    return safewrite(fd, str, strlen(str)) < 0 ? -1 : 0;
+}
+
+
+static int
+testOVSDBTransact(int fd,
+                  virJSONStreamParserPtr parser,
+                  virJSONValuePtr msg)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virJSONValuePtr params = virJSONValueObjectGetArray(msg, "params");
+    virJSONValuePtr reply;
+    unsigned int id;
+    char *str = NULL;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (!params ||
+        virJSONValueObjectGetNumberUint(msg, "id", &id) < 0 ||
+        STRNEQ_NULLABLE(virJSONValueGetString(virJSONValueArrayGet(params, 0)),
+                        "Open_vSwitch"))
+        return -1;
+
+    server.transactions++;
+    server.lastops = virJSONValueArraySize(params) - 1;
+
+    if (server.sendEcho) {
+        if (testOVSDBSendString(fd, "{\"method\":\"echo\",\"params\":[],"
+                                    "\"id\":\"echo\"}") < 0)
+            return -1;
+
+        if (!(reply = testOVSDBRecv(fd, parser)))
+            return -1;
+
+        server.gotEchoReply =
+            STREQ_NULLABLE(virJSONValueObjectGetString(reply, "id"), "echo") &&
+            virJSONValueObjectGetArray(reply, "result");
+        virJSONValueFree(reply);
+    }
+
+    virBufferAsprintf(&buf, "{\"id\":%u,\"result\":[", id);
+
+    for (i = 1; i < virJSONValueArraySize(params); i++) {
+        virJSONValuePtr op = virJSONValueArrayGet(params, i);
+        virJSONValuePtr where = virJSONValueObjectGetArray(op, "where");
+        virJSONValuePtr cond = where ? virJSONValueArrayGet(where, 0) : NULL;
+        const char *name = NULL;
+        const char *rows = "{\"rows\":[]}";
+
+        if (STRNEQ_NULLABLE(virJSONValueObjectGetString(op, "op"), "select") ||
+            STRNEQ_NULLABLE(virJSONValueObjectGetString(op, "table"),
+                            "Interface") ||
+            !cond ||
+            !(name = virJSONValueGetString(virJSONValueArrayGet(cond, 2)))) {
+            virBufferFreeAndReset(&buf);
+            return -1;
+        }
+
+        for (j = 0; j < ARRAY_CARDINALITY(testOVSDBInterfaces); j++) {
+            if (STREQ(name, testOVSDBInterfaces[j].name))
+                rows = testOVSDBInterfaces[j].reply;
+        }
+
+        if (i > 1)
+            virBufferAddChar(&buf, ',');
+        virBufferAdd(&buf, rows, -1);
+    }
+
+    virBufferAddLit(&buf, "],\"error\":null}");
+
+    if (!(str = virBufferContentAndReset(&buf)))
+        goto cleanup;
+
+    ret = testOVSDBSendString(fd, str);
+
+ cleanup:
+    VIR_FREE(str);
+    return ret;
+}
+
+
+static void
+testOVSDBServe(void *opaque ATTRIBUTE_UNUSED)
+{
+    int fd;
+
+    while ((fd = accept(server.listenfd, NULL, NULL)) >= 0) {
+        virJSONStreamParserPtr parser;
+        virJSONValuePtr msg;
+
+        server.connections++;
+
+        if (!(parser = virJSONStreamParserNew(testOVSDBQueueMessage, NULL))) {
+            VIR_FORCE_CLOSE(fd);
+            continue;
+        }
+
+        while ((msg = testOVSDBRecv(fd, parser))) {
+            /* the test case may reset the flag as soon as it has the reply */
+            bool closeAfterReply = server.closeAfterReply;
+            int rc = -1;
+
+            if (STREQ_NULLABLE(virJSONValueObjectGetString(msg, "method"),
+                               "transact"))
+                rc = testOVSDBTransact(fd, parser, msg);
+
+            virJSONValueFree(msg);
+
+            if (rc < 0 || closeAfterReply)
+                break;
+        }
+
+        virJSONStreamParserFree(parser);
+        VIR_FORCE_CLOSE(fd);
+
+        while (server.nmsgs)
+            virJSONValueFree(server.msgs[--server.nmsgs]);
+        VIR_FREE(server.msgs);
+    }
+}
+
+
+static int
+testOVSDBStart(void)
+{
+    struct sockaddr_un addr;
+    char *tmpdir_template = NULL;
+
+    server.listenfd = -1;
+
+    if (VIR_STRDUP(tmpdir_template, "/tmp/libvirt_XXXXXX") < 0)
+        return -1;
+
+    if (!(server.tmpdir = mkdtemp(tmpdir_template))) {
+        VIR_FREE(tmpdir_template);
+        return -1;
+    }
+
+    if (virAsprintf(&server.path, "%s/db.sock", server.tmpdir) < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (virStrcpyStatic(addr.sun_path, server.path) == NULL)
+        return -1;
+
+    if ((server.listenfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(server.listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(server.listenfd, 1) < 0)
+        return -1;
+
+    if (virThreadCreate(&server.thread, true, testOVSDBServe, NULL) < 0)
+        return -1;
+    server.running = true;
+
+    return virNetDevOpenvswitchSetDBSocket(server.path);
+}
+
+
+static void
+testOVSDBStop(void)
+{
+    ignore_value(virNetDevOpenvswitchSetDBSocket(NULL));
+
+    if (server.running) {
+        shutdown(server.listenfd, SHUT_RDWR);
+        virThreadJoin(&server.thread);
+    }
+    VIR_FORCE_CLOSE(server.listenfd);
+
+    if (server.path)
+        unlink(server.path);
+    if (server.tmpdir)
+        rmdir(server.tmpdir);
+    VIR_FREE(server.path);
+    VIR_FREE(server.tmpdir);
+}
+
+
+static int
+testCheckStats(const char *name,
+               virDomainInterfaceStatsPtr stats,
+               long long rx_bytes, long long rx_packets,
+               long long rx_errs, long long rx_drop,
+               long long tx_bytes, long long tx_packets,
+               long long tx_errs, long long tx_drop)
+{
+    if (stats->rx_bytes != rx_bytes || stats->rx_packets != rx_packets ||
+        stats->rx_errs != rx_errs || stats->rx_drop != rx_drop ||
+        stats->tx_bytes != tx_bytes || stats->tx_packets != tx_packets ||
+        stats->tx_errs != tx_errs || stats->tx_drop != tx_drop) {
+        fprintf(stderr,
+                "%s: unexpected stats rx %lld %lld %lld %lld "
+                "tx %lld %lld %lld %lld\n", name,
+                stats->rx_bytes, stats->rx_packets,
+                stats->rx_errs, stats->rx_drop,
+                stats->tx_bytes, stats->tx_packets,
+                stats->tx_errs, stats->tx_drop);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testInterfaceStats(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainInterfaceStatsStruct stats;
+
+    if (virNetDevOpenvswitchInterfaceStats("vhu0", &stats) < 0)
+        return -1;
+
+    /* TX/RX are swapped as OVS reports the host view */
+    if (testCheckStats("vhu0", &stats, 200, 20, 3, 4, 100, 10, 1, 2) < 0)
+        return -1;
+
+    if (virNetDevOpenvswitchInterfaceStats("nosuchif", &stats) == 0) {
+        fprintf(stderr, "unknown interface reported stats\n");
+        return -1;
+    }
+    virResetLastError();
+
+    return 0;
+}
+
+
+static int
+testInterfaceStatsList(const void *opaque ATTRIBUTE_UNUSED)
+{
+    const char *ifnames[] = { "vhu0", "nosuchif", "vhu1" };
+    virDomainInterfaceStatsStruct stats[ARRAY_CARDINALITY(ifnames)];
+    size_t transactions = server.transactions;
+
+    if (virNetDevOpenvswitchInterfaceStatsList(ifnames,
+                                               ARRAY_CARDINALITY(ifnames),
+                                               stats) < 0)
+        return -1;
+
+    if (server.transactions != transactions + 1 ||
+        server.lastops != ARRAY_CARDINALITY(ifnames)) {
+        fprintf(stderr, "expected one transaction with %zu selects, "
+                "got %zu transactions, last with %zu operations\n",
+                ARRAY_CARDINALITY(ifnames),
+                server.transactions - transactions, server.lastops);
+        return -1;
+    }
+
+    if (testCheckStats("vhu0", &stats[0], 200, 20, 3, 4, 100, 10, 1, 2) < 0 ||
+        testCheckStats("nosuchif", &stats[1], -1, -1, -1, -1, -1, -1, -1, -1) < 0 ||
+        testCheckStats("vhu1", &stats[2], -1, -1, -1, -1, 5, -1, -1, -1) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testEcho(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainInterfaceStatsStruct stats;
+    int ret = -1;
+
+    server.sendEcho = true;
+    server.gotEchoReply = false;
+
+    if (virNetDevOpenvswitchInterfaceStats("vhu0", &stats) < 0)
+        goto cleanup;
+
+    if (!server.gotEchoReply) {
+        fprintf(stderr, "echo request was not answered\n");
+        goto cleanup;
+    }
+
+    ret = testCheckStats("vhu0", &stats, 200, 20, 3, 4, 100, 10, 1, 2);
+
+ cleanup:
+    server.sendEcho = false;
+    return ret;
+}
+
+
+static int
+testReconnect(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainInterfaceStatsStruct stats;
+    size_t connections;
+    int ret = -1;
+
+    /* make sure there's an established connection first */
+    if (virNetDevOpenvswitchInterfaceStats("vhu0", &stats) < 0)
+        return -1;
+
+    connections = server.connections;
+    server.closeAfterReply = true;
+
+    /* the first call is served, then the server hangs up ... */
+    if (virNetDevOpenvswitchInterfaceStats("vhu0", &stats) < 0)
+        goto cleanup;
+
+    server.closeAfterReply = false;
+
+    /* ... so the next one has to reconnect */
+    if (virNetDevOpenvswitchInterfaceStats("vhu0", &stats) < 0)
+        goto cleanup;
+
+    if (server.connections != connections + 1) {
+        fprintf(stderr, "expected one reconnection, got %zu\n",
+                server.connections - connections);
+        goto cleanup;
+    }
+
+    ret = testCheckStats("vhu0", &stats, 200, 20, 3, 4, 100, 10, 1, 2);
+
+ cleanup:
+    server.closeAfterReply = false;
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (testOVSDBStart() < 0) {
+        fprintf(stderr, "failed to start fake OVSDB server\n");
+        testOVSDBStop();
+        return EXIT_FAILURE;
+    }
+
+    if (virTestRun("Interface stats", testInterfaceStats, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Interface stats list", testInterfaceStatsList, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Echo", testEcho, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Reconnect", testReconnect, NULL) < 0)
+        ret = -1;
+
+    testOVSDBStop();
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_YAJL2 */
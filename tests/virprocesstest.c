@@ -0,0 +1,184 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library;  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virprocess.h"
+#include "virlog.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.processtest");
+
+struct testParseStatData {
+    const char *data;
+    int ret;
+    unsigned long long usertime;
+    unsigned long long systime;
+    long rss;
+    int cpu;
+};
+
+static int
+testParseStat(const void *opaque)
+{
+    const struct testParseStatData *data = opaque;
+    unsigned long long usertime = 0;
+    unsigned long long systime = 0;
+    long rss = 0;
+    int cpu = 0;
+    int rc;
+
+    rc = virProcessParseStat(data->data, &usertime, &systime, &rss, &cpu);
+
+    if (rc != data->ret) {
+        fprintf(stderr, "Expected return %d, got %d\n", data->ret, rc);
+        return -1;
+    }
+
+    if (rc < 0)
+        return 0;
+
+    if (usertime != data->usertime || systime != data->systime ||
+        rss != data->rss || cpu != data->cpu) {
+        fprintf(stderr,
+                "Expected utime=%llu stime=%llu rss=%ld cpu=%d, "
+                "got utime=%llu stime=%llu rss=%ld cpu=%d\n",
+                data->usertime, data->systime, data->rss, data->cpu,
+                usertime, systime, rss, cpu);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+struct testParseSchedWaitData {
+    const char *data;
+    int ret;
+    unsigned long long waitTime;
+};
+
+static int
+testParseSchedWait(const void *opaque)
+{
+    const struct testParseSchedWaitData *data = opaque;
+    unsigned long long waitTime = 1;
+    int rc;
+
+    rc = virProcessParseSchedWait(data->data, &waitTime);
+
+    if (rc != data->ret) {
+        fprintf(stderr, "Expected return %d, got %d\n", data->ret, rc);
+        return -1;
+    }
+
+    if (rc < 0) {
+        virResetLastError();
+        return 0;
+    }
+
+    if (waitTime != data->waitTime) {
+        fprintf(stderr, "Expected wait time %llu, got %llu\n",
+                data->waitTime, waitTime);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Fields following the command name in /proc/<pid>/stat, with utime 1500,
+ * stime 250, rss 2048 and processor 3 */
+#define STAT_FIELDS \
+    " S 1 1234 1234 0 -1 4202816 100 0 0 0 1500 250 0 0 20 0 4 0 12345 " \
+    "1048576 2048 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 3 " \
+    "0 0 0 0 0 0 0 0 0 0\n"
+
+#define SCHED_HEADER \
+    "CPU 0/KVM (1235, #threads: 4)\n" \
+    "-------------------------------------------------------------------\n" \
+    "se.exec_start                                :     123456789.012345\n" \
+    "se.vruntime                                  :          1234.567890\n"
+
+#define SCHED_FOOTER \
+    "nr_switches                                  :                 1000\n" \
+    "policy                                       :                    0\n" \
+    "prio                                         :                  120\n"
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define TEST_PARSE_STAT(name, str, rc) \
+    do { \
+        struct testParseStatData data = { \
+            str, rc, 1500, 250, 2048, 3 \
+        }; \
+        if (virTestRun("Parse stat " name, testParseStat, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    TEST_PARSE_STAT("plain", "1235 (qemu-kvm)" STAT_FIELDS, 0);
+    TEST_PARSE_STAT("comm with space", "1235 (CPU 0/KVM)" STAT_FIELDS, 0);
+    TEST_PARSE_STAT("comm with parentheses",
+                    "1235 (qemu ) (kvm) 3 (x)" STAT_FIELDS, 0);
+    TEST_PARSE_STAT("comm only with ')'", "1235 ())))" STAT_FIELDS, 0);
+    TEST_PARSE_STAT("no comm", "1235 S 1 1234 1234 0 -1", -1);
+    TEST_PARSE_STAT("truncated", "1235 (qemu) S 1 1234 1234 0 -1 4202816", -1);
+    TEST_PARSE_STAT("empty", "", -1);
+
+#define TEST_PARSE_SCHED_WAIT(name, str, rc, val) \
+    do { \
+        struct testParseSchedWaitData data = { str, rc, val }; \
+        if (virTestRun("Parse sched " name, testParseSchedWait, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    TEST_PARSE_SCHED_WAIT("wait_sum",
+                          SCHED_HEADER
+                          "se.statistics.wait_start                     :                 0.000000\n"
+                          "se.statistics.wait_sum                       :              1234.500000\n"
+                          SCHED_FOOTER,
+                          0, 1234500000ULL);
+    TEST_PARSE_SCHED_WAIT("old wait_sum",
+                          SCHED_HEADER
+                          "se.wait_sum                                  :                42.500000\n"
+                          SCHED_FOOTER,
+                          0, 42500000ULL);
+    TEST_PARSE_SCHED_WAIT("wait_sum on last line",
+                          SCHED_HEADER
+                          "se.statistics.wait_sum                       :                 2.5",
+                          0, 2500000ULL);
+    TEST_PARSE_SCHED_WAIT("no schedstats", SCHED_HEADER SCHED_FOOTER, 0, 0);
+    TEST_PARSE_SCHED_WAIT("empty", "", 0, 0);
+    TEST_PARSE_SCHED_WAIT("missing separator",
+                          SCHED_HEADER
+                          "se.statistics.wait_sum                                    1234.500000\n"
+                          SCHED_FOOTER,
+                          -1, 0);
+    TEST_PARSE_SCHED_WAIT("bad value",
+                          SCHED_HEADER
+                          "se.statistics.wait_sum                       :                   12abc\n"
+                          SCHED_FOOTER,
+                          -1, 0);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,150 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virreadbuffer.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+static int
+testReadBufferAppend(virReadBufferPtr buf,
+                     const char *str)
+{
+    size_t len = strlen(str);
+    size_t avail;
+    char *tail;
+
+    if (virReadBufferReserve(buf, len) < 0)
+        return -1;
+
+    if (!(tail = virReadBufferTail(buf, &avail)) || avail < len) {
+        fprintf(stderr, "not enough space reserved: %zu < %zu\n", avail, len);
+        return -1;
+    }
+
+    memcpy(tail, str, len);
+    virReadBufferAdvance(buf, len);
+    return 0;
+}
+
+
+static int
+testReadBufferBasic(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virReadBuffer buf = { 0 };
+    int ret = -1;
+
+    if (testReadBufferAppend(&buf, "hello ") < 0 ||
+        testReadBufferAppend(&buf, "world\n") < 0 ||
+        testReadBufferAppend(&buf, "tail") < 0)
+        goto cleanup;
+
+    if (STRNEQ(buf.data, "hello world\ntail")) {
+        fprintf(stderr, "unexpected content '%s'\n", buf.data);
+        goto cleanup;
+    }
+
+    virReadBufferConsume(&buf, strlen("hello world\n"));
+
+    if (buf.used != strlen("tail") || STRNEQ(buf.data, "tail")) {
+        fprintf(stderr, "unexpected content after consume '%s'\n", buf.data);
+        goto cleanup;
+    }
+
+    virReadBufferConsume(&buf, buf.used);
+
+    if (buf.used != 0 || !buf.data || buf.data[0] != '\0') {
+        fprintf(stderr, "small buffer was not kept for reuse\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virReadBufferFree(&buf);
+    return ret;
+}
+
+
+static int
+testReadBufferGrowth(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virReadBuffer buf = { 0 };
+    size_t reallocs = 0;
+    size_t lastSize = 0;
+    size_t i;
+    int ret = -1;
+
+    /* 4 MiB read in chunks of 1 KiB */
+    for (i = 0; i < 4096; i++) {
+        size_t avail;
+        char *tail;
+
+        if (virReadBufferReserve(&buf, 1024) < 0)
+            goto cleanup;
+
+        if (buf.size != lastSize) {
+            reallocs++;
+            lastSize = buf.size;
+        }
+
+        tail = virReadBufferTail(&buf, &avail);
+        memset(tail, 'x', 1024);
+        virReadBufferAdvance(&buf, 1024);
+    }
+
+    if (buf.used != 4096 * 1024 || strlen(buf.data) != buf.used) {
+        fprintf(stderr, "unexpected length %zu\n", buf.used);
+        goto cleanup;
+    }
+
+    if (reallocs > 16) {
+        fprintf(stderr, "too many reallocations: %zu\n", reallocs);
+        goto cleanup;
+    }
+
+    virReadBufferConsume(&buf, buf.used);
+
+    if (buf.data || buf.size != 0) {
+        fprintf(stderr, "large buffer was not released\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virReadBufferFree(&buf);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Basic", testReadBufferBasic, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Growth", testReadBufferGrowth, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
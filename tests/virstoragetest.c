@@ -21,6 +21,7 @@
 #include <config.h>
 
 #include <stdlib.h>
+#include <utime.h>
 
 #include "testutils.h"
 #include "vircommand.h"
@@ -137,6 +138,7 @@ testPrepImages(void)
     virCommandPtr cmd = NULL;
     char *buf = NULL;
     bool compat = false;
+    struct utimbuf times;
 
     qemuimg = virFindFileInPath("qemu-img");
     if (!qemuimg)
@@ -249,6 +251,18 @@ testPrepImages(void)
     }
 #endif
 
+    /* Backdate the images so that the backing chain lookups cache their
+     * headers; the tests below then check that files rewritten in place
+     * by 'qemu-img rebase' are read again */
+    times.actime = times.modtime = time(NULL) - 3600;
+    if (utime(absraw, &times) < 0 ||
+        utime(absqcow2, &times) < 0 ||
+        utime(abswrap, &times) < 0 ||
+        utime(absqed, &times) < 0) {
+        fprintf(stderr, "unable to set time of images\n");
+        goto cleanup;
+    }
+
     ret = 0;
  cleanup:
     VIR_FREE(buf);
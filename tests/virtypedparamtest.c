@@ -201,6 +201,70 @@ testTypedParamsGetStringList(const void *opaque ATTRIBUTE_UNUSED)
     return rv;
 }
 
+static int
+testTypedParamsList(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int rv = -1;
+    virTypedParamList list = { 0 };
+    virTypedParameterPtr params = NULL;
+    virTypedParameterPtr reserved;
+    size_t nparams = 0;
+    char longname[VIR_TYPED_PARAM_FIELD_LENGTH + 1];
+
+    if (virTypedParamListReserve(&list, 4) < 0)
+        goto cleanup;
+
+    reserved = list.par;
+
+    if (virTypedParamListAddInt(&list, -1, "int") < 0 ||
+        virTypedParamListAddULLong(&list, 1ULL << 40, "%s.%zu.%s",
+                                   "block", (size_t) 3, "rd.bytes") < 0 ||
+        virTypedParamListAddString(&list, "vda", "block.%d.name", 3) < 0 ||
+        virTypedParamListAddBoolean(&list, true, "bool") < 0)
+        goto cleanup;
+
+    /* the reserved array must have been used as is */
+    if (list.par != reserved || list.npar != 4)
+        goto cleanup;
+
+    /* names which don't fit must be rejected rather than truncated */
+    memset(longname, 'a', sizeof(longname) - 1);
+    longname[sizeof(longname) - 1] = '\0';
+    if (virTypedParamListAddUInt(&list, 1, "%s", longname) == 0 ||
+        list.npar != 4)
+        goto cleanup;
+
+    if (virTypedParamListAddUInt(&list, 42, "uint") < 0)
+        goto cleanup;
+
+    nparams = virTypedParamListStealParams(&list, &params);
+    if (nparams != 5 || list.par || list.npar)
+        goto cleanup;
+
+    if (STRNEQ(params[0].field, "int") ||
+        params[0].type != VIR_TYPED_PARAM_INT ||
+        params[0].value.i != -1 ||
+        STRNEQ(params[1].field, "block.3.rd.bytes") ||
+        params[1].type != VIR_TYPED_PARAM_ULLONG ||
+        params[1].value.ul != 1ULL << 40 ||
+        STRNEQ(params[2].field, "block.3.name") ||
+        params[2].type != VIR_TYPED_PARAM_STRING ||
+        STRNEQ(params[2].value.s, "vda") ||
+        STRNEQ(params[3].field, "bool") ||
+        params[3].type != VIR_TYPED_PARAM_BOOLEAN ||
+        params[3].value.b != 1 ||
+        STRNEQ(params[4].field, "uint") ||
+        params[4].type != VIR_TYPED_PARAM_UINT ||
+        params[4].value.ui != 42)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    virTypedParamListClear(&list);
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
 static int
 testTypedParamsValidator(void)
 {
@@ -302,6 +366,9 @@ mymain(void)
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("Parameter list", testTypedParamsList, NULL) < 0)
+        rv = -1;
+
     if (rv < 0)
         return EXIT_FAILURE;
     return EXIT_SUCCESS;
@@ -1079,6 +1079,81 @@ cmdDaemonLogOutputs(vshControl *ctl, const vshCmd *cmd)
     return true;
 }
 
+/* -----------------------------
+ * Command daemon-startup-times
+ * -----------------------------
+ */
+static const vshCmdInfo info_daemon_startup_times[] = {
+    {.name = "help",
+     .data = N_("get the duration of the daemon startup phases")
+    },
+    {.name = "desc",
+     .data = N_("Lists the phases of the daemon startup along with the time "
+                "each of them started at and how long it took.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonStartupTimes(vshControl *ctl, const vshCmd *cmd ATTRIBUTE_UNUSED)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int count = 0;
+    unsigned long long first = 0;
+    size_t i;
+    bool ret = false;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (virAdmConnectGetStartupTimes(priv->conn, &params, &nparams, 0) < 0 ||
+        virTypedParamsGetUInt(params, nparams, "phase.count", &count) < 0) {
+        vshError(ctl, "%s", _("Unable to get daemon startup times"));
+        goto cleanup;
+    }
+
+    /* Start times are printed relative to the first phase */
+    for (i = 0; i < count; i++) {
+        char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+        unsigned long long start;
+
+        snprintf(field, sizeof(field), "phase.%zu.start", i);
+        if (virTypedParamsGetULLong(params, nparams, field, &start) == 1 &&
+            (!first || start < first))
+            first = start;
+    }
+
+    vshPrintExtra(ctl, " %-25s %-12s %-12s\n",
+                  _("Phase"), _("Start (ms)"), _("Duration (ms)"));
+    vshPrintExtra(ctl, "-----------------------------------------------------\n");
+
+    for (i = 0; i < count; i++) {
+        char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+        const char *name = NULL;
+        unsigned long long start = 0;
+        unsigned long long duration = 0;
+
+        snprintf(field, sizeof(field), "phase.%zu.name", i);
+        if (virTypedParamsGetString(params, nparams, field, &name) < 0)
+            goto cleanup;
+
+        snprintf(field, sizeof(field), "phase.%zu.start", i);
+        if (virTypedParamsGetULLong(params, nparams, field, &start) < 0)
+            goto cleanup;
+
+        snprintf(field, sizeof(field), "phase.%zu.duration", i);
+        if (virTypedParamsGetULLong(params, nparams, field, &duration) < 0)
+            goto cleanup;
+
+        vshPrint(ctl, " %-25s %-12llu %-12llu\n",
+                 NULLSTR(name), start - first, duration);
+    }
+
+    ret = true;
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
 static void *
 vshAdmConnectionHandler(vshControl *ctl)
 {
@@ -1419,6 +1494,12 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "daemon-startup-times",
+     .handler = cmdDaemonStartupTimes,
+     .opts = NULL,
+     .info = info_daemon_startup_times,
+     .flags = 0
+    },
     {.name = NULL}
 };
 